@@ -26,6 +26,8 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "maidsafe/base/crypto.h"
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
 #include <maidsafe/cryptopp/integer.h>
 #include <maidsafe/cryptopp/pwdbased.h>
 #include <maidsafe/cryptopp/sha.h>
@@ -37,6 +39,10 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <maidsafe/cryptopp/modes.h>
 #include <maidsafe/cryptopp/rsa.h>
 #include <maidsafe/cryptopp/osrng.h>
+#include <algorithm>
+#include <list>
+#include <map>
+#include <utility>
 #include "maidsafe/maidsafe-dht_config.h"
 #include "maidsafe/base/utils.h"
 #include "maidsafe/base/log.h"
@@ -49,6 +55,165 @@ CryptoPP::RandomNumberGenerator &GlobalRNG() {
   return rand_pool;
 }
 
+namespace {
+
+typedef CryptoPP::RSASS<CryptoPP::PKCS1v15, CryptoPP::SHA512>::Verifier
+    RsaVerifier;
+
+// Map holding at most max_size entries, dropping the least recently used.
+// Not thread safe.
+template <class T>
+class LruMap {
+ public:
+  explicit LruMap(const size_t &max_size)
+      : kMaxSize_(max_size), entries_(), order_() {}
+  bool Get(const std::string &key, T *value) {
+    typename EntryMap::iterator it = entries_.find(key);
+    if (it == entries_.end())
+      return false;
+    order_.splice(order_.end(), order_, it->second.second);
+    *value = it->second.first;
+    return true;
+  }
+  void Add(const std::string &key, const T &value) {
+    if (kMaxSize_ == 0 || entries_.count(key) != 0)
+      return;
+    if (entries_.size() >= kMaxSize_) {
+      entries_.erase(order_.front());
+      order_.pop_front();
+    }
+    order_.push_back(key);
+    entries_.insert(std::make_pair(key,
+        std::make_pair(value, --order_.end())));
+  }
+  void Clear() {
+    entries_.clear();
+    order_.clear();
+  }
+  size_t Size() const { return entries_.size(); }
+ private:
+  typedef std::map<std::string,
+      std::pair<T, std::list<std::string>::iterator> > EntryMap;
+  const size_t kMaxSize_;
+  EntryMap entries_;
+  std::list<std::string> order_;
+};
+
+// Signatures already found valid, keyed by a digest of the public key,
+// signature and data, and public keys already parsed.
+class SignatureCache {
+ public:
+  static SignatureCache *GetInstance() {
+    static SignatureCache cache;
+    return &cache;
+  }
+  static std::string Digest(const char *data, const size_t &data_size,
+                            const std::string &signature,
+                            const std::string &key) {
+    CryptoPP::SHA512 hash;
+    std::string digest(CryptoPP::SHA512::DIGESTSIZE, 0);
+    const char *fields[] = { key.data(), signature.data(), data };
+    const size_t sizes[] = { key.size(), signature.size(), data_size };
+    for (int i = 0; i < 3; ++i) {
+      boost::uint64_t size(sizes[i]);
+      hash.Update(reinterpret_cast<const byte*>(&size), sizeof(size));
+      hash.Update(reinterpret_cast<const byte*>(fields[i]), sizes[i]);
+    }
+    hash.Final(reinterpret_cast<byte*>(&digest[0]));
+    return digest;
+  }
+  bool Verified(const std::string &digest) {
+    boost::mutex::scoped_lock guard(mutex_);
+    bool verified(false);
+    return verified_.Get(digest, &verified);
+  }
+  void AddVerified(const std::string &digest) {
+    boost::mutex::scoped_lock guard(mutex_);
+    verified_.Add(digest, true);
+  }
+  // Throws CryptoPP::Exception if key is not a valid public key.
+  boost::shared_ptr<RsaVerifier> Verifier(const std::string &key) {
+    boost::shared_ptr<RsaVerifier> verifier;
+    {
+      boost::mutex::scoped_lock guard(mutex_);
+      if (verifiers_.Get(key, &verifier))
+        return verifier;
+    }
+    CryptoPP::StringSource pubkey(key, true);
+    verifier.reset(new RsaVerifier(pubkey));
+    boost::mutex::scoped_lock guard(mutex_);
+    verifiers_.Add(key, verifier);
+    return verifier;
+  }
+  void Clear() {
+    boost::mutex::scoped_lock guard(mutex_);
+    verified_.Clear();
+    verifiers_.Clear();
+  }
+  size_t VerifiedSize() {
+    boost::mutex::scoped_lock guard(mutex_);
+    return verified_.Size();
+  }
+ private:
+  SignatureCache()
+      : verified_(kVerifiedSignatureCacheSize),
+        verifiers_(kVerifierCacheSize), mutex_() {}
+  SignatureCache(const SignatureCache&);
+  SignatureCache& operator=(const SignatureCache&);
+  LruMap<bool> verified_;
+  LruMap< boost::shared_ptr<RsaVerifier> > verifiers_;
+  boost::mutex mutex_;
+};
+
+// Verifies signature of data with verifier, and caches the digest of the
+// three if it is valid.
+bool VerifyString(SignatureCache *cache, const RsaVerifier &verifier,
+                  const char *data, const size_t &size,
+                  const std::string &signature, const std::string &digest) {
+  if (signature.size() != verifier.SignatureLength())
+    return false;
+  if (!verifier.VerifyMessage(reinterpret_cast<const byte*>(data), size,
+                              reinterpret_cast<const byte*>(signature.data()),
+                              signature.size()))
+    return false;
+  cache->AddVerified(digest);
+  return true;
+}
+
+typedef std::map<std::string, boost::shared_ptr<RsaVerifier> > VerifierMap;
+
+// Sets (*results)[i] to 1 for each valid signature among items[begin, end).
+// Verifiers for invalid keys are NULL.
+void CheckSigRange(const std::vector<SignedData> *items,
+                   const VerifierMap *verifiers, const size_t &begin,
+                   const size_t &end, std::vector<char> *results) {
+  SignatureCache *cache(SignatureCache::GetInstance());
+  for (size_t i = begin; i < end; ++i) {
+    const SignedData &item = (*items)[i];
+    std::string digest(SignatureCache::Digest(item.data.data(),
+                                              item.data.size(),
+                                              item.signature,
+                                              item.public_key));
+    if (cache->Verified(digest)) {
+      (*results)[i] = 1;
+      continue;
+    }
+    VerifierMap::const_iterator it = verifiers->find(item.public_key);
+    if (it == verifiers->end() || it->second.get() == NULL)
+      continue;
+    try {
+      if (VerifyString(cache, *it->second, item.data.data(), item.data.size(),
+                       item.signature, digest))
+        (*results)[i] = 1;
+    }
+    catch(const CryptoPP::Exception &e) {
+      DLOG(ERROR) << "Crypto::AsymCheckSigs - " << e.what() << std::endl;
+    }
+  }
+}
+
+}  // namespace
+
 std::string Crypto::XOROperation(const std::string &first,
                                  const std::string &second) {
   std::string result(first);
@@ -130,6 +295,37 @@ std::string Crypto::HashFunc(const std::string &input,
   return result;
 }
 
+namespace {
+
+CryptoPP::HashTransformation *NewHash(const HashType &type) {
+  switch (type) {
+    case SHA_1:
+      return new CryptoPP::SHA1;
+    case SHA_256:
+      return new CryptoPP::SHA256;
+    case SHA_384:
+      return new CryptoPP::SHA384;
+    default:
+      return new CryptoPP::SHA512;
+  }
+}
+
+std::string HexEncode(const std::string &input) {
+  std::string result;
+  CryptoPP::StringSource(input, true,
+      new CryptoPP::HexEncoder(new CryptoPP::StringSink(result), false));
+  return result;
+}
+
+}  // namespace
+
+std::string Crypto::Hash(const char *input, const size_t &size,
+                         const bool &hex) {
+  HashContext context(hash_algorithm_);
+  context.Update(input, size);
+  return context.Final(hex);
+}
+
 std::string Crypto::Hash(const std::string &input,
                          const std::string &output,
                          const OperationType &operation_type,
@@ -381,16 +577,45 @@ std::string Crypto::AsymSign(const std::string &input,
   }
 }
 
+std::string Crypto::AsymSign(const char *input, const size_t &size,
+                             const std::string &key) {
+  SignContext context(key);
+  context.Update(input, size);
+  return context.Final();
+}
+
+bool Crypto::AsymCheckSig(const char *input_data, const size_t &size,
+                          const std::string &input_signature,
+                          const std::string &key) {
+  SignatureCache *cache(SignatureCache::GetInstance());
+  std::string digest(SignatureCache::Digest(input_data, size, input_signature,
+                                            key));
+  if (cache->Verified(digest))
+    return true;
+  try {
+    boost::shared_ptr<RsaVerifier> verifier(cache->Verifier(key));
+    return VerifyString(cache, *verifier, input_data, size, input_signature,
+                        digest);
+  }
+  catch(const CryptoPP::Exception &e) {
+    DLOG(ERROR) << "Crypto::AsymCheckSig - " << e.what() << std::endl;
+    return false;
+  }
+}
+
 bool Crypto::AsymCheckSig(const std::string &input_data,
                           const std::string &input_signature,
                           const std::string &key,
                           const OperationType &operation_type) {
-  if (operation_type == STRING_FILE || operation_type == FILE_FILE)
+  if (operation_type == STRING_STRING)
+    return AsymCheckSig(input_data.data(), input_data.size(), input_signature,
+                        key);
+  if (operation_type != FILE_STRING)
     return false;
   try {
-    CryptoPP::StringSource pubkey(key, true);
-    CryptoPP::RSASS<CryptoPP::PKCS1v15, CryptoPP::SHA512>::Verifier
-        verifier(pubkey);
+    boost::shared_ptr<RsaVerifier> verifier_ptr(
+        SignatureCache::GetInstance()->Verifier(key));
+    const RsaVerifier &verifier(*verifier_ptr);
     bool result = false;
     CryptoPP::SecByteBlock *signature;
     CryptoPP::SignatureVerificationFilter *verifierFilter;
@@ -401,15 +626,8 @@ bool Crypto::AsymCheckSig(const std::string &input_data,
     signatureString.Get(*signature, signature->size());
     verifierFilter = new CryptoPP::SignatureVerificationFilter(verifier);
     verifierFilter->Put(*signature, verifier.SignatureLength());
-    if (operation_type == STRING_STRING) {
-      CryptoPP::StringSource ssource(input_data, true, verifierFilter);
-      result = verifierFilter->GetLastResult();
-    } else if (operation_type == FILE_STRING) {
-      CryptoPP::FileSource fsource(input_data.c_str(), true, verifierFilter);
-      result = verifierFilter->GetLastResult();
-    } else {
-      return false;
-    }
+    CryptoPP::FileSource fsource(input_data.c_str(), true, verifierFilter);
+    result = verifierFilter->GetLastResult();
     delete signature;
     return result;
   }
@@ -419,6 +637,224 @@ bool Crypto::AsymCheckSig(const std::string &input_data,
   }
 }
 
+size_t Crypto::AsymCheckSigs(const std::vector<SignedData> &items,
+                             const boost::uint16_t &threads,
+                             std::vector<bool> *results) {
+  results->assign(items.size(), false);
+  if (items.empty())
+    return 0;
+  SignatureCache *cache(SignatureCache::GetInstance());
+  VerifierMap verifiers;
+  for (size_t i = 0; i < items.size(); ++i) {
+    if (verifiers.count(items[i].public_key) != 0)
+      continue;
+    boost::shared_ptr<RsaVerifier> verifier;
+    try {
+      verifier = cache->Verifier(items[i].public_key);
+    }
+    catch(const CryptoPP::Exception &e) {
+      DLOG(ERROR) << "Crypto::AsymCheckSigs - " << e.what() << std::endl;
+    }
+    verifiers.insert(std::make_pair(items[i].public_key, verifier));
+  }
+  // std::vector<bool> can't be written from several threads.
+  std::vector<char> valid(items.size(), 0);
+  size_t thread_count(threads == 0 ? 1 : threads);
+  if (thread_count > items.size())
+    thread_count = items.size();
+  size_t chunk((items.size() + thread_count - 1) / thread_count);
+  boost::thread_group workers;
+  for (size_t begin = chunk; begin < items.size(); begin += chunk) {
+    workers.create_thread(boost::bind(&CheckSigRange, &items, &verifiers,
+        begin, std::min(begin + chunk, items.size()), &valid));
+  }
+  CheckSigRange(&items, &verifiers, 0, chunk, &valid);
+  workers.join_all();
+  size_t valid_count(0);
+  for (size_t i = 0; i < valid.size(); ++i) {
+    if (valid[i] != 0) {
+      (*results)[i] = true;
+      ++valid_count;
+    }
+  }
+  return valid_count;
+}
+
+void Crypto::ClearSignatureCache() {
+  SignatureCache::GetInstance()->Clear();
+}
+
+size_t Crypto::VerifiedSignatureCacheSize() {
+  return SignatureCache::GetInstance()->VerifiedSize();
+}
+
+HashContext::HashContext(const HashType &type) : hash_(NewHash(type)) {}
+
+HashContext::~HashContext() {}
+
+void HashContext::Update(const char *data, const size_t &size) {
+  hash_->Update(reinterpret_cast<const byte*>(data), size);
+}
+
+void HashContext::Update(const std::string &data) {
+  Update(data.data(), data.size());
+}
+
+std::string HashContext::Final(const bool &hex) {
+  std::string digest(hash_->DigestSize(), 0);
+  hash_->Final(reinterpret_cast<byte*>(&digest[0]));
+  return hex ? HexEncode(digest) : digest;
+}
+
+SignContext::SignContext(const std::string &private_key)
+    : signer_(), accumulator_() {
+  try {
+    CryptoPP::StringSource privkey(private_key, true);
+    signer_.reset(new CryptoPP::RSASS<CryptoPP::PKCS1v15,
+                                      CryptoPP::SHA512>::Signer(privkey));
+    accumulator_.reset(signer_->NewSignatureAccumulator(GlobalRNG()));
+  }
+  catch(const CryptoPP::Exception &e) {
+    DLOG(ERROR) << "SignContext - " << e.what() << std::endl;
+    signer_.reset();
+    accumulator_.reset();
+  }
+}
+
+SignContext::~SignContext() {}
+
+void SignContext::Update(const char *data, const size_t &size) {
+  if (accumulator_.get() != NULL)
+    accumulator_->Update(reinterpret_cast<const byte*>(data), size);
+}
+
+void SignContext::Update(const std::string &data) {
+  Update(data.data(), data.size());
+}
+
+std::string SignContext::Final() {
+  if (accumulator_.get() == NULL)
+    return "";
+  try {
+    std::string signature(signer_->MaxSignatureLength(), 0);
+    signature.resize(signer_->SignAndRestart(GlobalRNG(), *accumulator_,
+        reinterpret_cast<byte*>(&signature[0]), true));
+    return signature;
+  }
+  catch(const CryptoPP::Exception &e) {
+    DLOG(ERROR) << "SignContext - " << e.what() << std::endl;
+    return "";
+  }
+}
+
+VerifyContext::VerifyContext(const std::string &public_key,
+                             const std::string &signature)
+    : verifier_(), accumulator_() {
+  try {
+    verifier_ = SignatureCache::GetInstance()->Verifier(public_key);
+    if (signature.size() != verifier_->SignatureLength())
+      return;
+    accumulator_.reset(verifier_->NewVerificationAccumulator());
+    verifier_->InputSignature(*accumulator_,
+        reinterpret_cast<const byte*>(signature.data()), signature.size());
+  }
+  catch(const CryptoPP::Exception &e) {
+    DLOG(ERROR) << "VerifyContext - " << e.what() << std::endl;
+    accumulator_.reset();
+  }
+}
+
+VerifyContext::~VerifyContext() {}
+
+void VerifyContext::Update(const char *data, const size_t &size) {
+  if (accumulator_.get() != NULL)
+    accumulator_->Update(reinterpret_cast<const byte*>(data), size);
+}
+
+void VerifyContext::Update(const std::string &data) {
+  Update(data.data(), data.size());
+}
+
+bool VerifyContext::Final() {
+  if (accumulator_.get() == NULL)
+    return false;
+  try {
+    bool result(verifier_->VerifyAndRestart(*accumulator_));
+    accumulator_.reset();
+    return result;
+  }
+  catch(const CryptoPP::Exception &e) {
+    DLOG(ERROR) << "VerifyContext - " << e.what() << std::endl;
+    accumulator_.reset();
+    return false;
+  }
+}
+
+CryptoExecutor::CryptoExecutor(const boost::uint16_t &threads,
+                               const size_t &max_queued)
+    : kMaxQueued_(max_queued), tasks_(), stopping_(false), mutex_(), cond_(),
+      threads_() {
+  for (boost::uint16_t i = 0; i < threads; ++i)
+    threads_.create_thread(boost::bind(&CryptoExecutor::Run, this));
+}
+
+CryptoExecutor::~CryptoExecutor() {
+  {
+    boost::mutex::scoped_lock guard(mutex_);
+    stopping_ = true;
+  }
+  cond_.notify_all();
+  threads_.join_all();
+}
+
+bool CryptoExecutor::Submit(const Task &task) {
+  {
+    boost::mutex::scoped_lock guard(mutex_);
+    if (stopping_ || threads_.size() == 0 || tasks_.size() >= kMaxQueued_)
+      return false;
+    tasks_.push_back(task);
+  }
+  cond_.notify_one();
+  return true;
+}
+
+static void CheckSigTask(const std::string &input_data,
+                         const std::string &input_signature,
+                         const std::string &key,
+                         const CryptoExecutor::CheckSigFunctor &complete) {
+  Crypto cobj;
+  complete(cobj.AsymCheckSig(input_data, input_signature, key, STRING_STRING));
+}
+
+bool CryptoExecutor::AsymCheckSig(const std::string &input_data,
+                                  const std::string &input_signature,
+                                  const std::string &key,
+                                  const CheckSigFunctor &complete) {
+  return Submit(boost::bind(&CheckSigTask, input_data, input_signature, key,
+                            complete));
+}
+
+size_t CryptoExecutor::Queued() {
+  boost::mutex::scoped_lock guard(mutex_);
+  return tasks_.size();
+}
+
+void CryptoExecutor::Run() {
+  while (true) {
+    Task task;
+    {
+      boost::mutex::scoped_lock guard(mutex_);
+      while (tasks_.empty() && !stopping_)
+        cond_.wait(guard);
+      if (tasks_.empty())
+        return;
+      task = tasks_.front();
+      tasks_.pop_front();
+    }
+    task();
+  }
+}
+
 std::string Crypto::Compress(const std::string &input,
                              const std::string &output,
                              const boost::uint16_t &compression_level,
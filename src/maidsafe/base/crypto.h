@@ -35,9 +35,24 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MAIDSAFE_BASE_CRYPTO_H_
 
 #include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <deque>
 #include <string>
+#include <vector>
 
 
+namespace CryptoPP {
+class HashTransformation;
+class PK_MessageAccumulator;
+class PK_Signer;
+class PK_Verifier;
+}  // namespace CryptoPP
+
 namespace crypto {
 
 namespace test {
@@ -48,6 +63,10 @@ class CryptoTest_BEH_BASE_SymmEncrypt_Test;
 const boost::uint16_t AES256_KeySize = 32;  // size in bytes
 const boost::uint16_t  AES256_IVSize = 16;   // in bytes
 const boost::uint16_t  kMaxCompressionLevel = 9;
+// Number of successful signature verifications remembered by AsymCheckSig.
+const boost::uint32_t kVerifiedSignatureCacheSize = 8192;
+// Number of parsed public keys kept by AsymCheckSig.
+const boost::uint32_t kVerifierCacheSize = 256;
 
 /**
 * Types of operation regarding source and destination
@@ -66,6 +85,17 @@ enum SymmetricEncryptionType { AES_256 };
 */
 enum ObfuscationType { XOR };
 
+/**
+* Some data, its signature and the public key to verify it with.
+*/
+struct SignedData {
+  SignedData() : data(), signature(), public_key() {}
+  SignedData(const std::string &data, const std::string &signature,
+             const std::string &public_key)
+      : data(data), signature(signature), public_key(public_key) {}
+  std::string data, signature, public_key;
+};
+
 /**
 * @class Crypto
 * Object with the following cryptographic operations: Hash a string, AES
@@ -114,6 +144,12 @@ class Crypto {
                    const std::string &output,
                    const OperationType &operation_type,
                    const bool &hex);
+  /**
+  * Hashes size bytes at input in place.
+  * @param hex True for the hex encoded digest, False for the raw one
+  * @return the digest
+  */
+  std::string Hash(const char *input, const size_t &size, const bool &hex);
   void set_symm_algorithm(const SymmetricEncryptionType &type) {
     symm_algorithm_ = type;
   }
@@ -204,8 +240,17 @@ class Crypto {
                        const std::string &key,
                        const OperationType &operation_type);
   /**
+  * Signs size bytes at input in place with a private key.
+  * @return the signature or an empty string if key is not a valid private key
+  */
+  std::string AsymSign(const char *input, const size_t &size,
+                       const std::string &key);
+  /**
   * Verifies the signature of some data signed with a public key using
-  * the corresponding public key.
+  * the corresponding public key.  Parsed public keys, and a digest of each
+  * key, signature and data string found valid, are cached for the whole
+  * process, so verifying the same signature of a string again costs a hash
+  * rather than an RSA operation.  Data from files is always verified.
   * @param input_data string or path to file of the original data that was
   * signed
   * @param input_signature signature to be verified
@@ -218,6 +263,34 @@ class Crypto {
                     const std::string &key,
                     const OperationType &operation_type);
   /**
+  * Verifies the signature of size bytes at input_data in place, using the
+  * same caches as AsymCheckSig.
+  * @return True if the signature is valid, false otherwise
+  */
+  bool AsymCheckSig(const char *input_data, const size_t &size,
+                    const std::string &input_signature,
+                    const std::string &key);
+  /**
+  * Verifies many signatures at once, as AsymCheckSig does for STRING_STRING.
+  * Each public key is parsed once for the whole batch, and the signatures are
+  * split between the given number of threads, the calling one included.
+  * @param items data, signatures and public keys to verify
+  * @param threads number of threads to use, at least one
+  * @param results set to one result per item, true if its signature is valid
+  * @return the number of valid signatures
+  */
+  size_t AsymCheckSigs(const std::vector<SignedData> &items,
+                       const boost::uint16_t &threads,
+                       std::vector<bool> *results);
+  /**
+  * Empties the caches used by AsymCheckSig.
+  */
+  static void ClearSignatureCache();
+  /**
+  * @return the number of verified signatures cached by AsymCheckSig
+  */
+  static size_t VerifiedSignatureCacheSize();
+  /**
   * Compress a string or a file using gzip.  Compression level must be
   * between 0 and 9 inclusive or function returns "".  It also returns an
   * empty string if input from a file could not be read or cannot write the
@@ -263,6 +336,122 @@ class Crypto {
   SymmetricEncryptionType symm_algorithm_;
 };
 
+/**
+* @class HashContext
+* Hashes data given in pieces, none of which is copied.  The digest is the same
+* as Crypto::Hash gives for all the pieces concatenated.
+*/
+class HashContext {
+ public:
+  explicit HashContext(const HashType &type);
+  ~HashContext();
+  void Update(const char *data, const size_t &size);
+  void Update(const std::string &data);
+  /**
+  * Returns the digest of the data given since construction or the last call
+  * to Final, and starts again.
+  * @param hex True for the hex encoded digest, False for the raw one
+  */
+  std::string Final(const bool &hex);
+ private:
+  HashContext(const HashContext&);
+  HashContext& operator=(const HashContext&);
+  boost::scoped_ptr<CryptoPP::HashTransformation> hash_;
+};
+
+/**
+* @class SignContext
+* Signs data given in pieces with a private key, as Crypto::AsymSign does for
+* all the pieces concatenated, without copying them.
+*/
+class SignContext {
+ public:
+  explicit SignContext(const std::string &private_key);
+  ~SignContext();
+  void Update(const char *data, const size_t &size);
+  void Update(const std::string &data);
+  /**
+  * Returns the signature of the data given since construction or the last
+  * call to Final, and starts again.  Returns an empty string if the key is
+  * not a valid private key.
+  */
+  std::string Final();
+ private:
+  SignContext(const SignContext&);
+  SignContext& operator=(const SignContext&);
+  boost::scoped_ptr<CryptoPP::PK_Signer> signer_;
+  boost::scoped_ptr<CryptoPP::PK_MessageAccumulator> accumulator_;
+};
+
+/**
+* @class VerifyContext
+* Verifies a signature of data given in pieces, as Crypto::AsymCheckSig does
+* for all the pieces concatenated, without copying them.  Parsed public keys
+* are shared with AsymCheckSig, but results aren't cached.
+*/
+class VerifyContext {
+ public:
+  VerifyContext(const std::string &public_key, const std::string &signature);
+  ~VerifyContext();
+  void Update(const char *data, const size_t &size);
+  void Update(const std::string &data);
+  /**
+  * Returns true if the signature is valid for the data given.  The context
+  * can't be used again afterwards.
+  */
+  bool Final();
+ private:
+  VerifyContext(const VerifyContext&);
+  VerifyContext& operator=(const VerifyContext&);
+  boost::shared_ptr<CryptoPP::PK_Verifier> verifier_;
+  boost::scoped_ptr<CryptoPP::PK_MessageAccumulator> accumulator_;
+};
+
+/**
+* @class CryptoExecutor
+* Runs cryptographic work on its own threads so that the caller's thread,
+* typically one delivering network messages, isn't held up by it.  Tasks are
+* run in the order submitted; at most max_queued may be waiting at a time.
+* On destruction, tasks already queued are run before the threads stop.
+*/
+class CryptoExecutor {
+ public:
+  typedef boost::function<void()> Task;
+  typedef boost::function<void(bool)> CheckSigFunctor;
+  CryptoExecutor(const boost::uint16_t &threads, const size_t &max_queued);
+  ~CryptoExecutor();
+  /**
+  * Queues a task to be run by one of the threads.
+  * @param task the work to run, including any completion it needs
+  * @return false, without queueing the task, if the queue is full or the
+  * executor is stopping
+  */
+  bool Submit(const Task &task);
+  /**
+  * Verifies a signature as Crypto::AsymCheckSig does with STRING_STRING, then
+  * runs complete with the result, both on one of the threads.
+  * @return false, without queueing the check, if the queue is full
+  */
+  bool AsymCheckSig(const std::string &input_data,
+                    const std::string &input_signature,
+                    const std::string &key,
+                    const CheckSigFunctor &complete);
+  /**
+  * @return the number of tasks waiting to be run
+  */
+  size_t Queued();
+ private:
+  CryptoExecutor(const CryptoExecutor&);
+  CryptoExecutor& operator=(const CryptoExecutor&);
+  void Run();
+  const size_t kMaxQueued_;
+  std::deque<Task> tasks_;
+  bool stopping_;
+  boost::mutex mutex_;
+  boost::condition_variable cond_;
+  boost::thread_group threads_;
+};
+
 /**
 * @class RsaKeyPair
 * Object that generates and holds a RSA key pair (private and public keys) of
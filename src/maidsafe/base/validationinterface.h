@@ -43,6 +43,8 @@ namespace base {
  * and to validate the id of the sender of the request.  This methods should be
  * implemented by the user.
  * id_ is the ID of the node doing the validation.
+ * A node's Kademlia service calls these methods from its crypto worker
+ * threads, several at a time, so implementations must be thread safe.
  */
 class SignatureValidator {
  public:
@@ -288,6 +288,33 @@ NAMESPACE_END
 	#define CRYPTOPP_BOOL_SSE2_INTRINSICS_AVAILABLE 0
 #endif
 
+// AES-NI and SHA extension kernels are compiled with per-function target attributes
+// (GCC 4.9+, Clang) so the rest of the library keeps its baseline instruction set,
+// and are only entered after a CPUID check at runtime.
+#if defined(CRYPTOPP_X86_ASM_AVAILABLE) && defined(__GNUC__) && (CRYPTOPP_GCC_VERSION >= 40900 || (defined(__clang__) && __clang_major__ >= 4))
+	#define CRYPTOPP_TARGET_AESNI __attribute__((target("aes")))
+	#define CRYPTOPP_TARGET_SHANI __attribute__((target("sha,sse4.1")))
+	#define CRYPTOPP_ISA_INTRINSICS_COMPILER 1
+#elif defined(_MSC_VER) && !defined(CRYPTOPP_DISABLE_ASM) && (defined(_M_IX86) || defined(_M_X64))
+	#define CRYPTOPP_TARGET_AESNI
+	#define CRYPTOPP_TARGET_SHANI
+	#define CRYPTOPP_ISA_INTRINSICS_COMPILER (_MSC_VER >= 1500)
+#else
+	#define CRYPTOPP_ISA_INTRINSICS_COMPILER 0
+#endif
+
+#if CRYPTOPP_ISA_INTRINSICS_COMPILER && !defined(CRYPTOPP_DISABLE_AESNI)
+	#define CRYPTOPP_BOOL_AESNI_INTRINSICS_AVAILABLE 1
+#else
+	#define CRYPTOPP_BOOL_AESNI_INTRINSICS_AVAILABLE 0
+#endif
+
+#if CRYPTOPP_ISA_INTRINSICS_COMPILER && !defined(CRYPTOPP_DISABLE_SHANI) && (!defined(_MSC_VER) || _MSC_VER >= 1900)
+	#define CRYPTOPP_BOOL_SHANI_INTRINSICS_AVAILABLE 1
+#else
+	#define CRYPTOPP_BOOL_SHANI_INTRINSICS_AVAILABLE 0
+#endif
+
 #if CRYPTOPP_BOOL_SSE2_INTRINSICS_AVAILABLE || CRYPTOPP_BOOL_SSE2_ASM_AVAILABLE || defined(CRYPTOPP_X64_MASM_AVAILABLE)
 	#define CRYPTOPP_BOOL_ALIGN16_ENABLED 1
 #else
@@ -39,6 +39,7 @@ bool CpuId(word32 input, word32 *output)
 		__asm
 		{
 			mov eax, input
+			xor ecx, ecx
 			cpuid
 			mov edi, output
 			mov [edi], eax
@@ -71,7 +72,7 @@ bool CpuId(word32 input, word32 *output)
 			"pushq %%rbx; cpuid; mov %%ebx, %%edi; popq %%rbx"
 #endif
 			: "=a" (output[0]), "=D" (output[1]), "=c" (output[2]), "=d" (output[3])
-			: "a" (input)
+			: "a" (input), "c" (0)
 		);
 	}
 
@@ -92,7 +93,11 @@ static void SigIllHandlerSSE2(int)
 
 bool CpuId(word32 input, word32 *output)
 {
+#if _MSC_VER >= 1500
+	__cpuidex((int *)output, input, 0);
+#else
 	__cpuid((int *)output, input);
+#endif
 	return true;
 }
 
@@ -146,6 +151,7 @@ static bool TrySSE2()
 
 bool g_x86DetectionDone = false;
 bool g_hasISSE = false, g_hasSSE2 = false, g_hasSSSE3 = false, g_hasMMX = false, g_isP4 = false;
+bool g_hasAESNI = false, g_hasSHA = false;
 word32 g_cacheLineSize = CRYPTOPP_L1_CACHE_LINE_SIZE;
 
 void DetectX86Features()
@@ -160,6 +166,16 @@ void DetectX86Features()
 	if ((cpuid1[3] & (1 << 26)) != 0)
 		g_hasSSE2 = TrySSE2();
 	g_hasSSSE3 = g_hasSSE2 && (cpuid1[2] & (1<<9));
+	g_hasAESNI = g_hasSSE2 && (cpuid1[2] & (1<<25));
+
+	// leaf 7 (structured extended features) reports the SHA extensions in EBX bit 29;
+	// the kernels also use SSE4.1
+	if (cpuid[0] >= 7)
+	{
+		word32 cpuid7[4];
+		if (CpuId(7, cpuid7))
+			g_hasSHA = g_hasSSSE3 && (cpuid1[2] & (1<<19)) && (cpuid7[1] & (1<<29));
+	}
 
 	if ((cpuid1[3] & (1 << 25)) != 0)
 		g_hasISSE = true;
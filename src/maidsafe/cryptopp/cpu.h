@@ -28,6 +28,8 @@ extern CRYPTOPP_DLL bool g_hasSSE2;
 extern CRYPTOPP_DLL bool g_hasISSE;
 extern CRYPTOPP_DLL bool g_hasMMX;
 extern CRYPTOPP_DLL bool g_hasSSSE3;
+extern CRYPTOPP_DLL bool g_hasAESNI;
+extern CRYPTOPP_DLL bool g_hasSHA;
 extern CRYPTOPP_DLL bool g_isP4;
 extern CRYPTOPP_DLL word32 g_cacheLineSize;
 CRYPTOPP_DLL void CRYPTOPP_API DetectX86Features();
@@ -70,6 +72,20 @@ inline bool HasSSSE3()
 	return g_hasSSSE3;
 }
 
+inline bool HasAESNI()
+{
+	if (!g_x86DetectionDone)
+		DetectX86Features();
+	return g_hasAESNI;
+}
+
+inline bool HasSHA()
+{
+	if (!g_x86DetectionDone)
+		DetectX86Features();
+	return g_hasSHA;
+}
+
 inline bool IsP4()
 {
 	if (!g_x86DetectionDone)
@@ -92,6 +108,8 @@ inline int GetCacheLineSize()
 }
 
 inline bool HasSSSE3()	{return false;}
+inline bool HasAESNI()	{return false;}
+inline bool HasSHA()	{return false;}
 inline bool IsP4()		{return false;}
 
 // assume MMX and SSE2 if intrinsics are enabled
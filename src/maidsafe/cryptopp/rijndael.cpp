@@ -69,6 +69,10 @@ being unloaded from L1 cache, until that round is finished.
 #include "misc.h"
 #include "cpu.h"
 
+#if CRYPTOPP_BOOL_AESNI_INTRINSICS_AVAILABLE
+#include <wmmintrin.h>
+#endif
+
 #ifdef __sun
 #include <alloca.h>
 #else
@@ -206,6 +210,193 @@ void Rijndael::Base::FillDecTable()
 	s_TdFilled = true;
 }
 
+#if CRYPTOPP_BOOL_AESNI_INTRINSICS_AVAILABLE
+
+// AES-NI kernels. When HasAESNI() is true UncheckedSetKey() leaves every round key
+// in byte order. The decryption schedule already has InvMixColumns applied to its
+// inner round keys (equivalent inverse cipher), which is the form aesdec expects.
+
+template <bool ENCRYPT>
+CRYPTOPP_TARGET_AESNI static inline __m128i AESNI_Block(__m128i block, const __m128i *subkeys, unsigned int rounds)
+{
+	block = _mm_xor_si128(block, subkeys[0]);
+	for (unsigned int i=1; i<rounds; i++)
+		block = ENCRYPT ? _mm_aesenc_si128(block, subkeys[i]) : _mm_aesdec_si128(block, subkeys[i]);
+	return ENCRYPT ? _mm_aesenclast_si128(block, subkeys[rounds]) : _mm_aesdeclast_si128(block, subkeys[rounds]);
+}
+
+// interleaving four independent blocks hides the latency of the round instructions
+template <bool ENCRYPT>
+CRYPTOPP_TARGET_AESNI static inline void AESNI_4_Blocks(__m128i &block0, __m128i &block1, __m128i &block2, __m128i &block3, const __m128i *subkeys, unsigned int rounds)
+{
+	__m128i rk = subkeys[0];
+	block0 = _mm_xor_si128(block0, rk);
+	block1 = _mm_xor_si128(block1, rk);
+	block2 = _mm_xor_si128(block2, rk);
+	block3 = _mm_xor_si128(block3, rk);
+	for (unsigned int i=1; i<rounds; i++)
+	{
+		rk = subkeys[i];
+		if (ENCRYPT)
+		{
+			block0 = _mm_aesenc_si128(block0, rk);
+			block1 = _mm_aesenc_si128(block1, rk);
+			block2 = _mm_aesenc_si128(block2, rk);
+			block3 = _mm_aesenc_si128(block3, rk);
+		}
+		else
+		{
+			block0 = _mm_aesdec_si128(block0, rk);
+			block1 = _mm_aesdec_si128(block1, rk);
+			block2 = _mm_aesdec_si128(block2, rk);
+			block3 = _mm_aesdec_si128(block3, rk);
+		}
+	}
+	rk = subkeys[rounds];
+	if (ENCRYPT)
+	{
+		block0 = _mm_aesenclast_si128(block0, rk);
+		block1 = _mm_aesenclast_si128(block1, rk);
+		block2 = _mm_aesenclast_si128(block2, rk);
+		block3 = _mm_aesenclast_si128(block3, rk);
+	}
+	else
+	{
+		block0 = _mm_aesdeclast_si128(block0, rk);
+		block1 = _mm_aesdeclast_si128(block1, rk);
+		block2 = _mm_aesdeclast_si128(block2, rk);
+		block3 = _mm_aesdeclast_si128(block3, rk);
+	}
+}
+
+static inline bool AESNI_Overlaps(const byte *a, const byte *b, size_t length)
+{
+	return a < b + length && b < a + length;
+}
+
+// Four blocks are all loaded before any of them is stored, so a group may only be
+// processed together if no output block is read back as a later block's input.
+// CFB encryption does exactly that (inBlocks trails outBlocks by one block), so it
+// goes one block at a time; CFB decryption, CTR and ECB can use the wide path.
+static bool AESNI_CanProcessInParallel(const byte *inBlocks, const byte *xorBlocks, const byte *outBlocks, size_t length, word32 flags)
+{
+	if (flags & BlockTransformation::BT_DontIncrementInOutPointers)
+		return false;
+	bool reverse = (flags & BlockTransformation::BT_ReverseDirection) != 0;
+	if (!(flags & BlockTransformation::BT_InBlockIsCounter) && AESNI_Overlaps(outBlocks, inBlocks, length) &&
+		(reverse ? outBlocks < inBlocks : outBlocks > inBlocks))
+		return false;
+	if (xorBlocks && AESNI_Overlaps(outBlocks, xorBlocks, length) &&
+		(reverse ? outBlocks < xorBlocks : outBlocks > xorBlocks))
+		return false;
+	return true;
+}
+
+// same contract as BlockTransformation::AdvancedProcessBlocks()
+template <bool ENCRYPT>
+CRYPTOPP_TARGET_AESNI static size_t AESNI_AdvancedProcessBlocks(const word32 *keys, unsigned int rounds, const byte *inBlocks, const byte *xorBlocks, byte *outBlocks, size_t length, word32 flags)
+{
+	const ptrdiff_t blockSize = 16;
+	const bool counter = (flags & BlockTransformation::BT_InBlockIsCounter) != 0;
+	const bool xorInput = xorBlocks && (flags & BlockTransformation::BT_XorInput);
+	const bool xorOutput = xorBlocks && !(flags & BlockTransformation::BT_XorInput);
+	const bool parallel = AESNI_CanProcessInParallel(inBlocks, xorBlocks, outBlocks, length, flags);
+	ptrdiff_t inIncrement = (flags & (BlockTransformation::BT_InBlockIsCounter|BlockTransformation::BT_DontIncrementInOutPointers)) ? 0 : blockSize;
+	ptrdiff_t xorIncrement = xorBlocks ? blockSize : 0;
+	ptrdiff_t outIncrement = (flags & BlockTransformation::BT_DontIncrementInOutPointers) ? 0 : blockSize;
+
+	if (flags & BlockTransformation::BT_ReverseDirection)
+	{
+		assert(length % blockSize == 0);
+		inBlocks += length - blockSize;
+		if (xorBlocks)
+			xorBlocks += length - blockSize;
+		outBlocks += length - blockSize;
+		inIncrement = -inIncrement;
+		xorIncrement = -xorIncrement;
+		outIncrement = -outIncrement;
+	}
+
+	__m128i subkeys[15];
+	for (unsigned int i=0; i<=rounds; i++)
+		subkeys[i] = _mm_loadu_si128((const __m128i *)(keys+4*i));
+
+	if (parallel)
+	{
+		// adds one to the last byte of a counter block, like the generic code does
+		const __m128i one = _mm_set_epi32(1<<24, 0, 0, 0);
+		while (length >= size_t(4*blockSize))
+		{
+			__m128i block0, block1, block2, block3;
+			block0 = _mm_loadu_si128((const __m128i *)inBlocks);
+			if (counter)
+			{
+				block1 = _mm_add_epi8(block0, one);
+				block2 = _mm_add_epi8(block1, one);
+				block3 = _mm_add_epi8(block2, one);
+				const_cast<byte *>(inBlocks)[blockSize-1] += 4;
+			}
+			else
+			{
+				block1 = _mm_loadu_si128((const __m128i *)(inBlocks+inIncrement));
+				block2 = _mm_loadu_si128((const __m128i *)(inBlocks+2*inIncrement));
+				block3 = _mm_loadu_si128((const __m128i *)(inBlocks+3*inIncrement));
+				inBlocks += 4*inIncrement;
+			}
+
+			if (xorInput)
+			{
+				block0 = _mm_xor_si128(block0, _mm_loadu_si128((const __m128i *)xorBlocks));
+				block1 = _mm_xor_si128(block1, _mm_loadu_si128((const __m128i *)(xorBlocks+xorIncrement)));
+				block2 = _mm_xor_si128(block2, _mm_loadu_si128((const __m128i *)(xorBlocks+2*xorIncrement)));
+				block3 = _mm_xor_si128(block3, _mm_loadu_si128((const __m128i *)(xorBlocks+3*xorIncrement)));
+			}
+
+			AESNI_4_Blocks<ENCRYPT>(block0, block1, block2, block3, subkeys, rounds);
+
+			if (xorOutput)
+			{
+				block0 = _mm_xor_si128(block0, _mm_loadu_si128((const __m128i *)xorBlocks));
+				block1 = _mm_xor_si128(block1, _mm_loadu_si128((const __m128i *)(xorBlocks+xorIncrement)));
+				block2 = _mm_xor_si128(block2, _mm_loadu_si128((const __m128i *)(xorBlocks+2*xorIncrement)));
+				block3 = _mm_xor_si128(block3, _mm_loadu_si128((const __m128i *)(xorBlocks+3*xorIncrement)));
+			}
+			if (xorBlocks)
+				xorBlocks += 4*xorIncrement;
+
+			_mm_storeu_si128((__m128i *)outBlocks, block0);
+			_mm_storeu_si128((__m128i *)(outBlocks+outIncrement), block1);
+			_mm_storeu_si128((__m128i *)(outBlocks+2*outIncrement), block2);
+			_mm_storeu_si128((__m128i *)(outBlocks+3*outIncrement), block3);
+			outBlocks += 4*outIncrement;
+			length -= 4*blockSize;
+		}
+	}
+
+	while (length >= size_t(blockSize))
+	{
+		__m128i block = _mm_loadu_si128((const __m128i *)inBlocks);
+		if (xorInput)
+			block = _mm_xor_si128(block, _mm_loadu_si128((const __m128i *)xorBlocks));
+		block = AESNI_Block<ENCRYPT>(block, subkeys, rounds);
+		if (xorOutput)
+			block = _mm_xor_si128(block, _mm_loadu_si128((const __m128i *)xorBlocks));
+		_mm_storeu_si128((__m128i *)outBlocks, block);
+
+		if (counter)
+			const_cast<byte *>(inBlocks)[blockSize-1]++;
+		inBlocks += inIncrement;
+		if (xorBlocks)
+			xorBlocks += xorIncrement;
+		outBlocks += outIncrement;
+		length -= blockSize;
+	}
+
+	return length;
+}
+
+#endif	// #if CRYPTOPP_BOOL_AESNI_INTRINSICS_AVAILABLE
+
 void Rijndael::Base::UncheckedSetKey(const byte *userKey, unsigned int keylen, const NameValuePairs &)
 {
 	AssertValidKeyLength(keylen);
@@ -289,10 +480,23 @@ void Rijndael::Base::UncheckedSetKey(const byte *userKey, unsigned int keylen, c
 
 	ConditionalByteReverse(BIG_ENDIAN_ORDER, m_key.begin(), m_key.begin(), 16);
 	ConditionalByteReverse(BIG_ENDIAN_ORDER, m_key + m_rounds*4, m_key + m_rounds*4, 16);
+#if CRYPTOPP_BOOL_AESNI_INTRINSICS_AVAILABLE
+	// the AES-NI kernels want the inner round keys in byte order as well
+	if (HasAESNI())
+		ConditionalByteReverse(BIG_ENDIAN_ORDER, m_key + 4, m_key + 4, (m_rounds-1)*16);
+#endif
 }
 
 void Rijndael::Enc::ProcessAndXorBlock(const byte *inBlock, const byte *xorBlock, byte *outBlock) const
 {
+#if CRYPTOPP_BOOL_AESNI_INTRINSICS_AVAILABLE
+	if (HasAESNI())
+	{
+		AESNI_AdvancedProcessBlocks<true>(m_key, m_rounds, inBlock, xorBlock, outBlock, 16, 0);
+		return;
+	}
+#endif
+
 #if CRYPTOPP_BOOL_SSE2_ASM_AVAILABLE || defined(CRYPTOPP_X64_MASM_AVAILABLE)
 	if (HasSSE2())
 	{
@@ -369,6 +573,14 @@ void Rijndael::Enc::ProcessAndXorBlock(const byte *inBlock, const byte *xorBlock
 
 void Rijndael::Dec::ProcessAndXorBlock(const byte *inBlock, const byte *xorBlock, byte *outBlock) const
 {
+#if CRYPTOPP_BOOL_AESNI_INTRINSICS_AVAILABLE
+	if (HasAESNI())
+	{
+		AESNI_AdvancedProcessBlocks<false>(m_key, m_rounds, inBlock, xorBlock, outBlock, 16, 0);
+		return;
+	}
+#endif
+
 	typedef BlockGetAndPut<word32, NativeByteOrder> Block;
 
 	word32 s0, s1, s2, s3, t0, t1, t2, t3;
@@ -930,6 +1142,11 @@ static inline bool AliasedWithTable(const byte *begin, const byte *end)
 
 size_t Rijndael::Enc::AdvancedProcessBlocks(const byte *inBlocks, const byte *xorBlocks, byte *outBlocks, size_t length, word32 flags) const
 {
+#if CRYPTOPP_BOOL_AESNI_INTRINSICS_AVAILABLE
+	if (HasAESNI())
+		return AESNI_AdvancedProcessBlocks<true>(m_key, m_rounds, inBlocks, xorBlocks, outBlocks, length, flags);
+#endif
+
 #if CRYPTOPP_BOOL_SSE2_ASM_AVAILABLE || defined(CRYPTOPP_X64_MASM_AVAILABLE)
 	if (length < BLOCKSIZE)
 		return length;
@@ -990,6 +1207,18 @@ size_t Rijndael::Enc::AdvancedProcessBlocks(const byte *inBlocks, const byte *xo
 
 #endif
 
+#if CRYPTOPP_BOOL_AESNI_INTRINSICS_AVAILABLE
+
+size_t Rijndael::Dec::AdvancedProcessBlocks(const byte *inBlocks, const byte *xorBlocks, byte *outBlocks, size_t length, word32 flags) const
+{
+	if (HasAESNI())
+		return AESNI_AdvancedProcessBlocks<false>(m_key, m_rounds, inBlocks, xorBlocks, outBlocks, length, flags);
+
+	return BlockTransformation::AdvancedProcessBlocks(inBlocks, xorBlocks, outBlocks, length, flags);
+}
+
+#endif
+
 NAMESPACE_END
 
 #endif
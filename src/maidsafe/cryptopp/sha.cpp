@@ -14,6 +14,10 @@
 #include "misc.h"
 #include "cpu.h"
 
+#if CRYPTOPP_BOOL_SHANI_INTRINSICS_AVAILABLE
+#include <immintrin.h>
+#endif
+
 NAMESPACE_BEGIN(CryptoPP)
 
 // start of Steve Reid's code
@@ -446,16 +450,79 @@ void CRYPTOPP_FASTCALL X86_SHA256_HashBlocks(word32 *state, const word32 *data,
 }
 #endif
 
+#if CRYPTOPP_BOOL_SHANI_INTRINSICS_AVAILABLE
+
+// SHA-256 using the SHA extensions. Like X86_SHA256_HashBlocks() it takes the
+// message in its original (big-endian) byte order; length is a multiple of 64.
+CRYPTOPP_TARGET_SHANI static void SHANI_SHA256_HashBlocks(word32 *state, const word32 *data, size_t length)
+{
+	const __m128i mask = _mm_set_epi32(0x0c0d0e0f, 0x08090a0b, 0x04050607, 0x00010203);
+
+	// the round instructions keep the state as ABEF and CDGH
+	__m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0xB1);
+	__m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(state+4)), 0x1B);
+	__m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+	state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+	while (length >= SHA256::BLOCKSIZE)
+	{
+		const __m128i abef = state0, cdgh = state1;
+		__m128i w[4];
+		for (unsigned int i=0; i<4; i++)
+			w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data+4*i)), mask);
+
+		for (unsigned int i=0; i<16; i++)
+		{
+			__m128i msg = _mm_add_epi32(w[i&3], _mm_loadu_si128((const __m128i *)(SHA256_K+4*i)));
+			state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+			state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0E));
+			if (i < 12)
+			{
+				// W[i+4..i+7] from W[i..i+3] and the three groups after it
+				msg = _mm_sha256msg1_epu32(w[i&3], w[(i+1)&3]);
+				msg = _mm_add_epi32(msg, _mm_alignr_epi8(w[(i+3)&3], w[(i+2)&3], 4));
+				w[i&3] = _mm_sha256msg2_epu32(msg, w[(i+3)&3]);
+			}
+		}
+
+		state0 = _mm_add_epi32(state0, abef);
+		state1 = _mm_add_epi32(state1, cdgh);
+		data += SHA256::BLOCKSIZE/4;
+		length -= SHA256::BLOCKSIZE;
+	}
+
+	tmp = _mm_shuffle_epi32(state0, 0x1B);
+	state1 = _mm_shuffle_epi32(state1, 0xB1);
+	_mm_storeu_si128((__m128i *)state, _mm_blend_epi16(tmp, state1, 0xF0));
+	_mm_storeu_si128((__m128i *)(state+4), _mm_alignr_epi8(state1, tmp, 8));
+}
+
+#endif
+
 #if defined(CRYPTOPP_X86_ASM_AVAILABLE) || defined(CRYPTOPP_X64_MASM_AVAILABLE)
 
 size_t SHA256::HashMultipleBlocks(const word32 *input, size_t length)
 {
+#if CRYPTOPP_BOOL_SHANI_INTRINSICS_AVAILABLE
+	if (HasSHA())
+	{
+		SHANI_SHA256_HashBlocks(m_state, input, length&(size_t(0)-BLOCKSIZE));
+		return length % BLOCKSIZE;
+	}
+#endif
 	X86_SHA256_HashBlocks(m_state, input, (length&(size_t(0)-BLOCKSIZE)) - !HasSSE2());
 	return length % BLOCKSIZE;
 }
 
 size_t SHA224::HashMultipleBlocks(const word32 *input, size_t length)
 {
+#if CRYPTOPP_BOOL_SHANI_INTRINSICS_AVAILABLE
+	if (HasSHA())
+	{
+		SHANI_SHA256_HashBlocks(m_state, input, length&(size_t(0)-BLOCKSIZE));
+		return length % BLOCKSIZE;
+	}
+#endif
 	X86_SHA256_HashBlocks(m_state, input, (length&(size_t(0)-BLOCKSIZE)) - !HasSSE2());
 	return length % BLOCKSIZE;
 }
@@ -491,6 +558,13 @@ void SHA256::Transform(word32 *state, const word32 *data)
 #if defined(CRYPTOPP_X86_ASM_AVAILABLE) || defined(CRYPTOPP_X64_MASM_AVAILABLE)
 	// this byte reverse is a waste of time, but this function is only called by MDC
 	ByteReverse(W, data, BLOCKSIZE);
+#if CRYPTOPP_BOOL_SHANI_INTRINSICS_AVAILABLE
+	if (HasSHA())
+	{
+		SHANI_SHA256_HashBlocks(state, W, BLOCKSIZE);
+		return;
+	}
+#endif
 	X86_SHA256_HashBlocks(state, W, BLOCKSIZE - !HasSSE2());
 #else
 	word32 T[8];
@@ -26,27 +26,78 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "maidsafe/kademlia/datastore.h"
+#include <boost/functional/hash.hpp>
+#include <boost/thread/locks.hpp>
 #include <exception>
+#include "maidsafe/base/log.h"
 #include "maidsafe/base/utils.h"
+#include "maidsafe/kademlia/datastorebackend.h"
+#include "maidsafe/maidsafe-dht_config.h"
 
 
 namespace kad {
 
+typedef boost::shared_lock<boost::shared_mutex> SharedLock;
+typedef boost::unique_lock<boost::shared_mutex> UniqueLock;
+
 DataStore::DataStore(const boost::uint32_t &t_refresh)
-    : datastore_(), t_refresh_(0), mutex_() {
+    : shards_(), backend_(), t_refresh_(0) {
+  t_refresh_ = t_refresh + (base::RandomUint32() % 5);
+  Init();
+}
+
+DataStore::DataStore(const boost::uint32_t &t_refresh,
+                     boost::shared_ptr<DataStoreBackend> backend)
+    : shards_(), backend_(backend), t_refresh_(0) {
   t_refresh_ = t_refresh + (base::RandomUint32() % 5);
+  Init();
 }
 
 DataStore::~DataStore() {
-  datastore_.clear();
+  ClearShards();
+}
+
+bool DataStore::Open() {
+  if (!backend_)
+    return true;
+  std::vector<key_value_tuple> tuples;
+  if (!backend_->Load(&tuples)) {
+    DLOG(ERROR) << "DataStore - failed to load the persistent backend."
+                << std::endl;
+    return false;
+  }
+  for (size_t i = 0; i < tuples.size(); ++i)
+    Shard(tuples[i].key_).datastore_.insert(tuples[i]);
+  return true;
+}
+
+void DataStore::Init() {
+  for (boost::uint16_t i = 0; i < kDataStoreShards; ++i)
+    shards_.push_back(boost::shared_ptr<DataStoreShard>(new DataStoreShard));
+}
+
+DataStoreShard& DataStore::Shard(const std::string &key) {
+  return *shards_[boost::hash<std::string>()(key) % shards_.size()];
+}
+
+void DataStore::PersistPut(const key_value_tuple &tuple) {
+  if (backend_ && !backend_->Put(tuple))
+    DLOG(WARNING) << "DataStore - failed to persist an entry." << std::endl;
+}
+
+void DataStore::PersistErase(const std::string &key, const std::string &value) {
+  if (backend_ && !backend_->Erase(key, value))
+    DLOG(WARNING) << "DataStore - failed to persist an erase." << std::endl;
 }
 
 bool DataStore::Keys(std::set<std::string> *keys) {
   keys->clear();
-  boost::mutex::scoped_lock guard(mutex_);
-  for (datastore::iterator it = datastore_.begin();
-       it != datastore_.end(); ++it)
-    keys->insert(it->key_);
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    SharedLock guard(shards_[i]->mutex_);
+    for (datastore::iterator it = shards_[i]->datastore_.begin();
+         it != shards_[i]->datastore_.end(); ++it)
+      keys->insert(it->key_);
+  }
   return true;
 }
 
@@ -59,27 +110,30 @@ bool DataStore::StoreItem(const std::string &key, const std::string &value,
   boost::uint32_t time_stamp = base::GetEpochTime();
   key_value_tuple tuple(key, value, time_stamp,
       time_to_live + time_stamp, time_to_live, hashable);
-  boost::mutex::scoped_lock guard(mutex_);
-  std::pair<datastore::iterator, bool> p = datastore_.insert(tuple);
+  DataStoreShard &shard = Shard(key);
+  UniqueLock guard(shard.mutex_);
+  std::pair<datastore::iterator, bool> p = shard.datastore_.insert(tuple);
 
   if (!p.second) {
     if ((p.first->del_status_ == NOT_DELETED) ||
         (tuple.ttl_ == -1) ||
         (p.first->expire_time_ < tuple.expire_time_ && p.first->ttl_ != -1)) {
-      datastore_.replace(p.first, tuple);
+      shard.datastore_.replace(p.first, tuple);
     } else {
       return false;
     }
   }
+  PersistPut(tuple);
   return true;
 }
 
 bool DataStore::LoadItem(const std::string &key,
                          std::vector<std::string> *values) {
   values->clear();
-  boost::mutex::scoped_lock guard(mutex_);
+  DataStoreShard &shard = Shard(key);
+  SharedLock guard(shard.mutex_);
   std::pair<datastore::iterator, datastore::iterator> p =
-      datastore_.equal_range(boost::make_tuple(key));
+      shard.datastore_.equal_range(boost::make_tuple(key));
   if (p.first == p.second)
     return false;
   boost::uint32_t now = base::GetEpochTime();
@@ -96,38 +150,45 @@ bool DataStore::LoadItem(const std::string &key,
 }
 
 bool DataStore::DeleteItem(const std::string &key, const std::string &value) {
-  datastore::iterator it = datastore_.find(boost::make_tuple(key, value));
-  boost::mutex::scoped_lock guard(mutex_);
-  if (it == datastore_.end())
+  DataStoreShard &shard = Shard(key);
+  UniqueLock guard(shard.mutex_);
+  datastore::iterator it = shard.datastore_.find(boost::make_tuple(key, value));
+  if (it == shard.datastore_.end())
     return false;
-  datastore_.erase(it);
+  shard.datastore_.erase(it);
+  PersistErase(key, value);
   return true;
 }
 
 bool DataStore::DeleteKey(const std::string &key) {
-  boost::mutex::scoped_lock guard(mutex_);
+  DataStoreShard &shard = Shard(key);
+  UniqueLock guard(shard.mutex_);
   std::pair<datastore::iterator, datastore::iterator> p =
-      datastore_.equal_range(boost::make_tuple(key));
+      shard.datastore_.equal_range(boost::make_tuple(key));
   if (p.first == p.second)
     return false;
-  datastore_.erase(p.first, p.second);
+  for (datastore::iterator it = p.first; it != p.second; ++it)
+    PersistErase(it->key_, it->value_);
+  shard.datastore_.erase(p.first, p.second);
   return true;
 }
 
 boost::uint32_t DataStore::LastRefreshTime(const std::string &key,
                                            const std::string &value) {
-  boost::mutex::scoped_lock guard(mutex_);
-  datastore::iterator it = datastore_.find(boost::make_tuple(key, value));
-  if (it == datastore_.end())
+  DataStoreShard &shard = Shard(key);
+  SharedLock guard(shard.mutex_);
+  datastore::iterator it = shard.datastore_.find(boost::make_tuple(key, value));
+  if (it == shard.datastore_.end())
     return 0;
   return it->last_refresh_time_;
 }
 
 boost::uint32_t DataStore::ExpireTime(const std::string &key,
                                       const std::string &value) {
-  boost::mutex::scoped_lock guard(mutex_);
-  datastore::iterator it = datastore_.find(boost::make_tuple(key, value));
-  if (it == datastore_.end())
+  DataStoreShard &shard = Shard(key);
+  SharedLock guard(shard.mutex_);
+  datastore::iterator it = shard.datastore_.find(boost::make_tuple(key, value));
+  if (it == shard.datastore_.end())
     return 0;
   return it->expire_time_;
 }
@@ -135,47 +196,106 @@ boost::uint32_t DataStore::ExpireTime(const std::string &key,
 std::vector<refresh_value> DataStore::ValuesToRefresh() {
   std::vector<refresh_value> values;
   datastore::index<kad::t_last_refresh_time>::type::iterator it, up_limit;
-  boost::mutex::scoped_lock guard(mutex_);
-  datastore::index<kad::t_last_refresh_time>::type& indx =
-      datastore_.get<kad::t_last_refresh_time>();
-  boost::uint32_t now = base::GetEpochTime();
-  boost::uint32_t time_limit = now - t_refresh_;
-  up_limit = indx.upper_bound(time_limit);
-  for (it = indx.begin(); it != up_limit; ++it) {
-    if (it->ttl_ == -1 && it->del_status_ == NOT_DELETED) {
-      values.push_back(refresh_value(it->key_, it->value_, it->ttl_));
-    } else {
-      boost::int32_t ttl_remaining = it->expire_time_ - now;
-      if (ttl_remaining > 0 && it->del_status_ == NOT_DELETED)
-        values.push_back(refresh_value(it->key_, it->value_, ttl_remaining));
-      else if (it->del_status_ != NOT_DELETED)
-        values.push_back(refresh_value(it->key_, it->value_, it->del_status_));
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    SharedLock guard(shards_[i]->mutex_);
+    datastore::index<kad::t_last_refresh_time>::type& indx =
+        shards_[i]->datastore_.get<kad::t_last_refresh_time>();
+    boost::uint32_t now = base::GetEpochTime();
+    boost::uint32_t time_limit = now - t_refresh_;
+    up_limit = indx.upper_bound(time_limit);
+    for (it = indx.begin(); it != up_limit; ++it) {
+      if (it->ttl_ == -1 && it->del_status_ == NOT_DELETED) {
+        values.push_back(refresh_value(it->key_, it->value_, it->ttl_));
+      } else {
+        boost::int32_t ttl_remaining = it->expire_time_ - now;
+        if (ttl_remaining > 0 && it->del_status_ == NOT_DELETED)
+          values.push_back(refresh_value(it->key_, it->value_, ttl_remaining));
+        else if (it->del_status_ != NOT_DELETED)
+          values.push_back(refresh_value(it->key_, it->value_,
+                                         it->del_status_));
+      }
     }
   }
   return values;
 }
 
 void DataStore::DeleteExpiredValues() {
-  datastore::index<kad::t_expire_time>::type::iterator up_limit, down_limit, it;
-  boost::mutex::scoped_lock guard(mutex_);
-  datastore::index<kad::t_expire_time>::type& indx =
-      datastore_.get<kad::t_expire_time>();
-  boost::uint32_t now = base::GetEpochTime();
-  up_limit = indx.lower_bound(now);
-  down_limit = indx.upper_bound(0);
-  indx.erase(down_limit, up_limit);
+  datastore::index<kad::t_expire_time>::type::iterator up_limit, down_limit;
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    UniqueLock guard(shards_[i]->mutex_);
+    datastore::index<kad::t_expire_time>::type& indx =
+        shards_[i]->datastore_.get<kad::t_expire_time>();
+    boost::uint32_t now = base::GetEpochTime();
+    up_limit = indx.lower_bound(now);
+    down_limit = indx.upper_bound(0);
+    if (backend_) {
+      for (datastore::index<kad::t_expire_time>::type::iterator it =
+           down_limit; it != up_limit; ++it)
+        PersistErase(it->key_, it->value_);
+    }
+    indx.erase(down_limit, up_limit);
+  }
+  if (backend_ && backend_->NeedsCompaction(Size()))
+    Compact();
 }
 
 void DataStore::Clear() {
-  boost::mutex::scoped_lock guard(mutex_);
-  datastore_.clear();
+  if (!backend_) {
+    ClearShards();
+    return;
+  }
+  // All shards are held so that no change reaches the backend between the
+  // shards being emptied and the backend being cleared.
+  for (size_t i = 0; i < shards_.size(); ++i)
+    shards_[i]->mutex_.lock();
+  for (size_t i = 0; i < shards_.size(); ++i)
+    shards_[i]->datastore_.clear();
+  if (!backend_->Clear())
+    DLOG(WARNING) << "DataStore - failed to clear the backend." << std::endl;
+  for (size_t i = 0; i < shards_.size(); ++i)
+    shards_[i]->mutex_.unlock();
+}
+
+void DataStore::ClearShards() {
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    UniqueLock guard(shards_[i]->mutex_);
+    shards_[i]->datastore_.clear();
+  }
+}
+
+size_t DataStore::Size() {
+  size_t size(0);
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    SharedLock guard(shards_[i]->mutex_);
+    size += shards_[i]->datastore_.size();
+  }
+  return size;
+}
+
+bool DataStore::persistent() const {
+  return backend_ != NULL;
+}
+
+bool DataStore::Compact() {
+  if (!backend_ || !backend_->StartCompaction())
+    return false;
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    SharedLock guard(shards_[i]->mutex_);
+    for (datastore::iterator it = shards_[i]->datastore_.begin();
+         it != shards_[i]->datastore_.end(); ++it) {
+      if (!backend_->AddToCompaction(*it))
+        return false;
+    }
+  }
+  return backend_->FinishCompaction();
 }
 
 boost::int32_t DataStore::TimeToLive(const std::string &key,
                                      const std::string &value) {
-  boost::mutex::scoped_lock guard(mutex_);
-  datastore::iterator it = datastore_.find(boost::make_tuple(key, value));
-  if (it == datastore_.end())
+  DataStoreShard &shard = Shard(key);
+  SharedLock guard(shard.mutex_);
+  datastore::iterator it = shard.datastore_.find(boost::make_tuple(key, value));
+  if (it == shard.datastore_.end())
     return 0;
   return it->ttl_;
 }
@@ -187,9 +307,10 @@ boost::uint32_t DataStore::t_refresh() const {
 std::vector<std::pair<std::string, bool> > DataStore::LoadKeyAppendableAttr(
     const std::string &key) {
   std::vector< std::pair<std::string, bool> > result;
-  boost::mutex::scoped_lock guard(mutex_);
+  DataStoreShard &shard = Shard(key);
+  SharedLock guard(shard.mutex_);
   std::pair<datastore::iterator, datastore::iterator> p =
-      datastore_.equal_range(boost::make_tuple(key));
+      shard.datastore_.equal_range(boost::make_tuple(key));
   while (p.first != p.second) {
     result.push_back(std::pair<std::string, bool>(p.first->value_,
         p.first->hashable_));
@@ -201,9 +322,10 @@ std::vector<std::pair<std::string, bool> > DataStore::LoadKeyAppendableAttr(
 bool DataStore::RefreshItem(const std::string &key,
                             const std::string &value,
                             std::string *str_delete_req) {
-  boost::mutex::scoped_lock guard(mutex_);
-  datastore::iterator it = datastore_.find(boost::make_tuple(key, value));
-  if (it == datastore_.end()) {
+  DataStoreShard &shard = Shard(key);
+  UniqueLock guard(shard.mutex_);
+  datastore::iterator it = shard.datastore_.find(boost::make_tuple(key, value));
+  if (it == shard.datastore_.end()) {
     printf("Look it up, it's in the dictionary.\n");
     return false;
   }
@@ -219,15 +341,19 @@ bool DataStore::RefreshItem(const std::string &key,
   tuple.expire_time_ = it->expire_time_;
   tuple.hashable_ = it->hashable_;
 
-  return datastore_.replace(it, tuple);
+  if (!shard.datastore_.replace(it, tuple))
+    return false;
+  PersistPut(tuple);
+  return true;
 }
 
 bool DataStore::MarkForDeletion(const std::string &key,
                                 const std::string &value,
                                 const std::string &ser_del_request) {
-  boost::mutex::scoped_lock guard(mutex_);
-  datastore::iterator it = datastore_.find(boost::make_tuple(key, value));
-  if (it == datastore_.end())
+  DataStoreShard &shard = Shard(key);
+  UniqueLock guard(shard.mutex_);
+  datastore::iterator it = shard.datastore_.find(boost::make_tuple(key, value));
+  if (it == shard.datastore_.end())
     return false;
   // Check if already deleted or marked as deleted
   if (it->del_status_ != NOT_DELETED)
@@ -240,14 +366,18 @@ bool DataStore::MarkForDeletion(const std::string &key,
   tuple.ser_delete_req_ = ser_del_request;
   tuple.del_status_ = MARKED_FOR_DELETION;
 
-  return datastore_.replace(it, tuple);
+  if (!shard.datastore_.replace(it, tuple))
+    return false;
+  PersistPut(tuple);
+  return true;
 }
 
 bool DataStore::MarkAsDeleted(const std::string &key,
                               const std::string &value) {
-  boost::mutex::scoped_lock guard(mutex_);
-  datastore::iterator it = datastore_.find(boost::make_tuple(key, value));
-  if (it == datastore_.end() || it->del_status_ != MARKED_FOR_DELETION)
+  DataStoreShard &shard = Shard(key);
+  UniqueLock guard(shard.mutex_);
+  datastore::iterator it = shard.datastore_.find(boost::make_tuple(key, value));
+  if (it == shard.datastore_.end() || it->del_status_ != MARKED_FOR_DELETION)
     return false;
   key_value_tuple tuple(key, value, 0);
   tuple.ttl_ = it->ttl_;
@@ -257,7 +387,10 @@ bool DataStore::MarkAsDeleted(const std::string &key,
   tuple.ser_delete_req_ = it->ser_delete_req_;
   tuple.del_status_ = DELETED;
 
-  return datastore_.replace(it, tuple);
+  if (!shard.datastore_.replace(it, tuple))
+    return false;
+  PersistPut(tuple);
+  return true;
 }
 
 bool DataStore::UpdateItem(const std::string &key,
@@ -265,9 +398,11 @@ bool DataStore::UpdateItem(const std::string &key,
                            const std::string &new_value,
                            const boost::int32_t &time_to_live,
                            const bool &hashable) {
-  boost::mutex::scoped_lock guard(mutex_);
-  datastore::iterator it = datastore_.find(boost::make_tuple(key, old_value));
-  if (it == datastore_.end() || it->del_status_ == MARKED_FOR_DELETION ||
+  DataStoreShard &shard = Shard(key);
+  UniqueLock guard(shard.mutex_);
+  datastore::iterator it =
+      shard.datastore_.find(boost::make_tuple(key, old_value));
+  if (it == shard.datastore_.end() || it->del_status_ == MARKED_FOR_DELETION ||
       it->del_status_ == DELETED)
     return false;
 
@@ -279,7 +414,12 @@ bool DataStore::UpdateItem(const std::string &key,
   tuple.del_status_ = NOT_DELETED;
   tuple.hashable_ = hashable;
 
-  return datastore_.replace(it, tuple);
+  if (!shard.datastore_.replace(it, tuple))
+    return false;
+  if (old_value != new_value)
+    PersistErase(key, old_value);
+  PersistPut(tuple);
+  return true;
 }
 
 }  // namespace kad
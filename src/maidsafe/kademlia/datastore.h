@@ -34,7 +34,8 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <boost/multi_index/member.hpp>
 #include <boost/multi_index/composite_key.hpp>
 #include <boost/cstdint.hpp>
-#include <boost/thread/mutex.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/shared_mutex.hpp>
 #include <string>
 #include <vector>
 #include <set>
@@ -115,11 +116,31 @@ typedef boost::multi_index::multi_index_container<
   >
 > datastore;
 
+// One partition of the DataStore.  Lookups take the mutex shared, so they only
+// wait for writers to the same shard.
+struct DataStoreShard {
+  DataStoreShard() : datastore_(), mutex_() {}
+  datastore datastore_;
+  boost::shared_mutex mutex_;
+};
+
+class DataStoreBackend;
+
+// Keys are spread over kDataStoreShards shards by hash, each with its own lock.
+// Operations on several keys (Keys, ValuesToRefresh, DeleteExpiredValues and
+// Clear) visit the shards one at a time, so they never hold more than one
+// shard's lock.
 class DataStore {
  public:
   // t_refresh = refresh time of key/value pair in seconds
   explicit DataStore(const boost::uint32_t &t_refresh);
+  // Writes every change through to backend.  Open must be called before use.
+  DataStore(const boost::uint32_t &t_refresh,
+            boost::shared_ptr<DataStoreBackend> backend);
   ~DataStore();
+  // Loads the entries held by the backend.  Returns false if they could not
+  // be read.  Does nothing for a DataStore without a backend.
+  bool Open();
   bool Keys(std::set<std::string> *keys);
   // time_to_live is in seconds.
   bool StoreItem(const std::string &key, const std::string &value,
@@ -151,11 +172,25 @@ class DataStore {
                   const boost::int32_t &time_to_live,
                   const bool &hashable);
   boost::uint32_t t_refresh() const;
+  // Number of key/value pairs held, including those marked for deletion.
+  size_t Size();
+  // True if entries are kept in a backend and survive the DataStore.
+  bool persistent() const;
+  // Rewrites the backend from the current entries.  DeleteExpiredValues does
+  // this once the backend needs compacting.
+  bool Compact();
  private:
-  datastore datastore_;
+  DataStore(const DataStore&);
+  DataStore& operator=(const DataStore&);
+  void Init();
+  DataStoreShard& Shard(const std::string &key);
+  void PersistPut(const key_value_tuple &tuple);
+  void PersistErase(const std::string &key, const std::string &value);
+  void ClearShards();
+  std::vector< boost::shared_ptr<DataStoreShard> > shards_;
+  boost::shared_ptr<DataStoreBackend> backend_;
   // refresh time in seconds
   boost::uint32_t t_refresh_;
-  boost::mutex mutex_;
 };
 
 }  // namespace kad
@@ -0,0 +1,356 @@
+/* Copyright (c) 2009 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "maidsafe/kademlia/datastorebackend.h"
+#include <boost/crc.hpp>
+#include <cstdio>
+#include <map>
+#include <utility>
+#include "maidsafe/base/log.h"
+#include "maidsafe/base/utils.h"
+#include "maidsafe/maidsafe-dht_config.h"
+#include "maidsafe/protobuf/datastore_log.pb.h"
+
+namespace fs = boost::filesystem;
+
+namespace kad {
+
+namespace {
+
+const boost::uint64_t kRecordHeaderSize = 8;
+
+void PutUint32(const boost::uint32_t &n, char *buffer) {
+  for (int i = 0; i < 4; ++i)
+    buffer[i] = static_cast<char>((n >> (8 * i)) & 0xff);
+}
+
+boost::uint32_t GetUint32(const char *buffer) {
+  boost::uint32_t n = 0;
+  for (int i = 3; i >= 0; --i)
+    n = (n << 8) | static_cast<unsigned char>(buffer[i]);
+  return n;
+}
+
+boost::uint32_t Checksum(const std::string &data) {
+  boost::crc_32_type crc;
+  crc.process_bytes(data.data(), data.size());
+  return crc.checksum();
+}
+
+// Frames a serialised record as <size><crc32 of record><record>, with the size
+// and checksum little-endian.
+std::string FrameRecord(const DataStoreLogRecord &record) {
+  std::string payload;
+  record.SerializeToString(&payload);
+  char header[kRecordHeaderSize];
+  PutUint32(static_cast<boost::uint32_t>(payload.size()), header);
+  PutUint32(Checksum(payload), header + 4);
+  return std::string(header, kRecordHeaderSize) + payload;
+}
+
+std::string PutRecord(const key_value_tuple &tuple) {
+  DataStoreLogRecord record;
+  record.set_type(DataStoreLogRecord::PUT);
+  record.set_key(tuple.key_);
+  record.set_value(tuple.value_);
+  record.set_ser_delete_req(tuple.ser_delete_req_);
+  record.set_last_refresh_time(tuple.last_refresh_time_);
+  record.set_expire_time(tuple.expire_time_);
+  record.set_ttl(tuple.ttl_);
+  record.set_hashable(tuple.hashable_);
+  record.set_del_status(tuple.del_status_);
+  return FrameRecord(record);
+}
+
+std::string EraseRecord(const std::string &key, const std::string &value) {
+  DataStoreLogRecord record;
+  record.set_type(DataStoreLogRecord::ERASE);
+  record.set_key(key);
+  record.set_value(value);
+  return FrameRecord(record);
+}
+
+key_value_tuple ToTuple(const DataStoreLogRecord &record) {
+  key_value_tuple tuple(record.key(), record.value(),
+                        record.last_refresh_time());
+  tuple.ser_delete_req_ = record.ser_delete_req();
+  tuple.expire_time_ = record.expire_time();
+  tuple.ttl_ = record.ttl();
+  tuple.hashable_ = record.hashable();
+  tuple.del_status_ = static_cast<delete_status>(record.del_status());
+  return tuple;
+}
+
+// Reads the record at *offset and moves *offset past it.  Returns false at the
+// end of the log or at a torn or corrupt record.
+bool ReadRecord(const boost::uint64_t &log_size, std::ifstream *input,
+                boost::uint64_t *offset, DataStoreLogRecord *record) {
+  char header[kRecordHeaderSize];
+  if (log_size - *offset < kRecordHeaderSize ||
+      !input->read(header, kRecordHeaderSize))
+    return false;
+  boost::uint32_t size = GetUint32(header);
+  if (size > log_size - *offset - kRecordHeaderSize)
+    return false;
+  std::string payload(size, '\0');
+  if (size > 0 && !input->read(&payload[0], size))
+    return false;
+  if (Checksum(payload) != GetUint32(header + 4) ||
+      !record->ParseFromString(payload))
+    return false;
+  *offset += kRecordHeaderSize + size;
+  return true;
+}
+
+bool Oversized(const boost::uint64_t &log_records, const size_t &live_entries) {
+  return log_records > kDataStoreCompactionThreshold &&
+         log_records > 2 * static_cast<boost::uint64_t>(live_entries);
+}
+
+}  // namespace
+
+LogDataStoreBackend::LogDataStoreBackend(const std::string &directory)
+    : log_path_(fs::path(directory) / "datastore.log"),
+      compaction_path_(fs::path(directory) / "datastore.log.compact"), log_(),
+      compaction_log_(), log_records_(0), compaction_records_(0),
+      compacting_(false), pending_records_(), mutex_() {}
+
+LogDataStoreBackend::~LogDataStoreBackend() {
+  boost::mutex::scoped_lock guard(mutex_);
+  AbandonCompaction();
+  log_.close();
+}
+
+bool LogDataStoreBackend::Load(std::vector<key_value_tuple> *tuples) {
+  boost::mutex::scoped_lock guard(mutex_);
+  AbandonCompaction();
+  log_.close();
+  boost::uint64_t log_size(0);
+  try {
+    fs::create_directories(log_path_.parent_path());
+    // A crash while replacing the log can leave only the compacted one.
+    if (!fs::exists(log_path_) && fs::exists(compaction_path_))
+      fs::rename(compaction_path_, log_path_);
+    fs::remove(compaction_path_);
+    if (fs::exists(log_path_))
+      log_size = fs::file_size(log_path_);
+  }
+  catch(const std::exception &e) {
+    DLOG(ERROR) << "LogDataStoreBackend::Load - " << e.what() << std::endl;
+    return false;
+  }
+
+  typedef std::map<std::pair<std::string, std::string>, key_value_tuple>
+      Entries;
+  Entries entries;
+  log_records_ = 0;
+  boost::uint64_t offset(0);
+  if (log_size > 0) {
+    std::ifstream input(log_path_.string().c_str(),
+                        std::ios::in | std::ios::binary);
+    DataStoreLogRecord record;
+    while (ReadRecord(log_size, &input, &offset, &record)) {
+      ++log_records_;
+      std::pair<std::string, std::string> id(record.key(), record.value());
+      if (record.type() == DataStoreLogRecord::ERASE) {
+        entries.erase(id);
+        continue;
+      }
+      Entries::iterator it = entries.find(id);
+      if (it == entries.end())
+        entries.insert(std::make_pair(id, ToTuple(record)));
+      else
+        it->second = ToTuple(record);
+    }
+  }
+
+  std::vector<key_value_tuple> live;
+  boost::uint32_t now = base::GetEpochTime();
+  for (Entries::iterator it = entries.begin(); it != entries.end(); ++it) {
+    if (it->second.expire_time_ == 0 || it->second.expire_time_ >= now)
+      live.push_back(it->second);
+  }
+  tuples->insert(tuples->end(), live.begin(), live.end());
+
+  if (offset < log_size) {
+    DLOG(WARNING) << "LogDataStoreBackend::Load - dropping "
+                  << log_size - offset << " bytes of torn or corrupt records"
+                  << " from " << log_path_.string() << std::endl;
+    return RewriteLog(live);
+  }
+  if (Oversized(log_records_, live.size()))
+    return RewriteLog(live);
+  log_.open(log_path_.string().c_str(),
+            std::ios::out | std::ios::binary | std::ios::app);
+  return log_.good();
+}
+
+bool LogDataStoreBackend::Put(const key_value_tuple &tuple) {
+  std::string record(PutRecord(tuple));
+  boost::mutex::scoped_lock guard(mutex_);
+  return Append(record);
+}
+
+bool LogDataStoreBackend::Erase(const std::string &key,
+                                const std::string &value) {
+  std::string record(EraseRecord(key, value));
+  boost::mutex::scoped_lock guard(mutex_);
+  return Append(record);
+}
+
+bool LogDataStoreBackend::Clear() {
+  boost::mutex::scoped_lock guard(mutex_);
+  AbandonCompaction();
+  log_.close();
+  log_.open(log_path_.string().c_str(),
+            std::ios::out | std::ios::binary | std::ios::trunc);
+  log_records_ = 0;
+  return log_.good();
+}
+
+bool LogDataStoreBackend::NeedsCompaction(const size_t &live_entries) {
+  boost::mutex::scoped_lock guard(mutex_);
+  return !compacting_ && Oversized(log_records_, live_entries);
+}
+
+bool LogDataStoreBackend::StartCompaction() {
+  boost::mutex::scoped_lock guard(mutex_);
+  if (compacting_ || !log_.is_open())
+    return false;
+  compaction_log_.open(compaction_path_.string().c_str(),
+                       std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!compaction_log_.good()) {
+    AbandonCompaction();
+    return false;
+  }
+  compaction_records_ = 0;
+  compacting_ = true;
+  return true;
+}
+
+bool LogDataStoreBackend::AddToCompaction(const key_value_tuple &tuple) {
+  std::string record(PutRecord(tuple));
+  boost::mutex::scoped_lock guard(mutex_);
+  if (!compacting_)
+    return false;
+  compaction_log_.write(record.data(), record.size());
+  ++compaction_records_;
+  if (!compaction_log_.good()) {
+    AbandonCompaction();
+    return false;
+  }
+  return true;
+}
+
+bool LogDataStoreBackend::FinishCompaction() {
+  boost::mutex::scoped_lock guard(mutex_);
+  if (!compacting_)
+    return false;
+  for (size_t i = 0; i < pending_records_.size(); ++i)
+    compaction_log_.write(pending_records_[i].data(),
+                          pending_records_[i].size());
+  compaction_records_ += pending_records_.size();
+  compaction_log_.flush();
+  if (!compaction_log_.good()) {
+    AbandonCompaction();
+    return false;
+  }
+  compacting_ = false;
+  pending_records_.clear();
+  if (!ReplaceLog())
+    return false;
+  log_records_ = compaction_records_;
+  return true;
+}
+
+boost::uint64_t LogDataStoreBackend::LogRecords() {
+  boost::mutex::scoped_lock guard(mutex_);
+  return log_records_;
+}
+
+bool LogDataStoreBackend::Append(const std::string &record) {
+  if (!log_.is_open())
+    return false;
+  log_.write(record.data(), record.size());
+  log_.flush();
+  ++log_records_;
+  if (compacting_)
+    pending_records_.push_back(record);
+  return log_.good();
+}
+
+bool LogDataStoreBackend::RewriteLog(
+    const std::vector<key_value_tuple> &tuples) {
+  compaction_log_.open(compaction_path_.string().c_str(),
+                       std::ios::out | std::ios::binary | std::ios::trunc);
+  for (size_t i = 0; i < tuples.size(); ++i) {
+    std::string record(PutRecord(tuples[i]));
+    compaction_log_.write(record.data(), record.size());
+  }
+  compaction_log_.flush();
+  if (!compaction_log_.good()) {
+    AbandonCompaction();
+    return false;
+  }
+  if (!ReplaceLog())
+    return false;
+  log_records_ = tuples.size();
+  return true;
+}
+
+bool LogDataStoreBackend::ReplaceLog() {
+  compaction_log_.close();
+  log_.close();
+  bool replaced(true);
+#ifdef MAIDSAFE_WIN32
+  // rename doesn't replace an existing file on Windows.  Load recovers from a
+  // crash between the two calls.
+  std::remove(log_path_.string().c_str());
+#endif
+  if (std::rename(compaction_path_.string().c_str(),
+                  log_path_.string().c_str()) != 0) {
+    DLOG(ERROR) << "LogDataStoreBackend::ReplaceLog - failed to replace "
+                << log_path_.string() << std::endl;
+    std::remove(compaction_path_.string().c_str());
+    replaced = false;
+  }
+  log_.open(log_path_.string().c_str(),
+            std::ios::out | std::ios::binary | std::ios::app);
+  return replaced && log_.good();
+}
+
+void LogDataStoreBackend::AbandonCompaction() {
+  if (compaction_log_.is_open()) {
+    compaction_log_.close();
+    std::remove(compaction_path_.string().c_str());
+  }
+  compaction_log_.clear();
+  compacting_ = false;
+  pending_records_.clear();
+}
+
+}  // namespace kad
@@ -0,0 +1,101 @@
+/* Copyright (c) 2009 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MAIDSAFE_KADEMLIA_DATASTOREBACKEND_H_
+#define MAIDSAFE_KADEMLIA_DATASTOREBACKEND_H_
+
+#include <boost/cstdint.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
+#include <fstream>  // NOLINT
+#include <string>
+#include <vector>
+#include "maidsafe/kademlia/datastore.h"
+
+namespace kad {
+
+// Persistent storage behind a DataStore.  The DataStore keeps every entry in
+// memory and writes each change through to the backend, so the backend is only
+// read when the DataStore is created.
+class DataStoreBackend {
+ public:
+  virtual ~DataStoreBackend() {}
+  // Appends every entry held by the backend to tuples.
+  virtual bool Load(std::vector<key_value_tuple> *tuples) = 0;
+  // Adds the entry, replacing any existing one with the same key and value.
+  virtual bool Put(const key_value_tuple &tuple) = 0;
+  virtual bool Erase(const std::string &key, const std::string &value) = 0;
+  virtual bool Clear() = 0;
+  // Returns true if the space used is large compared to live_entries, the
+  // number of entries currently held by the DataStore.
+  virtual bool NeedsCompaction(const size_t &live_entries) = 0;
+  // Compaction rewrites the backend from the live entries:  StartCompaction,
+  // then AddToCompaction for each entry, then FinishCompaction.  Puts and
+  // Erases made in between are kept.  A Clear or a failure abandons the
+  // compaction, leaving the backend as it was.
+  virtual bool StartCompaction() = 0;
+  virtual bool AddToCompaction(const key_value_tuple &tuple) = 0;
+  virtual bool FinishCompaction() = 0;
+};
+
+// Keeps the entries in an append-only log of checksummed records in directory.
+// A record torn by a crash ends the replay in Load and is dropped.  Compaction
+// writes the new log to a temporary file which then replaces the old one.
+class LogDataStoreBackend : public DataStoreBackend {
+ public:
+  explicit LogDataStoreBackend(const std::string &directory);
+  ~LogDataStoreBackend();
+  bool Load(std::vector<key_value_tuple> *tuples);
+  bool Put(const key_value_tuple &tuple);
+  bool Erase(const std::string &key, const std::string &value);
+  bool Clear();
+  bool NeedsCompaction(const size_t &live_entries);
+  bool StartCompaction();
+  bool AddToCompaction(const key_value_tuple &tuple);
+  bool FinishCompaction();
+  // Number of records in the current log.
+  boost::uint64_t LogRecords();
+ private:
+  LogDataStoreBackend(const LogDataStoreBackend&);
+  LogDataStoreBackend& operator=(const LogDataStoreBackend&);
+  bool Append(const std::string &record);
+  bool RewriteLog(const std::vector<key_value_tuple> &tuples);
+  bool ReplaceLog();
+  void AbandonCompaction();
+  boost::filesystem::path log_path_, compaction_path_;
+  std::ofstream log_, compaction_log_;
+  boost::uint64_t log_records_, compaction_records_;
+  bool compacting_;
+  // Records appended to the log while compacting, which are copied to the end
+  // of the compacted log.
+  std::vector<std::string> pending_records_;
+  boost::mutex mutex_;
+};
+
+}  // namespace kad
+
+#endif  // MAIDSAFE_KADEMLIA_DATASTOREBACKEND_H_
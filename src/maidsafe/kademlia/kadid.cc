@@ -24,67 +24,148 @@ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
 TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
 THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
-
 #include "maidsafe/kademlia/kadid.h"
 #include <bitset>
+#include <cstring>
 #include "maidsafe/base/log.h"
 #include "maidsafe/base/utils.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MAIDSAFE_KADID_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || \
+      (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MAIDSAFE_KADID_SSE2
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 
 namespace kad {
 
+namespace {
+
+inline size_t LowestSetBit(const boost::uint32_t &mask) {
+#if defined(_MSC_VER)
+  unsigned long index;  // NOLINT
+  _BitScanForward(&index, mask);
+  return index;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+
+// Returns the position of the first byte at which the ids differ, or
+// kKeySizeBytes if they are equal.
+size_t FirstDifference(const unsigned char *id1, const unsigned char *id2) {
+  size_t i(0);
+#if defined(MAIDSAFE_KADID_AVX2)
+  for (; i + 32 <= kKeySizeBytes; i += 32) {
+    boost::uint32_t equal = _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(id1 + i)),
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(id2 + i))));
+    if (equal != 0xffffffff)
+      return i + LowestSetBit(~equal);
+  }
+#elif defined(MAIDSAFE_KADID_SSE2)
+  for (; i + 16 <= kKeySizeBytes; i += 16) {
+    boost::uint32_t equal = _mm_movemask_epi8(_mm_cmpeq_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(id1 + i)),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(id2 + i))));
+    if (equal != 0xffff)
+      return i + LowestSetBit(~equal);
+  }
+#endif
+  for (; i < kKeySizeBytes; ++i) {
+    if (id1[i] != id2[i])
+      return i;
+  }
+  return kKeySizeBytes;
+}
+
+void XorIds(const unsigned char *id1, const unsigned char *id2,
+            unsigned char *result) {
+  size_t i(0);
+#if defined(MAIDSAFE_KADID_AVX2)
+  for (; i + 32 <= kKeySizeBytes; i += 32) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(result + i),
+        _mm256_xor_si256(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(id1 + i)),
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(id2 + i))));
+  }
+#elif defined(MAIDSAFE_KADID_SSE2)
+  for (; i + 16 <= kKeySizeBytes; i += 16) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(result + i),
+        _mm_xor_si128(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(id1 + i)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(id2 + i))));
+  }
+#endif
+  for (; i < kKeySizeBytes; ++i)
+    result[i] = id1[i] ^ id2[i];
+}
+
+}  // namespace
+
 size_t BitToByteCount(const size_t &bit_count) {
   return static_cast<size_t>(0.999999 + static_cast<double>(bit_count) / 8);
 }
 
-KadId::KadId() : raw_id_(kZeroId) {}
+KadId::KadId() : valid_(true) {
+  std::memset(raw_id_, 0, kKeySizeBytes);
+}
 
-KadId::KadId(const KadId &other) : raw_id_(other.raw_id_) {}
+KadId::KadId(const KadId &other) : valid_(other.valid_) {
+  std::memcpy(raw_id_, other.raw_id_, kKeySizeBytes);
+}
 
-KadId::KadId(const KadIdType &type) : raw_id_(kKeySizeBytes, -1) {
+KadId::KadId(const KadIdType &type) : valid_(true) {
+  std::memset(raw_id_, -1, kKeySizeBytes);
   switch (type) {
     case kMaxId :
       break;  // already set
     case kRandomId :
-      for (std::string::iterator it = raw_id_.begin(); it != raw_id_.end();
-           ++it) {
-        (*it) = base::RandomUint32();
-      }
+      for (size_t i = 0; i < kKeySizeBytes; ++i)
+        raw_id_[i] = base::RandomUint32();
       break;
     default :
       break;
   }
 }
 
-KadId::KadId(const std::string &id) : raw_id_(id) {}
+KadId::KadId(const std::string &id) : valid_(false) {
+  Assign(id);
+}
 
 KadId::KadId(const std::string &id, const EncodingType &encoding_type)
-    : raw_id_() {
+    : valid_(false) {
+  std::memset(raw_id_, 0, kKeySizeBytes);
   try {
     switch (encoding_type) {
       case kBinary : DecodeFromBinary(id);
         break;
-      case kHex : raw_id_ = base::DecodeFromHex(id);
+      case kHex : Assign(base::DecodeFromHex(id));
         break;
-      case kBase32 : raw_id_ = base::DecodeFromBase32(id);
+      case kBase32 : Assign(base::DecodeFromBase32(id));
         break;
-      case kBase64 : raw_id_ = base::DecodeFromBase64(id);
+      case kBase64 : Assign(base::DecodeFromBase64(id));
         break;
-      default : raw_id_ = id;
+      default : Assign(id);
     }
   }
   catch(const std::exception &e) {
     LOG(ERROR) << "KadId Ctor: " << e.what();
-    raw_id_.clear();
-    return;
+    Assign("");
   }
-  if (!IsValid())
-    raw_id_.clear();
 }
 
-KadId::KadId(const boost::uint16_t &power) : raw_id_(kZeroId) {
+KadId::KadId(const boost::uint16_t &power) : valid_(true) {
+  std::memset(raw_id_, 0, kKeySizeBytes);
   if (power >= kKeySizeBits) {
-    raw_id_.clear();
+    valid_ = false;
     return;
   }
   boost::uint16_t shift = power % 8;
@@ -95,16 +176,17 @@ KadId::KadId(const boost::uint16_t &power) : raw_id_(kZeroId) {
   }
 }
 
-KadId::KadId(const KadId &id1, const KadId &id2) : raw_id_(kZeroId) {
+KadId::KadId(const KadId &id1, const KadId &id2) : valid_(true) {
+  std::memset(raw_id_, 0, kKeySizeBytes);
   if (!id1.IsValid() || !id2.IsValid()) {
-    raw_id_.clear();
+    valid_ = false;
     return;
   }
   if (id1 == id2) {
-    raw_id_ = id1.raw_id_;
+    std::memcpy(raw_id_, id1.raw_id_, kKeySizeBytes);
     return;
   }
-  std::string min_id(id1.raw_id_), max_id(id2.raw_id_);
+  const unsigned char *min_id(id1.raw_id_), *max_id(id2.raw_id_);
   if (id1 > id2) {
     max_id = id1.raw_id_;
     min_id = id2.raw_id_;
@@ -136,9 +218,17 @@ KadId::KadId(const KadId &id1, const KadId &id2) : raw_id_(kZeroId) {
   }
 }
 
+void KadId::Assign(const std::string &id) {
+  valid_ = (id.size() == kKeySizeBytes);
+  if (valid_)
+    std::memcpy(raw_id_, id.data(), kKeySizeBytes);
+  else
+    std::memset(raw_id_, 0, kKeySizeBytes);
+}
+
 std::string KadId::EncodeToBinary() const {
   std::string binary;
-  binary.reserve(kKeySizeBytes);
+  binary.reserve(kKeySizeBits);
   for (size_t i = 0; i < kKeySizeBytes; ++i) {
     std::bitset<8> temp(static_cast<int>(raw_id_[i]));
     binary += temp.to_string();
@@ -148,13 +238,11 @@ std::string KadId::EncodeToBinary() const {
 
 void KadId::DecodeFromBinary(const std::string &binary_id) {
   std::bitset<kKeySizeBits> binary_bitset(binary_id);
-  if (!IsValid()) {
-    raw_id_.assign(kKeySizeBytes, 0);
-  }
   for (size_t i = 0; i < kKeySizeBytes; ++i) {
     std::bitset<8> temp(binary_id.substr(i * 8, 8));
     raw_id_[i] = temp.to_ulong();
   }
+  valid_ = true;
 }
 
 void KadId::SplitRange(const KadId &min_id, const KadId &max_id,
@@ -164,43 +252,70 @@ void KadId::SplitRange(const KadId &min_id, const KadId &max_id,
   if (!min_id.IsValid() || !max_id.IsValid() ||
       !max_id1->IsValid() || !min_id1->IsValid() || min_id >= max_id) {
     KadId fail_id;
-    fail_id.raw_id_.clear();
+    fail_id.valid_ = false;
     *max_id1 = fail_id;
     *min_id1 = fail_id;
+    return;
   }
-  size_t first_diff_bit(0);
-  for (; first_diff_bit < kKeySizeBytes; ++first_diff_bit) {
-    if (min_id.raw_id_[first_diff_bit] != max_id.raw_id_[first_diff_bit])
-     break;
-  }
-  std::string max1_raw_id(max_id.raw_id_), min1_raw_id(min_id.raw_id_);
-  unsigned char max1_diff_char(max1_raw_id[first_diff_bit]);
-  unsigned char min1_diff_char(min1_raw_id[first_diff_bit]);
-  max1_raw_id[first_diff_bit] = (max1_diff_char + min1_diff_char) >> 1;
-  max1_diff_char = max1_raw_id[first_diff_bit];
-  min1_raw_id[first_diff_bit] = max1_diff_char + 1;
-  *max_id1 = KadId(max1_raw_id);
-  *min_id1 = KadId(min1_raw_id);
+  size_t first_diff_bit(FirstDifference(min_id.raw_id_, max_id.raw_id_));
+  *max_id1 = max_id;
+  *min_id1 = min_id;
+  unsigned char max1_diff_char(max_id1->raw_id_[first_diff_bit]);
+  unsigned char min1_diff_char(min_id1->raw_id_[first_diff_bit]);
+  max_id1->raw_id_[first_diff_bit] = (max1_diff_char + min1_diff_char) >> 1;
+  max1_diff_char = max_id1->raw_id_[first_diff_bit];
+  min_id1->raw_id_[first_diff_bit] = max1_diff_char + 1;
 }
 
 bool KadId::CloserToTarget(const KadId &id1, const KadId &id2,
                            const KadId &target_id) {
   if (!id1.IsValid() || !id2.IsValid() || !target_id.IsValid())
     return false;
-  std::string raw_id1(id1.raw_id_);
-  std::string raw_id2(id2.raw_id_);
-  std::string raw_id_target(target_id.raw_id_);
-  for (boost::uint16_t i = 0; i < kKeySizeBytes; ++i) {
-    unsigned char result1 = raw_id1[i] ^ raw_id_target[i];
-    unsigned char result2 = raw_id2[i] ^ raw_id_target[i];
-    if (result1 != result2)
-      return result1 < result2;
+  // The distances first differ where the ids themselves first differ.
+  size_t i = FirstDifference(id1.raw_id_, id2.raw_id_);
+  if (i == kKeySizeBytes)
+    return false;
+  unsigned char result1 = id1.raw_id_[i] ^ target_id.raw_id_[i];
+  unsigned char result2 = id2.raw_id_[i] ^ target_id.raw_id_[i];
+  return result1 < result2;
+}
+
+boost::uint16_t KadId::CommonPrefixLength(const KadId &other) const {
+  if (!valid_ || !other.valid_)
+    return 0;
+  size_t i = FirstDifference(raw_id_, other.raw_id_);
+  if (i == kKeySizeBytes)
+    return kKeySizeBits;
+  boost::uint16_t length = 8 * i;
+  for (unsigned char diff = raw_id_[i] ^ other.raw_id_[i]; (diff & 0x80) == 0;
+       diff <<= 1)
+    ++length;
+  return length;
+}
+
+size_t KadId::Hash() const {
+  if (!valid_)
+    return 0;
+  boost::uint64_t hash(0), word(0);
+  size_t i(0);
+  for (; i + sizeof(word) <= kKeySizeBytes; i += sizeof(word)) {
+    memcpy(&word, raw_id_ + i, sizeof(word));
+    hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+    hash ^= hash >> 32;
   }
-  return false;
+  for (; i < kKeySizeBytes; ++i)
+    hash = (hash ^ raw_id_[i]) * 0x9e3779b97f4a7c15ULL;
+  return static_cast<size_t>(hash);
+}
+
+size_t hash_value(const KadId &id) {
+  return id.Hash();
 }
 
 const std::string KadId::String() const {
-  return raw_id_;
+  if (!valid_)
+    return "";
+  return std::string(reinterpret_cast<const char*>(raw_id_), kKeySizeBytes);
 }
 
 const std::string KadId::ToStringEncoded(
@@ -209,53 +324,60 @@ const std::string KadId::ToStringEncoded(
     return "";
   switch (encoding_type) {
     case kBinary : return EncodeToBinary();
-    case kHex : return base::EncodeToHex(raw_id_);
-    case kBase32 : return base::EncodeToBase32(raw_id_);
-    case kBase64 : return base::EncodeToBase64(raw_id_);
-    default : return raw_id_;
+    case kHex : return base::EncodeToHex(String());
+    case kBase32 : return base::EncodeToBase32(String());
+    case kBase64 : return base::EncodeToBase64(String());
+    default : return String();
   }
 }
 
 bool KadId::IsValid() const {
-  return raw_id_.size() == kKeySizeBytes;
+  return valid_;
 }
 
 bool KadId::operator == (const KadId &rhs) const {
-  return raw_id_ == rhs.raw_id_;
+  if (!valid_ || !rhs.valid_)
+    return valid_ == rhs.valid_;
+  return FirstDifference(raw_id_, rhs.raw_id_) == kKeySizeBytes;
 }
 
 bool KadId::operator != (const KadId &rhs) const {
-  return raw_id_ != rhs.raw_id_;
+  return !(*this == rhs);
 }
 
 bool KadId::operator < (const KadId &rhs) const {
-  return raw_id_ < rhs.raw_id_;
+  // An invalid id orders before every valid one.
+  if (!valid_ || !rhs.valid_)
+    return !valid_ && rhs.valid_;
+  size_t i = FirstDifference(raw_id_, rhs.raw_id_);
+  return i != kKeySizeBytes && raw_id_[i] < rhs.raw_id_[i];
 }
 
 bool KadId::operator > (const KadId &rhs) const {
-  return raw_id_ > rhs.raw_id_;
+  return rhs < *this;
 }
 
 bool KadId::operator <= (const KadId &rhs) const {
-  return raw_id_ <= rhs.raw_id_;
+  return !(rhs < *this);
 }
 
 bool KadId::operator >= (const KadId &rhs) const {
-  return raw_id_ >= rhs.raw_id_;
+  return !(*this < rhs);
 }
 
 KadId& KadId::operator = (const KadId &rhs) {
-  this->raw_id_ = rhs.raw_id_;
+  std::memcpy(raw_id_, rhs.raw_id_, kKeySizeBytes);
+  valid_ = rhs.valid_;
   return *this;
 }
 
 const KadId KadId::operator ^ (const KadId &rhs) const {
   KadId result;
-  std::string::const_iterator this_it = raw_id_.begin();
-  std::string::const_iterator rhs_it = rhs.raw_id_.begin();
-  std::string::iterator result_it = result.raw_id_.begin();
-  for (; this_it != raw_id_.end(); ++this_it, ++rhs_it, ++result_it)
-    *result_it = *this_it ^ *rhs_it;
+  if (!valid_ || !rhs.valid_) {
+    result.valid_ = false;
+    return result;
+  }
+  XorIds(raw_id_, rhs.raw_id_, result.raw_id_);
   return result;
 }
 }
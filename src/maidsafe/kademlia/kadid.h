@@ -48,6 +48,8 @@ size_t BitToByteCount(const size_t &bit_count);
 /**
 * @class KadId
 * Class used to contain a valid kademlia id in the range [0, 2 ^ kKeySizeBits)
+* The id is held in a fixed-size array, so copying and comparing ids never
+* allocates.
 */
 
 class KadId {
@@ -123,6 +125,22 @@ class KadId {
   static bool CloserToTarget(const KadId &id1, const KadId &id2,
                              const KadId &target_id);
 
+  /**
+  * Number of leading bits shared with another id.  This is the index of the
+  * k-bucket, counted from the furthest, that other falls in as seen from this
+  * id.
+  * @param other KadId object.
+  * @return A value in [0, kKeySizeBits], kKeySizeBits if the ids are equal.
+  * 0 if either id is invalid.
+  */
+  boost::uint16_t CommonPrefixLength(const KadId &other) const;
+
+  /**
+  * Hash of the whole id, for use in hashed containers.
+  * @return The hash, equal for equal ids.
+  */
+  size_t Hash() const;
+
   /** Decoded representation of the kademlia id.
   * @return A decoded string representation of the kademlia id.
   */
@@ -135,7 +153,7 @@ class KadId {
   const std::string ToStringEncoded(const EncodingType &encoding_type) const;
 
   /**
-  * Checks that raw_id_ has size kKeySizeBytes.
+  * Checks that the id was constructed from a value of kKeySizeBytes.
   */
   bool IsValid() const;
 
@@ -156,9 +174,16 @@ class KadId {
  private:
   std::string EncodeToBinary() const;
   void DecodeFromBinary(const std::string &binary_id);
-  std::string raw_id_;
+  void Assign(const std::string &id);
+  unsigned char raw_id_[kKeySizeBytes];
+  bool valid_;
 };
 
+/**
+* Allows KadId to be used with boost::hash and boost::unordered containers.
+*/
+size_t hash_value(const KadId &id);
+
 }  // namespace kad
 
 #endif  // MAIDSAFE_KADEMLIA_KADID_H_
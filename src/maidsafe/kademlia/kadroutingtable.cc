@@ -27,12 +27,46 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "maidsafe/kademlia/kadroutingtable.h"
 #include <boost/cstdint.hpp>
+#include <algorithm>
 #include "maidsafe/base/utils.h"
 #include "maidsafe/kademlia/contact.h"
 #include "maidsafe/kademlia/kbucket.h"
 
 namespace kad {
 
+namespace {
+
+// Heap order for k-buckets with the one nearest to key at the front.  K-buckets
+// cover disjoint ranges aligned to their size, so which can hold the closer id
+// is decided by the first bit at which their lowest ids differ.
+class BucketFurtherFromKey {
+ public:
+  BucketFurtherFromKey(const KadId &key,
+                       const std::vector< boost::shared_ptr<KBucket> > &kbs)
+      : key_(key), k_buckets_(kbs) {}
+  bool operator()(const boost::uint16_t &lhs,
+                  const boost::uint16_t &rhs) const {
+    return KadId::CloserToTarget(k_buckets_[rhs]->range_min(),
+                                 k_buckets_[lhs]->range_min(), key_);
+  }
+ private:
+  const KadId &key_;
+  const std::vector< boost::shared_ptr<KBucket> > &k_buckets_;
+};
+
+// Heap order for contacts with the one furthest from key at the front.
+class ContactCloserToKey {
+ public:
+  explicit ContactCloserToKey(const KadId &key) : key_(key) {}
+  bool operator()(const Contact *lhs, const Contact *rhs) const {
+    return KadId::CloserToTarget(lhs->node_id(), rhs->node_id(), key_);
+  }
+ private:
+  const KadId &key_;
+};
+
+}  // namespace
+
 RoutingTable::RoutingTable(const KadId &holder_id, const boost::uint16_t &rt_K)
     : k_buckets_(), bucket_upper_address_(), holder_id_(holder_id),
       bucket_of_holder_(0), brother_bucket_of_holder_(-1),
@@ -58,26 +92,6 @@ boost::int16_t RoutingTable::KBucketIndex(const KadId &key) {
   return (*lower_bound_iter).second;
 }
 
-std::vector<boost::uint16_t> RoutingTable::SortBucketsByDistance(
-    const KadId &key) {
-  std::map<KadId, boost::uint16_t> distance;
-  // For a given k-bucket, all contacts are either all closer to or all further
-  // from a given key than every other contact outwith that k-bucket.  Hence we
-  // iterate through each k-bucket's max id and insert xor distance to map.
-  std::map<KadId, boost::uint16_t>::iterator iter;
-  for (iter = bucket_upper_address_.begin();
-       iter != bucket_upper_address_.end(); ++iter) {
-    distance.insert(std::pair<KadId, boost::uint16_t>(((*iter).first ^ key),
-                                                       (*iter).second));
-  }
-  std::vector<boost::uint16_t> indices;
-  for (std::map<KadId, boost::uint16_t>::iterator dist_iter = distance.begin();
-       dist_iter != distance.end(); ++dist_iter) {
-    indices.push_back((*dist_iter).second);
-  }
-  return indices;
-}
-
 // TODO(Team): optimise method.  A map is not neaded, sort the vector using
 // std::sort
 int RoutingTable::SortContactsByDistance(const KadId &key,
@@ -191,29 +205,52 @@ int RoutingTable::AddContact(const Contact &new_contact) {
 void RoutingTable::FindCloseNodes(
     const KadId &key, int count, const std::vector<Contact> &exclude_contacts,
     std::vector<Contact> *close_nodes) {
-  int index = KBucketIndex(key);
-  if (index < 0)
-    return;
-  k_buckets_[index]->GetContacts(count, exclude_contacts, close_nodes);
-  bool full = (count == static_cast<int>(close_nodes->size()));
-  if (full)
+  if (count <= 0 || KBucketIndex(key) < 0)
     return;
-  std::vector<boost::uint16_t> indices = SortBucketsByDistance(key);
-  // Start for loop at 1, as we have already added contacts from closest bucket.
-  for (boost::uint32_t index_no = 1; index_no < indices.size(); ++index_no) {
-    std::vector<Contact> contacts;
-    k_buckets_[indices[index_no]]->GetContacts(K_, exclude_contacts, &contacts);
-    if (0 != SortContactsByDistance(key, &contacts))
-      continue;
-    boost::uint32_t iter(0);
-    while (!full && iter < contacts.size()) {
-      close_nodes->push_back(contacts[iter]);
-      ++iter;
-      full = (count == static_cast<int>(close_nodes->size()));
+  ExcludeSet exclude_ids;
+  for (size_t i = 0; i < exclude_contacts.size(); ++i)
+    exclude_ids.insert(exclude_contacts[i].node_id());
+  // K-buckets are taken from a heap, nearest to key first.  The closest
+  // contacts found so far are kept in a heap with the furthest at the front,
+  // and once there are count of them, the first k-bucket which cannot hold a
+  // closer one ends the search.
+  std::vector<boost::uint16_t> buckets(k_buckets_.size());
+  for (size_t i = 0; i < buckets.size(); ++i)
+    buckets[i] = static_cast<boost::uint16_t>(i);
+  BucketFurtherFromKey bucket_order(key, k_buckets_);
+  std::make_heap(buckets.begin(), buckets.end(), bucket_order);
+  ContactCloserToKey contact_order(key);
+  std::vector<const Contact*> closest;
+  closest.reserve(count);
+  while (!buckets.empty()) {
+    const KBucket &kbucket = *k_buckets_[buckets.front()];
+    std::pop_heap(buckets.begin(), buckets.end(), bucket_order);
+    buckets.pop_back();
+    // For an id outwith the k-bucket, the k-bucket's range holds a closer id
+    // exactly when its lowest id is closer.
+    if (closest.size() == static_cast<size_t>(count) &&
+        !KadId::CloserToTarget(kbucket.range_min(), closest.front()->node_id(),
+                               key))
+      break;
+    for (size_t i = 0; i < kbucket.Size(); ++i) {
+      const Contact &contact = kbucket.ContactAt(i);
+      if (!exclude_ids.empty() &&
+          exclude_ids.find(contact.node_id()) != exclude_ids.end())
+        continue;
+      if (closest.size() < static_cast<size_t>(count)) {
+        closest.push_back(&contact);
+        std::push_heap(closest.begin(), closest.end(), contact_order);
+      } else if (KadId::CloserToTarget(contact.node_id(),
+                                       closest.front()->node_id(), key)) {
+        std::pop_heap(closest.begin(), closest.end(), contact_order);
+        closest.back() = &contact;
+        std::push_heap(closest.begin(), closest.end(), contact_order);
+      }
     }
-    if (full)
-      return;
   }
+  std::sort_heap(closest.begin(), closest.end(), contact_order);
+  for (size_t i = 0; i < closest.size(); ++i)
+    close_nodes->push_back(*closest[i]);
 }
 
 void RoutingTable::GetRefreshList(const boost::uint16_t &start_kbucket,
@@ -400,8 +437,11 @@ void RoutingTable::GetFurthestContacts(
     return;
   }
 
+  ExcludeSet exclude_ids;
+  for (size_t i = 0; i < exclude_contacts.size(); ++i)
+    exclude_ids.insert(exclude_contacts[i].node_id());
   for (size_t n = 0; n < k_buckets_.size(); ++n) {
-    k_buckets_[n]->GetContacts(K_, exclude_contacts, close_nodes);
+    k_buckets_[n]->GetContacts(K_, exclude_ids, close_nodes);
   }
 
   int a = SortContactsByDistance(key, close_nodes);
@@ -58,8 +58,9 @@ class RoutingTable {
   // Update the "last accessed" timestamp of the k-bucket which covers
   // the range containing the specified key in the key/ID space
   void TouchKBucket(const KadId &node_id);
-  // Finds a number of known nodes closest to the node/value with the
-  // specified key.
+  // Finds the count known nodes closest to the node/value with the specified
+  // key, ordered from closest to furthest.  Only the k-buckets which could
+  // hold one of them are visited.
   void FindCloseNodes(const KadId &key, int count,
                       const std::vector<Contact> &exclude_contacts,
                       std::vector<Contact> *close_nodes);
@@ -87,8 +88,6 @@ class RoutingTable {
 // Calculate the index of the k-bucket which is responsible for the specified
 // key (or ID)
 //  int KBucketIndex(const std::string &key);
-  // Return vector of k-bucket indices sorted from closest to key to furthest
-  std::vector<boost::uint16_t> SortBucketsByDistance(const KadId &key);
   // Takes a vector of contacts arranged in arbitrary order and sorts them from
   // closest to key to furthest.  Returns 0 on success.
   int SortContactsByDistance(const KadId &key, std::vector<Contact> *contacts);
@@ -210,4 +210,39 @@ void KadRpcs::Update(const KadId &key, const SignedValue &new_value,
   service.Update(ctler, &args, resp, callback);
 }
 
+void KadRpcs::BatchStore(const std::vector<BatchStoreEntry> &entries,
+      const bool &publish, const bool &cache_copy, const std::string &ip,
+      const boost::uint16_t &port, const std::string &rendezvous_ip,
+      const boost::uint16_t &rendezvous_port, BatchStoreResponse *resp,
+      rpcprotocol::Controller *ctler, google::protobuf::Closure *callback) {
+  BatchStoreRequest args;
+  for (size_t i = 0; i < entries.size(); ++i)
+    *args.add_entries() = entries[i];
+  args.set_publish(publish);
+  if (cache_copy)
+    args.set_cache_copy(true);
+  ContactInfo *sender_info = args.mutable_sender_info();
+  *sender_info = info_;
+  rpcprotocol::Channel channel(pchannel_manager_, transport_handler_,
+      ctler->transport_id(), ip, port, "", 0, rendezvous_ip, rendezvous_port);
+  KademliaService::Stub service(&channel);
+  service.BatchStore(ctler, &args, resp, callback);
+}
+
+void KadRpcs::BatchFindValue(const std::vector<KadId> &keys,
+      const std::string &ip, const boost::uint16_t &port,
+      const std::string &rendezvous_ip, const boost::uint16_t &rendezvous_port,
+      BatchFindValueResponse *resp, rpcprotocol::Controller *ctler,
+      google::protobuf::Closure *callback) {
+  BatchFindValueRequest args;
+  for (size_t i = 0; i < keys.size(); ++i)
+    args.add_keys(keys[i].String());
+  ContactInfo *sender_info = args.mutable_sender_info();
+  *sender_info = info_;
+  rpcprotocol::Channel channel(pchannel_manager_, transport_handler_,
+      ctler->transport_id(), ip, port, "", 0, rendezvous_ip, rendezvous_port);
+  KademliaService::Stub service(&channel);
+  service.BatchFindValue(ctler, &args, resp, callback);
+}
+
 }  // namespace kad
@@ -98,6 +98,15 @@ class KadRpcs {
       const boost::uint16_t &port, const std::string &rendezvous_ip,
       const boost::uint16_t &rendezvous_port, UpdateResponse *resp,
       rpcprotocol::Controller *ctler, google::protobuf::Closure *callback);
+  void BatchStore(const std::vector<BatchStoreEntry> &entries,
+      const bool &publish, const bool &cache_copy, const std::string &ip,
+      const boost::uint16_t &port, const std::string &rendezvous_ip,
+      const boost::uint16_t &rendezvous_port, BatchStoreResponse *resp,
+      rpcprotocol::Controller *ctler, google::protobuf::Closure *callback);
+  void BatchFindValue(const std::vector<KadId> &keys, const std::string &ip,
+      const boost::uint16_t &port, const std::string &rendezvous_ip,
+      const boost::uint16_t &rendezvous_port, BatchFindValueResponse *resp,
+      rpcprotocol::Controller *ctler, google::protobuf::Closure *callback);
   void set_info(const ContactInfo &info);
  private:
   KadRpcs(const KadRpcs&);
@@ -26,6 +26,8 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <boost/compressed_pair.hpp>
+#include <algorithm>
+#include <set>
 #include <utility>
 #include "maidsafe/base/log.h"
 #include "maidsafe/kademlia/kadservice.h"
@@ -57,7 +59,8 @@ KadService::KadService(const NatRpcs &nat_rpcs,
       node_hasRSAkeys_(hasRSAkeys), node_info_(), alternative_store_(NULL),
       add_contact_(add_cts), get_random_contacts_(rand_cts),
       get_contact_(get_ctc), get_closestK_contacts_(get_kcts), ping_(ping),
-      remove_contact_(remove_contact), signature_validator_(NULL) {}
+      remove_contact_(remove_contact), signature_validator_(NULL),
+      store_mutex_(), crypto_executor_() {}
 
 void KadService::Bootstrap_NatDetectionRv(const NatDetectionResponse *response,
                                           struct NatDetectionData data) {
@@ -247,6 +250,7 @@ void KadService::FindValue(google::protobuf::RpcController *controller,
         for (unsigned int i = 0; i < values_str.size(); i++)
           response->add_values(values_str[i]);
       }
+      response->set_ttl(ValuesTtl(key, values_str));
       response->set_result(kRpcResultSuccess);
       rpcprotocol::Controller *ctrl = static_cast<rpcprotocol::Controller*>
         (controller);
@@ -269,6 +273,79 @@ void KadService::FindValue(google::protobuf::RpcController *controller,
 void KadService::Store(google::protobuf::RpcController *controller,
                        const StoreRequest *request, StoreResponse *response,
                        google::protobuf::Closure *done) {
+  Dispatch(&KadService::RunStore, controller, request, response, done);
+}
+
+void KadService::BatchStore(google::protobuf::RpcController *controller,
+                            const BatchStoreRequest *request,
+                            BatchStoreResponse *response,
+                            google::protobuf::Closure *done) {
+  Dispatch(&KadService::RunBatchStore, controller, request, response, done);
+}
+
+void KadService::Delete(google::protobuf::RpcController *controller,
+                        const DeleteRequest *request, DeleteResponse *response,
+                        google::protobuf::Closure *done) {
+  Dispatch(&KadService::RunDelete, controller, request, response, done);
+}
+
+void KadService::Update(google::protobuf::RpcController *controller,
+                        const UpdateRequest *request,
+                        UpdateResponse *response,
+                        google::protobuf::Closure *done) {
+  Dispatch(&KadService::RunUpdate, controller, request, response, done);
+}
+
+void KadService::StartCryptoWorkers(const boost::uint16_t &threads,
+                                    const size_t &max_queued) {
+  crypto_executor_.reset(new crypto::CryptoExecutor(threads, max_queued));
+}
+
+void KadService::StopCryptoWorkers() {
+  crypto_executor_.reset();
+}
+
+template <class Request, class Response>
+void KadService::Dispatch(void (KadService::*method)(
+                              google::protobuf::RpcController*,
+                              const Request*, Response*,
+                              google::protobuf::Closure*),
+                          google::protobuf::RpcController *controller,
+                          const Request *request, Response *response,
+                          google::protobuf::Closure *done) {
+  if (crypto_executor_.get() == NULL) {
+    (this->*method)(controller, request, response, done);
+    return;
+  }
+  // The channel deletes the request as soon as this returns.
+  boost::shared_ptr<Request> request_copy(new Request(*request));
+  if (!crypto_executor_->Submit(boost::bind(
+          &KadService::RunWithRequest<Request, Response>, this, method,
+          controller, request_copy, response, done))) {
+    DLOG(WARNING) << "KadService - crypto workers busy, dropping "
+                  << request->GetDescriptor()->name() << std::endl;
+    response->set_result(kRpcResultFailure);
+    response->set_node_id(node_info_.node_id());
+    done->Run();
+  }
+}
+
+template <class Request, class Response>
+void KadService::RunWithRequest(void (KadService::*method)(
+                                    google::protobuf::RpcController*,
+                                    const Request*, Response*,
+                                    google::protobuf::Closure*),
+                                google::protobuf::RpcController *controller,
+                                boost::shared_ptr<Request> request,
+                                Response *response,
+                                google::protobuf::Closure *done) {
+  (this->*method)(controller, request.get(), response, done);
+}
+
+void KadService::RunStore(google::protobuf::RpcController *controller,
+                          const StoreRequest *request,
+                          StoreResponse *response,
+                          google::protobuf::Closure *done) {
   if (!node_joined_) {
     response->set_result(kRpcResultFailure);
     done->Run();
@@ -276,39 +353,115 @@ void KadService::Store(google::protobuf::RpcController *controller,
     return;
   }
   Contact sender;
-  rpcprotocol::Controller *ctrl = static_cast<rpcprotocol::Controller*>
-                                  (controller);
+  bool stored(false);
   if (!CheckStoreRequest(request, &sender)) {
     response->set_result(kRpcResultFailure);
   } else if (node_hasRSAkeys_) {
-    if (signature_validator_ == NULL) {
-      DLOG(WARNING) << "Null validator" << std::endl;
-      response->set_result(kRpcResultFailure);
-    } else if (!signature_validator_->ValidateSignerId(
-            request->signed_request().signer_id(),
-            request->signed_request().public_key(),
-            request->signed_request().signed_public_key())) {
-      DLOG(WARNING) << "Failed to validate signer id" << std::endl;
-      response->set_result(kRpcResultFailure);
-    } else if (!signature_validator_->ValidateRequest(
-            request->signed_request().signed_request(),
-            request->signed_request().public_key(),
-            request->signed_request().signed_public_key(), request->key())) {
-      DLOG(WARNING) << "Failed to validate Store request for kad value"
-                    << std::endl;
+    if (!ValidateSignedRequest(request->signed_request(), request->key())) {
       response->set_result(kRpcResultFailure);
     } else {
-      StoreValueLocal(request->key(), request->sig_value(), sender,
-                      request->ttl(), request->publish(), response, ctrl);
+      boost::mutex::scoped_lock guard(store_mutex_);
+      stored = StoreValueLocal(request->key(), request->sig_value(),
+                               request->ttl(), request->publish(), response);
     }
   } else {
-    StoreValueLocal(request->key(), request->value(), sender, request->ttl(),
-                    request->publish(), response, ctrl);
+    boost::mutex::scoped_lock guard(store_mutex_);
+    stored = StoreValueLocal(request->key(), request->value(), request->ttl(),
+                             request->publish(), response);
   }
+  if (stored)
+    AddSender(sender, controller);
   response->set_node_id(node_info_.node_id());
   done->Run();
 }
 
+void KadService::RunBatchStore(google::protobuf::RpcController *controller,
+                               const BatchStoreRequest *request,
+                               BatchStoreResponse *response,
+                               google::protobuf::Closure *done) {
+  response->set_node_id(node_info_.node_id());
+  Contact sender;
+  if (!node_joined_ || !request->IsInitialized() ||
+      request->entries_size() > kMaxBatchSize ||
+      !GetSender(request->sender_info(), &sender)) {
+    response->set_result(kRpcResultFailure);
+    done->Run();
+    return;
+  }
+  bool stored(false);
+  if (request->cache_copy()) {
+    stored = StoreCacheCopies(*request, response);
+  } else {
+    for (int i = 0; i < request->entries_size(); ++i) {
+      const BatchStoreEntry &entry = request->entries(i);
+      StoreResponse *result = response->add_results();
+      if (!CheckStoreEntry(entry)) {
+        result->set_result(kRpcResultFailure);
+      } else if (node_hasRSAkeys_) {
+        if (!ValidateSignedRequest(entry.signed_request(), entry.key())) {
+          result->set_result(kRpcResultFailure);
+          continue;
+        }
+        boost::mutex::scoped_lock guard(store_mutex_);
+        if (StoreValueLocal(entry.key(), entry.sig_value(), entry.ttl(),
+                            request->publish(), result))
+          stored = true;
+        else
+          result->set_result(kRpcResultFailure);
+      } else {
+        boost::mutex::scoped_lock guard(store_mutex_);
+        if (StoreValueLocal(entry.key(), entry.value(), entry.ttl(),
+                            request->publish(), result))
+          stored = true;
+      }
+    }
+  }
+  if (stored)
+    AddSender(sender, controller);
+  response->set_result(kRpcResultSuccess);
+  done->Run();
+}
+
+void KadService::BatchFindValue(google::protobuf::RpcController *controller,
+                                const BatchFindValueRequest *request,
+                                BatchFindValueResponse *response,
+                                google::protobuf::Closure *done) {
+  response->set_node_id(node_info_.node_id());
+  Contact sender;
+  if (!node_joined_ || !request->IsInitialized() ||
+      request->keys_size() > kMaxBatchSize ||
+      !GetSender(request->sender_info(), &sender)) {
+    response->set_result(kRpcResultFailure);
+    done->Run();
+    return;
+  }
+  for (int i = 0; i < request->keys_size(); ++i) {
+    const std::string &key(request->keys(i));
+    FindResponse *result = response->add_results();
+    result->set_node_id(node_info_.node_id());
+    std::vector<std::string> values_str;
+    if (alternative_store_ != NULL && alternative_store_->Has(key)) {
+      *result->mutable_alternative_value_holder() = node_info_;
+      result->set_result(kRpcResultSuccess);
+    } else if (pdatastore_->LoadItem(key, &values_str)) {
+      if (node_hasRSAkeys_) {
+        for (size_t n = 0; n < values_str.size(); ++n)
+          result->add_signed_values()->ParseFromString(values_str[n]);
+      } else {
+        for (size_t n = 0; n < values_str.size(); ++n)
+          result->add_values(values_str[n]);
+      }
+      result->set_ttl(ValuesTtl(key, values_str));
+      result->set_result(kRpcResultSuccess);
+    } else {
+      result->set_result(kRpcResultFailure);
+    }
+  }
+  AddSender(sender, controller);
+  response->set_result(kRpcResultSuccess);
+  done->Run();
+}
+
 void KadService::Downlist(google::protobuf::RpcController *controller,
                           const DownlistRequest *request,
                           DownlistResponse *response,
@@ -548,11 +701,104 @@ bool KadService::CheckStoreRequest(const StoreRequest *request,
   return GetSender(request->sender_info(), sender);
 }
 
-void KadService::StoreValueLocal(const std::string &key,
-                                 const std::string &value, Contact sender,
+bool KadService::CheckStoreEntry(const BatchStoreEntry &entry) {
+  if (node_hasRSAkeys_)
+    return entry.has_signed_request() && entry.has_sig_value();
+  return entry.has_value();
+}
+
+bool KadService::ValidateSignedRequest(const SignedRequest &request,
+                                       const std::string &key) {
+  if (signature_validator_ == NULL) {
+    DLOG(WARNING) << "Null validator" << std::endl;
+    return false;
+  }
+  if (!signature_validator_->ValidateSignerId(request.signer_id(),
+          request.public_key(), request.signed_public_key())) {
+    DLOG(WARNING) << "Failed to validate signer id" << std::endl;
+    return false;
+  }
+  if (!signature_validator_->ValidateRequest(request.signed_request(),
+          request.public_key(), request.signed_public_key(), key)) {
+    DLOG(WARNING) << "Failed to validate Store request for kad value"
+                  << std::endl;
+    return false;
+  }
+  return true;
+}
+
+boost::int32_t KadService::ValuesTtl(const std::string &key,
+                                    const std::vector<std::string> &values) {
+  boost::int32_t ttl(-1);
+  boost::int32_t now(base::GetEpochTime());
+  for (size_t i = 0; i < values.size(); ++i) {
+    if (pdatastore_->TimeToLive(key, values[i]) < 0)
+      continue;
+    boost::int32_t remaining(pdatastore_->ExpireTime(key, values[i]) - now);
+    if (remaining < 0)
+      remaining = 0;
+    if (ttl < 0 || remaining < ttl)
+      ttl = remaining;
+  }
+  return ttl;
+}
+
+bool KadService::StoreCacheCopies(const BatchStoreRequest &request,
+                                  BatchStoreResponse *response) {
+  bool stored(false);
+  boost::mutex::scoped_lock guard(store_mutex_);
+  // Cache copies never add to, or replace, values already held for a key.
+  std::set<std::string> held_keys;
+  for (int i = 0; i < request.entries_size(); ++i) {
+    std::vector<std::string> values;
+    if (pdatastore_->LoadItem(request.entries(i).key(), &values))
+      held_keys.insert(request.entries(i).key());
+  }
+  for (int i = 0; i < request.entries_size(); ++i) {
+    const BatchStoreEntry &entry = request.entries(i);
+    StoreResponse *result = response->add_results();
+    if (held_keys.count(entry.key()) == 0 && StoreCacheCopy(entry, result))
+      stored = true;
+    else
+      result->set_result(kRpcResultFailure);
+  }
+  return stored;
+}
+
+bool KadService::StoreCacheCopy(const BatchStoreEntry &entry,
+                                StoreResponse *response) {
+  boost::int32_t ttl(entry.ttl());
+  if (ttl <= 0 || ttl > kCacheCopyTtl)
+    ttl = kCacheCopyTtl;
+  if (node_hasRSAkeys_) {
+    // A copy carries no signed request from the value's owner, so it can only
+    // be authenticated when the key is the hash of the signed value itself.
+    if (!entry.has_sig_value())
+      return false;
+    crypto::HashContext hash(crypto::SHA_512);
+    hash.Update(entry.sig_value().value());
+    hash.Update(entry.sig_value().value_signature());
+    return entry.key() == hash.Final(false) &&
+           StoreValueLocal(entry.key(), entry.sig_value(), ttl, true, response);
+  }
+  return entry.has_value() &&
+         StoreValueLocal(entry.key(), entry.value(), ttl, true, response);
+}
+
+void KadService::AddSender(const Contact &sender,
+                           google::protobuf::RpcController *controller) {
+  rpcprotocol::Controller *ctrl =
+      static_cast<rpcprotocol::Controller*>(controller);
+  if (ctrl != NULL)
+    add_contact_(sender, ctrl->rtt(), false);
+  else
+    add_contact_(sender, 0.0, false);
+}
+
+bool KadService::StoreValueLocal(const std::string &key,
+                                 const std::string &value,
                                  const boost::int32_t &ttl,
-                                 const bool &publish, StoreResponse *response,
-                                 rpcprotocol::Controller *ctrl) {
+                                 const bool &publish, StoreResponse *response) {
   bool result;
   if (publish) {
     result = pdatastore_->StoreItem(key, value, ttl, false);
@@ -566,27 +812,17 @@ void KadService::StoreValueLocal(const std::string &key,
       req->ParseFromString(ser_del_request);
     }
   }
-  if (result) {
-    response->set_result(kRpcResultSuccess);
-    if (ctrl != NULL) {
-      add_contact_(sender, ctrl->rtt(), false);
-    } else {
-      add_contact_(sender, 0.0, false);
-    }
-  } else {
-    response->set_result(kRpcResultFailure);
-  }
+  response->set_result(result ? kRpcResultSuccess : kRpcResultFailure);
+  return result;
 }
 
-void KadService::StoreValueLocal(const std::string &key,
-                                 const SignedValue &value, Contact sender,
+bool KadService::StoreValueLocal(const std::string &key,
+                                 const SignedValue &value,
                                  const boost::int32_t &ttl, const bool &publish,
-                                 StoreResponse *response,
-                                 rpcprotocol::Controller *ctrl) {
+                                 StoreResponse *response) {
   bool result, hashable;
-  std::string ser_value(value.value() + value.value_signature());
   if (publish) {
-    if (CanStoreSignedValueHashable(key, ser_value, &hashable)) {
+    if (CanStoreSignedValueHashable(key, value, &hashable)) {
       result = pdatastore_->StoreItem(key, value.SerializeAsString(), ttl,
                                       hashable);
       if (!result) {
@@ -601,7 +837,7 @@ void KadService::StoreValueLocal(const std::string &key,
     result = pdatastore_->RefreshItem(key, value.SerializeAsString(),
                                       &ser_del_request);
 
-    if (!result && CanStoreSignedValueHashable(key, ser_value, &hashable) &&
+    if (!result && CanStoreSignedValueHashable(key, value, &hashable) &&
         ser_del_request.empty()) {
       result = pdatastore_->StoreItem(key, value.SerializeAsString(), ttl,
                                       hashable);
@@ -615,41 +851,41 @@ void KadService::StoreValueLocal(const std::string &key,
         DLOG(WARNING) << "pdatastore_->RefreshItem Failed.";
     }
   }
-  if (result) {
-    response->set_result(kRpcResultSuccess);
-    if (ctrl != NULL) {
-      add_contact_(sender, ctrl->rtt(), false);
-    } else {
-      add_contact_(sender, 0.0, false);
-    }
-  } else {
-    response->set_result(kRpcResultFailure);
-  }
+  response->set_result(result ? kRpcResultSuccess : kRpcResultFailure);
+  return result;
 }
 
 bool KadService::CanStoreSignedValueHashable(const std::string &key,
-                                             const std::string &value,
+                                             const SignedValue &value,
                                              bool *hashable) {
   std::vector< std::pair<std::string, bool> > attr;
   attr = pdatastore_->LoadKeyAppendableAttr(key);
   *hashable = false;
+  // The value is compared and hashed as value() + value_signature(), without
+  // building that string.
+  const std::string &data(value.value()), &signature(value.value_signature());
   if (attr.empty()) {
-    crypto::Crypto cobj;
-    cobj.set_hash_algorithm(crypto::SHA_512);
-    if (key == cobj.Hash(value, "", crypto::STRING_STRING, false))
+    crypto::HashContext hash(crypto::SHA_512);
+    hash.Update(data);
+    hash.Update(signature);
+    if (key == hash.Final(false))
       *hashable = true;
   } else if (attr.size() == 1) {
     *hashable = attr[0].second;
-    if (*hashable && value != attr[0].first) {
+    const std::string &held(attr[0].first);
+    if (*hashable && (held.size() != data.size() + signature.size() ||
+        held.compare(0, data.size(), data) != 0 ||
+        held.compare(data.size(), signature.size(), signature) != 0)) {
       return false;
     }
   }
   return true;
 }
 
-void KadService::Delete(google::protobuf::RpcController *controller,
-                        const DeleteRequest *request, DeleteResponse *response,
-                        google::protobuf::Closure *done) {
+void KadService::RunDelete(google::protobuf::RpcController *controller,
+                           const DeleteRequest *request,
+                           DeleteResponse *response,
+                           google::protobuf::Closure *done) {
   // only node with RSAkeys can delete values
   if (!node_joined_ || !node_hasRSAkeys_ || signature_validator_ == NULL ||
       !request->IsInitialized()) {
@@ -675,21 +911,21 @@ void KadService::Delete(google::protobuf::RpcController *controller,
   }
 
   // only the signer of the value can delete it
-  std::vector<std::string> values_str;
-  if (!pdatastore_->LoadItem(request->key(), &values_str)) {
-    response->set_result(kRpcResultFailure);
-    done->Run();
-    return;
-  }
   crypto::Crypto cobj;
   if (cobj.AsymCheckSig(request->value().value(),
       request->value().value_signature(),
       request->signed_request().public_key(), crypto::STRING_STRING)) {
+    bool marked(false);
+    {
+      boost::mutex::scoped_lock guard(store_mutex_);
+      std::vector<std::string> values_str;
+      marked = pdatastore_->LoadItem(request->key(), &values_str) &&
+               pdatastore_->MarkForDeletion(request->key(),
+                   request->value().SerializeAsString(),
+                   request->signed_request().SerializeAsString());
+    }
     Contact sender;
-    if (pdatastore_->MarkForDeletion(request->key(),
-        request->value().SerializeAsString(),
-        request->signed_request().SerializeAsString()) &&
-        GetSender(request->sender_info(), &sender)) {
+    if (marked && GetSender(request->sender_info(), &sender)) {
       rpcprotocol::Controller *ctrl = static_cast<rpcprotocol::Controller*>
         (controller);
       if (ctrl != NULL)
@@ -705,10 +941,10 @@ void KadService::Delete(google::protobuf::RpcController *controller,
   done->Run();
 }
 
-void KadService::Update(google::protobuf::RpcController *controller,
-                        const UpdateRequest *request,
-                        UpdateResponse *response,
-                        google::protobuf::Closure *done) {
+void KadService::RunUpdate(google::protobuf::RpcController *controller,
+                           const UpdateRequest *request,
+                           UpdateResponse *response,
+                           google::protobuf::Closure *done) {
   // only node with RSAkeys can update values
   response->set_node_id(node_info_.node_id());
   response->set_result(kRpcResultFailure);
@@ -758,29 +994,7 @@ void KadService::Update(google::protobuf::RpcController *controller,
     return;
   }
 
-  // Check the key exists
-  std::vector<std::string> values_str;
-  if (!pdatastore_->LoadItem(request->key(), &values_str)) {
-    done->Run();
-    DLOG(WARNING) << "KadService::Update - Didn't find key" << std::endl;
-    return;
-  }
-
-  // Check the value to be updated exists
-  bool found(false);
   std::string ser_sv(request->old_value().SerializeAsString());
-  for (size_t n = 0; n < values_str.size() && !found; ++n) {
-    if (ser_sv == values_str[n]) {
-      found = true;
-    }
-  }
-
-  if (!found) {
-    done->Run();
-    DLOG(WARNING) << "KadService::Update - Didn't find value" << std::endl;
-    return;
-  }
-
   crypto::Crypto cobj;
   if (!cobj.AsymCheckSig(request->new_value().value(),
                          request->new_value().value_signature(),
@@ -823,20 +1037,36 @@ hashable replacement values.
 //  }
 *******************************************************************************/
 
-  bool new_hashable(request->key() ==
-                    cobj.Hash(request->new_value().value() +
-                                  request->new_value().value_signature(),
-                              "", crypto::STRING_STRING, false));
-  Contact sender;
-  if (!pdatastore_->UpdateItem(request->key(),
-                               request->old_value().SerializeAsString(),
-                               request->new_value().SerializeAsString(),
-                               request->ttl(), new_hashable)) {
+  crypto::HashContext new_hash(crypto::SHA_512);
+  new_hash.Update(request->new_value().value());
+  new_hash.Update(request->new_value().value_signature());
+  bool new_hashable(request->key() == new_hash.Final(false));
+
+  // The signatures are checked above, outside store_mutex_; the lookup of the
+  // old value and its replacement must not interleave with another request.
+  bool updated(false);
+  {
+    boost::mutex::scoped_lock guard(store_mutex_);
+    std::vector<std::string> values_str;
+    if (!pdatastore_->LoadItem(request->key(), &values_str)) {
+      DLOG(WARNING) << "KadService::Update - Didn't find key" << std::endl;
+    } else if (std::find(values_str.begin(), values_str.end(), ser_sv) ==
+               values_str.end()) {
+      DLOG(WARNING) << "KadService::Update - Didn't find value" << std::endl;
+    } else if (!pdatastore_->UpdateItem(request->key(), ser_sv,
+                   request->new_value().SerializeAsString(), request->ttl(),
+                   new_hashable)) {
+      DLOG(WARNING) << "KadService::Update - Failed UpdateItem" << std::endl;
+    } else {
+      updated = true;
+    }
+  }
+  if (!updated) {
     done->Run();
-    DLOG(WARNING) << "KadService::Update - Failed UpdateItem" << std::endl;
     return;
   }
 
+  Contact sender;
   if (GetSender(request->sender_info(), &sender)) {
     rpcprotocol::Controller *ctrl = static_cast<rpcprotocol::Controller*>
                                     (controller);
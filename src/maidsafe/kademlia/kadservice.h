@@ -27,11 +27,15 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #ifndef MAIDSAFE_KADEMLIA_KADSERVICE_H_
 #define MAIDSAFE_KADEMLIA_KADSERVICE_H_
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 #include <memory>
 #include <string>
 #include <vector>
 #include "gtest/gtest_prod.h"
 #include "maidsafe/maidsafe-dht_config.h"
+#include "maidsafe/base/crypto.h"
 #include "maidsafe/protobuf/kademlia_service.pb.h"
 #include "maidsafe/kademlia/contact.h"
 #include "maidsafe/kademlia/natrpc.h"
@@ -131,6 +135,19 @@ class KadService : public KademliaService {
               const UpdateRequest *request,
               UpdateResponse *response,
               google::protobuf::Closure *done);
+  // Stores each entry of the request as Store would, and sets one result per
+  // entry.  The whole batch fails if it holds more than kMaxBatchSize entries.
+  void BatchStore(google::protobuf::RpcController *controller,
+                  const BatchStoreRequest *request,
+                  BatchStoreResponse *response,
+                  google::protobuf::Closure *done);
+  // Sets one result per key, holding the key's values or the details of this
+  // node if it holds the key in its AlternativeStore.  Unlike FindValue, no
+  // closest nodes are returned for keys this node doesn't hold.
+  void BatchFindValue(google::protobuf::RpcController *controller,
+                      const BatchFindValueRequest *request,
+                      BatchFindValueResponse *response,
+                      google::protobuf::Closure *done);
   inline void set_node_joined(const bool &joined) {
     node_joined_ = joined;
   }
@@ -143,6 +160,16 @@ class KadService : public KademliaService {
   inline void set_signature_validator(base::SignatureValidator *sig_validator) {
     signature_validator_ = sig_validator;
   }
+  // From now on, runs Store, BatchStore, Delete and Update, which verify
+  // signatures, on threads of their own rather than the caller's, refusing
+  // requests while max_queued are already waiting.  The signature validator
+  // may then be called from several threads at once; changes to the datastore
+  // are still made one request at a time.
+  void StartCryptoWorkers(const boost::uint16_t &threads,
+                          const size_t &max_queued);
+  // Waits for requests already queued to be handled, then goes back to
+  // handling them on the caller's thread.
+  void StopCryptoWorkers();
  private:
   FRIEND_TEST(NatDetectionTest, BEH_KAD_SendNatDet);
   FRIEND_TEST(NatDetectionTest, BEH_KAD_BootstrapNatDetRv);
@@ -157,6 +184,35 @@ class KadService : public KademliaService {
           NatDetectionTestDb_FUNC_KAD_CompleteBootstrapNatDet_Test;
   friend class test_kadservice_db::KadServicesTestDb_BEH_KAD_UpdateValue_Test;
 
+  // Runs method on the crypto workers if they are started, or else directly.
+  template <class Request, class Response>
+  void Dispatch(void (KadService::*method)(google::protobuf::RpcController*,
+                                           const Request*, Response*,
+                                           google::protobuf::Closure*),
+                google::protobuf::RpcController *controller,
+                const Request *request, Response *response,
+                google::protobuf::Closure *done);
+  template <class Request, class Response>
+  void RunWithRequest(void (KadService::*method)(
+                          google::protobuf::RpcController*,
+                          const Request*, Response*,
+                          google::protobuf::Closure*),
+                      google::protobuf::RpcController *controller,
+                      boost::shared_ptr<Request> request, Response *response,
+                      google::protobuf::Closure *done);
+  void RunStore(google::protobuf::RpcController *controller,
+                const StoreRequest *request, StoreResponse *response,
+                google::protobuf::Closure *done);
+  void RunBatchStore(google::protobuf::RpcController *controller,
+                     const BatchStoreRequest *request,
+                     BatchStoreResponse *response,
+                     google::protobuf::Closure *done);
+  void RunDelete(google::protobuf::RpcController *controller,
+                 const DeleteRequest *request, DeleteResponse *response,
+                 google::protobuf::Closure *done);
+  void RunUpdate(google::protobuf::RpcController *controller,
+                 const UpdateRequest *request, UpdateResponse *response,
+                 google::protobuf::Closure *done);
   bool GetSender(const ContactInfo &sender_info, Contact *sender);
   void Bootstrap_NatDetectionRv(const NatDetectionResponse *response,
                                 struct NatDetectionData data);
@@ -169,16 +225,30 @@ class KadService : public KademliaService {
       struct NatDetectionPingData data);
   void SendNatDetection(struct NatDetectionData data);
   bool CheckStoreRequest(const StoreRequest *request, Contact *sender);
-  void StoreValueLocal(const std::string &key, const std::string &value,
-                       Contact sender, const boost::int32_t &ttl,
-                       const bool &publish, StoreResponse *response,
-                       rpcprotocol::Controller *ctrl);
-  void StoreValueLocal(const std::string &key, const SignedValue &value,
-                       Contact sender, const boost::int32_t &ttl,
-                       const bool &publish, StoreResponse *response,
-                       rpcprotocol::Controller *ctrl);
+  bool CheckStoreEntry(const BatchStoreEntry &entry);
+  bool ValidateSignedRequest(const SignedRequest &request,
+                             const std::string &key);
+  // Sets the result of response and returns true if the value was stored.
+  bool StoreValueLocal(const std::string &key, const std::string &value,
+                       const boost::int32_t &ttl, const bool &publish,
+                       StoreResponse *response);
+  bool StoreValueLocal(const std::string &key, const SignedValue &value,
+                       const boost::int32_t &ttl, const bool &publish,
+                       StoreResponse *response);
+  // Seconds until the first of the values held under key expires, -1 if none
+  // of them expire.
+  boost::int32_t ValuesTtl(const std::string &key,
+                           const std::vector<std::string> &values);
+  // Stores the entries of a cache_copy BatchStore under keys not already held.
+  bool StoreCacheCopies(const BatchStoreRequest &request,
+                        BatchStoreResponse *response);
+  // Stores a path-cached copy of a value, with its TTL capped at kCacheCopyTtl.
+  // store_mutex_ must be held.
+  bool StoreCacheCopy(const BatchStoreEntry &entry, StoreResponse *response);
+  void AddSender(const Contact &sender,
+                 google::protobuf::RpcController *controller);
   bool CanStoreSignedValueHashable(const std::string &key,
-                                   const std::string &value, bool *hashable);
+                                   const SignedValue &value, bool *hashable);
   NatRpcs nat_rpcs_;
   boost::shared_ptr<DataStore> pdatastore_;
   bool node_joined_, node_hasRSAkeys_;
@@ -191,6 +261,11 @@ class KadService : public KademliaService {
   PingFunctor ping_;
   RemoveContactFunctor remove_contact_;
   base::SignatureValidator *signature_validator_;
+  // Serialises the datastore check-and-write steps of requests handled on
+  // crypto workers.
+  boost::mutex store_mutex_;
+  // Last, so that queued requests are handled before the rest is destroyed.
+  boost::scoped_ptr<crypto::CryptoExecutor> crypto_executor_;
   KadService(const KadService&);
   KadService& operator=(const KadService&);
 };
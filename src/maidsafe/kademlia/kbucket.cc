@@ -26,24 +26,43 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "maidsafe/kademlia/kbucket.h"
-#include "maidsafe/kademlia/contact.h"
+#include <algorithm>
 
 namespace kad {
 
+namespace {
+
+// Marks an empty entry of KBucket::index_.
+const boost::uint16_t kNoSlot = 0xffff;
+
+}  // namespace
+
 KBucket::KBucket(const KadId &min, const KadId &max,
                  const boost::uint16_t &kb_K)
-    : last_accessed_(0), contacts_(), range_min_(min), range_max_(max),
-      K_(kb_K) {}
-
-KBucket::~KBucket() {
-  contacts_.clear();
+    : last_accessed_(0), slots_(kb_K), order_(), free_slots_(), index_(),
+      range_min_(min), range_max_(max), K_(kb_K) {
+  order_.reserve(K_);
+  free_slots_.reserve(K_);
+  for (boost::uint16_t i = K_; i > 0; --i)
+    free_slots_.push_back(i - 1);
+  // Keep the table at most half full, so probe sequences stay short.
+  size_t index_size(2);
+  while (index_size < 2 * static_cast<size_t>(K_))
+    index_size *= 2;
+  index_.assign(index_size, kNoSlot);
 }
 
+KBucket::~KBucket() {}
+
 bool KBucket::KeyInRange(const KadId &key) {
   return static_cast<bool>((range_min_ <= key) && (key <= range_max_));
 }
 
-size_t KBucket::Size() const { return contacts_.size(); }
+size_t KBucket::Size() const { return order_.size(); }
+
+const Contact& KBucket::ContactAt(const size_t &position) const {
+  return slots_[order_[position]];
+}
 
 boost::uint32_t KBucket::last_accessed() const { return last_accessed_; }
 
@@ -51,97 +70,115 @@ void KBucket::set_last_accessed(const boost::uint32_t &time_accessed) {
   last_accessed_  = time_accessed;
 }
 
-KBucketExitCode KBucket::AddContact(const Contact &new_contact) {
-  Contact new_contact_local(new_contact);
-  int position(-1), i(0);
-  // Check if the contact is already in the kbucket to remove it from
-  // it and adding it at the top of it
-  for (std::list<Contact>::const_iterator it = contacts_.begin();
-       it != contacts_.end() && position == -1; ++it) {
-    Contact current_element = *it;
-    if (new_contact_local.Equals(current_element))
-      position = i;
-    ++i;
+size_t KBucket::Find(const KadId &node_id, const Contact *contact) const {
+  size_t mask(index_.size() - 1);
+  for (size_t i = node_id.Hash() & mask; index_[i] != kNoSlot;
+       i = (i + 1) & mask) {
+    const Contact &current = slots_[index_[i]];
+    if (contact == NULL ? current.node_id() == node_id
+                        : contact->Equals(current))
+      return i;
   }
-  if (position != -1) {
-    std::list<Contact>::iterator it = contacts_.begin();
-    std::advance(it, position);
-    contacts_.erase(it);
-  }
-
-  if (contacts_.size() == K_)
-    return FULL;
+  return index_.size();
+}
 
-  contacts_.push_front(new_contact_local);
-  return SUCCEED;
+void KBucket::Index(const boost::uint16_t &slot) {
+  size_t mask(index_.size() - 1);
+  size_t i(slots_[slot].node_id().Hash() & mask);
+  while (index_[i] != kNoSlot)
+    i = (i + 1) & mask;
+  index_[i] = slot;
 }
 
-void KBucket::RemoveContact(const KadId &node_id, const bool &force) {
-  int position(-1), i(0);
-  for (std::list<Contact>::const_iterator it = contacts_.begin();
-       it != contacts_.end(); ++it) {
-    if (it->node_id() == node_id) {
+void KBucket::Unindex(size_t position) {
+  // Close the gap by moving back any later entry of the probe sequence which
+  // would otherwise no longer be reachable from its home position.
+  size_t mask(index_.size() - 1);
+  for (size_t i = (position + 1) & mask; index_[i] != kNoSlot;
+       i = (i + 1) & mask) {
+    size_t home(slots_[index_[i]].node_id().Hash() & mask);
+    if (((i - home) & mask) >= ((i - position) & mask)) {
+      index_[position] = index_[i];
       position = i;
     }
-    ++i;
   }
+  index_[position] = kNoSlot;
+}
 
-  if (position != -1) {
-    std::list<Contact>::iterator it = contacts_.begin();
-    std::advance(it, position);
-    Contact current_element = *it;
-    current_element.IncreaseFailed_RPC();
-    contacts_.erase(it);
-    if (current_element.failed_rpc() <= kFailedRpc && !force) {
-      std::list<Contact>::iterator new_it = contacts_.begin();
-      std::advance(new_it, position);
-      contacts_.insert(new_it, current_element);
-    }
+KBucketExitCode KBucket::AddContact(const Contact &new_contact) {
+  // If the contact is already in the kbucket, it is moved to the top of it
+  size_t position = Find(new_contact.node_id(), &new_contact);
+  boost::uint16_t slot;
+  if (position != index_.size()) {
+    slot = index_[position];
+    order_.erase(std::find(order_.begin(), order_.end(), slot));
+    slots_[slot] = new_contact;
+  } else {
+    if (order_.size() == K_)
+      return FULL;
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+    slots_[slot] = new_contact;
+    Index(slot);
   }
+  order_.insert(order_.begin(), slot);
+  return SUCCEED;
+}
+
+void KBucket::RemoveContact(const KadId &node_id, const bool &force) {
+  size_t position = Find(node_id, NULL);
+  if (position == index_.size())
+    return;
+  boost::uint16_t slot = index_[position];
+  slots_[slot].IncreaseFailed_RPC();
+  if (slots_[slot].failed_rpc() <= kFailedRpc && !force)
+    return;
+  Unindex(position);
+  order_.erase(std::find(order_.begin(), order_.end(), slot));
+  free_slots_.push_back(slot);
 }
 
 bool KBucket::GetContact(const KadId &node_id, Contact *contact) {
-  bool result = false;
-  for (std::list<Contact>::const_iterator it = contacts_.begin();
-       it != contacts_.end() && !result; ++it) {
-    if (it->node_id() == node_id) {
-      *contact = (*it);
-      result = true;
-    }
-  }
-  return result;
+  size_t position = Find(node_id, NULL);
+  if (position == index_.size())
+    return false;
+  *contact = slots_[index_[position]];
+  return true;
 }
 
 void KBucket::GetContacts(const boost::uint16_t &count,
                           const std::vector<Contact> &exclude_contacts,
                           std::vector<Contact> *contacts) {
-  bool insert;
-  boost::uint16_t i(0);
-  for (std::list<Contact>::iterator it = contacts_.begin();
-       it != contacts_.end() && i < count; ++it) {
-    insert = true;
-    for (std::vector<Contact>::const_iterator it1 = exclude_contacts.begin();
-         it1 != exclude_contacts.end() && insert; ++it1) {
-      if (it->node_id() == it1->node_id())
-        insert = false;
-    }
-    if (insert) {
-      contacts->push_back(*it);
-      ++i;
+  ExcludeSet exclude_ids;
+  for (size_t i = 0; i < exclude_contacts.size(); ++i)
+    exclude_ids.insert(exclude_contacts[i].node_id());
+  GetContacts(count, exclude_ids, contacts);
+}
+
+void KBucket::GetContacts(const boost::uint16_t &count,
+                          const ExcludeSet &exclude_ids,
+                          std::vector<Contact> *contacts) {
+  boost::uint16_t added(0);
+  for (size_t i = 0; i < order_.size() && added < count; ++i) {
+    const Contact &contact = slots_[order_[i]];
+    if (exclude_ids.empty() ||
+        exclude_ids.find(contact.node_id()) == exclude_ids.end()) {
+      contacts->push_back(contact);
+      ++added;
     }
   }
 }
 
-KadId KBucket::range_min() const { return range_min_; }
+const KadId& KBucket::range_min() const { return range_min_; }
 
-KadId KBucket::range_max() const { return range_max_; }
+const KadId& KBucket::range_max() const { return range_max_; }
 
 Contact KBucket::LastSeenContact() {
-  if (contacts_.empty()) {
+  if (order_.empty()) {
     Contact empty;
     return empty;
   }
-  return contacts_.back();
+  return slots_[order_.back()];
 }
 
 }  // namespace kad
@@ -28,16 +28,22 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef MAIDSAFE_KADEMLIA_KBUCKET_H_
 #define MAIDSAFE_KADEMLIA_KBUCKET_H_
 
-#include <list>
+#include <boost/unordered_set.hpp>
 #include <vector>
 #include <string>
+#include "maidsafe/kademlia/contact.h"
 #include "maidsafe/kademlia/kadid.h"
 #include "maidsafe/maidsafe-dht_config.h"
 
 namespace kad {
 
-class Contact;
+// Node IDs of contacts to be left out of a set of results.
+typedef boost::unordered_set<KadId> ExcludeSet;
 
+// Contacts are held in K fixed slots allocated when the k-bucket is created.
+// order_ lists the occupied slots from most to least recently seen, and index_
+// is an open-addressed hash table from node ID to slot, so adding, finding and
+// removing a contact never scans the bucket or allocates.
 class KBucket {
  public:
   // The lower and upper boundary for the range in the 512-bit ID
@@ -54,6 +60,9 @@ class KBucket {
   void GetContacts(const boost::uint16_t &count,
                    const std::vector<Contact> &exclude_contacts,
                    std::vector<Contact> *contacts);
+  // As above, excluding contacts whose node IDs are in exclude_ids.
+  void GetContacts(const boost::uint16_t &count, const ExcludeSet &exclude_ids,
+                   std::vector<Contact> *contacts);
   // remove the existing contact with the specified node_id
   void RemoveContact(const KadId &node_id, const bool &force);
   // Tests whether the specified key (i.e. node ID) is in the range
@@ -63,16 +72,25 @@ class KBucket {
   bool KeyInRange(const KadId &key);
   // return the number of contacts in this k-bucket
   size_t Size() const;
+  // Returns the contact at position, counted from the most recently seen, where
+  // position < Size().  The reference is valid until the k-bucket is changed.
+  const Contact& ContactAt(const size_t &position) const;
   // returns last seen contact of the kbucket (end of the list)
   Contact LastSeenContact();
   boost::uint32_t last_accessed() const;
   void set_last_accessed(const boost::uint32_t &time_accessed);
-  KadId range_min() const;
-  KadId range_max() const;
+  const KadId& range_min() const;
+  const KadId& range_max() const;
 
  private:
+  // Returns the position in index_ of the contact with node_id, which must
+  // also equal contact if that is given, or index_.size() if there is none.
+  size_t Find(const KadId &node_id, const Contact *contact) const;
+  void Index(const boost::uint16_t &slot);
+  void Unindex(size_t position);
   boost::uint32_t last_accessed_;
-  std::list<Contact> contacts_;
+  std::vector<Contact> slots_;
+  std::vector<boost::uint16_t> order_, free_slots_, index_;
   KadId range_min_, range_max_;
   boost::uint16_t K_;
 };
@@ -33,9 +33,13 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef MAIDSAFE_KADEMLIA_KNODE_API_H_
 #define MAIDSAFE_KADEMLIA_KNODE_API_H_
 
+#include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
 #include <maidsafe/maidsafe-dht_config.h>
+#include <maidsafe/kademlia/contact.h>
 #include <maidsafe/kademlia/kadid.h>
+#include <maidsafe/protobuf/contact_info.pb.h>
+#include <maidsafe/protobuf/signed_kadvalue.pb.h>
 
 #include <string>
 #include <vector>
@@ -64,12 +68,76 @@ class TransportHandler;
 
 namespace kad {
 
-class Contact;
-class ContactInfo;
 class KadRpcs;
 class KNodeImpl;
-class SignedValue;
-class SignedRequest;
+
+// Result of FindNodes.
+struct FindNodesResult {
+  FindNodesResult() : succeeded(false), closest_nodes() {}
+  bool succeeded;
+  // The closest nodes found, ordered from closest to furthest from the key.
+  std::vector<Contact> closest_nodes;
+};
+
+// Result of Find.  If the value was found, values (or signed_values, in
+// networks whose nodes have RSA keys) holds it, or alternative_value_holder
+// holds the contact details of a node with the value in its AlternativeStore.
+// Otherwise closest_nodes holds the closest nodes found.
+struct FindValueResult {
+  FindValueResult()
+      : succeeded(false), values(), signed_values(),
+        alternative_value_holder(), closest_nodes(), needs_cache_copy(false),
+        cache_copy_holder() {}
+  bool succeeded;
+  std::vector<std::string> values;
+  std::vector<SignedValue> signed_values;
+  ContactInfo alternative_value_holder;
+  std::vector<Contact> closest_nodes;
+  // If needs_cache_copy is true, cache_copy_holder is the closest node asked
+  // for the value which didn't have it.  Find has already sent it a copy.
+  bool needs_cache_copy;
+  Contact cache_copy_holder;
+};
+
+// Counters for the path caching done by Find.  hits and misses count the
+// value lookups which did and didn't find a value, copies_sent the copies of
+// found values sent to the closest node which lacked them and copies_stored
+// those which that node accepted.
+struct PathCacheStats {
+  PathCacheStats() : hits(0), misses(0), copies_sent(0), copies_stored(0) {}
+  boost::uint64_t hits, misses, copies_sent, copies_stored;
+};
+
+// Result of Store.  If a refresh found that the value had been deleted,
+// signed_request holds the request it was deleted with.
+struct StoreValueResult {
+  StoreValueResult() : succeeded(false), signed_request() {}
+  bool succeeded;
+  SignedRequest signed_request;
+};
+
+// An entry of StoreBatch.  In networks whose nodes have RSA keys signed_value
+// and signed_request are stored, otherwise value is.
+struct StoreEntry {
+  StoreEntry() : key(), value(), signed_value(), signed_request(), ttl(0) {}
+  KadId key;
+  std::string value;
+  SignedValue signed_value;
+  SignedRequest signed_request;
+  boost::int32_t ttl;
+};
+
+typedef boost::function<void(const FindNodesResult&)> FindNodesFunctor;
+typedef boost::function<void(const FindValueResult&)> FindValueFunctor;
+typedef boost::function<void(const StoreValueResult&)> StoreValueFunctor;
+// Functor for Delete and Update, called with whether the operation succeeded.
+typedef boost::function<void(const bool&)> VoidFunctorOneBool;
+// Functors for StoreBatch and FindBatch, called with one result per entry or
+// key, in the order they were passed.
+typedef boost::function<void(const std::vector<StoreValueResult>&)>
+    StoreBatchFunctor;
+typedef boost::function<void(const std::vector<FindValueResult>&)>
+    FindBatchFunctor;
 
 /**
 * @class KNode
@@ -181,9 +249,9 @@ class KNode {
             const boost::uint16_t &external_port,
             VoidFunctorOneString callback);
   /**
-  * Leave the kademlia network.  All values stored in the node are erased and
-  * nodes from the routing table are saved as bootstrapping nodes in the
-  * config file
+  * Leave the kademlia network.  All values stored in the node are erased,
+  * unless SetDataStoreDirectory was used, and nodes from the routing table are
+  * saved as bootstrapping nodes in the config file
   */
   void Leave();
   /**
@@ -215,6 +283,10 @@ class KNode {
   * Delete a Value of the network, only in networks with nodes that have public
   * and private keys a value, that is of the form data; signed data, can be
   * deleted.  Only the one who signed the value can delete it.
+  * The value is deleted from the k closest nodes only.  If it is stored under
+  * the hash of the signed value, nodes holding a cached copy of it (see
+  * PathCacheStatistics) keep it and may still return it for up to
+  * kCacheCopyTtl seconds.
   * @param key kad::KadId object that is the key under which the value is stored
   * @param signed_value signed value to be deleted
   * @param signed_request request to delete the value, it is validated before the
@@ -271,6 +343,57 @@ class KNode {
   */
   void FindKClosestNodes(const KadId &node_id, VoidFunctorOneString callback);
   /**
+  * The functions below are equivalent to StoreValue, DeleteValue, UpdateValue,
+  * FindValue and FindKClosestNodes respectively, but deliver their result as a
+  * struct rather than as a serialised protocol buffer.
+  */
+  void Store(const KadId &key, const SignedValue &signed_value,
+             const SignedRequest &signed_request, const boost::int32_t &ttl,
+             StoreValueFunctor callback);
+  void Store(const KadId &key, const std::string &value,
+             const boost::int32_t &ttl, StoreValueFunctor callback);
+  void Delete(const KadId &key, const SignedValue &signed_value,
+              const SignedRequest &signed_request,
+              VoidFunctorOneBool callback);
+  void Update(const KadId &key, const SignedValue &old_value,
+              const SignedValue &new_value,
+              const SignedRequest &signed_request, boost::uint32_t ttl,
+              VoidFunctorOneBool callback);
+  void Find(const KadId &key, const bool &check_alternative_store,
+            FindValueFunctor callback);
+  void FindNodes(const KadId &key, FindNodesFunctor callback);
+  /**
+  * Store many values with as few RPCs as possible.  Each value is stored on
+  * the k closest nodes to its key, as with Store, but all values bound for the
+  * same node are sent in BatchStore RPCs of up to kMaxBatchSize entries.
+  * @param entries the values to be stored
+  * @param callback called with one result per entry once all are done
+  */
+  void StoreBatch(const std::vector<StoreEntry> &entries,
+                  StoreBatchFunctor callback);
+  /**
+  * Find the values of many keys.  Keys whose values aren't held locally are
+  * asked for in BatchFindValue RPCs, one per closest node found for the keys;
+  * any key not found that way is then looked up as with Find.
+  * @param keys the keys to find
+  * @param check_alternative_store true if the AlternativeStore should be
+  * checked for each key first
+  * @param callback called with one result per key once all are done
+  */
+  void FindBatch(const std::vector<KadId> &keys,
+                 const bool &check_alternative_store,
+                 FindBatchFunctor callback);
+  /**
+  * Counters for path caching.  Whenever a value lookup succeeds the values
+  * are copied to the closest node asked which didn't have them, with a TTL of
+  * at most kCacheCopyTtl, so lookups of popular keys are answered before
+  * reaching the k closest nodes.  Copies are kept until they expire, even if
+  * the value is deleted or updated in the meantime.
+  * @return the counters since the node was created or they were last reset
+  */
+  PathCacheStats PathCacheStatistics();
+  void ResetPathCacheStatistics();
+  /**
   * Find the k closest nodes to a key in the node's routing table.
   * @param key id to which the nodes closest to it are returned
   * @param exclude_contacts vector of nodes that must be excluded from the
@@ -432,6 +555,15 @@ class KNode {
   */
   boost::int32_t KeyValueTTL(const KadId &key, const std::string &value) const;
   /**
+  * Keep the values stored in the node in a log in directory, so they survive a
+  * restart of the node and are not erased by Leave.  Values already in the log
+  * are loaded.  Must be called before joining.
+  * @param directory directory holding the log, created if it does not exist
+  * @return True if the persistent store is used, false if the node is joined
+  * or the log could not be read, in which case the current store is kept
+  */
+  bool SetDataStoreDirectory(const std::string &directory);
+  /**
   * If this is set to a non-NULL value, then the AlternativeStore will be used
   * before Kad's native DataStore.
   * @param alternative_store reference to a base::AlternativeStore object
@@ -440,6 +572,15 @@ class KNode {
   base::AlternativeStore *alternative_store();
   void set_signature_validator(base::SignatureValidator *validator);
   /**
+  * Enables proximity-aware lookups.  Each search iteration still contacts the
+  * closest uncontacted node, but picks the rest of its alpha contacts among
+  * the kProximityCandidates * alpha closest by their measured round trip time
+  * rather than strictly by distance.  Lookups still end only once the k
+  * closest nodes found have all been asked.
+  * @param enabled true to enable, false for plain XOR ordering (the default)
+  */
+  void set_proximity_lookups(const bool &enabled);
+  /**
   * Returns the type of nat which the node is behind.  If used when the node
   * is not joined it will return NONE
   * @return type of nat
@@ -112,6 +112,58 @@ void KNode::FindKClosestNodes(const KadId &node_id,
   pimpl_->FindKClosestNodes(node_id, callback);
 }
 
+void KNode::Store(const KadId &key, const SignedValue &signed_value,
+                  const SignedRequest &signed_request,
+                  const boost::int32_t &ttl, StoreValueFunctor callback) {
+  pimpl_->Store(key, signed_value, signed_request, ttl, callback);
+}
+
+void KNode::Store(const KadId &key, const std::string &value,
+                  const boost::int32_t &ttl, StoreValueFunctor callback) {
+  pimpl_->Store(key, value, ttl, callback);
+}
+
+void KNode::Delete(const KadId &key, const SignedValue &signed_value,
+                   const SignedRequest &signed_request,
+                   VoidFunctorOneBool callback) {
+  pimpl_->Delete(key, signed_value, signed_request, callback);
+}
+
+void KNode::Update(const KadId &key, const SignedValue &old_value,
+                   const SignedValue &new_value,
+                   const SignedRequest &signed_request, boost::uint32_t ttl,
+                   VoidFunctorOneBool callback) {
+  pimpl_->Update(key, old_value, new_value, signed_request, ttl, callback);
+}
+
+void KNode::Find(const KadId &key, const bool &check_alternative_store,
+                 FindValueFunctor callback) {
+  pimpl_->Find(key, check_alternative_store, callback);
+}
+
+void KNode::StoreBatch(const std::vector<StoreEntry> &entries,
+                       StoreBatchFunctor callback) {
+  pimpl_->StoreBatch(entries, callback);
+}
+
+void KNode::FindBatch(const std::vector<KadId> &keys,
+                      const bool &check_alternative_store,
+                      FindBatchFunctor callback) {
+  pimpl_->FindBatch(keys, check_alternative_store, callback);
+}
+
+PathCacheStats KNode::PathCacheStatistics() {
+  return pimpl_->PathCacheStatistics();
+}
+
+void KNode::ResetPathCacheStatistics() {
+  pimpl_->ResetPathCacheStatistics();
+}
+
+void KNode::FindNodes(const KadId &key, FindNodesFunctor callback) {
+  pimpl_->FindNodes(key, callback);
+}
+
 void KNode::GetKNodesFromRoutingTable(
     const KadId &key,
     const std::vector<Contact> &exclude_contacts,
@@ -235,6 +287,10 @@ boost::int32_t KNode::KeyValueTTL(const KadId &key,
   return pimpl_->KeyValueTTL(key, value);
 }
 
+bool KNode::SetDataStoreDirectory(const std::string &directory) {
+  return pimpl_->SetDataStoreDirectory(directory);
+}
+
 void KNode::set_alternative_store(base::AlternativeStore* alternative_store) {
   pimpl_->set_alternative_store(alternative_store);
 }
@@ -247,6 +303,10 @@ void KNode::set_signature_validator(base::SignatureValidator *validator) {
   pimpl_->set_signature_validator(validator);
 }
 
+void KNode::set_proximity_lookups(const bool &enabled) {
+  pimpl_->set_proximity_lookups(enabled);
+}
+
 void KNode::UpdateValue(const KadId &key, const SignedValue &old_value,
                         const SignedValue &new_value,
                         const SignedRequest &signed_request,
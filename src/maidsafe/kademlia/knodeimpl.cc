@@ -35,6 +35,8 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <algorithm>
 #include <iostream>  // NOLINT Fraser - required for handling .kadconfig file
 #include <fstream>  // NOLINT
+#include <limits>
+#include <set>
 #include <vector>
 
 #include "maidsafe/base/alternativestore.h"
@@ -44,6 +46,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "maidsafe/base/routingtable.h"
 #include "maidsafe/base/utils.h"
 #include "maidsafe/base/validationinterface.h"
+#include "maidsafe/kademlia/datastorebackend.h"
 #include "maidsafe/kademlia/kadid.h"
 #include "maidsafe/kademlia/knodeimpl.h"
 #include "maidsafe/protobuf/contact_info.pb.h"
@@ -55,6 +58,79 @@ namespace fs = boost::filesystem;
 
 namespace kad {
 
+namespace {
+
+// The string based operations are the typed ones with their result serialised
+// by one of these.
+
+void SerialiseFindResult(const FindValueResult &result,
+                         VoidFunctorOneString callback) {
+  FindResponse response;
+  response.set_result(result.succeeded ? kRpcResultSuccess : kRpcResultFailure);
+  for (size_t i = 0; i < result.values.size(); ++i)
+    response.add_values(result.values[i]);
+  for (size_t i = 0; i < result.signed_values.size(); ++i)
+    *response.add_signed_values() = result.signed_values[i];
+  if (!result.alternative_value_holder.node_id().empty())
+    *response.mutable_alternative_value_holder() =
+        result.alternative_value_holder;
+  for (size_t i = 0; i < result.closest_nodes.size(); ++i) {
+    Contact contact(result.closest_nodes[i]);
+    std::string ser_contact;
+    if (contact.SerialiseToString(&ser_contact))
+      response.add_closest_nodes(ser_contact);
+  }
+  if (result.needs_cache_copy) {
+    Contact contact(result.cache_copy_holder);
+    std::string ser_contact;
+    if (contact.SerialiseToString(&ser_contact))
+      response.set_needs_cache_copy(ser_contact);
+  }
+  callback(response.SerializeAsString());
+}
+
+void SerialiseBootstrapResult(const FindValueResult &result,
+                              VoidFunctorOneString callback) {
+  base::GeneralResponse response;
+  response.set_result(result.succeeded ? kRpcResultSuccess : kRpcResultFailure);
+  callback(response.SerializeAsString());
+}
+
+void SerialiseStoreResult(const StoreValueResult &result,
+                          VoidFunctorOneString callback) {
+  StoreResponse response;
+  response.set_result(result.succeeded ? kRpcResultSuccess : kRpcResultFailure);
+  if (result.signed_request.IsInitialized())
+    *response.mutable_signed_request() = result.signed_request;
+  callback(response.SerializeAsString());
+}
+
+void SerialiseDeleteResult(const bool &succeeded,
+                           VoidFunctorOneString callback) {
+  DeleteResponse response;
+  response.set_result(succeeded ? kRpcResultSuccess : kRpcResultFailure);
+  callback(response.SerializeAsString());
+}
+
+void IgnoreDeleteResult(const bool&) {}
+
+void SerialiseUpdateResult(const bool &succeeded,
+                           VoidFunctorOneString callback) {
+  UpdateResponse response;
+  response.set_result(succeeded ? kRpcResultSuccess : kRpcResultFailure);
+  callback(response.SerializeAsString());
+}
+
+void ToFindNodesResult(const FindValueResult &result,
+                       FindNodesFunctor callback) {
+  FindNodesResult find_nodes_result;
+  find_nodes_result.succeeded = result.succeeded;
+  find_nodes_result.closest_nodes = result.closest_nodes;
+  callback(find_nodes_result);
+}
+
+}  // namespace
+
 // some tools which will be used in the implementation of KNode class
 
 bool CompareContact(const ContactAndTargetKey &first,
@@ -92,51 +168,30 @@ void SortContactList(const KadId &target_key,
   }
 }
 
-// sort the contact list according the distance to the target key
-void SortLookupContact(const KadId &target_key,
-                       std::list<LookupContact> *contact_list) {
-  if (contact_list->empty()) {
-    return;
-  }
-  std::list<ContactAndTargetKey> temp_list;
-  std::list<LookupContact>::iterator it;
-  // clone the contacts into a temporary list together with the target key
-  for (it = contact_list->begin(); it != contact_list->end(); ++it) {
-    ContactAndTargetKey new_ck;
-    new_ck.contact = it->kad_contact;
-    new_ck.target_key = target_key;
-    new_ck.contacted = it->contacted;
-    temp_list.push_back(new_ck);
-  }
-  temp_list.sort(CompareContact);
-  // restore the sorted contacts from the temporary list.
-  contact_list->clear();
-  std::list<ContactAndTargetKey>::iterator it1;
-  for (it1 = temp_list.begin(); it1 != temp_list.end(); ++it1) {
-    struct LookupContact ctc;
-    ctc.kad_contact = it1->contact;
-    ctc.contacted = it1->contacted;
-    contact_list->push_back(ctc);
-  }
-}
-
 KNodeImpl::KNodeImpl(rpcprotocol::ChannelManager *channel_manager,
                      transport::TransportHandler *transport_handler,
                      NodeType type, const std::string &private_key,
                      const std::string &public_key, const bool &port_forwarded,
                      const bool &use_upnp, const boost::uint16_t &k)
     : routingtable_mutex_(), kadconfig_mutex_(),
-      extendshortlist_mutex_(), joinbootstrapping_mutex_(), leave_mutex_(),
-      activeprobes_mutex_(), pendingcts_mutex_(),
+      joinbootstrapping_mutex_(), leave_mutex_(), pendingcts_mutex_(),
       ptimer_(new base::CallLaterTimer), pchannel_manager_(channel_manager),
       transport_handler_(transport_handler), transport_id_(0),
       pservice_channel_(), pdata_store_(new DataStore(kRefreshTime)),
       alternative_store_(NULL), premote_service_(), kadrpcs_(channel_manager,
       transport_handler), natrpcs_(channel_manager, transport_handler),
-      is_joined_(false), prouting_table_(), node_id_(), fake_kClientId_(),
-      host_ip_(), type_(type), host_port_(0), rv_ip_(),
-      rv_port_(0), bootstrapping_nodes_(), K_(k), alpha_(kAlpha), beta_(kBeta),
-      refresh_routine_started_(false), kad_config_path_(""), local_host_ip_(),
+      is_joined_(false), prouting_table_(),
+      lookup_cache_(kLookupCacheSize, kLookupCacheTtl), path_cache_mutex_(),
+      path_cache_stats_(), value_cache_(kValueCacheSize, kValueCacheTtl),
+      rtt_estimator_(kRttEstimatorSize, kMinRpcTimeout,
+                     rpcprotocol::kRpcTimeout, kMaxRpcBackoff,
+                     kRttSampleWindow),
+      proximity_lookups_(false), hedge_mutex_(), hedge_tokens_(0), node_id_(),
+      fake_kClientId_(), host_ip_(), type_(type), host_port_(0), rv_ip_(),
+      rv_port_(0), bootstrapping_nodes_(), K_(k), alpha_(kAlpha),
+      beta_(kBeta), refresh_time_(kRefreshTime),
+      refresh_routine_started_(false), kad_config_path_(""),
+      local_host_ip_(),
       local_host_port_(0), stopping_(false), port_forwarded_(port_forwarded),
       use_upnp_(use_upnp), contacts_to_add_(), addcontacts_routine_(),
       add_ctc_cond_(), private_key_(private_key), public_key_(public_key),
@@ -152,17 +207,24 @@ KNodeImpl::KNodeImpl(rpcprotocol::ChannelManager *channel_manager,
                      const std::string &private_key,
                      const std::string &public_key,
                      const bool &port_forwarded, const bool &use_upnp)
-    : routingtable_mutex_(), kadconfig_mutex_(), extendshortlist_mutex_(),
-      joinbootstrapping_mutex_(), leave_mutex_(), activeprobes_mutex_(),
+    : routingtable_mutex_(), kadconfig_mutex_(),
+      joinbootstrapping_mutex_(), leave_mutex_(),
       pendingcts_mutex_(), ptimer_(new base::CallLaterTimer),
       pchannel_manager_(channel_manager), transport_handler_(transport_handler),
       transport_id_(0), pservice_channel_(),
       pdata_store_(new DataStore(refresh_time)), alternative_store_(NULL),
       premote_service_(), kadrpcs_(channel_manager, transport_handler),
       natrpcs_(channel_manager, transport_handler), is_joined_(false),
-      prouting_table_(), node_id_(), fake_kClientId_(), host_ip_(), type_(type),
-      host_port_(0), rv_ip_(), rv_port_(0), bootstrapping_nodes_(), K_(k),
-      alpha_(alpha), beta_(beta), refresh_routine_started_(false),
+      prouting_table_(), lookup_cache_(kLookupCacheSize, kLookupCacheTtl),
+      path_cache_mutex_(), path_cache_stats_(),
+      value_cache_(kValueCacheSize, kValueCacheTtl),
+      rtt_estimator_(kRttEstimatorSize, kMinRpcTimeout,
+                     rpcprotocol::kRpcTimeout, kMaxRpcBackoff,
+                     kRttSampleWindow),
+      proximity_lookups_(false), hedge_mutex_(), hedge_tokens_(0), node_id_(),
+      fake_kClientId_(), host_ip_(), type_(type), host_port_(0), rv_ip_(),
+      rv_port_(0), bootstrapping_nodes_(), K_(k), alpha_(alpha), beta_(beta),
+      refresh_time_(refresh_time), refresh_routine_started_(false),
       kad_config_path_(), local_host_ip_(), local_host_port_(0),
       stopping_(false), port_forwarded_(port_forwarded), use_upnp_(use_upnp),
       contacts_to_add_(), addcontacts_routine_(), add_ctc_cond_(),
@@ -175,13 +237,6 @@ KNodeImpl::~KNodeImpl() {
     Leave();
 }
 
-inline void KNodeImpl::CallbackWithFailure(VoidFunctorOneString callback) {
-  base::GeneralResponse result_msg;
-  result_msg.set_result(kRpcResultFailure);
-  std::string result(result_msg.SerializeAsString());
-  callback(result);
-}
-
 void KNodeImpl::Bootstrap_Callback(const BootstrapResponse *response,
                                    BootstrapData data) {
   BootstrapResponse result_msg;
@@ -239,7 +294,8 @@ void KNodeImpl::Join_Bootstrapping_Iteration_Client(
     args->is_callbacked = true;
     if (type_ != CLIENT)
       host_nat_type_ = DIRECT_CONNECTED;
-    StartSearchIteration(node_id_, BOOTSTRAP, args->callback);
+    StartSearchIteration(node_id_, BOOTSTRAP,
+        boost::bind(&SerialiseBootstrapResult, _1, args->callback));
     // start a schedule to delete expired key/value pairs only once
     if (!refresh_routine_started_) {
       ptimer_->AddCallLater(kRefreshTime*1000,
@@ -333,7 +389,8 @@ void KNodeImpl::Join_Bootstrapping_Iteration(
                                             transport_id_);
     kadrpcs_.set_info(contact_info());
     args->is_callbacked = true;
-    StartSearchIteration(node_id_, BOOTSTRAP, args->callback);
+    StartSearchIteration(node_id_, BOOTSTRAP,
+        boost::bind(&SerialiseBootstrapResult, _1, args->callback));
     recheck_nat_type_ = false;
   } else if (result_msg.result() == kRpcResultFailure &&
              !result_msg.has_nat_type()) {
@@ -352,7 +409,8 @@ void KNodeImpl::Join_Bootstrapping_Iteration(
                                             transport_id_);
     kadrpcs_.set_info(contact_info());
     args->is_callbacked = true;
-    StartSearchIteration(node_id_, BOOTSTRAP, args->callback);
+    StartSearchIteration(node_id_, BOOTSTRAP,
+        boost::bind(&SerialiseBootstrapResult, _1, args->callback));
   } else if (!args->cached_nodes.empty()) {
     Contact bootstrap_candidate = args->cached_nodes.back();
     args->cached_nodes.pop_back();  // inefficient!!!!
@@ -532,7 +590,7 @@ void KNodeImpl::Join(const KadId &node_id, const std::string &kad_config_file,
   }
 
   // Set kad_config_path_
-  kad_config_path_ = fs::path(kad_config_file, fs::native);
+  kad_config_path_ = fs::path(kad_config_file);
   prouting_table_.reset(new RoutingTable(node_id_, K_));
   Join_RefreshNode(callback, got_external_address);
 }
@@ -601,7 +659,7 @@ void KNodeImpl::Join(const KadId &node_id, const std::string &kad_config_file,
   rv_ip_ = "";
   rv_port_ = 0;
   // Set kad_config_path_
-  kad_config_path_ = fs::path(kad_config_file, fs::native);
+  kad_config_path_ = fs::path(kad_config_file);
   prouting_table_.reset(new RoutingTable(node_id_, K_));
 
   is_joined_ = true;
@@ -648,12 +706,16 @@ void KNodeImpl::Leave() {
       pchannel_manager_->ClearCallLaters();
       transport_handler_->StopPingRendezvous();
       UnRegisterKadService();
-      pdata_store_->Clear();
+      if (!pdata_store_->persistent())
+        pdata_store_->Clear();
       add_ctc_cond_.notify_one();
       addcontacts_routine_->join();
       SaveBootstrapContacts();
       exclude_bs_contacts_.clear();
       prouting_table_->Clear();
+      lookup_cache_.Clear();
+      value_cache_.Clear();
+      rtt_estimator_.Clear();
       (*base::PublicRoutingTable::GetInstance())
           [base::IntToString(host_port_)]->Clear();
     }
@@ -771,7 +833,7 @@ void KNodeImpl::RefreshRoutine() {
     SaveBootstrapContacts();
     // Refresh the k-buckets
     pdata_store_->DeleteExpiredValues();
-    StartSearchIteration(node_id_, FIND_NODE, &dummy_callback);
+    StartSearchIteration(node_id_, FIND_NODE, &dummy_find_callback);
     // schedule the next refresh routine
     ptimer_->AddCallLater(kRefreshTime*1000,
                           boost::bind(&KNodeImpl::RefreshRoutine, this));
@@ -832,8 +894,7 @@ void KNodeImpl::StoreValue_IterativeStoreValue(
             callback_data.data->sig_value, response->signed_request()))
           del_req = response->signed_request();
       }
-      AddContact(callback_data.remote_ctc, callback_data.rpc_ctrler->rtt(),
-          false);
+      AddRespondingContact(callback_data.remote_ctc, callback_data.rpc_ctrler);
     } else {
       // it has timeout
       RemoveContact(callback_data.remote_ctc.node_id());
@@ -847,18 +908,16 @@ void KNodeImpl::StoreValue_IterativeStoreValue(
   if (callback_data.data->contacted_nodes >=
       callback_data.data->closest_nodes.size() || del_req.IsInitialized()) {
     // Finish storing
-    StoreResponse store_value_result;
+    StoreValueResult store_value_result;
     boost::uint32_t d(static_cast<boost::uint32_t>
       (K_ * kMinSuccessfulPecentageStore));
     if (callback_data.data->save_nodes >= d) {
       // Succeeded - min. number of copies were stored
-      store_value_result.set_result(kRpcResultSuccess);
+      store_value_result.succeeded = true;
     } else if (del_req.IsInitialized()) {
       // While refreshing a value, found that it has been Deleted with the
       // Delete RPC
-      store_value_result.set_result(kRpcResultFailure);
-      SignedRequest *sreq = store_value_result.mutable_signed_request();
-      *sreq = del_req;
+      store_value_result.signed_request = del_req;
       DLOG(WARNING) << "Found during refresh that value has been deleted"
                     << std::endl;
     } else {
@@ -869,14 +928,12 @@ void KNodeImpl::StoreValue_IterativeStoreValue(
       //                  recursively try until we've either stored min.
       //                  allowed number of copies or tried every node in our
       //                  routing table.
-      store_value_result.set_result(kRpcResultFailure);
       DLOG(ERROR) << "Successful Store rpc's " << callback_data.data->save_nodes
                   << std::endl << "Successful Store rpc's required "
                   << K_ * kMinSuccessfulPecentageStore << std::endl;
     }
-    std::string store_value_result_str(store_value_result.SerializeAsString());
     callback_data.data->is_callbacked = true;
-    callback_data.data->callback(store_value_result_str);
+    callback_data.data->callback(store_value_result);
   } else {
     // Continues...
     // send RPC to this contact
@@ -888,7 +945,7 @@ void KNodeImpl::StoreValue_IterativeStoreValue(
     StoreResponse *resp = new StoreResponse;
     StoreCallbackArgs callback_args(callback_data.data);
     callback_args.remote_ctc = next_node;
-    callback_args.rpc_ctrler = new rpcprotocol::Controller;
+    callback_args.rpc_ctrler = NewController(next_node.node_id());
 
     ConnectionType conn_type = CheckContactLocalAddress(next_node.node_id(),
       next_node.local_ip(), next_node.local_port(), next_node.host_ip());
@@ -925,177 +982,161 @@ void KNodeImpl::StoreValue_IterativeStoreValue(
   }
 }
 
-void KNodeImpl::StoreValue_ExecuteStoreRPCs(const std::string &result,
+void KNodeImpl::StoreValue_ExecuteStoreRPCs(const FindNodesResult &result,
                                             const KadId &key,
                                             const std::string &value,
                                             const SignedValue &sig_value,
                                             const SignedRequest &sig_req,
                                             const bool &publish,
                                             const boost::int32_t &ttl,
-                                            VoidFunctorOneString callback) {
+                                            StoreValueFunctor callback) {
   if (!is_joined_)
     return;
-  // validate the result
-  bool is_valid = true;
-  FindResponse result_msg;
-  if (!result_msg.ParseFromString(result)) {
-    is_valid = false;
-  } else if (result_msg.closest_nodes_size() == 0) {
-    is_valid = false;
+  if (result.closest_nodes.empty()) {
+    callback(StoreValueResult());
+    return;
   }
-  if ((is_valid) || (result_msg.result() == kRpcResultSuccess)) {
-    std::vector<Contact> closest_nodes;
-    for (int i = 0; i < result_msg.closest_nodes_size(); ++i) {
-      Contact node;
-      node.ParseFromString(result_msg.closest_nodes(i));
-      closest_nodes.push_back(node);
-    }
-    if (!closest_nodes.empty()) {
-      bool stored_local = false;
-      if (type_ != CLIENT) {
-        // If this node itself is closer to the key than the last (furthest)
-        // node in the returned list, store the value at this node as well.
-        if (closest_nodes.size() < K_) {
-          stored_local = true;
-        } else {
-          stored_local = KadId::CloserToTarget(node_id_,
-              closest_nodes.back().node_id(), key);
-        }
-        if (stored_local) {
-          bool local_result;
-          std::string local_value;
-          if (sig_value.IsInitialized()) {
-            local_value = sig_value.SerializeAsString();
-          } else {
-            local_value = value;
-          }
-          if (publish) {
-            local_result = StoreValueLocal(key, local_value, ttl);
-          } else {
-            local_result = RefreshValueLocal(key, local_value, ttl);
-          }
-          if (local_result && closest_nodes.size() >= K_) {
-            closest_nodes.pop_back();
-            DLOG(INFO) << "StoreValue_ExecuteStoreRPCs storing locally"
-                       << std::endl;
-          }
-        }
-      }
-      boost::shared_ptr<IterativeStoreValueData>
-          data(new struct IterativeStoreValueData(closest_nodes, key, value,
-               callback, publish, ttl, sig_value, sig_req));
-      if (stored_local)
-        ++data->save_nodes;
-      // decide the parallel level
-      int parallel_size;
-      if (data->closest_nodes.size() > alpha_)
-        parallel_size = alpha_;
-      else
-        parallel_size = data->closest_nodes.size();
-      for (int i = 0; i < parallel_size; ++i) {
-        StoreCallbackArgs callback_args(data);
-        StoreValue_IterativeStoreValue(NULL, callback_args);
-      }
-      return;
-    }
-    StoreResponse local_result;
-    local_result.set_result(kRpcResultFailure);
-    std::string local_result_str(local_result.SerializeAsString());
-    callback(local_result_str);
-  } else {
-    CallbackWithFailure(callback);
+  std::vector<Contact> closest_nodes(result.closest_nodes);
+  bool stored_local = StoreValue_StoreIfClose(key,
+      sig_value.IsInitialized() ? sig_value.SerializeAsString() : value,
+      publish, ttl, &closest_nodes);
+  boost::shared_ptr<IterativeStoreValueData>
+      data(new struct IterativeStoreValueData(closest_nodes, key, value,
+           callback, publish, ttl, sig_value, sig_req));
+  if (stored_local)
+    ++data->save_nodes;
+  // decide the parallel level
+  int parallel_size;
+  if (data->closest_nodes.size() > alpha_)
+    parallel_size = alpha_;
+  else
+    parallel_size = data->closest_nodes.size();
+  for (int i = 0; i < parallel_size; ++i) {
+    StoreCallbackArgs callback_args(data);
+    StoreValue_IterativeStoreValue(NULL, callback_args);
+  }
+}
+
+bool KNodeImpl::StoreValue_StoreIfClose(const KadId &key,
+                                        const std::string &value,
+                                        const bool &publish,
+                                        const boost::int32_t &ttl,
+                                        std::vector<Contact> *closest_nodes) {
+  if (type_ == CLIENT)
+    return false;
+  // If this node itself is closer to the key than the last (furthest) node in
+  // the list, store the value at this node as well.
+  if (closest_nodes->size() >= K_ && !KadId::CloserToTarget(node_id_,
+      closest_nodes->back().node_id(), key))
+    return false;
+  bool local_result;
+  if (publish)
+    local_result = StoreValueLocal(key, value, ttl);
+  else
+    local_result = RefreshValueLocal(key, value, ttl);
+  if (local_result && closest_nodes->size() >= K_) {
+    closest_nodes->pop_back();
+    DLOG(INFO) << "StoreValue_StoreIfClose storing locally" << std::endl;
   }
+  return local_result;
+}
+
+void KNodeImpl::Store(const KadId &key, const SignedValue &signed_value,
+                      const SignedRequest &signed_request,
+                      const boost::int32_t &ttl, StoreValueFunctor callback) {
+  if (!signed_value.IsInitialized() || !signed_request.IsInitialized()) {
+    callback(StoreValueResult());
+    return;
+  }
+  value_cache_.Remove(key);
+  CachedFindNodes(key, boost::bind(&KNodeImpl::StoreValue_ExecuteStoreRPCs,
+                                   this, _1, key, "", signed_value,
+                                   signed_request, true, ttl, callback));
+}
+
+void KNodeImpl::Store(const KadId &key, const std::string &value,
+                      const boost::int32_t &ttl, StoreValueFunctor callback) {
+  SignedValue svalue;
+  SignedRequest sreq;
+  value_cache_.Remove(key);
+  CachedFindNodes(key, boost::bind(&KNodeImpl::StoreValue_ExecuteStoreRPCs,
+                                   this, _1, key, value, svalue, sreq, true,
+                                   ttl, callback));
 }
 
 void KNodeImpl::StoreValue(const KadId &key, const SignedValue &signed_value,
                            const SignedRequest &signed_request,
                            const boost::int32_t &ttl,
                            VoidFunctorOneString callback) {
-  if (!signed_value.IsInitialized() || !signed_request.IsInitialized()) {
-    StoreResponse resp;
-    resp.set_result(kad::kRpcResultFailure);
-    std::string ser_resp(resp.SerializeAsString());
-    callback(ser_resp);
-    return;
-  }
-  FindKClosestNodes(key, boost::bind(&KNodeImpl::StoreValue_ExecuteStoreRPCs,
-                                     this, _1, key, "", signed_value,
-                                     signed_request, true, ttl, callback));
+  Store(key, signed_value, signed_request, ttl,
+        boost::bind(&SerialiseStoreResult, _1, callback));
 }
 
 void KNodeImpl::StoreValue(const KadId &key, const std::string &value,
                            const boost::int32_t &ttl,
                            VoidFunctorOneString callback) {
-  SignedValue svalue;
-  SignedRequest sreq;
-  FindKClosestNodes(key, boost::bind(&KNodeImpl::StoreValue_ExecuteStoreRPCs,
-                    this, _1, key, value, svalue, sreq, true, ttl, callback));
+  Store(key, value, ttl, boost::bind(&SerialiseStoreResult, _1, callback));
 }
 
-void KNodeImpl::FindValue(const KadId &key, const bool &check_alternative_store,
-                          VoidFunctorOneString callback) {
+void KNodeImpl::Find(const KadId &key, const bool &check_alternative_store,
+                     FindValueFunctor callback) {
   // Search in own alternative store first if check_alternative_store == true
-  kad::FindResponse result_msg;
+  FindValueResult result;
   if (check_alternative_store && alternative_store_ != NULL) {
     if (alternative_store_->Has(key.String())) {
-      result_msg.set_result(kad::kRpcResultSuccess);
-      *result_msg.mutable_alternative_value_holder() = contact_info();
-      DLOG(INFO) << "In KNodeImpl::FindValue - node " <<
-                 result_msg.alternative_value_holder().node_id().substr(0, 20)
+      result.succeeded = true;
+      result.alternative_value_holder = contact_info();
+      DLOG(INFO) << "In KNodeImpl::Find - node " <<
+                 result.alternative_value_holder.node_id().substr(0, 20)
                  << " got value in alt store." << std::endl;
-      std::string ser_find_result(result_msg.SerializeAsString());
-      callback(ser_find_result);
+      callback(result);
       return;
     }
   }
   std::vector<std::string> values;
   //  Searching for value in local DataStore
   if (FindValueLocal(key, &values)) {
-    result_msg.set_result(kad::kRpcResultSuccess);
+    result.succeeded = true;
     if (HasRSAKeys()) {
-      for (size_t n = 0; n < values.size(); ++n) {
-        SignedValue *sig_value = result_msg.add_signed_values();
-        sig_value->ParseFromString(values[n]);
-      }
-    } else {
+      result.signed_values.resize(values.size());
       for (size_t n = 0; n < values.size(); ++n)
-        result_msg.add_values(values[n]);
+        result.signed_values[n].ParseFromString(values[n]);
+    } else {
+      result.values.swap(values);
     }
-    std::string ser_find_result(result_msg.SerializeAsString());
-    callback(ser_find_result);
+    callback(result);
+    return;
+  }
+  //  or among the values found recently
+  if (value_cache_.Get(key, &result)) {
+    callback(result);
     return;
   }
   //  Value not found locally, looking for it in the network
   StartSearchIteration(key, FIND_VALUE, callback);
 }
 
-void KNodeImpl::FindNode_GetNode(const std::string &result,
+void KNodeImpl::FindValue(const KadId &key, const bool &check_alternative_store,
+                          VoidFunctorOneString callback) {
+  Find(key, check_alternative_store,
+       boost::bind(&SerialiseFindResult, _1, callback));
+}
+
+void KNodeImpl::FindNode_GetNode(const FindNodesResult &result,
                                  const KadId &node_id,
                                  VoidFunctorOneString callback) {
-  // validate the result
-  bool is_valid = true;
-  FindResponse result_msg;
   FindNodeResult find_node_result;
   std::string find_node_result_str;
-  if (!result_msg.ParseFromString(result))
-    is_valid = false;
-  else if ((!result_msg.has_result())||
-        (result_msg.closest_nodes_size() == 0)) {
-      is_valid = false;
-  }
-  if ((is_valid)||(result_msg.result() == kRpcResultSuccess)) {
-    for (int i = 0; i < result_msg.closest_nodes_size(); ++i) {
-      Contact node;
-      node.ParseFromString(result_msg.closest_nodes(i));
-      if (node.node_id() == node_id) {
-        find_node_result.set_result(kRpcResultSuccess);
-        std::string node_str;
-        node.SerialiseToString(&node_str);
-        find_node_result.set_contact(node_str);
-        find_node_result.SerializeToString(&find_node_result_str);
-        callback(find_node_result_str);
-        return;
-      }
+  for (size_t i = 0; i < result.closest_nodes.size(); ++i) {
+    if (result.closest_nodes[i].node_id() == node_id) {
+      find_node_result.set_result(kRpcResultSuccess);
+      Contact node(result.closest_nodes[i]);
+      std::string node_str;
+      node.SerialiseToString(&node_str);
+      find_node_result.set_contact(node_str);
+      find_node_result.SerializeToString(&find_node_result_str);
+      callback(find_node_result_str);
+      return;
     }
   }
   // Failed to get any result
@@ -1108,8 +1149,8 @@ void KNodeImpl::GetNodeContactDetails(const KadId &node_id,
                                       VoidFunctorOneString callback,
                                       const bool &local) {
   if (!local) {
-    FindKClosestNodes(node_id, boost::bind(&KNodeImpl::FindNode_GetNode, this,
-                      _1, node_id, callback));
+    FindNodes(node_id, boost::bind(&KNodeImpl::FindNode_GetNode, this, _1,
+                                   node_id, callback));
   } else {
     FindNodeResult result;
     std::string ser_result;
@@ -1129,8 +1170,508 @@ void KNodeImpl::GetNodeContactDetails(const KadId &node_id,
 
 void KNodeImpl::FindKClosestNodes(const KadId &node_id,
                                   VoidFunctorOneString callback) {
-  std::vector<Contact> start_up_short_list;
-  StartSearchIteration(node_id, FIND_NODE, callback);
+  StartSearchIteration(node_id, FIND_NODE,
+                       boost::bind(&SerialiseFindResult, _1, callback));
+}
+
+void KNodeImpl::FindNodes(const KadId &key, FindNodesFunctor callback) {
+  StartSearchIteration(key, FIND_NODE,
+                       boost::bind(&ToFindNodesResult, _1, callback));
+}
+
+void KNodeImpl::CachedFindNodes(const KadId &key, FindNodesFunctor callback) {
+  FindNodesResult result;
+  if (lookup_cache_.Get(key, &result.closest_nodes)) {
+    result.succeeded = true;
+    callback(result);
+    return;
+  }
+  FindNodes(key, boost::bind(&KNodeImpl::CachedFindNodes_Callback, this, _1,
+                             key, callback));
+}
+
+void KNodeImpl::CachedFindNodes_Callback(const FindNodesResult &result,
+                                         const KadId &key,
+                                         FindNodesFunctor callback) {
+  if (result.succeeded)
+    lookup_cache_.Add(key, result.closest_nodes);
+  callback(result);
+}
+
+void KNodeImpl::StoreBatch(const std::vector<StoreEntry> &entries,
+                           StoreBatchFunctor callback) {
+  std::vector<BatchStoreEntry> batch_entries(entries.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    value_cache_.Remove(entries[i].key);
+    batch_entries[i].set_key(entries[i].key.String());
+    batch_entries[i].set_ttl(entries[i].ttl);
+    if (HasRSAKeys()) {
+      // Entries without a valid signed value and request are left out.
+      if (entries[i].signed_value.IsInitialized() &&
+          entries[i].signed_request.IsInitialized()) {
+        *batch_entries[i].mutable_sig_value() = entries[i].signed_value;
+        *batch_entries[i].mutable_signed_request() = entries[i].signed_request;
+      }
+    } else {
+      batch_entries[i].set_value(entries[i].value);
+    }
+  }
+  boost::shared_ptr<BatchStoreData> data(
+      new BatchStoreData(batch_entries, true, callback));
+  StoreBatch_FindNodes(data);
+}
+
+void KNodeImpl::StoreBatch_FindNodes(boost::shared_ptr<BatchStoreData> data) {
+  std::set<KadId> keys;
+  for (size_t i = 0; i < data->entries.size(); ++i)
+    keys.insert(KadId(data->entries[i].key()));
+  {
+    boost::mutex::scoped_lock guard(data->mutex);
+    data->lookups = keys.size();
+  }
+  if (keys.empty()) {
+    StoreBatch_ExecuteStoreRPCs(data);
+    return;
+  }
+  for (std::set<KadId>::iterator it = keys.begin(); it != keys.end(); ++it)
+    CachedFindNodes(*it, boost::bind(&KNodeImpl::StoreBatch_FindNodesCallback,
+                                     this, _1, *it, data));
+}
+
+void KNodeImpl::StoreBatch_FindNodesCallback(
+    const FindNodesResult &result, const KadId &key,
+    boost::shared_ptr<BatchStoreData> data) {
+  {
+    boost::mutex::scoped_lock guard(data->mutex);
+    data->closest_nodes[key] = result.closest_nodes;
+    if (--data->lookups != 0)
+      return;
+  }
+  StoreBatch_ExecuteStoreRPCs(data);
+}
+
+void KNodeImpl::StoreBatch_ExecuteStoreRPCs(
+    boost::shared_ptr<BatchStoreData> data) {
+  if (!is_joined_)
+    return;
+  // Group the entries by the node they are to be stored on
+  std::map<KadId, BatchStoreCallbackArgs> destinations;
+  for (size_t i = 0; i < data->entries.size(); ++i) {
+    const BatchStoreEntry &entry = data->entries[i];
+    if (!entry.has_value() && !entry.has_sig_value())
+      continue;
+    std::vector<Contact> closest_nodes(
+        data->closest_nodes[KadId(entry.key())]);
+    if (closest_nodes.empty())
+      continue;
+    if (StoreValue_StoreIfClose(KadId(entry.key()),
+            entry.has_sig_value() ? entry.sig_value().SerializeAsString() :
+                                    entry.value(),
+            data->publish, entry.ttl(), &closest_nodes))
+      ++data->save_nodes[i];
+    for (size_t n = 0; n < closest_nodes.size(); ++n) {
+      std::map<KadId, BatchStoreCallbackArgs>::iterator it =
+          destinations.insert(std::make_pair(closest_nodes[n].node_id(),
+                              BatchStoreCallbackArgs(data))).first;
+      it->second.remote_ctc = closest_nodes[n];
+      it->second.indices.push_back(i);
+    }
+  }
+  // Split each node's entries into RPCs of at most kMaxBatchSize entries
+  std::vector<BatchStoreCallbackArgs> rpcs;
+  for (std::map<KadId, BatchStoreCallbackArgs>::iterator it =
+       destinations.begin(); it != destinations.end(); ++it) {
+    const std::vector<size_t> &indices(it->second.indices);
+    for (size_t begin = 0; begin < indices.size(); begin += kMaxBatchSize) {
+      BatchStoreCallbackArgs callback_args(data);
+      callback_args.remote_ctc = it->second.remote_ctc;
+      callback_args.indices.assign(indices.begin() + begin,
+          indices.begin() + std::min(indices.size(), begin + kMaxBatchSize));
+      rpcs.push_back(callback_args);
+    }
+  }
+  if (rpcs.empty()) {
+    StoreBatch_RpcDone(data);
+    return;
+  }
+  {
+    boost::mutex::scoped_lock guard(data->mutex);
+    data->rpcs = rpcs.size();
+  }
+  for (size_t i = 0; i < rpcs.size(); ++i)
+    StoreBatch_SendRPC(rpcs[i]);
+}
+
+void KNodeImpl::StoreBatch_SendRPC(BatchStoreCallbackArgs callback_args) {
+  std::vector<BatchStoreEntry> entries;
+  for (size_t i = 0; i < callback_args.indices.size(); ++i)
+    entries.push_back(callback_args.data->entries[callback_args.indices[i]]);
+  const Contact &remote = callback_args.remote_ctc;
+  std::string contact_ip, rendezvous_ip;
+  boost::uint16_t contact_port, rendezvous_port(0);
+  if (callback_args.rpc_ctrler == NULL &&
+      CheckContactLocalAddress(remote.node_id(), remote.local_ip(),
+          remote.local_port(), remote.host_ip()) == LOCAL) {
+    callback_args.retry = true;
+    contact_ip = remote.local_ip();
+    contact_port = remote.local_port();
+  } else {
+    contact_ip = remote.host_ip();
+    contact_port = remote.host_port();
+    rendezvous_ip = remote.rendezvous_ip();
+    rendezvous_port = remote.rendezvous_port();
+  }
+  delete callback_args.rpc_ctrler;
+  callback_args.rpc_ctrler = NewController(remote.node_id());
+  BatchStoreResponse *resp = new BatchStoreResponse;
+  google::protobuf::Closure *done = google::protobuf::NewCallback<
+      KNodeImpl, const BatchStoreResponse*, BatchStoreCallbackArgs>(
+          this, &KNodeImpl::StoreBatch_HandleResult, resp, callback_args);
+  kadrpcs_.BatchStore(entries, callback_args.data->publish, false, contact_ip,
+                      contact_port, rendezvous_ip, rendezvous_port, resp,
+                      callback_args.rpc_ctrler, done);
+}
+
+void KNodeImpl::StoreBatch_HandleResult(const BatchStoreResponse *response,
+                                        BatchStoreCallbackArgs callback_args) {
+  boost::shared_ptr<BatchStoreData> data(callback_args.data);
+  if (response->IsInitialized() && response->has_node_id() &&
+      response->node_id() != callback_args.remote_ctc.node_id().String() &&
+      callback_args.retry) {
+    // send RPC to this contact's remote address because local failed
+    delete response;
+    UpdatePDRTContactToRemote(callback_args.remote_ctc.node_id(),
+                              callback_args.remote_ctc.host_ip());
+    callback_args.retry = false;
+    StoreBatch_SendRPC(callback_args);
+    return;
+  }
+  if (!response->IsInitialized() || callback_args.rpc_ctrler->Failed()) {
+    RemoveContact(callback_args.remote_ctc.node_id());
+  } else {
+    AddRespondingContact(callback_args.remote_ctc, callback_args.rpc_ctrler);
+    size_t count(std::min(callback_args.indices.size(),
+                          static_cast<size_t>(response->results_size())));
+    for (size_t i = 0; i < count; ++i) {
+      size_t index(callback_args.indices[i]);
+      const StoreResponse &result = response->results(i);
+      if (result.result() == kRpcResultSuccess) {
+        boost::mutex::scoped_lock guard(data->mutex);
+        ++data->save_nodes[index];
+      } else if (result.has_signed_request() &&
+                 data->entries[index].has_sig_value() &&
+                 DelValueLocal(KadId(data->entries[index].key()),
+                               data->entries[index].sig_value(),
+                               result.signed_request())) {
+        boost::mutex::scoped_lock guard(data->mutex);
+        data->delete_requests[index] = result.signed_request();
+      }
+    }
+  }
+  delete callback_args.rpc_ctrler;
+  delete response;
+  StoreBatch_RpcDone(data);
+}
+
+void KNodeImpl::StoreBatch_RpcDone(boost::shared_ptr<BatchStoreData> data) {
+  std::vector<StoreValueResult> results(data->entries.size());
+  {
+    boost::mutex::scoped_lock guard(data->mutex);
+    if (data->rpcs > 1) {
+      --data->rpcs;
+      return;
+    }
+    data->rpcs = 0;
+    boost::uint32_t d(static_cast<boost::uint32_t>
+      (K_ * kMinSuccessfulPecentageStore));
+    // A value found to have been deleted fails however many nodes took it.
+    for (size_t i = 0; i < results.size(); ++i) {
+      results[i].signed_request = data->delete_requests[i];
+      results[i].succeeded = !results[i].signed_request.IsInitialized() &&
+                             data->save_nodes[i] >= d;
+    }
+  }
+  data->callback(results);
+}
+
+void KNodeImpl::FindBatch(const std::vector<KadId> &keys,
+                          const bool &check_alternative_store,
+                          FindBatchFunctor callback) {
+  boost::shared_ptr<BatchFindData> data(new BatchFindData(keys, callback));
+  std::set<KadId> lookup_keys;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    FindValueResult &result = data->results[i];
+    std::vector<std::string> values;
+    if (check_alternative_store && alternative_store_ != NULL &&
+        alternative_store_->Has(keys[i].String())) {
+      result.succeeded = true;
+      result.alternative_value_holder = contact_info();
+    } else if (FindValueLocal(keys[i], &values)) {
+      result.succeeded = true;
+      if (HasRSAKeys()) {
+        result.signed_values.resize(values.size());
+        for (size_t n = 0; n < values.size(); ++n)
+          result.signed_values[n].ParseFromString(values[n]);
+      } else {
+        result.values.swap(values);
+      }
+    } else if (!value_cache_.Get(keys[i], &result)) {
+      data->pending.push_back(i);
+      lookup_keys.insert(keys[i]);
+    }
+  }
+  data->unresolved = data->pending.size();
+  data->lookups = lookup_keys.size();
+  if (data->unresolved == 0) {
+    callback(data->results);
+    return;
+  }
+  for (std::set<KadId>::iterator it = lookup_keys.begin();
+       it != lookup_keys.end(); ++it)
+    CachedFindNodes(*it, boost::bind(&KNodeImpl::FindBatch_FindNodesCallback,
+                                     this, _1, *it, data));
+}
+
+void KNodeImpl::FindBatch_FindNodesCallback(
+    const FindNodesResult &result, const KadId &key,
+    boost::shared_ptr<BatchFindData> data) {
+  {
+    boost::mutex::scoped_lock guard(data->mutex);
+    data->closest_nodes[key] = result.closest_nodes;
+    if (--data->lookups != 0)
+      return;
+  }
+  FindBatch_ExecuteFindRPCs(data);
+}
+
+void KNodeImpl::FindBatch_ExecuteFindRPCs(
+    boost::shared_ptr<BatchFindData> data) {
+  if (!is_joined_)
+    return;
+  // Ask the closest node found for each key, grouping the keys by node
+  std::map<KadId, BatchFindCallbackArgs> destinations;
+  std::vector<size_t> no_nodes;
+  for (size_t i = 0; i < data->pending.size(); ++i) {
+    size_t index(data->pending[i]);
+    const std::vector<Contact> &closest_nodes =
+        data->closest_nodes[data->keys[index]];
+    if (closest_nodes.empty()) {
+      no_nodes.push_back(index);
+      continue;
+    }
+    std::map<KadId, BatchFindCallbackArgs>::iterator it =
+        destinations.insert(std::make_pair(closest_nodes.front().node_id(),
+                            BatchFindCallbackArgs(data))).first;
+    it->second.remote_ctc = closest_nodes.front();
+    it->second.indices.push_back(index);
+  }
+  for (std::map<KadId, BatchFindCallbackArgs>::iterator it =
+       destinations.begin(); it != destinations.end(); ++it) {
+    const std::vector<size_t> &indices(it->second.indices);
+    const Contact &remote = it->second.remote_ctc;
+    for (size_t begin = 0; begin < indices.size(); begin += kMaxBatchSize) {
+      BatchFindCallbackArgs callback_args(data);
+      callback_args.remote_ctc = remote;
+      callback_args.indices.assign(indices.begin() + begin,
+          indices.begin() + std::min(indices.size(), begin + kMaxBatchSize));
+      FindBatch_SendRPC(callback_args);
+    }
+  }
+  // Keys without any close node are looked up individually
+  for (size_t i = 0; i < no_nodes.size(); ++i)
+    Find(data->keys[no_nodes[i]], false,
+         boost::bind(&KNodeImpl::FindBatch_Resolve, this, _1, no_nodes[i],
+                     data));
+}
+
+void KNodeImpl::FindBatch_SendRPC(BatchFindCallbackArgs callback_args) {
+  std::vector<KadId> keys;
+  for (size_t i = 0; i < callback_args.indices.size(); ++i)
+    keys.push_back(callback_args.data->keys[callback_args.indices[i]]);
+  const Contact &remote = callback_args.remote_ctc;
+  std::string contact_ip, rendezvous_ip;
+  boost::uint16_t contact_port, rendezvous_port(0);
+  if (callback_args.rpc_ctrler == NULL &&
+      CheckContactLocalAddress(remote.node_id(), remote.local_ip(),
+          remote.local_port(), remote.host_ip()) == LOCAL) {
+    callback_args.retry = true;
+    contact_ip = remote.local_ip();
+    contact_port = remote.local_port();
+  } else {
+    contact_ip = remote.host_ip();
+    contact_port = remote.host_port();
+    rendezvous_ip = remote.rendezvous_ip();
+    rendezvous_port = remote.rendezvous_port();
+  }
+  delete callback_args.rpc_ctrler;
+  callback_args.rpc_ctrler = NewController(remote.node_id());
+  BatchFindValueResponse *resp = new BatchFindValueResponse;
+  google::protobuf::Closure *done = google::protobuf::NewCallback<
+      KNodeImpl, const BatchFindValueResponse*, BatchFindCallbackArgs>(
+          this, &KNodeImpl::FindBatch_HandleResult, resp, callback_args);
+  kadrpcs_.BatchFindValue(keys, contact_ip, contact_port, rendezvous_ip,
+                          rendezvous_port, resp, callback_args.rpc_ctrler,
+                          done);
+}
+
+void KNodeImpl::FindBatch_HandleResult(const BatchFindValueResponse *response,
+                                       BatchFindCallbackArgs callback_args) {
+  boost::shared_ptr<BatchFindData> data(callback_args.data);
+  if (response->IsInitialized() && response->has_node_id() &&
+      response->node_id() != callback_args.remote_ctc.node_id().String() &&
+      callback_args.retry) {
+    // send RPC to this contact's remote address because local failed
+    delete response;
+    UpdatePDRTContactToRemote(callback_args.remote_ctc.node_id(),
+                              callback_args.remote_ctc.host_ip());
+    callback_args.retry = false;
+    FindBatch_SendRPC(callback_args);
+    return;
+  }
+  std::vector<size_t> not_found;
+  if (!response->IsInitialized() || callback_args.rpc_ctrler->Failed() ||
+      response->result() != kRpcResultSuccess) {
+    if (!response->IsInitialized() || callback_args.rpc_ctrler->Failed())
+      RemoveContact(callback_args.remote_ctc.node_id());
+    not_found = callback_args.indices;
+  } else {
+    AddRespondingContact(callback_args.remote_ctc, callback_args.rpc_ctrler);
+    for (size_t i = 0; i < callback_args.indices.size(); ++i) {
+      if (i >= static_cast<size_t>(response->results_size()) ||
+          response->results(i).result() != kRpcResultSuccess) {
+        not_found.push_back(callback_args.indices[i]);
+        continue;
+      }
+      const FindResponse &found = response->results(i);
+      FindValueResult result;
+      result.succeeded = true;
+      for (int n = 0; n < found.values_size(); ++n)
+        result.values.push_back(found.values(n));
+      for (int n = 0; n < found.signed_values_size(); ++n)
+        result.signed_values.push_back(found.signed_values(n));
+      if (found.has_alternative_value_holder())
+        result.alternative_value_holder = found.alternative_value_holder();
+      else
+        value_cache_.Add(data->keys[callback_args.indices[i]], result,
+                         found.has_ttl() ? found.ttl() : 0);
+      FindBatch_Resolve(result, callback_args.indices[i], data);
+    }
+  }
+  delete callback_args.rpc_ctrler;
+  delete response;
+  // Keys the node didn't have are looked up individually
+  for (size_t i = 0; i < not_found.size(); ++i)
+    Find(data->keys[not_found[i]], false,
+         boost::bind(&KNodeImpl::FindBatch_Resolve, this, _1, not_found[i],
+                     data));
+}
+
+void KNodeImpl::FindBatch_Resolve(const FindValueResult &result,
+                                  const size_t &index,
+                                  boost::shared_ptr<BatchFindData> data) {
+  {
+    boost::mutex::scoped_lock guard(data->mutex);
+    data->results[index] = result;
+    if (--data->unresolved != 0)
+      return;
+  }
+  data->callback(data->results);
+}
+
+void KNodeImpl::ValueChanged_Callback(const bool &result, const KadId &key,
+                                      VoidFunctorOneBool callback) {
+  value_cache_.Remove(key);
+  callback(result);
+}
+
+void KNodeImpl::SendCacheCopy(const KadId &key, const FindValueResult &result,
+                              const boost::int32_t &ttl) {
+  std::vector<BatchStoreEntry> entries;
+  for (size_t i = 0; i < result.signed_values.size() &&
+       entries.size() < static_cast<size_t>(kMaxBatchSize); ++i) {
+    // The holder only accepts signed copies it can authenticate, i.e. those
+    // stored under the hash of the signed value.
+    crypto::HashContext hash(crypto::SHA_512);
+    hash.Update(result.signed_values[i].value());
+    hash.Update(result.signed_values[i].value_signature());
+    if (hash.Final(false) != key.String())
+      continue;
+    BatchStoreEntry entry;
+    entry.set_key(key.String());
+    *entry.mutable_sig_value() = result.signed_values[i];
+    entry.set_ttl(ttl);
+    entries.push_back(entry);
+  }
+  for (size_t i = 0; i < result.values.size() &&
+       entries.size() < static_cast<size_t>(kMaxBatchSize); ++i) {
+    BatchStoreEntry entry;
+    entry.set_key(key.String());
+    entry.set_value(result.values[i]);
+    entry.set_ttl(ttl);
+    entries.push_back(entry);
+  }
+  if (entries.empty())
+    return;
+  const Contact &holder = result.cache_copy_holder;
+  std::string contact_ip, rendezvous_ip;
+  boost::uint16_t contact_port, rendezvous_port(0);
+  if (CheckContactLocalAddress(holder.node_id(), holder.local_ip(),
+          holder.local_port(), holder.host_ip()) == LOCAL) {
+    contact_ip = holder.local_ip();
+    contact_port = holder.local_port();
+  } else {
+    contact_ip = holder.host_ip();
+    contact_port = holder.host_port();
+    rendezvous_ip = holder.rendezvous_ip();
+    rendezvous_port = holder.rendezvous_port();
+  }
+  {
+    boost::mutex::scoped_lock guard(path_cache_mutex_);
+    ++path_cache_stats_.copies_sent;
+  }
+  rpcprotocol::Controller *ctrl = NewController(holder.node_id());
+  BatchStoreResponse *resp = new BatchStoreResponse;
+  google::protobuf::Closure *done = google::protobuf::NewCallback<
+      KNodeImpl, const BatchStoreResponse*, rpcprotocol::Controller*>(
+          this, &KNodeImpl::SendCacheCopy_Callback, resp, ctrl);
+  kadrpcs_.BatchStore(entries, true, true, contact_ip, contact_port,
+                      rendezvous_ip, rendezvous_port, resp, ctrl, done);
+}
+
+void KNodeImpl::SendCacheCopy_Callback(const BatchStoreResponse *response,
+                                       rpcprotocol::Controller *ctrl) {
+  if (response->IsInitialized() && !ctrl->Failed() &&
+      response->result() == kRpcResultSuccess) {
+    for (int i = 0; i < response->results_size(); ++i) {
+      if (response->results(i).result() == kRpcResultSuccess) {
+        boost::mutex::scoped_lock guard(path_cache_mutex_);
+        ++path_cache_stats_.copies_stored;
+        break;
+      }
+    }
+  }
+  delete response;
+  delete ctrl;
+}
+
+boost::int32_t KNodeImpl::CacheCopyTtl(const size_t &closer,
+                                       const boost::int32_t &values_ttl) const {
+  boost::int32_t ttl(closer < 31 ? kCacheCopyTtl >> closer : 0);
+  if (ttl < kMinCacheCopyTtl)
+    ttl = kMinCacheCopyTtl;
+  if (values_ttl > 0 && values_ttl < ttl)
+    ttl = values_ttl;
+  return ttl;
+}
+
+PathCacheStats KNodeImpl::PathCacheStatistics() {
+  boost::mutex::scoped_lock guard(path_cache_mutex_);
+  return path_cache_stats_;
+}
+
+void KNodeImpl::ResetPathCacheStatistics() {
+  boost::mutex::scoped_lock guard(path_cache_mutex_);
+  path_cache_stats_ = PathCacheStats();
 }
 
 void KNodeImpl::GetKNodesFromRoutingTable(
@@ -1176,8 +1717,7 @@ void KNodeImpl::Ping_HandleResult(const PingResponse *response,
   } else {
     result_msg = *response;
     if (response->result() == kRpcResultSuccess) {
-      AddContact(callback_data.remote_ctc, callback_data.rpc_ctrler->rtt(),
-                 false);
+      AddRespondingContact(callback_data.remote_ctc, callback_data.rpc_ctrler);
     } else {
       RemoveContact(callback_data.remote_ctc.node_id());
     }
@@ -1224,7 +1764,7 @@ void KNodeImpl::Ping(const Contact &remote, VoidFunctorOneString callback) {
     PingResponse *resp = new PingResponse;
     PingCallbackArgs  callback_args(callback);
     callback_args.remote_ctc = remote;
-    callback_args.rpc_ctrler = new rpcprotocol::Controller;
+    callback_args.rpc_ctrler = NewController(remote.node_id());
     ConnectionType conn_type = CheckContactLocalAddress(remote.node_id(),
                                                         remote.local_ip(),
                                                         remote.local_port(),
@@ -1259,6 +1799,8 @@ int KNodeImpl::AddContact(Contact new_contact, const float & rtt,
       boost::mutex::scoped_lock gaurd(routingtable_mutex_);
       new_contact.set_last_seen(base::GetEpochMilliseconds());
       result = prouting_table_->AddContact(new_contact);
+      if (result == 0)
+        lookup_cache_.AddContact(new_contact.node_id(), K_);
     } else {
       result = 0;
     }
@@ -1288,9 +1830,26 @@ int KNodeImpl::AddContact(Contact new_contact, const float & rtt,
   return result;
 }
 
+void KNodeImpl::AddRespondingContact(const Contact &contact,
+                                     rpcprotocol::Controller *ctrl) {
+  boost::uint64_t rtt(ctrl->Duration());
+  if (rtt == 0)
+    rtt = static_cast<boost::uint64_t>(ctrl->rtt());
+  rtt_estimator_.AddSample(contact.node_id(), rtt);
+  AddContact(contact, ctrl->rtt(), false);
+}
+
+rpcprotocol::Controller* KNodeImpl::NewController(const KadId &node_id) {
+  rpcprotocol::Controller *ctrl = new rpcprotocol::Controller;
+  ctrl->set_timeout_ms(rtt_estimator_.Timeout(node_id));
+  return ctrl;
+}
+
 void KNodeImpl::RemoveContact(const KadId &node_id) {
+  rtt_estimator_.AddFailure(node_id);
   (*base::PublicRoutingTable::GetInstance())[boost::lexical_cast<std::string>
       (host_port_)]->DeleteTupleByKadId(node_id.String());
+  lookup_cache_.RemoveContact(node_id);
   boost::mutex::scoped_lock gaurd(routingtable_mutex_);
   prouting_table_->RemoveContact(node_id, false);
 }
@@ -1315,8 +1874,7 @@ bool KNodeImpl::StoreValueLocal(const KadId &key, const std::string &value,
     if (attr.empty()) {
       crypto::Crypto cobj;
       cobj.set_hash_algorithm(crypto::SHA_512);
-      if (key.String() == cobj.Hash(value, "", crypto::STRING_STRING,
-                                             false))
+      if (key.String() == cobj.Hash(value.data(), value.size(), false))
         hashable = true;
     } else if (attr.size() == 1) {
       hashable = attr[0].second;
@@ -1432,6 +1990,7 @@ void KNodeImpl::RegisterKadService() {
   premote_service_->set_node_info(contact_info());
   premote_service_->set_alternative_store(alternative_store_);
   premote_service_->set_signature_validator(signature_validator_);
+  premote_service_->StartCryptoWorkers(kCryptoWorkers, kCryptoQueueSize);
   pservice_channel_.reset(new rpcprotocol::Channel(pchannel_manager_,
                                                    transport_handler_));
   pservice_channel_->SetService(premote_service_.get());
@@ -1443,6 +2002,8 @@ void KNodeImpl::UnRegisterKadService() {
   pchannel_manager_->UnRegisterChannel(
       premote_service_->GetDescriptor()->name());
   pchannel_manager_->ClearCallLaters();
+  // Requests still queued are answered through the channel.
+  premote_service_->StopCryptoWorkers();
   pservice_channel_.reset();
   premote_service_.reset();
 }
@@ -1563,6 +2124,7 @@ void KNodeImpl::CheckToInsert_Callback(const std::string &result, KadId id,
   PingResponse result_msg;
   if (!result_msg.ParseFromString(result) ||
       result_msg.result() != kRpcResultSuccess) {
+    lookup_cache_.RemoveContact(id);
     boost::mutex::scoped_lock gaurd(routingtable_mutex_);
     prouting_table_->RemoveContact(id, true);
     prouting_table_->AddContact(new_contact);
@@ -1595,7 +2157,7 @@ void KNodeImpl::CheckAddContacts() {
 
 void KNodeImpl::StartSearchIteration(const KadId &key,
                                      const RemoteFindMethod &method,
-                                     VoidFunctorOneString callback) {
+                                     FindValueFunctor callback) {
   // Getting the first alpha contacts
   std::vector<Contact> close_nodes, exclude_contacts;
   {
@@ -1604,16 +2166,13 @@ void KNodeImpl::StartSearchIteration(const KadId &key,
                                     &close_nodes);
   }
   if (close_nodes.empty()) {
-    CallbackWithFailure(callback);
+    callback(FindValueResult());
     return;
   }
   boost::shared_ptr<IterativeLookUpData> data(new IterativeLookUpData(method,
       key, callback));
-  for (unsigned int i = 0; i < close_nodes.size(); ++i) {
-    struct LookupContact ctc;
-    ctc.kad_contact = close_nodes[i];
-    data->short_list.push_back(ctc);
-  }
+  for (unsigned int i = 0; i < close_nodes.size(); ++i)
+    data->AddToShortList(close_nodes[i]);
   SearchIteration(data);
 }
 
@@ -1625,7 +2184,7 @@ void KNodeImpl::SendFindRpc(Contact remote,
   FindResponse *resp = new FindResponse;
   FindCallbackArgs callback_args(data);
   callback_args.remote_ctc = remote;
-  callback_args.rpc_ctrler = new rpcprotocol::Controller;
+  callback_args.rpc_ctrler = NewController(remote.node_id());
   std::string contact_ip, rendezvous_ip("");
   boost::uint16_t contact_port, rendezvous_port(0);
   if (conn_type == LOCAL) {
@@ -1649,8 +2208,10 @@ void KNodeImpl::SendFindRpc(Contact remote,
       tmp_contact.SerialiseToString(&contact_str);
       resp->set_requester_ext_addr(contact_str);
     }
-    if (data->key == remote.node_id())
+    if (data->key == remote.node_id()) {
+      boost::mutex::scoped_lock guard(data->mutex);
       data->wait_for_key = true;
+    }
     kadrpcs_.FindNode(data->key, contact_ip, contact_port, rendezvous_ip,
                       rendezvous_port, resp, callback_args.rpc_ctrler, done);
   } else if (data->method == FIND_VALUE) {
@@ -1663,127 +2224,217 @@ void KNodeImpl::SendFindRpc(Contact remote,
   }
 }
 
+// The RPC's callback can run before the RPC returns, so this must not be called
+// with data->mutex locked.
+void KNodeImpl::SendFindRpcs(const std::vector<Contact> &remotes,
+                             boost::shared_ptr<IterativeLookUpData> data) {
+  for (unsigned int i = 0; i < remotes.size(); ++i) {
+    ConnectionType conn_type = CheckContactLocalAddress(remotes[i].node_id(),
+        remotes[i].local_ip(), remotes[i].local_port(), remotes[i].host_ip());
+    SendFindRpc(remotes[i], data, conn_type);
+  }
+}
+
 void KNodeImpl::SearchIteration(boost::shared_ptr<IterativeLookUpData> data) {
-  if ((data->is_callbacked)||(!is_joined_ && data->method != BOOTSTRAP))
+  if (!is_joined_ && data->method != BOOTSTRAP)
     return;
-  // Found an alternative value holder or the actual value
-  if (data->method == FIND_VALUE && (!data->values_found.empty() ||
-      !data->sig_values_found.empty() ||
-      !data->alternative_value_holder.node_id().empty()))
+  std::vector<Contact> pending_to_contact;
+  bool finished(false), final_iteration(false), restart(false);
+  {
+    boost::mutex::scoped_lock guard(data->mutex);
+    if (data->is_callbacked)
+      return;
+    if (data->method == FIND_VALUE && (!data->values_found.empty() ||
+        !data->sig_values_found.empty() ||
+        !data->alternative_value_holder.node_id().empty())) {
+      // Found an alternative value holder or the actual value
+      finished = true;
+    } else if (data->current_alpha.size() > beta_ || data->wait_for_key) {
+      // Wait for beta to start the iteration
+      return;
+    } else {
+      // check if there are closer nodes than the ones already seen
+      bool closer_nodes(data->active_contacts.empty());
+      if (!closer_nodes) {
+        const KadId &last_active = data->active_contacts.rbegin()->first;
+        std::map<KadId, LookupContact>::iterator it;
+        for (it = data->short_list.begin();
+             it != data->short_list.end() && it->first < last_active; ++it) {
+          if (!it->second.contacted) {
+            closer_nodes = true;
+            break;
+          }
+        }
+      }
+      if (!closer_nodes) {
+        // waiting for all the rpc's sent in the iteration
+        if (!data->current_alpha.empty())
+          return;
+        final_iteration = true;
+      } else {
+        // send Rpc Find to alpha contacts
+        data->current_alpha.clear();
+        std::vector<LookupContact*> candidates;
+        SelectProbes(data, &candidates);
+        for (size_t i = 0; i < candidates.size(); ++i) {
+          data->current_alpha.push_back(candidates[i]->kad_contact);
+          data->active_probes.push_back(candidates[i]->kad_contact);
+          candidates[i]->contacted = true;
+          pending_to_contact.push_back(candidates[i]->kad_contact);
+        }
+        if (pending_to_contact.empty()) {
+          if (!data->active_probes.empty()) {
+            // wait for the active probes
+            return;
+          } else if (data->active_contacts.empty()) {
+            restart = true;
+          } else {
+            finished = true;
+          }
+        }
+      }
+    }
+  }
+  if (finished) {
     SearchIteration_Callback(data);
+  } else if (final_iteration) {
+    SendFinalIteration(data);
+  } else if (restart) {
+    // try with another alpha contacts just
+    std::vector<Contact> close_nodes, exclude_contacts;
+    {
+      boost::mutex::scoped_lock gaurd(routingtable_mutex_);
+      prouting_table_->FindCloseNodes(data->key, alpha_, exclude_contacts,
+                                      &close_nodes);
+    }
+    if (close_nodes.empty()) {
+      SearchIteration_Callback(data);
+      return;
+    }
+    {
+      boost::mutex::scoped_lock guard(data->mutex);
+      for (unsigned int i = 0; i < close_nodes.size(); ++i) {
+        if (!data->AddToShortList(close_nodes[i]))
+          data->short_list[close_nodes[i].node_id() ^ data->key].contacted =
+              false;
+      }
+    }
+    SearchIteration(data);
+  } else {
+    SendFindRpcs(pending_to_contact, data);
+    ScheduleHedges(pending_to_contact, data);
+  }
+}
 
-  // sort the active contacts
-  SortContactList(data->key, &data->active_contacts);
-  // sort the short_list
-  SortLookupContact(data->key, &data->short_list);
-  // Wait for beta to start the iteration
-  activeprobes_mutex_.lock();
-  unsigned int remaining_of_iter = data->current_alpha.size();
-  activeprobes_mutex_.unlock();
-  if (remaining_of_iter > beta_ || data->wait_for_key) {
+void KNodeImpl::SelectProbes(boost::shared_ptr<IterativeLookUpData> data,
+                             std::vector<LookupContact*> *probes) {
+  size_t max_candidates(alpha_);
+  if (proximity_lookups_)
+    max_candidates *= kProximityCandidates;
+  std::map<KadId, LookupContact>::iterator it;
+  for (it = data->short_list.begin(); it != data->short_list.end() &&
+       probes->size() < max_candidates; ++it) {
+    if (!it->second.contacted)
+      probes->push_back(&it->second);
+  }
+  if (probes->size() <= alpha_)
     return;
+  // Always take the closest one so that every iteration makes progress, then
+  // the rest by expected response time, keeping XOR order for ties.  Those
+  // skipped are still closer than the last active contact and so are asked in
+  // a later iteration.
+  std::vector< std::pair<double, size_t> > order;
+  for (size_t i = 1; i < probes->size(); ++i) {
+    const KadId &id((*probes)[i]->kad_contact.node_id());
+    double cost(0);
+    if (rtt_estimator_.SmoothedRtt(id, &cost))
+      cost += rtt_estimator_.Failures(id) * kProximityFailurePenalty;
+    else
+      cost = std::numeric_limits<double>::max();
+    order.push_back(std::make_pair(cost, i));
   }
+  std::sort(order.begin(), order.end());
+  std::vector<LookupContact*> chosen(1, (*probes)[0]);
+  for (size_t i = 0; chosen.size() < alpha_; ++i)
+    chosen.push_back((*probes)[order[i].second]);
+  probes->swap(chosen);
+}
 
-  // check if there are closer nodes than the ones already seen
-  bool closer_nodes = false;
-  if (data->active_contacts.empty()) {
-    closer_nodes = true;
-  } else {
-    std::list<LookupContact>::iterator it;
-    ContactAndTargetKey last_active;
-    last_active.contact = data->active_contacts.back();
-    last_active.target_key = data->key;
-    for (it = data->short_list.begin(); it != data->short_list.end(); ++it) {
-      if (!it->contacted) {
-        ContactAndTargetKey notcontated;
-        notcontated.contact = it->kad_contact;
-        notcontated.target_key = data->key;
-        if (CompareContact(notcontated, last_active)) {
-          closer_nodes = true;
-          break;
-        }
-      }
+void KNodeImpl::ScheduleHedges(const std::vector<Contact> &probes,
+                               boost::shared_ptr<IterativeLookUpData> data) {
+  if (kHedgeBudget == 0)
+    return;
+  {
+    boost::mutex::scoped_lock guard(hedge_mutex_);
+    hedge_tokens_ += probes.size() * kHedgeBudget / 100.0;
+    if (hedge_tokens_ > kMaxHedgeBurst)
+      hedge_tokens_ = kMaxHedgeBurst;
+  }
+  boost::uint64_t deadline(0);
+  if (!rtt_estimator_.Percentile(kHedgePercentile, kHedgeMinSamples,
+                                 &deadline))
+    return;
+  for (size_t i = 0; i < probes.size(); ++i)
+    ptimer_->AddCallLater(deadline, boost::bind(&KNodeImpl::HedgeProbe, this,
+                                                probes[i], data));
+}
+
+void KNodeImpl::HedgeProbe(const Contact &probe,
+                           boost::shared_ptr<IterativeLookUpData> data) {
+  if (!is_joined_ && data->method != BOOTSTRAP)
+    return;
+  std::vector<Contact> hedge;
+  {
+    boost::mutex::scoped_lock guard(data->mutex);
+    if (data->is_callbacked || data->in_final_iteration)
+      return;
+    std::list<Contact>::iterator alpha_it;
+    for (alpha_it = data->current_alpha.begin();
+         alpha_it != data->current_alpha.end(); ++alpha_it) {
+      if (alpha_it->node_id() == probe.node_id())
+        break;
     }
-  }
-  if (!closer_nodes) {
-    // waiting for all the rpc's sent in the iteration
-    if (remaining_of_iter > 0)
+    if (alpha_it == data->current_alpha.end())
       return;
-    SendFinalIteration(data);
-  } else {
-    // send Rpc Find to alpha contacts
-    activeprobes_mutex_.lock();
-    data->current_alpha.clear();
-    activeprobes_mutex_.unlock();
-    int contacted_now = 0;
-    std::list<LookupContact>::iterator it;
-    std::vector<Contact> pending_to_contact;
-    for (it = data->short_list.begin(); it != data->short_list.end() &&
-         contacted_now < alpha_; ++it) {
-      if (!it->contacted) {
-        Contact remote;
-        remote = it->kad_contact;
-        activeprobes_mutex_.lock();
-        data->current_alpha.push_back(remote);
-        data->active_probes.push_back(remote);
-        activeprobes_mutex_.unlock();
-        it->contacted = true;
-        pending_to_contact.push_back(remote);
-        ++contacted_now;
-      }
+    std::map<KadId, LookupContact>::iterator it;
+    for (it = data->short_list.begin(); it != data->short_list.end(); ++it) {
+      if (!it->second.contacted)
+        break;
     }
-    if (contacted_now == 0) {
-      if (!data->active_probes.empty()) {
-        // wait for the active probes
+    if (it == data->short_list.end())
+      return;
+    {
+      boost::mutex::scoped_lock hedge_guard(hedge_mutex_);
+      if (hedge_tokens_ < 1)
         return;
-      } else if (data->active_contacts.empty()) {
-        // try with another alpha contacts just
-        std::vector<Contact> close_nodes, exclude_contacts;
-        {
-          boost::mutex::scoped_lock gaurd(routingtable_mutex_);
-          prouting_table_->FindCloseNodes(data->key, alpha_, exclude_contacts,
-                                          &close_nodes);
-        }
-        if (close_nodes.empty()) {
-          SearchIteration_Callback(data);
-          return;
-        }
-        for (unsigned int i = 0; i < close_nodes.size(); ++i) {
-          struct LookupContact ctc;
-          ctc.kad_contact = close_nodes[i];
-          data->short_list.push_back(ctc);
-        }
-        SearchIteration(data);
-      } else {
-        SearchIteration_Callback(data);
-      }
-    } else {
-      for (unsigned int i = 0; i < pending_to_contact.size(); ++i) {
-        ConnectionType conn_type = CheckContactLocalAddress(
-            pending_to_contact[i].node_id(), pending_to_contact[i].local_ip(),
-            pending_to_contact[i].local_port(),
-            pending_to_contact[i].host_ip());
-        SendFindRpc(pending_to_contact[i], data, conn_type);
-      }
+      hedge_tokens_ -= 1;
     }
+    // The slow probe stays active and its answer is still used, but the
+    // iteration now waits on the hedge instead.
+    it->second.contacted = true;
+    *alpha_it = it->second.kad_contact;
+    data->active_probes.push_back(it->second.kad_contact);
+    hedge.push_back(it->second.kad_contact);
   }
+  SendFindRpcs(hedge, data);
 }
 
 void KNodeImpl::SearchIteration_ExtendShortList(
     const FindResponse *response,
     FindCallbackArgs callback_data) {
-  if (!is_joined_ && callback_data.data->method != BOOTSTRAP) {
+  boost::shared_ptr<IterativeLookUpData> data(callback_data.data);
+  if (!is_joined_ && data->method != BOOTSTRAP) {
     delete response;
     delete callback_data.rpc_ctrler;
     return;
   }
   bool is_valid = true;
   if ((!response->IsInitialized() || callback_data.rpc_ctrler->Failed()) &&
-      callback_data.data->method != BOOTSTRAP) {
+      data->method != BOOTSTRAP) {
     RemoveContact(callback_data.remote_ctc.node_id());
     is_valid = false;
-    callback_data.data->dead_ids.push_back(
-        callback_data.remote_ctc.node_id().String());
+    boost::mutex::scoped_lock guard(data->mutex);
+    data->dead_ids.push_back(callback_data.remote_ctc.node_id().String());
   }
 
   if (is_valid) {
@@ -1797,248 +2448,203 @@ void KNodeImpl::SearchIteration_ExtendShortList(
         callback_data.rpc_ctrler = NULL;
         UpdatePDRTContactToRemote(callback_data.remote_ctc.node_id(),
                                   callback_data.remote_ctc.host_ip());
-        SendFindRpc(callback_data.remote_ctc, callback_data.data, REMOTE);
+        SendFindRpc(callback_data.remote_ctc, data, REMOTE);
         return;
       }
     }
   }
 
+  bool send_downlist(false), in_final_iteration(false);
   if (!is_valid || response->result() == kRpcResultFailure) {
-    SearchIteration_CancelActiveProbe(callback_data.remote_ctc,
-        callback_data.data);
     delete response;
     delete callback_data.rpc_ctrler;
     callback_data.rpc_ctrler = NULL;
-    if (callback_data.data->is_callbacked) {
-      if (callback_data.data->active_probes.empty() &&
-          callback_data.data->method != BOOTSTRAP) {
-        SendDownlist(callback_data.data);
-      }
-      return;
+    boost::mutex::scoped_lock guard(data->mutex);
+    SearchIteration_CancelActiveProbe(callback_data.remote_ctc, data);
+    if (data->is_callbacked) {
+      send_downlist = data->active_probes.empty() &&
+                      data->method != BOOTSTRAP;
     }
+    in_final_iteration = data->in_final_iteration;
   } else {
-    if (!is_joined_ && callback_data.data->method != BOOTSTRAP) {
+    if (!is_joined_ && data->method != BOOTSTRAP) {
       delete response;
       delete callback_data.rpc_ctrler;
       callback_data.rpc_ctrler = NULL;
       return;
     }
-    AddContact(callback_data.remote_ctc, callback_data.rpc_ctrler->rtt(),
-               false);
-    if (callback_data.data->is_callbacked) {
-      SearchIteration_CancelActiveProbe(callback_data.remote_ctc,
-                                        callback_data.data);
-      delete response;
-      delete callback_data.rpc_ctrler;
-      callback_data.rpc_ctrler = NULL;
-      if (callback_data.data->active_probes.empty() &&
-          callback_data.data->method != BOOTSTRAP) {
-        SendDownlist(callback_data.data);
+    AddRespondingContact(callback_data.remote_ctc, callback_data.rpc_ctrler);
+    Contact self_node(node_id_, host_ip_, host_port_, local_host_ip_,
+                      local_host_port_);
+    boost::mutex::scoped_lock guard(data->mutex);
+    SearchIteration_CancelActiveProbe(callback_data.remote_ctc, data);
+    if (data->is_callbacked) {
+      send_downlist = data->active_probes.empty() &&
+                      data->method != BOOTSTRAP;
+    } else {
+      // Mark this node as active
+      data->active_contacts.insert(std::pair<KadId, Contact>(
+          callback_data.remote_ctc.node_id() ^ data->key,
+          callback_data.remote_ctc));
+      // and as a candidate for a cached copy if it lacks the value
+      if (data->method == FIND_VALUE && response->values_size() == 0 &&
+          response->signed_values_size() == 0 &&
+          !response->has_alternative_value_holder()) {
+        data->no_value_contacts.insert(std::pair<KadId, Contact>(
+            callback_data.remote_ctc.node_id() ^ data->key,
+            callback_data.remote_ctc));
+      } else if (response->values_size() != 0 ||
+                 response->signed_values_size() != 0) {
+        boost::int32_t ttl(response->has_ttl() ? response->ttl() : 0);
+        if (data->values_ttl < 0 || (ttl >= 0 && ttl < data->values_ttl))
+          data->values_ttl = ttl;
       }
-      return;
-    }
 
-    // Mark this node as active
-    callback_data.data->active_contacts.push_back(callback_data.remote_ctc);
-
-    // extend the value list if there are any new values found
-    std::list<std::string>::iterator it1;
-    bool is_new;
-    for (int i = 0; i < response->values_size(); ++i) {
-      is_new = true;
-      for (it1 = callback_data.data->values_found.begin();
-           it1 != callback_data.data->values_found.end(); ++it1) {
-        if (*it1 == response->values(i)) {
-          is_new = false;
-          break;
+      // extend the value list if there are any new values found
+      std::list<std::string>::iterator it1;
+      bool is_new;
+      for (int i = 0; i < response->values_size(); ++i) {
+        is_new = true;
+        for (it1 = data->values_found.begin(); it1 != data->values_found.end();
+             ++it1) {
+          if (*it1 == response->values(i)) {
+            is_new = false;
+            break;
+          }
         }
-      }
-      if (is_new) {
-        callback_data.data->values_found.push_back(response->values(i));
-      }
-    }
-    std::list<kad::SignedValue>::iterator it_svals;
-    for (int i = 0; i < response->signed_values_size(); ++i) {
-      is_new = true;
-      for (it_svals = callback_data.data->sig_values_found.begin();
-           it_svals != callback_data.data->sig_values_found.end(); ++it_svals) {
-        if (it_svals->value() == response->signed_values(i).value() &&
-            it_svals->value_signature() ==
-              response->signed_values(i).value_signature()) {
-          is_new = false;
-          break;
+        if (is_new) {
+          data->values_found.push_back(response->values(i));
         }
       }
-      if (is_new) {
-        callback_data.data->sig_values_found.push_back(
-          response->signed_values(i));
-      }
-    }
-
-    // Now extend short list with the returned contacts
-    std::list<LookupContact>::iterator it2;
-    for (int i = 0; i < response->closest_nodes_size(); ++i) {
-      Contact test_contact;
-      if (!test_contact.ParseFromString(response->closest_nodes(i)))
-        continue;
-      // AddContact(test_contact, false);
-      is_new = true;
-      for (it2 = callback_data.data->short_list.begin();
-           it2 != callback_data.data->short_list.end(); ++it2) {
-        if (test_contact.Equals(it2->kad_contact)) {
-          is_new = false;
-          break;
+      std::list<kad::SignedValue>::iterator it_svals;
+      for (int i = 0; i < response->signed_values_size(); ++i) {
+        is_new = true;
+        for (it_svals = data->sig_values_found.begin();
+             it_svals != data->sig_values_found.end(); ++it_svals) {
+          if (it_svals->value() == response->signed_values(i).value() &&
+              it_svals->value_signature() ==
+                response->signed_values(i).value_signature()) {
+            is_new = false;
+            break;
+          }
         }
-      }
-      if (is_new) {
-        // add to the front
-        Contact self_node(node_id_, host_ip_, host_port_, local_host_ip_,
-                          local_host_port_);
-        if (!test_contact.Equals(self_node)) {
-          LookupContact ctc;
-          ctc.kad_contact = test_contact;
-          callback_data.data->short_list.push_front(ctc);
+        if (is_new) {
+          data->sig_values_found.push_back(response->signed_values(i));
         }
       }
-      // Implementation of downlist algorithm
-      // Add to the downlist as a candidate with the is_down flag set to false
-      // by default
-      struct DownListCandidate candidate;
-      candidate.node = test_contact;
-      candidate.is_down = false;
-      bool is_appended = false;
-      std::list<struct DownListData>::iterator it5;
-      for (it5 = callback_data.data->downlist.begin();
-           it5 != callback_data.data->downlist.end(); ++it5) {
-        if (it5->giver.Equals(callback_data.remote_ctc)) {
-          it5->candidate_list.push_back(candidate);
-          is_appended = true;
-          break;
+
+      // Now extend short list with the returned contacts
+      for (int i = 0; i < response->closest_nodes_size(); ++i) {
+        Contact test_contact;
+        if (!test_contact.ParseFromString(response->closest_nodes(i)))
+          continue;
+        if (!test_contact.Equals(self_node))
+          data->AddToShortList(test_contact);
+        // Implementation of downlist algorithm
+        // Add to the downlist as a candidate with the is_down flag set to false
+        // by default
+        struct DownListCandidate candidate;
+        candidate.node = test_contact;
+        candidate.is_down = false;
+        bool is_appended = false;
+        std::list<struct DownListData>::iterator it5;
+        for (it5 = data->downlist.begin(); it5 != data->downlist.end();
+             ++it5) {
+          if (it5->giver.Equals(callback_data.remote_ctc)) {
+            it5->candidate_list.push_back(candidate);
+            is_appended = true;
+            break;
+          }
         }
+        if (!is_appended) {
+          struct DownListData downlist_data;
+          downlist_data.giver = callback_data.remote_ctc;
+          downlist_data.candidate_list.push_back(candidate);
+          data->downlist.push_back(downlist_data);
+        }
+        // End of implementation downlist algorithm
       }
-      if (!is_appended) {
-        struct DownListData downlist_data;
-        downlist_data.giver = callback_data.remote_ctc;
-        downlist_data.candidate_list.push_back(candidate);
-        callback_data.data->downlist.push_back(downlist_data);
-      }
-      // End of implementation downlist algorithm
+      in_final_iteration = data->in_final_iteration;
     }
-    SearchIteration_CancelActiveProbe(callback_data.remote_ctc,
-                                      callback_data.data);
+    guard.unlock();
     delete callback_data.rpc_ctrler;
     callback_data.rpc_ctrler = NULL;
     delete response;
   }
-  if (callback_data.data->in_final_iteration) {
-    FinalIteration(callback_data.data);
+  if (send_downlist) {
+    SendDownlist(data);
+  } else if (in_final_iteration) {
+    FinalIteration(data);
   } else {
-    SearchIteration(callback_data.data);
+    SearchIteration(data);
   }
 }
 
 void KNodeImpl::SendFinalIteration(
     boost::shared_ptr<IterativeLookUpData> data) {
-  if (data->active_contacts.size() >= K_) {
-    if (!data->active_contacts.empty()) {
+  std::vector<Contact> pending_to_contact;
+  {
+    boost::mutex::scoped_lock guard(data->mutex);
+    if (data->active_contacts.size() >= K_) {
       // checking if the active probes are closer than the Kth closest node
-      std::list<Contact>::iterator it1;
-      std::list<Contact>::iterator it2 = data->active_contacts.begin();
-      for (int i = 1; i < K_; ++i)
-        ++it2;
-      ContactAndTargetKey kth_contact;
-      kth_contact.contact = *it2;
-      kth_contact.target_key = data->key;
-      activeprobes_mutex_.lock();
-      for (it1 = data->active_probes.begin(); it1 != data->active_probes.end();
-          ++it1) {
-        ContactAndTargetKey active_ctc;
-        active_ctc.contact = *it1;
-        active_ctc.target_key = data->key;
-        if (CompareContact(active_ctc, kth_contact)) {
-          activeprobes_mutex_.unlock();
+      std::map<KadId, Contact>::iterator kth_contact =
+          data->active_contacts.begin();
+      std::advance(kth_contact, K_ - 1);
+      std::list<Contact>::iterator it;
+      for (it = data->active_probes.begin(); it != data->active_probes.end();
+           ++it) {
+        if ((it->node_id() ^ data->key) < kth_contact->first)
           return;
+      }
+    } else {
+      if (data->in_final_iteration)
+        return;
+      size_t rpc_to_send = K_ - data->active_contacts.size();
+      data->in_final_iteration = true;
+      std::map<KadId, LookupContact>::iterator it;
+      for (it = data->short_list.begin(); it != data->short_list.end() &&
+           pending_to_contact.size() < rpc_to_send; ++it) {
+        if (!it->second.contacted) {
+          data->active_probes.push_back(it->second.kad_contact);
+          it->second.contacted = true;
+          pending_to_contact.push_back(it->second.kad_contact);
         }
       }
-      activeprobes_mutex_.unlock();
-    }
-    SearchIteration_Callback(data);
-    return;
-  }
-  if (data->in_final_iteration)
-    return;
-  int rpc_to_send = K_ - data->active_contacts.size();
-  int contacted = 0;
-  std::vector<Contact> pending_to_contact;
-  data->in_final_iteration = true;
-  std::list<LookupContact>::iterator it;
-  for (it = data->short_list.begin(); it != data->short_list.end() &&
-       contacted < rpc_to_send; ++it) {
-    if (!it->contacted) {
-      Contact remote;
-      remote = it->kad_contact;
-      data->active_probes.push_back(remote);
-      it->contacted = true;
-      ++contacted;
-      pending_to_contact.push_back(remote);
     }
   }
-  if (contacted == 0) {
+  if (pending_to_contact.empty())
     SearchIteration_Callback(data);
-  } else {
-    for (unsigned int i = 0; i < pending_to_contact.size(); ++i) {
-      ConnectionType conn_type = CheckContactLocalAddress(
-          pending_to_contact[i].node_id(), pending_to_contact[i].local_ip(),
-          pending_to_contact[i].local_port(), pending_to_contact[i].host_ip());
-      SendFindRpc(pending_to_contact[i], data, conn_type);
-    }
-  }
+  else
+    SendFindRpcs(pending_to_contact, data);
 }
 
 void KNodeImpl::FinalIteration(boost::shared_ptr<IterativeLookUpData> data) {
-  if ((data->is_callbacked)||(!is_joined_ && data->method != BOOTSTRAP))
-    return;
-
-  activeprobes_mutex_.lock();
-  if (!data->active_probes.empty()) {
-    activeprobes_mutex_.unlock();
-    return;
-  }
-  activeprobes_mutex_.unlock();
-
-  // sort the active contacts
-  SortContactList(data->key, &data->active_contacts);
-  // check whether thare are any closer nodes
-  SortLookupContact(data->key, &data->short_list);
-
-  // check if there are closer nodes than the ones already seen and send the rpc
-  int contacted = 0;
-  std::list<LookupContact>::iterator it;
-  ContactAndTargetKey last_active;
-  last_active.contact = data->active_contacts.back();
-  last_active.target_key = data->key;
-  for (it = data->short_list.begin(); it != data->short_list.end(); ++it) {
-    if (!it->contacted) {
-      ContactAndTargetKey notcontated;
-      notcontated.contact = it->kad_contact;
-      notcontated.target_key = data->key;
-      if (CompareContact(notcontated, last_active)) {
-        Contact remote;
-        remote = it->kad_contact;
-        data->active_probes.push_back(remote);
-        ConnectionType conn_type = CheckContactLocalAddress(remote.node_id(),
-                                                            remote.local_ip(),
-                                                            remote.local_port(),
-                                                            remote.host_ip());
-        SendFindRpc(remote, data, conn_type);
-        it->contacted = true;
-        ++contacted;
+  if (!is_joined_ && data->method != BOOTSTRAP)
+    return;
+  std::vector<Contact> pending_to_contact;
+  {
+    boost::mutex::scoped_lock guard(data->mutex);
+    if (data->is_callbacked || !data->active_probes.empty())
+      return;
+    // check if there are closer nodes than the ones already seen and send the
+    // rpc
+    if (!data->active_contacts.empty()) {
+      const KadId &last_active = data->active_contacts.rbegin()->first;
+      std::map<KadId, LookupContact>::iterator it;
+      for (it = data->short_list.begin();
+           it != data->short_list.end() && it->first < last_active; ++it) {
+        if (!it->second.contacted) {
+          data->active_probes.push_back(it->second.kad_contact);
+          it->second.contacted = true;
+          pending_to_contact.push_back(it->second.kad_contact);
+        }
       }
     }
   }
-  if (contacted == 0) {
+  if (pending_to_contact.empty())
     SearchIteration_Callback(data);
-  }
+  else
+    SendFindRpcs(pending_to_contact, data);
 }
 
 void KNodeImpl::SearchIteration_CancelActiveProbe(
@@ -2047,129 +2653,122 @@ void KNodeImpl::SearchIteration_CancelActiveProbe(
   if (!is_joined_ && data->method != BOOTSTRAP)
     return;
   std::list<Contact>::iterator it;
-
-  activeprobes_mutex_.lock();
   for (it = data->active_probes.begin(); it != data->active_probes.end();
        ++it) {
-    if (sender.Equals(*it) && !data->active_probes.empty()) {
+    if (sender.Equals(*it)) {
       data->active_probes.erase(it);
       break;
     }
   }
-  std::list<Contact>::iterator it1;
-  for (it1 = data->current_alpha.begin(); it1 != data->current_alpha.end();
-       ++it1) {
-    if (sender.node_id() == data->key)
-      data->wait_for_key = false;
-    if (sender.Equals(*it1) && !data->current_alpha.empty()) {
-      data->current_alpha.erase(it1);
+  if (!data->current_alpha.empty() && sender.node_id() == data->key)
+    data->wait_for_key = false;
+  for (it = data->current_alpha.begin(); it != data->current_alpha.end();
+       ++it) {
+    if (sender.Equals(*it)) {
+      data->current_alpha.erase(it);
       break;
     }
   }
-  activeprobes_mutex_.unlock();
 }
 
 void KNodeImpl::SearchIteration_Callback(
     boost::shared_ptr<IterativeLookUpData> data) {
-  std::string ser_result;
-  // If we're bootstrapping, we are only now finished.  In this case the
-  // callback should be of type base::GeneralResponse
-  if (data->is_callbacked)
-    return;
-  data->is_callbacked = true;
-  if (data->method == BOOTSTRAP) {
-    base::GeneralResponse result;
-    if (data->active_contacts.empty()) {
-      // no active contacts
-      result.set_result(kRpcResultFailure);
-      is_joined_ = false;
-    } else {
-      result.set_result(kRpcResultSuccess);
-      if (!is_joined_) {
-        is_joined_ = true;
-        premote_service_->set_node_joined(true);
-        premote_service_->set_node_info(contact_info());
-        addcontacts_routine_.reset(new boost::thread(
-            &KNodeImpl::CheckAddContacts, this));
-        // start a schedule to delete expired key/value pairs only once
-        if (!refresh_routine_started_) {
-          ptimer_->AddCallLater(kRefreshTime * 1000,
-                                boost::bind(&KNodeImpl::RefreshRoutine, this));
-          ptimer_->AddCallLater(2000,
-                                boost::bind(&KNodeImpl::RefreshValuesRoutine,
-                                            this));
-          refresh_routine_started_ = true;
-        }
-      }
-    }
-    result.SerializeToString(&ser_result);
-  } else {
-    if (!is_joined_)
+  FindValueResult result;
+  boost::uint64_t hits(0), misses(0);
+  boost::int32_t cache_copy_ttl(0), values_ttl(0);
+  {
+    boost::mutex::scoped_lock guard(data->mutex);
+    if (data->is_callbacked)
       return;
-    // take K closest contacts from active contacts as the closest nodes
-    std::list<Contact>::iterator it1;
-    int count;
-    FindResponse result;
-    if (data->method == FIND_VALUE &&
-        !data->alternative_value_holder.node_id().empty()) {
-      result.set_result(kRpcResultSuccess);
-      *result.mutable_alternative_value_holder() =
-          data->alternative_value_holder;
-    } else if (data->method == FIND_VALUE && (!data->values_found.empty() ||
-               !data->sig_values_found.empty())) {
-      result.set_result(kRpcResultSuccess);
-      for (std::list<std::string>::iterator it2 = data->values_found.begin();
-           it2 != data->values_found.end(); ++it2) {
-        result.add_values(*it2);
-      }
-      for (std::list<SignedValue>::iterator it2 =
-           data->sig_values_found.begin(); it2 != data->sig_values_found.end();
-           ++it2) {
-        SignedValue *svalue = result.add_signed_values();
-        *svalue = *it2;
-      }
+    data->is_callbacked = true;
+    if (data->method == BOOTSTRAP) {
+      // If we're bootstrapping, we are only now finished.
+      result.succeeded = !data->active_contacts.empty();
     } else {
-      for (it1 = data->active_contacts.begin(), count = 0;
-           it1 != data->active_contacts.end() && count < K_; ++it1, ++count) {
-        std::string ser_contact;
-        // Adding contact info of nodes contacted in the iterative search
-        // the nodes are ordered from closest to furthest away from the key/node
-        // id searched
-        if (it1->SerialiseToString(&ser_contact))
-          result.add_closest_nodes(ser_contact);
+      if (!is_joined_)
+        return;
+      if (data->method == FIND_VALUE &&
+          !data->alternative_value_holder.node_id().empty()) {
+        result.succeeded = true;
+        result.alternative_value_holder = data->alternative_value_holder;
+      } else if (data->method == FIND_VALUE && (!data->values_found.empty() ||
+                 !data->sig_values_found.empty())) {
+        result.succeeded = true;
+        result.values.assign(data->values_found.begin(),
+                             data->values_found.end());
+        result.signed_values.assign(data->sig_values_found.begin(),
+                                    data->sig_values_found.end());
+      } else {
+        // take K closest contacts from active contacts as the closest nodes,
+        // ordered from closest to furthest away from the key/node id searched
+        std::map<KadId, Contact>::iterator it1;
+        int count;
+        for (it1 = data->active_contacts.begin(), count = 0;
+             it1 != data->active_contacts.end() && count < K_;
+             ++it1, ++count) {
+          result.closest_nodes.push_back(it1->second);
+        }
+        result.succeeded =
+            !result.closest_nodes.empty() && data->method == FIND_NODE;
       }
-      if (result.closest_nodes_size() > 0 && data->method == FIND_NODE)
-        result.set_result(kRpcResultSuccess);
-      else
-        result.set_result(kRpcResultFailure);
-    }
-
-    // Add the last seen contact that didn't reply with the value from the
-    // alternative store to to the alternative_value_holder field.
-    if (data->method == FIND_VALUE) {
-      boost::mutex::scoped_lock lock(activeprobes_mutex_);
-      std::list<Contact>::iterator itr = data->current_alpha.begin();
-      while (itr != data->current_alpha.end()) {
-        if (itr->node_id().String()
-            != data->alternative_value_holder.node_id()) {
-          std::string ser_contact;
-          if (itr->SerialiseToString(&ser_contact))
-            result.set_needs_cache_copy(ser_contact);
-          break;
+
+      if (data->method == FIND_VALUE) {
+        // The closest node which answered without the value gets a cached
+        // copy.
+        if (!result.values.empty() || !result.signed_values.empty()) {
+          ++hits;
+          if (!data->no_value_contacts.empty()) {
+            std::map<KadId, Contact>::iterator holder =
+                data->no_value_contacts.begin();
+            result.needs_cache_copy = true;
+            result.cache_copy_holder = holder->second;
+            size_t closer(std::distance(data->active_contacts.begin(),
+                data->active_contacts.lower_bound(holder->first)));
+            cache_copy_ttl = CacheCopyTtl(closer, data->values_ttl);
+          }
+          values_ttl = data->values_ttl;
+        } else if (result.alternative_value_holder.node_id().empty()) {
+          ++misses;
+        } else {
+          ++hits;
         }
-        ++itr;
       }
     }
-
-    result.SerializeToString(&ser_result);
   }
-  data->callback(ser_result);
-  activeprobes_mutex_.lock();
-  if (!data->active_probes.empty()) {
-    activeprobes_mutex_.unlock();
-    return;
+  if (hits != 0 || misses != 0) {
+    boost::mutex::scoped_lock guard(path_cache_mutex_);
+    path_cache_stats_.hits += hits;
+    path_cache_stats_.misses += misses;
+  }
+  if (data->method == BOOTSTRAP) {
+    if (!result.succeeded) {
+      is_joined_ = false;
+    } else if (!is_joined_) {
+      is_joined_ = true;
+      premote_service_->set_node_joined(true);
+      premote_service_->set_node_info(contact_info());
+      addcontacts_routine_.reset(new boost::thread(
+          &KNodeImpl::CheckAddContacts, this));
+      // start a schedule to delete expired key/value pairs only once
+      if (!refresh_routine_started_) {
+        ptimer_->AddCallLater(kRefreshTime * 1000,
+                              boost::bind(&KNodeImpl::RefreshRoutine, this));
+        ptimer_->AddCallLater(2000,
+                              boost::bind(&KNodeImpl::RefreshValuesRoutine,
+                                          this));
+        refresh_routine_started_ = true;
+      }
+    }
+  }
+  value_cache_.Add(data->key, result, values_ttl);
+  if (result.needs_cache_copy)
+    SendCacheCopy(data->key, result, cache_copy_ttl);
+  data->callback(result);
+  {
+    boost::mutex::scoped_lock guard(data->mutex);
+    if (!data->active_probes.empty())
+      return;
   }
-  activeprobes_mutex_.unlock();
   SendDownlist(data);
 }
 
@@ -2177,6 +2776,7 @@ void KNodeImpl::SendDownlist(boost::shared_ptr<IterativeLookUpData> data) {
   // Implementation of downlist algorithm
   // At the end of the search the corresponding entries of the downlist are sent
   // to all peers which gave those entries to this node during its search
+  boost::mutex::scoped_lock guard(data->mutex);
   if (data->downlist_sent || !is_joined_) return;
   if (data->dead_ids.empty()) {
     data->downlist_sent = true;
@@ -2217,7 +2817,7 @@ void KNodeImpl::SendDownlist(boost::shared_ptr<IterativeLookUpData> data) {
         rendezvous_port = it1->giver.rendezvous_port();
       }
       DownlistResponse *resp = new DownlistResponse;
-      rpcprotocol::Controller *ctrl = new rpcprotocol::Controller;
+      rpcprotocol::Controller *ctrl = NewController(it1->giver.node_id());
       google::protobuf::Closure *done = google::protobuf::NewCallback
           <DownlistResponse*, rpcprotocol::Controller*>
           (&dummy_downlist_callback, resp, ctrl);
@@ -2250,161 +2850,195 @@ boost::int32_t KNodeImpl::KeyValueTTL(const KadId &key,
   return pdata_store_->TimeToLive(key.String(), value);
 }
 
-void KNodeImpl::RefreshValue(const KadId &key, const std::string &value,
-                             const boost::int32_t &ttl,
-                             VoidFunctorOneString callback) {
+bool KNodeImpl::SetDataStoreDirectory(const std::string &directory) {
+  if (is_joined_ || directory.empty())
+    return false;
+  boost::shared_ptr<DataStoreBackend> backend(
+      new LogDataStoreBackend(directory));
+  boost::shared_ptr<DataStore> data_store(new DataStore(refresh_time_,
+                                                        backend));
+  if (!data_store->Open())
+    return false;
+  pdata_store_ = data_store;
+  return true;
+}
+
+void KNodeImpl::RefreshValuesRoutine() {
   if (!is_joined_ || !refresh_routine_started_  || stopping_)
     return;
-  SignedRequest sreq;
-  SignedValue svalue;
+  std::vector<refresh_value> values = pdata_store_->ValuesToRefresh();
+  boost::shared_ptr<RefreshValuesData> data(new RefreshValuesData);
+  for (size_t i = 0; i < values.size(); ++i) {
+    switch (values[i].del_status_) {
+      case NOT_DELETED: data->pending_keys[values[i].key_].push_back(values[i]);
+                        break;
+      case MARKED_FOR_DELETION: pdata_store_->MarkAsDeleted(values[i].key_,
+                                                            values[i].value_);
+                                break;
+      case DELETED: pdata_store_->DeleteItem(values[i].key_, values[i].value_);
+                    break;
+    }
+  }
+  if (data->pending_keys.empty()) {
+    ptimer_->AddCallLater(2000, boost::bind(&KNodeImpl::RefreshValuesRoutine,
+                                            this));
+    return;
+  }
   if (HasRSAKeys()) {
     crypto::Crypto cobj;
     cobj.set_hash_algorithm(crypto::SHA_512);
-    if (!svalue.ParseFromString(value))
-      return;
-    sreq.set_signer_id(node_id_.String());
-    sreq.set_public_key(public_key_);
-    sreq.set_signed_public_key(cobj.AsymSign(public_key_, "", private_key_,
-                               crypto::STRING_STRING));
-    sreq.set_signed_request(cobj.AsymSign(
-        cobj.Hash(public_key_ + sreq.signed_public_key() + key.String(), "",
-                  crypto::STRING_STRING, true),
-        "", private_key_, crypto::STRING_STRING));
-    FindKClosestNodes(key, boost::bind(&KNodeImpl::StoreValue_ExecuteStoreRPCs,
-                                       this, _1, key, "", svalue, sreq, false,
-                                       ttl, callback));
-  } else {
-    FindKClosestNodes(key, boost::bind(&KNodeImpl::StoreValue_ExecuteStoreRPCs,
-                                       this, _1, key, value, svalue, sreq,
-                                       false, ttl, callback));
+    data->signed_public_key = cobj.AsymSign(public_key_, "", private_key_,
+                                            crypto::STRING_STRING);
   }
+  RefreshNextKeys(data);
 }
 
-void KNodeImpl::RefreshValueCallback(
-    const std::string &result, const KadId &key, const std::string &value,
-    const boost::int32_t &ttl,
-    boost::shared_ptr<boost::uint32_t> refreshes_done,
-    const boost::uint32_t &total_refreshes) {
+void KNodeImpl::RefreshNextKeys(boost::shared_ptr<RefreshValuesData> data) {
   if (!is_joined_ || !refresh_routine_started_  || stopping_)
     return;
-  StoreResponse refresh_result;
-  if (!refresh_result.ParseFromString(result) ||
-      refresh_result.result() == kRpcResultSuccess ||
-      !refresh_result.has_signed_request())
-    RefreshValueLocal(key, value, ttl);
-  ++(*refreshes_done);
-  if (total_refreshes == *refreshes_done) {
+  if (data->pending_keys.empty()) {
+    // Finished this run
     ptimer_->AddCallLater(2000, boost::bind(&KNodeImpl::RefreshValuesRoutine,
                                             this));
+    return;
   }
+  boost::shared_ptr< std::vector<refresh_value> > values(
+      new std::vector<refresh_value>);
+  std::vector<BatchStoreEntry> entries;
+  NextRefreshEntries(data.get(), &entries, values.get());
+  boost::shared_ptr<BatchStoreData> batch(new BatchStoreData(entries, false,
+      boost::bind(&KNodeImpl::RefreshValuesCallback, this, _1, values, data)));
+  StoreBatch_FindNodes(batch);
 }
 
-void KNodeImpl::RefreshValuesRoutine() {
-  if (is_joined_ && refresh_routine_started_  && !stopping_) {
-    std::vector<refresh_value> values = pdata_store_->ValuesToRefresh();
-    if (values.empty()) {
-      ptimer_->AddCallLater(2000, boost::bind(&KNodeImpl::RefreshValuesRoutine,
-                                              this));
-    } else  {
-      boost::shared_ptr<boost::uint32_t> refreshes_done(new boost::uint32_t(0));
-      // *refreshes_done = 0;
-      for (size_t i = 0; i < values.size(); ++i) {
-        KadId id_key;
-        switch (values[i].del_status_) {
-          case NOT_DELETED: id_key = KadId(values[i].key_);
-                            RefreshValue(
-                                id_key, values[i].value_, values[i].ttl_,
-                                boost::bind(&KNodeImpl::RefreshValueCallback,
-                                            this, _1, id_key, values[i].value_,
-                                            values[i].ttl_, refreshes_done,
-                                            values.size()));
-                            break;
-         case MARKED_FOR_DELETION: pdata_store_->MarkAsDeleted(
-                                     values[i].key_, values[i].value_);
-                                   break;
-         case DELETED: pdata_store_->DeleteItem(values[i].key_,
-                                                values[i].value_);
-                       break;
-        }
+void KNodeImpl::NextRefreshEntries(RefreshValuesData *data,
+                                   std::vector<BatchStoreEntry> *entries,
+                                   std::vector<refresh_value> *values) {
+  crypto::Crypto cobj;
+  cobj.set_hash_algorithm(crypto::SHA_512);
+  for (boost::uint16_t n = 0; n < kRefreshKeysInFlight &&
+       !data->pending_keys.empty(); ++n) {
+    const std::string &key(data->pending_keys.begin()->first);
+    const std::vector<refresh_value> &key_values(
+        data->pending_keys.begin()->second);
+    SignedRequest sreq;
+    if (HasRSAKeys()) {
+      // One signed request for all the values of the key
+      sreq.set_signer_id(node_id_.String());
+      sreq.set_public_key(public_key_);
+      sreq.set_signed_public_key(data->signed_public_key);
+      crypto::HashContext request_hash(crypto::SHA_512);
+      request_hash.Update(public_key_);
+      request_hash.Update(data->signed_public_key);
+      request_hash.Update(key);
+      std::string hex_hash(request_hash.Final(true));
+      sreq.set_signed_request(cobj.AsymSign(hex_hash.data(), hex_hash.size(),
+                                            private_key_));
+    }
+    // The run's values were read when it started; leave out any deleted since,
+    // as refreshing them would store them again.
+    std::vector<std::string> live_values;
+    pdata_store_->LoadItem(key, &live_values);
+    for (size_t i = 0; i < key_values.size(); ++i) {
+      if (std::find(live_values.begin(), live_values.end(),
+                    key_values[i].value_) == live_values.end())
+        continue;
+      BatchStoreEntry entry;
+      entry.set_key(key);
+      entry.set_ttl(key_values[i].ttl_);
+      if (HasRSAKeys()) {
+        // Leave out any value which isn't a valid SignedValue
+        if (!entry.mutable_sig_value()->ParseFromString(key_values[i].value_))
+          continue;
+        *entry.mutable_signed_request() = sreq;
+      } else {
+        entry.set_value(key_values[i].value_);
       }
+      entries->push_back(entry);
+      values->push_back(key_values[i]);
     }
+    data->pending_keys.erase(data->pending_keys.begin());
   }
 }
 
-void KNodeImpl::DeleteValue(const KadId &key, const SignedValue &signed_value,
-                            const SignedRequest &signed_request,
-                            VoidFunctorOneString callback) {
+void KNodeImpl::RefreshValuesCallback(
+    const std::vector<StoreValueResult> &results,
+    boost::shared_ptr< std::vector<refresh_value> > values,
+    boost::shared_ptr<RefreshValuesData> data) {
+  if (!is_joined_ || !refresh_routine_started_  || stopping_)
+    return;
+  for (size_t i = 0; i < results.size() && i < values->size(); ++i) {
+    if (results[i].succeeded || !results[i].signed_request.IsInitialized()) {
+      RefreshValueLocal(KadId(values->at(i).key_), values->at(i).value_,
+                        values->at(i).ttl_);
+      continue;
+    }
+    // The value has been deleted.  The other nodes got the refresh at the same
+    // time, and any which had already dropped the value stored it again, so
+    // pass the delete on to them.
+    SignedValue sig_value;
+    if (sig_value.ParseFromString(values->at(i).value_))
+      Delete(KadId(values->at(i).key_), sig_value, results[i].signed_request,
+             boost::bind(&IgnoreDeleteResult, _1));
+  }
+  RefreshNextKeys(data);
+}
+
+void KNodeImpl::Delete(const KadId &key, const SignedValue &signed_value,
+                       const SignedRequest &signed_request,
+                       VoidFunctorOneBool callback) {
   if (!signed_value.IsInitialized() || !signed_request.IsInitialized()) {
-    DeleteResponse resp;
-    resp.set_result(kad::kRpcResultFailure);
-    std::string ser_resp(resp.SerializeAsString());
-    callback(ser_resp);
+    callback(false);
     return;
   }
-  FindKClosestNodes(key, boost::bind(&KNodeImpl::DelValue_ExecuteDeleteRPCs,
-                                     this, _1, key, signed_value,
-                                     signed_request, callback));
+  value_cache_.Remove(key);
+  VoidFunctorOneBool deleted(boost::bind(&KNodeImpl::ValueChanged_Callback,
+                                         this, _1, key, callback));
+  CachedFindNodes(key, boost::bind(&KNodeImpl::DelValue_ExecuteDeleteRPCs,
+                                   this, _1, key, signed_value, signed_request,
+                                   deleted));
 }
 
-void KNodeImpl::DelValue_ExecuteDeleteRPCs(const std::string &result,
+void KNodeImpl::DeleteValue(const KadId &key, const SignedValue &signed_value,
+                            const SignedRequest &signed_request,
+                            VoidFunctorOneString callback) {
+  Delete(key, signed_value, signed_request,
+         boost::bind(&SerialiseDeleteResult, _1, callback));
+}
+
+void KNodeImpl::DelValue_ExecuteDeleteRPCs(const FindNodesResult &result,
                                            const KadId &key,
                                            const SignedValue &value,
                                            const SignedRequest &sig_req,
-                                           VoidFunctorOneString callback) {
+                                           VoidFunctorOneBool callback) {
   if (!is_joined_)
     return;
-  // validate the result
-  bool is_valid = true;
-  FindResponse result_msg;
-  if (!result_msg.ParseFromString(result)) {
-    is_valid = false;
-  } else if (result_msg.closest_nodes_size() == 0) {
-    is_valid = false;
-  }
-  if ((is_valid) || (result_msg.result() == kRpcResultSuccess)) {
-    std::vector<Contact> closest_nodes;
-    for (int i = 0; i < result_msg.closest_nodes_size(); ++i) {
-      Contact node;
-      node.ParseFromString(result_msg.closest_nodes(i));
-      closest_nodes.push_back(node);
-    }
-    if (closest_nodes.size() > 0) {
-      bool deleted_local(false);
-      if (type_ != CLIENT) {
-        // Try to delete value from node
-        if (DelValueLocal(key, value, sig_req))
-          deleted_local = true;
-      }
-      boost::shared_ptr<IterativeDelValueData>
-          data(new struct IterativeDelValueData(closest_nodes, key, value,
-              sig_req, callback));
-      if (deleted_local)
-        ++data->del_nodes;
-      // decide the parallel level
-      int parallel_size;
-      if (data->closest_nodes.size() > alpha_)
-        parallel_size = alpha_;
-      else
-        parallel_size = data->closest_nodes.size();
-      for (int i = 0; i< parallel_size; ++i) {
-        DeleteCallbackArgs callback_args(data);
-        DelValue_IterativeDeleteValue(NULL, callback_args);
-      }
-      return;
-    }
-    DeleteResponse local_result;
-    local_result.set_result(kRpcResultFailure);
-    std::string local_result_str(local_result.SerializeAsString());
-    callback(local_result_str);
+  if (result.closest_nodes.empty()) {
+    callback(false);
     DLOG(WARNING) << "KNodeImpl::DelValue_ExecuteDeleteRPCs - No nodes."
                   << std::endl;
-  } else {
-    DeleteResponse local_result;
-    local_result.set_result(kRpcResultFailure);
-    std::string local_result_str(local_result.SerializeAsString());
-    callback(local_result_str);
-    DLOG(WARNING) << "KNodeImpl::DelValue_ExecuteDeleteRPCs - Invalid or fail."
-                  << std::endl;
+    return;
+  }
+  bool deleted_local(false);
+  if (type_ != CLIENT) {
+    // Try to delete value from node
+    if (DelValueLocal(key, value, sig_req))
+      deleted_local = true;
+  }
+  boost::shared_ptr<IterativeDelValueData>
+      data(new struct IterativeDelValueData(result.closest_nodes, key, value,
+          sig_req, callback));
+  if (deleted_local)
+    ++data->del_nodes;
+  // decide the parallel level
+  int parallel_size;
+  if (data->closest_nodes.size() > alpha_)
+    parallel_size = alpha_;
+  else
+    parallel_size = data->closest_nodes.size();
+  for (int i = 0; i< parallel_size; ++i) {
+    DeleteCallbackArgs callback_args(data);
+    DelValue_IterativeDeleteValue(NULL, callback_args);
   }
 }
 
@@ -2472,8 +3106,7 @@ void KNodeImpl::DelValue_IterativeDeleteValue(
       if (response->result() == kRpcResultSuccess) {
         ++callback_data.data->del_nodes;
       }
-      AddContact(callback_data.remote_ctc, callback_data.rpc_ctrler->rtt(),
-          false);
+      AddRespondingContact(callback_data.remote_ctc, callback_data.rpc_ctrler);
     } else {
       // it has timeout
       RemoveContact(callback_data.remote_ctc.node_id());
@@ -2487,21 +3120,16 @@ void KNodeImpl::DelValue_IterativeDeleteValue(
   if (callback_data.data->contacted_nodes >=
       callback_data.data->closest_nodes.size()) {
     // Finish storing
-    DeleteResponse del_value_result;
     boost::uint32_t d(static_cast<boost::uint32_t>
       (K_ * kMinSuccessfulPecentageStore));
-    if (callback_data.data->del_nodes >= d) {
-      // Succeeded - min. number of copies were stored
-      del_value_result.set_result(kRpcResultSuccess);
-    } else {
-      del_value_result.set_result(kRpcResultFailure);
+    bool succeeded(callback_data.data->del_nodes >= d);
+    if (!succeeded) {
       DLOG(ERROR) << "Successful Delete rpc's " << callback_data.data->del_nodes
                   << std::endl << "Successful Delete rpc's required "
                   << K_ * kMinSuccessfulPecentageStore << std::endl;
     }
-    std::string del_value_result_str(del_value_result.SerializeAsString());
     callback_data.data->is_callbacked = true;
-    callback_data.data->callback(del_value_result_str);
+    callback_data.data->callback(succeeded);
   } else {
     // Continues...
     // send RPC to this contact
@@ -2513,7 +3141,7 @@ void KNodeImpl::DelValue_IterativeDeleteValue(
     DeleteResponse *resp = new DeleteResponse;
     DeleteCallbackArgs callback_args(callback_data.data);
     callback_args.remote_ctc = next_node;
-    callback_args.rpc_ctrler = new rpcprotocol::Controller;
+    callback_args.rpc_ctrler = NewController(next_node.node_id());
 
     ConnectionType conn_type = CheckContactLocalAddress(next_node.node_id(),
                                                         next_node.local_ip(),
@@ -2543,62 +3171,55 @@ void KNodeImpl::DelValue_IterativeDeleteValue(
   }
 }
 
+void KNodeImpl::Update(const KadId &key, const SignedValue &old_value,
+                       const SignedValue &new_value,
+                       const SignedRequest &signed_request,
+                       boost::uint32_t ttl, VoidFunctorOneBool callback) {
+  if (!old_value.IsInitialized() || !new_value.IsInitialized() ||
+      !signed_request.IsInitialized()) {
+    callback(false);
+    DLOG(WARNING) << "KNodeImpl::Update - uninitialised values or request"
+                  << std::endl;
+    return;
+  }
+  value_cache_.Remove(key);
+  VoidFunctorOneBool updated(boost::bind(&KNodeImpl::ValueChanged_Callback,
+                                         this, _1, key, callback));
+  CachedFindNodes(key, boost::bind(&KNodeImpl::ExecuteUpdateRPCs, this, _1,
+                                   key, old_value, new_value, signed_request,
+                                   ttl, updated));
+}
+
 void KNodeImpl::UpdateValue(const KadId &key,
                             const SignedValue &old_value,
                             const SignedValue &new_value,
                             const SignedRequest &signed_request,
                             boost::uint32_t ttl,
                             VoidFunctorOneString callback) {
-  if (!old_value.IsInitialized() || !new_value.IsInitialized() ||
-      !signed_request.IsInitialized()) {
-    DeleteResponse resp;
-    resp.set_result(kad::kRpcResultFailure);
-    std::string ser_resp(resp.SerializeAsString());
-    callback(ser_resp);
-    DLOG(WARNING) << "KNodeImpl::UpdateValue - uninitialised values or request"
-                  << std::endl;
-    return;
-  }
-  FindKClosestNodes(key, boost::bind(&KNodeImpl::ExecuteUpdateRPCs,
-                                     this, _1, key, old_value, new_value,
-                                     signed_request, ttl, callback));
+  Update(key, old_value, new_value, signed_request, ttl,
+         boost::bind(&SerialiseUpdateResult, _1, callback));
 }
 
-void KNodeImpl::ExecuteUpdateRPCs(const std::string &result,
+void KNodeImpl::ExecuteUpdateRPCs(const FindNodesResult &result,
                                   const KadId &key,
                                   const SignedValue &old_value,
                                   const SignedValue &new_value,
                                   const SignedRequest &sig_req,
                                   boost::uint32_t ttl,
-                                  VoidFunctorOneString callback) {
+                                  VoidFunctorOneBool callback) {
   if (!is_joined_)
     return;
 
-  FindResponse result_msg;
-  if (!result_msg.ParseFromString(result) ||
-      result_msg.closest_nodes_size() == 0 ||
-      result_msg.result() != kRpcResultSuccess) {
-    DeleteResponse resp;
-    resp.set_result(kad::kRpcResultFailure);
-    std::string ser_resp(resp.SerializeAsString());
-    callback(ser_resp);
+  if (!result.succeeded || result.closest_nodes.empty()) {
+    callback(false);
     DLOG(WARNING) << "KNodeImpl::ExecuteUpdateRPCs - failed find nodes"
                   << std::endl;
     return;
   }
 
-  std::vector<Contact> closest_nodes;
-  for (int i = 0; i < result_msg.closest_nodes_size(); ++i) {
-    Contact node;
-    if (node.ParseFromString(result_msg.closest_nodes(i)))
-      closest_nodes.push_back(node);
-  }
-
+  const std::vector<Contact> &closest_nodes(result.closest_nodes);
   if (closest_nodes.size() < size_t(kMinSuccessfulPecentageStore * K_)) {
-    DeleteResponse resp;
-    resp.set_result(kad::kRpcResultFailure);
-    std::string ser_resp(resp.SerializeAsString());
-    callback(ser_resp);
+    callback(false);
     DLOG(WARNING) << "KNodeImpl::ExecuteUpdateRPCs - Not enough nodes"
                   << std::endl;
     return;
@@ -2616,7 +3237,7 @@ void KNodeImpl::ExecuteUpdateRPCs(const std::string &result,
     uca->response = new UpdateResponse;
     UpdatePDRTContactToRemote(closest_nodes[n].node_id(),
                               closest_nodes[n].host_ip());
-    uca->controller = new rpcprotocol::Controller;
+    uca->controller = NewController(uca->contact.node_id());
     google::protobuf::Closure *done = google::protobuf::NewCallback
                                       <KNodeImpl,
                                        boost::shared_ptr<UpdateCallbackArgs> >
@@ -2655,7 +3276,7 @@ void KNodeImpl::UpdateValueResponses(
       if (uca->uvd->retries < 1) {
         ++uca->uvd->retries;
         uca->response = new UpdateResponse;
-        uca->controller = new rpcprotocol::Controller;
+        uca->controller = NewController(uca->contact.node_id());
         google::protobuf::Closure *done;
         done = google::protobuf::NewCallback
                <KNodeImpl, boost::shared_ptr<UpdateCallbackArgs> >
@@ -2675,7 +3296,7 @@ void KNodeImpl::UpdateValueResponses(
       }
     // The RPC came back successfully
     } else {
-      AddContact(uca->contact, uca->controller->rtt(), false);
+      AddRespondingContact(uca->contact, uca->controller);
       ++uca->uvd->uvd_calledback;
       ++uca->uvd->uvd_succeeded;
     }
@@ -2685,20 +3306,14 @@ void KNodeImpl::UpdateValueResponses(
   delete uca->controller;
 
   if (uca->uvd->uvd_calledback == uca->uvd->found_nodes) {
-    UpdateResponse update_result;
-    if (uca->uvd->uvd_succeeded <
-        boost::uint8_t(K_ * kMinSuccessfulPecentageStore)) {
+    bool succeeded(uca->uvd->uvd_succeeded >=
+                   boost::uint8_t(K_ * kMinSuccessfulPecentageStore));
+    if (!succeeded) {
       // Sadly, we didn't gather the numbers to ensure success
-      update_result.set_result(kRpcResultFailure);
-
       DLOG(WARNING) << "KNodeImpl::ExecuteUpdateRPCs - Not enough succ in RPCs"
                     << std::endl;
-
-    } else {
-      update_result.set_result(kRpcResultSuccess);
     }
-    std::string serialised_result(update_result.SerializeAsString());
-    uca->uvd->uvd_callback(serialised_result);
+    uca->uvd->uvd_callback(succeeded);
   }
 }
 
@@ -46,6 +46,10 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "maidsafe/kademlia/natrpc.h"
 #include "maidsafe/kademlia/kadroutingtable.h"
 #include "maidsafe/kademlia/kadservice.h"
+#include "maidsafe/kademlia/knode-api.h"
+#include "maidsafe/kademlia/lookupcache.h"
+#include "maidsafe/kademlia/rttestimator.h"
+#include "maidsafe/kademlia/valuecache.h"
 #include "maidsafe/rpcprotocol/channel-api.h"
 #include "maidsafe/protobuf/general_messages.pb.h"
 #include "maidsafe/protobuf/kademlia_service.pb.h"
@@ -55,8 +59,6 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 namespace kad {
 class ContactInfo;
 
-struct LookupContact;
-
 struct ContactAndTargetKey {
   ContactAndTargetKey() : contact(), target_key(), contacted(false) {}
   Contact contact;
@@ -72,11 +74,10 @@ enum RemoteFindMethod { FIND_NODE, FIND_VALUE, BOOTSTRAP };
 void SortContactList(const KadId &target_key,
                      std::list<Contact> *contact_list);
 
-void SortLookupContact(const KadId &target_key,
-                       std::list<LookupContact> *contact_list);
-
 inline void dummy_callback(const std::string&) {}
 
+inline void dummy_find_callback(const FindValueResult&) {}
+
 inline void dummy_downlist_callback(DownlistResponse *response,
                                     rpcprotocol::Controller *ctrler) {
   delete response;
@@ -99,34 +100,54 @@ struct DownListData {
 // define data structures for callbacks
 struct LookupContact {
   LookupContact() : kad_contact(), contacted(false) {}
+  explicit LookupContact(const Contact &kad_contact)
+      : kad_contact(kad_contact), contacted(false) {}
   Contact kad_contact;
   bool contacted;
 };
 
+// State of one iterative lookup.  Every field other than method and key is
+// guarded by mutex, so concurrent lookups never contend with each other.
+// short_list and active_contacts are keyed by distance to key, keeping them
+// ordered from closest to furthest as contacts are added.
 struct IterativeLookUpData {
   IterativeLookUpData(const RemoteFindMethod &method,
-      const KadId &key, VoidFunctorOneString callback)
-      : method(method), key(key), short_list(), current_alpha(),
+      const KadId &key, FindValueFunctor callback)
+      : method(method), key(key), mutex(), short_list(), current_alpha(),
         active_contacts(), active_probes(),
         values_found(), dead_ids(), downlist(), downlist_sent(false),
         in_final_iteration(false), is_callbacked(false), wait_for_key(false),
-        callback(callback), alternative_value_holder(), sig_values_found() {}
-  RemoteFindMethod method;
-  KadId key;
-  std::list<LookupContact> short_list;
-  std::list<Contact> current_alpha, active_contacts, active_probes;
+        callback(callback), alternative_value_holder(), sig_values_found(),
+        no_value_contacts(), values_ttl(-1) {}
+  // Adds contact to short_list unless it is already there.
+  bool AddToShortList(const Contact &contact) {
+    return short_list.insert(std::pair<KadId, LookupContact>(
+        contact.node_id() ^ key, LookupContact(contact))).second;
+  }
+  const RemoteFindMethod method;
+  const KadId key;
+  boost::mutex mutex;
+  std::map<KadId, LookupContact> short_list;
+  std::list<Contact> current_alpha;
+  std::map<KadId, Contact> active_contacts;
+  std::list<Contact> active_probes;
   std::list<std::string> values_found, dead_ids;
   std::list<struct DownListData> downlist;
   bool downlist_sent, in_final_iteration, is_callbacked, wait_for_key;
-  VoidFunctorOneString callback;
+  FindValueFunctor callback;
   ContactInfo alternative_value_holder;
   std::list<kad::SignedValue> sig_values_found;
+  // Contacts which answered a FIND_VALUE without the value, keyed by distance.
+  std::map<KadId, Contact> no_value_contacts;
+  // Seconds until the first value found expires, -1 if none do and 0 if a
+  // node holding values didn't say.
+  boost::int32_t values_ttl;
 };
 
 struct IterativeStoreValueData {
   IterativeStoreValueData(const std::vector<Contact> &close_nodes,
                           const KadId &key, const std::string &value,
-                          VoidFunctorOneString callback,
+                          StoreValueFunctor callback,
                           const bool &publish_val,
                           const boost::int32_t &timetolive,
                           const SignedValue &svalue,
@@ -137,7 +158,7 @@ struct IterativeStoreValueData {
         sig_request(sreq) {}
   IterativeStoreValueData(const std::vector<Contact> &close_nodes,
                           const KadId &key, const std::string &value,
-                          VoidFunctorOneString callback,
+                          StoreValueFunctor callback,
                           const bool &publish_val,
                           const boost::uint32_t &timetolive)
       : closest_nodes(close_nodes), key(key), value(value), save_nodes(0),
@@ -148,7 +169,7 @@ struct IterativeStoreValueData {
   KadId key;
   std::string value;
   boost::uint32_t save_nodes, contacted_nodes, index;
-  VoidFunctorOneString callback;
+  StoreValueFunctor callback;
   bool is_callbacked;
   int data_type;
   bool publish;
@@ -160,14 +181,14 @@ struct IterativeStoreValueData {
 struct IterativeDelValueData {
   IterativeDelValueData(const std::vector<Contact> &close_nodes,
       const KadId &key, const SignedValue &svalue,
-      const SignedRequest &sreq, VoidFunctorOneString callback)
+      const SignedRequest &sreq, VoidFunctorOneBool callback)
       : closest_nodes(close_nodes), key(key), del_nodes(0), contacted_nodes(0),
         index(-1), callback(callback), is_callbacked(false), value(svalue),
         sig_request(sreq) {}
   std::vector<Contact> closest_nodes;
   KadId key;
   boost::uint32_t del_nodes, contacted_nodes, index;
-  VoidFunctorOneString callback;
+  VoidFunctorOneBool callback;
   bool is_callbacked;
   SignedValue value;
   SignedRequest sig_request;
@@ -176,7 +197,7 @@ struct IterativeDelValueData {
 struct UpdateValueData {
   UpdateValueData(const KadId &key, const SignedValue &old_value,
                   const SignedValue &new_value, const SignedRequest &sreq,
-                  VoidFunctorOneString callback, boost::uint8_t foundnodes)
+                  VoidFunctorOneBool callback, boost::uint8_t foundnodes)
       : uvd_key(key), uvd_old_value(old_value), uvd_new_value(new_value),
         uvd_request_signature(sreq), uvd_callback(callback), uvd_calledback(0),
         uvd_succeeded(0), retries(0), found_nodes(foundnodes), ttl(0),
@@ -185,7 +206,7 @@ struct UpdateValueData {
   SignedValue uvd_old_value;
   SignedValue uvd_new_value;
   SignedRequest uvd_request_signature;
-  VoidFunctorOneString uvd_callback;
+  VoidFunctorOneBool uvd_callback;
   boost::uint8_t uvd_calledback;
   boost::uint8_t uvd_succeeded;
   boost::uint8_t retries;
@@ -194,6 +215,72 @@ struct UpdateValueData {
   boost::mutex mutex;
 };
 
+// State of a batch store.  closest_nodes is filled in by a lookup for each
+// distinct key, then the entries are sent to each node in BatchStore RPCs and
+// save_nodes counts the copies stored of each entry.
+struct BatchStoreData {
+  BatchStoreData(const std::vector<BatchStoreEntry> &entries,
+                 const bool &publish, StoreBatchFunctor callback)
+      : mutex(), entries(entries), publish(publish), closest_nodes(),
+        lookups(0), save_nodes(entries.size(), 0),
+        delete_requests(entries.size()), rpcs(0), callback(callback) {}
+  boost::mutex mutex;
+  const std::vector<BatchStoreEntry> entries;
+  const bool publish;
+  std::map<KadId, std::vector<Contact> > closest_nodes;
+  size_t lookups;
+  std::vector<boost::uint32_t> save_nodes;
+  std::vector<SignedRequest> delete_requests;
+  size_t rpcs;
+  StoreBatchFunctor callback;
+};
+
+struct BatchStoreCallbackArgs {
+  explicit BatchStoreCallbackArgs(boost::shared_ptr<BatchStoreData> data)
+      : remote_ctc(), data(data), indices(), retry(false), rpc_ctrler(NULL) {}
+  Contact remote_ctc;
+  boost::shared_ptr<BatchStoreData> data;
+  // The indices in data->entries of the entries sent in the RPC.
+  std::vector<size_t> indices;
+  bool retry;
+  rpcprotocol::Controller *rpc_ctrler;
+};
+
+// State of a batch find.  unresolved counts the keys without a result yet.
+struct BatchFindData {
+  BatchFindData(const std::vector<KadId> &keys, FindBatchFunctor callback)
+      : mutex(), keys(keys), results(keys.size()), closest_nodes(),
+        pending(), lookups(0), unresolved(keys.size()), callback(callback) {}
+  boost::mutex mutex;
+  const std::vector<KadId> keys;
+  std::vector<FindValueResult> results;
+  std::map<KadId, std::vector<Contact> > closest_nodes;
+  // The indices of the keys to be asked for in BatchFindValue RPCs.
+  std::vector<size_t> pending;
+  size_t lookups, unresolved;
+  FindBatchFunctor callback;
+};
+
+struct BatchFindCallbackArgs {
+  explicit BatchFindCallbackArgs(boost::shared_ptr<BatchFindData> data)
+      : remote_ctc(), data(data), indices(), retry(false), rpc_ctrler(NULL) {}
+  Contact remote_ctc;
+  boost::shared_ptr<BatchFindData> data;
+  // The indices in data->keys of the keys sent in the RPC.
+  std::vector<size_t> indices;
+  bool retry;
+  rpcprotocol::Controller *rpc_ctrler;
+};
+
+// State of one run of the refresh routine.  The values due for refresh are
+// grouped by key, and the values of up to kRefreshKeysInFlight keys are
+// refreshed at a time in one batch store.
+struct RefreshValuesData {
+  RefreshValuesData() : pending_keys(), signed_public_key() {}
+  std::map<std::string, std::vector<refresh_value> > pending_keys;
+  std::string signed_public_key;
+};
+
 struct FindCallbackArgs {
  public:
   explicit FindCallbackArgs(boost::shared_ptr<IterativeLookUpData> data)
@@ -353,6 +440,10 @@ class TestKNodeImpl_BEH_KNodeImpl_Bootstrap_Callback_Test;
 class TestKNodeImpl_BEH_KNodeImpl_Join_Bootstrapping_Iteration_Test;
 class TestKNodeImpl_BEH_KNodeImpl_ExecuteRPCs_Test;
 class TestKNodeImpl_BEH_KNodeImpl_NotJoined_Test;
+class TestKNodeImpl_BEH_KNodeImpl_ProximityProbes_Test;
+class TestKNodeImpl_BEH_KNodeImpl_PathCacheCopies_Test;
+class TestKNodeImpl_BEH_KNodeImpl_RefreshValues_Test;
+class TestKNodeImpl_BEH_KNodeImpl_HedgeProbes_Test;
 }  // namespace test
 
 class KNodeImpl {
@@ -411,6 +502,28 @@ class KNodeImpl {
                              VoidFunctorOneString callback, const bool &local);
   virtual void FindKClosestNodes(const KadId &node_id,
                                  VoidFunctorOneString callback);
+  void Store(const KadId &key, const SignedValue &signed_value,
+             const SignedRequest &signed_request, const boost::int32_t &ttl,
+             StoreValueFunctor callback);
+  void Store(const KadId &key, const std::string &value,
+             const boost::int32_t &ttl, StoreValueFunctor callback);
+  void Delete(const KadId &key, const SignedValue &signed_value,
+              const SignedRequest &signed_request,
+              VoidFunctorOneBool callback);
+  void Update(const KadId &key, const SignedValue &old_value,
+              const SignedValue &new_value,
+              const SignedRequest &signed_request, boost::uint32_t ttl,
+              VoidFunctorOneBool callback);
+  void Find(const KadId &key, const bool &check_alternative_store,
+            FindValueFunctor callback);
+  void FindNodes(const KadId &key, FindNodesFunctor callback);
+  void StoreBatch(const std::vector<StoreEntry> &entries,
+                  StoreBatchFunctor callback);
+  void FindBatch(const std::vector<KadId> &keys,
+                 const bool &check_alternative_store,
+                 FindBatchFunctor callback);
+  PathCacheStats PathCacheStatistics();
+  void ResetPathCacheStatistics();
   void GetKNodesFromRoutingTable(const KadId &key,
                                  const std::vector<Contact> &exclude_contacts,
                                  std::vector<Contact> *close_nodes);
@@ -418,6 +531,9 @@ class KNodeImpl {
   virtual void Ping(const Contact &remote, VoidFunctorOneString callback);
   int AddContact(Contact new_contact, const float & rtt, const bool &only_db);
   void RemoveContact(const KadId &node_id);
+  void AddRespondingContact(const Contact &contact,
+                            rpcprotocol::Controller *ctrl);
+  rpcprotocol::Controller* NewController(const KadId &node_id);
   bool GetContact(const KadId &id, Contact *contact);
   bool FindValueLocal(const KadId &key, std::vector<std::string> *values);
   bool StoreValueLocal(const KadId &key, const std::string &value,
@@ -454,6 +570,7 @@ class KNodeImpl {
   inline KadRpcs* kadrpcs() { return &kadrpcs_; }
   bool HasRSAKeys();
   boost::int32_t KeyValueTTL(const KadId &key, const std::string &value) const;
+  bool SetDataStoreDirectory(const std::string &directory);
   inline void set_alternative_store(base::AlternativeStore* alt_store) {
     alternative_store_ = alt_store;
     if (premote_service_.get() != NULL)
@@ -467,6 +584,9 @@ class KNodeImpl {
     if (premote_service_ != 0)
       premote_service_->set_signature_validator(signature_validator_);
   }
+  inline void set_proximity_lookups(const bool &enabled) {
+    proximity_lookups_ = enabled;
+  }
   inline NatType host_nat_type() { return host_nat_type_; }
   inline bool recheck_nat_type() { return recheck_nat_type_; }
  private:
@@ -478,10 +598,14 @@ class KNodeImpl {
           TestKNodeImpl_BEH_KNodeImpl_Join_Bootstrapping_Iteration_Test;
   friend class test_knodeimpl::TestKNodeImpl_BEH_KNodeImpl_ExecuteRPCs_Test;
   friend class test_knodeimpl::TestKNodeImpl_BEH_KNodeImpl_NotJoined_Test;
+  friend class
+      test_knodeimpl::TestKNodeImpl_BEH_KNodeImpl_ProximityProbes_Test;
+  friend class test_knodeimpl::TestKNodeImpl_BEH_KNodeImpl_PathCacheCopies_Test;
+  friend class test_knodeimpl::TestKNodeImpl_BEH_KNodeImpl_RefreshValues_Test;
+  friend class test_knodeimpl::TestKNodeImpl_BEH_KNodeImpl_HedgeProbes_Test;
 
   KNodeImpl &operator=(const KNodeImpl&);
   KNodeImpl(const KNodeImpl&);
-  inline void CallbackWithFailure(VoidFunctorOneString callback);
   void Bootstrap_Callback(const BootstrapResponse *response,
                           BootstrapData data);
   void Bootstrap(const std::string &bootstrap_ip,
@@ -505,7 +629,7 @@ class KNodeImpl {
   boost::int16_t LoadBootstrapContacts();
   void RefreshRoutine();
   void StartSearchIteration(const KadId &key, const RemoteFindMethod &method,
-                            VoidFunctorOneString callback);
+                            FindValueFunctor callback);
   void SearchIteration_ExtendShortList(const FindResponse *response,
                                        FindCallbackArgs callback_data);
   void SearchIteration(boost::shared_ptr<IterativeLookUpData> data);
@@ -513,35 +637,92 @@ class KNodeImpl {
   void SendDownlist(boost::shared_ptr<IterativeLookUpData> data);
   void SendFindRpc(Contact remote, boost::shared_ptr<IterativeLookUpData> data,
                    const ConnectionType &conn_type);
+  void SendFindRpcs(const std::vector<Contact> &remotes,
+                    boost::shared_ptr<IterativeLookUpData> data);
+  // Must be called with data->mutex locked.
   void SearchIteration_CancelActiveProbe(
       Contact sender,
       boost::shared_ptr<IterativeLookUpData> data);
+  // Sets probes to the uncontacted contacts in data's short list to ask next:
+  // the alpha_ closest or, for proximity-aware lookups, the closest and then
+  // the fastest of a wider set.  Must be called with data->mutex locked.
+  void SelectProbes(boost::shared_ptr<IterativeLookUpData> data,
+                    std::vector<LookupContact*> *probes);
+  // Arranges for each probe to be hedged by HedgeProbe if it is slow.
+  void ScheduleHedges(const std::vector<Contact> &probes,
+                      boost::shared_ptr<IterativeLookUpData> data);
+  // Asks the closest uncontacted node in the short list in place of probe if
+  // it is still holding up the iteration and the hedging budget allows.
+  void HedgeProbe(const Contact &probe,
+                  boost::shared_ptr<IterativeLookUpData> data);
   void SearchIteration_Callback(boost::shared_ptr<IterativeLookUpData> data);
   void SendFinalIteration(boost::shared_ptr<IterativeLookUpData> data);
+  // Calls back with the closest contacts to key held in lookup_cache_, or
+  // failing that with the result of a FIND_NODE lookup, which is then cached.
+  void CachedFindNodes(const KadId &key, FindNodesFunctor callback);
+  void CachedFindNodes_Callback(const FindNodesResult &result,
+                                const KadId &key, FindNodesFunctor callback);
   void StoreValue_IterativeStoreValue(const StoreResponse *response,
                                       StoreCallbackArgs callback_data);
-  void StoreValue_ExecuteStoreRPCs(const std::string &result, const KadId &key,
+  // If this node is one of the closest to key, stores value locally and, if
+  // it did, drops the furthest of closest_nodes.
+  bool StoreValue_StoreIfClose(const KadId &key, const std::string &value,
+                               const bool &publish, const boost::int32_t &ttl,
+                               std::vector<Contact> *closest_nodes);
+  void StoreBatch_FindNodes(boost::shared_ptr<BatchStoreData> data);
+  void StoreBatch_FindNodesCallback(const FindNodesResult &result,
+                                    const KadId &key,
+                                    boost::shared_ptr<BatchStoreData> data);
+  void StoreBatch_ExecuteStoreRPCs(boost::shared_ptr<BatchStoreData> data);
+  void StoreBatch_SendRPC(BatchStoreCallbackArgs callback_args);
+  void StoreBatch_HandleResult(const BatchStoreResponse *response,
+                               BatchStoreCallbackArgs callback_args);
+  // Must be called once for every RPC sent, or once if none was sent.
+  void StoreBatch_RpcDone(boost::shared_ptr<BatchStoreData> data);
+  void FindBatch_FindNodesCallback(const FindNodesResult &result,
+                                   const KadId &key,
+                                   boost::shared_ptr<BatchFindData> data);
+  void FindBatch_ExecuteFindRPCs(boost::shared_ptr<BatchFindData> data);
+  void FindBatch_SendRPC(BatchFindCallbackArgs callback_args);
+  void FindBatch_HandleResult(const BatchFindValueResponse *response,
+                              BatchFindCallbackArgs callback_args);
+  void FindBatch_Resolve(const FindValueResult &result, const size_t &index,
+                         boost::shared_ptr<BatchFindData> data);
+  void ValueChanged_Callback(const bool &result, const KadId &key,
+                             VoidFunctorOneBool callback);
+  void SendCacheCopy(const KadId &key, const FindValueResult &result,
+                     const boost::int32_t &ttl);
+  void SendCacheCopy_Callback(const BatchStoreResponse *response,
+                              rpcprotocol::Controller *ctrl);
+  // The time to live of a cached copy sent to a node with closer nodes known
+  // to be closer to the key: kCacheCopyTtl halved for each of them, no less
+  // than kMinCacheCopyTtl and no more than values_ttl, if that is positive.
+  boost::int32_t CacheCopyTtl(const size_t &closer,
+                              const boost::int32_t &values_ttl) const;
+  void StoreValue_ExecuteStoreRPCs(const FindNodesResult &result,
+                                   const KadId &key,
                                    const std::string &value,
                                    const SignedValue &sig_value,
                                    const SignedRequest &sig_req,
                                    const bool &publish,
                                    const boost::int32_t &ttl,
-                                   VoidFunctorOneString callback);
-  void DelValue_ExecuteDeleteRPCs(const std::string &result, const KadId &key,
+                                   StoreValueFunctor callback);
+  void DelValue_ExecuteDeleteRPCs(const FindNodesResult &result,
+                                  const KadId &key,
                                   const SignedValue &value,
                                   const SignedRequest &sig_req,
-                                  VoidFunctorOneString callback);
+                                  VoidFunctorOneBool callback);
   void DelValue_IterativeDeleteValue(const DeleteResponse *response,
                                      DeleteCallbackArgs callback_data);
-  void ExecuteUpdateRPCs(const std::string &result,
+  void ExecuteUpdateRPCs(const FindNodesResult &result,
                          const KadId &key,
                          const SignedValue &old_value,
                          const SignedValue &new_value,
                          const SignedRequest &sig_req,
                          boost::uint32_t ttl,
-                         VoidFunctorOneString callback);
+                         VoidFunctorOneBool callback);
   void UpdateValueResponses(boost::shared_ptr<UpdateCallbackArgs> uca);
-  void FindNode_GetNode(const std::string &result, const KadId &node_id,
+  void FindNode_GetNode(const FindNodesResult &result, const KadId &node_id,
                         VoidFunctorOneString callback);
   void Ping_HandleResult(const PingResponse *response,
                          PingCallbackArgs callback_data);
@@ -556,17 +737,21 @@ class KNodeImpl {
                               Contact new_contact);
   void CheckAddContacts();
   void RefreshValuesRoutine();
-  void RefreshValue(const KadId &key, const std::string &value,
-                    const boost::int32_t &ttl, VoidFunctorOneString callback);
-  void RefreshValueCallback(const std::string &result, const KadId &key,
-                            const std::string &value, const boost::int32_t &ttl,
-                            boost::shared_ptr<boost::uint32_t> refreshes_done,
-                            const boost::uint32_t &total_refreshes);
+  void RefreshNextKeys(boost::shared_ptr<RefreshValuesData> data);
+  // Takes the values of up to kRefreshKeysInFlight keys off
+  // data->pending_keys and makes one entry per value to refresh, with one
+  // signed request per key.  values gets the refresh_value of each entry.
+  void NextRefreshEntries(RefreshValuesData *data,
+                          std::vector<BatchStoreEntry> *entries,
+                          std::vector<refresh_value> *values);
+  void RefreshValuesCallback(
+      const std::vector<StoreValueResult> &results,
+      boost::shared_ptr< std::vector<refresh_value> > values,
+      boost::shared_ptr<RefreshValuesData> data);
   void RecheckNatRoutine();
   void RecheckNatRoutineJoinCallback(const std::string &result);
-  boost::mutex routingtable_mutex_, kadconfig_mutex_, extendshortlist_mutex_,
-               joinbootstrapping_mutex_, leave_mutex_, activeprobes_mutex_,
-               pendingcts_mutex_;
+  boost::mutex routingtable_mutex_, kadconfig_mutex_,
+               joinbootstrapping_mutex_, leave_mutex_, pendingcts_mutex_;
   boost::shared_ptr<base::CallLaterTimer> ptimer_;
   rpcprotocol::ChannelManager *pchannel_manager_;
   transport::TransportHandler *transport_handler_;
@@ -579,6 +764,14 @@ class KNodeImpl {
   NatRpcs natrpcs_;
   volatile bool is_joined_;
   boost::shared_ptr<RoutingTable> prouting_table_;
+  LookupCache lookup_cache_;
+  boost::mutex path_cache_mutex_;
+  PathCacheStats path_cache_stats_;
+  ValueCache value_cache_;
+  RttEstimator rtt_estimator_;
+  bool proximity_lookups_;
+  boost::mutex hedge_mutex_;
+  double hedge_tokens_;
   KadId node_id_, fake_kClientId_;
   std::string host_ip_;
   NodeType type_;
@@ -587,6 +780,7 @@ class KNodeImpl {
   boost::uint16_t rv_port_;
   std::vector<Contact> bootstrapping_nodes_;
   const boost::uint16_t K_, alpha_, beta_;
+  const boost::uint32_t refresh_time_;
   bool refresh_routine_started_;
   boost::filesystem::path kad_config_path_;
   std::string local_host_ip_;
@@ -0,0 +1,120 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "maidsafe/kademlia/lookupcache.h"
+#include "maidsafe/base/utils.h"
+
+namespace kad {
+
+LookupCache::LookupCache(const size_t &max_size, const boost::uint64_t &ttl)
+    : kMaxSize_(max_size), kTtl_(ttl), entries_(), mutex_() {}
+
+bool LookupCache::Get(const KadId &key, std::vector<Contact> *close_nodes) {
+  boost::mutex::scoped_lock guard(mutex_);
+  EntryMap::iterator it = entries_.find(key);
+  if (it == entries_.end())
+    return false;
+  if (it->second.expiry <= base::GetEpochMilliseconds()) {
+    entries_.erase(it);
+    return false;
+  }
+  *close_nodes = it->second.close_nodes;
+  return true;
+}
+
+void LookupCache::Add(const KadId &key,
+                      const std::vector<Contact> &close_nodes) {
+  if (kMaxSize_ == 0 || close_nodes.empty())
+    return;
+  boost::uint64_t now(base::GetEpochMilliseconds());
+  boost::mutex::scoped_lock guard(mutex_);
+  if (entries_.size() >= kMaxSize_ && entries_.find(key) == entries_.end()) {
+    RemoveExpired(now);
+    if (entries_.size() >= kMaxSize_) {
+      EntryMap::iterator oldest = entries_.begin();
+      for (EntryMap::iterator it = entries_.begin(); it != entries_.end(); ++it)
+        if (it->second.expiry < oldest->second.expiry)
+          oldest = it;
+      entries_.erase(oldest);
+    }
+  }
+  Entry &entry = entries_[key];
+  entry.expiry = now + kTtl_;
+  entry.close_nodes = close_nodes;
+}
+
+void LookupCache::RemoveContact(const KadId &node_id) {
+  boost::mutex::scoped_lock guard(mutex_);
+  EntryMap::iterator it = entries_.begin();
+  while (it != entries_.end()) {
+    bool found(false);
+    for (size_t i = 0; i < it->second.close_nodes.size() && !found; ++i)
+      found = it->second.close_nodes[i].node_id() == node_id;
+    if (found)
+      entries_.erase(it++);
+    else
+      ++it;
+  }
+}
+
+void LookupCache::AddContact(const KadId &node_id, const size_t &k) {
+  boost::mutex::scoped_lock guard(mutex_);
+  EntryMap::iterator it = entries_.begin();
+  while (it != entries_.end()) {
+    const std::vector<Contact> &close_nodes(it->second.close_nodes);
+    bool found(false);
+    for (size_t i = 0; i < close_nodes.size() && !found; ++i)
+      found = close_nodes[i].node_id() == node_id;
+    if (!found && (close_nodes.size() < k || KadId::CloserToTarget(node_id,
+        close_nodes.back().node_id(), it->first)))
+      entries_.erase(it++);
+    else
+      ++it;
+  }
+}
+
+void LookupCache::Clear() {
+  boost::mutex::scoped_lock guard(mutex_);
+  entries_.clear();
+}
+
+size_t LookupCache::Size() {
+  boost::mutex::scoped_lock guard(mutex_);
+  return entries_.size();
+}
+
+void LookupCache::RemoveExpired(const boost::uint64_t &now) {
+  EntryMap::iterator it = entries_.begin();
+  while (it != entries_.end()) {
+    if (it->second.expiry <= now)
+      entries_.erase(it++);
+    else
+      ++it;
+  }
+}
+
+}  // namespace kad
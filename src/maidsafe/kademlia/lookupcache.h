@@ -0,0 +1,79 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MAIDSAFE_KADEMLIA_LOOKUPCACHE_H_
+#define MAIDSAFE_KADEMLIA_LOOKUPCACHE_H_
+
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+#include <map>
+#include <vector>
+#include "maidsafe/kademlia/contact.h"
+#include "maidsafe/kademlia/kadid.h"
+
+namespace kad {
+
+// Holds the closest contacts found by recent FIND_NODE lookups, so that a
+// store, delete, update or refresh of a recently resolved key can skip the
+// iterative lookup.  An entry expires ttl milliseconds after it was added and
+// is dropped as soon as any of its contacts is removed from the routing table
+// or fails an RPC, or a closer contact is added to the routing table.  When
+// the cache is full, the entry closest to expiry is evicted to make room.
+class LookupCache {
+ public:
+  LookupCache(const size_t &max_size, const boost::uint64_t &ttl);
+  // Sets close_nodes to the cached contacts for key and returns true if there
+  // is an unexpired entry for it.
+  bool Get(const KadId &key, std::vector<Contact> *close_nodes);
+  void Add(const KadId &key, const std::vector<Contact> &close_nodes);
+  // Drops every entry holding the contact with node_id.
+  void RemoveContact(const KadId &node_id);
+  // Drops every entry which the contact with node_id belongs in but isn't in,
+  // i.e. those with fewer than k contacts or one further from the key.
+  void AddContact(const KadId &node_id, const size_t &k);
+  void Clear();
+  size_t Size();
+ private:
+  struct Entry {
+    Entry() : expiry(0), close_nodes() {}
+    boost::uint64_t expiry;
+    std::vector<Contact> close_nodes;
+  };
+  typedef std::map<KadId, Entry> EntryMap;
+  // Must be called with mutex_ locked.
+  void RemoveExpired(const boost::uint64_t &now);
+  LookupCache(const LookupCache&);
+  LookupCache& operator=(const LookupCache&);
+  const size_t kMaxSize_;
+  const boost::uint64_t kTtl_;
+  EntryMap entries_;
+  boost::mutex mutex_;
+};
+
+}  // namespace kad
+
+#endif  // MAIDSAFE_KADEMLIA_LOOKUPCACHE_H_
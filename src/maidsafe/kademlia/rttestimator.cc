@@ -0,0 +1,150 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "maidsafe/kademlia/rttestimator.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "maidsafe/base/utils.h"
+
+namespace kad {
+
+RttEstimator::RttEstimator(const size_t &max_size,
+                           const boost::uint64_t &min_timeout,
+                           const boost::uint64_t &max_timeout,
+                           const boost::uint16_t &max_backoff,
+                           const size_t &sample_window)
+    : kMaxSize_(max_size), kMinTimeout_(min_timeout),
+      kMaxTimeout_(max_timeout), kMaxBackoff_(max_backoff),
+      kSampleWindow_(sample_window), entries_(), recent_samples_(),
+      mutex_() {}
+
+void RttEstimator::AddSample(const KadId &id, const boost::uint64_t &rtt) {
+  boost::mutex::scoped_lock guard(mutex_);
+  if (kSampleWindow_ != 0) {
+    if (recent_samples_.size() >= kSampleWindow_)
+      recent_samples_.pop_front();
+    recent_samples_.push_back(rtt);
+  }
+  if (kMaxSize_ == 0)
+    return;
+  Entry &entry = GetEntry(id);
+  double sample(static_cast<double>(rtt));
+  if (!entry.measured) {
+    entry.srtt = sample;
+    entry.rttvar = sample / 2;
+    entry.measured = true;
+  } else {
+    entry.rttvar = 0.75 * entry.rttvar + 0.25 * std::fabs(entry.srtt - sample);
+    entry.srtt = 0.875 * entry.srtt + 0.125 * sample;
+  }
+  entry.failures = 0;
+}
+
+void RttEstimator::AddFailure(const KadId &id) {
+  if (kMaxSize_ == 0)
+    return;
+  boost::mutex::scoped_lock guard(mutex_);
+  Entry &entry = GetEntry(id);
+  if (entry.failures < kMaxBackoff_)
+    ++entry.failures;
+}
+
+boost::uint64_t RttEstimator::Timeout(const KadId &id) {
+  boost::mutex::scoped_lock guard(mutex_);
+  EntryMap::iterator it = entries_.find(id);
+  if (it == entries_.end() || !it->second.measured)
+    return kMaxTimeout_;
+  boost::uint64_t timeout(static_cast<boost::uint64_t>(
+      it->second.srtt + 4 * it->second.rttvar));
+  if (timeout < kMinTimeout_)
+    timeout = kMinTimeout_;
+  for (boost::uint16_t i = 0; i < it->second.failures && timeout < kMaxTimeout_;
+       ++i)
+    timeout *= 2;
+  return timeout < kMaxTimeout_ ? timeout : kMaxTimeout_;
+}
+
+bool RttEstimator::SmoothedRtt(const KadId &id, double *srtt) {
+  boost::mutex::scoped_lock guard(mutex_);
+  EntryMap::iterator it = entries_.find(id);
+  if (it == entries_.end() || !it->second.measured)
+    return false;
+  *srtt = it->second.srtt;
+  return true;
+}
+
+boost::uint16_t RttEstimator::Failures(const KadId &id) {
+  boost::mutex::scoped_lock guard(mutex_);
+  EntryMap::iterator it = entries_.find(id);
+  return it == entries_.end() ? 0 : it->second.failures;
+}
+
+bool RttEstimator::Percentile(const double &percent,
+                              const size_t &min_samples,
+                              boost::uint64_t *rtt) {
+  std::vector<boost::uint64_t> samples;
+  {
+    boost::mutex::scoped_lock guard(mutex_);
+    if (recent_samples_.empty() || recent_samples_.size() < min_samples)
+      return false;
+    samples.assign(recent_samples_.begin(), recent_samples_.end());
+  }
+  size_t index(static_cast<size_t>(percent / 100 * (samples.size() - 1)));
+  if (index >= samples.size())
+    index = samples.size() - 1;
+  std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+  *rtt = samples[index];
+  return true;
+}
+
+void RttEstimator::Clear() {
+  boost::mutex::scoped_lock guard(mutex_);
+  entries_.clear();
+  recent_samples_.clear();
+}
+
+size_t RttEstimator::Size() {
+  boost::mutex::scoped_lock guard(mutex_);
+  return entries_.size();
+}
+
+RttEstimator::Entry& RttEstimator::GetEntry(const KadId &id) {
+  boost::uint64_t now(base::GetEpochMilliseconds());
+  if (entries_.size() >= kMaxSize_ && entries_.find(id) == entries_.end()) {
+    EntryMap::iterator oldest = entries_.begin();
+    for (EntryMap::iterator it = entries_.begin(); it != entries_.end(); ++it)
+      if (it->second.last_used < oldest->second.last_used)
+        oldest = it;
+    entries_.erase(oldest);
+  }
+  Entry &entry = entries_[id];
+  entry.last_used = now;
+  return entry;
+}
+
+}  // namespace kad
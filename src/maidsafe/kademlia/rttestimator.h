@@ -0,0 +1,94 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MAIDSAFE_KADEMLIA_RTTESTIMATOR_H_
+#define MAIDSAFE_KADEMLIA_RTTESTIMATOR_H_
+
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+#include <deque>
+#include <map>
+#include "maidsafe/kademlia/kadid.h"
+
+namespace kad {
+
+// Keeps per-contact round trip time estimates, smoothed as TCP does (RFC
+// 6298), and derives RPC timeouts from them.  The timeout for a contact is
+// srtt + 4 * rttvar, bounded by min_timeout and max_timeout, and doubled for
+// each consecutive failed RPC up to max_backoff times.  Contacts never measured
+// get max_timeout.  When full, the contact least recently updated is dropped.
+// The last sample_window samples from all contacts are also kept to give
+// percentiles of recent round trip times.
+class RttEstimator {
+ public:
+  RttEstimator(const size_t &max_size, const boost::uint64_t &min_timeout,
+               const boost::uint64_t &max_timeout,
+               const boost::uint16_t &max_backoff,
+               const size_t &sample_window);
+  // Adds a round trip time, in milliseconds, measured for an RPC to id, and
+  // clears its backoff.
+  void AddSample(const KadId &id, const boost::uint64_t &rtt);
+  // Records a failed RPC to id.
+  void AddFailure(const KadId &id);
+  // Timeout in milliseconds for the next RPC to id.
+  boost::uint64_t Timeout(const KadId &id);
+  // Sets srtt to the smoothed round trip time to id, in milliseconds, and
+  // returns true if it has been measured.
+  bool SmoothedRtt(const KadId &id, double *srtt);
+  // Number of consecutive failed RPCs to id, up to max_backoff.
+  boost::uint16_t Failures(const KadId &id);
+  // Sets rtt to the given percentile (0 to 100) of the recent samples and
+  // returns true if at least min_samples are held.
+  bool Percentile(const double &percent, const size_t &min_samples,
+                  boost::uint64_t *rtt);
+  void Clear();
+  size_t Size();
+ private:
+  struct Entry {
+    Entry() : srtt(0), rttvar(0), measured(false), failures(0), last_used(0) {}
+    double srtt, rttvar;
+    bool measured;
+    boost::uint16_t failures;
+    boost::uint64_t last_used;
+  };
+  typedef std::map<KadId, Entry> EntryMap;
+  // Must be called with mutex_ locked.
+  Entry& GetEntry(const KadId &id);
+  RttEstimator(const RttEstimator&);
+  RttEstimator& operator=(const RttEstimator&);
+  const size_t kMaxSize_;
+  const boost::uint64_t kMinTimeout_, kMaxTimeout_;
+  const boost::uint16_t kMaxBackoff_;
+  const size_t kSampleWindow_;
+  EntryMap entries_;
+  std::deque<boost::uint64_t> recent_samples_;
+  boost::mutex mutex_;
+};
+
+}  // namespace kad
+
+#endif  // MAIDSAFE_KADEMLIA_RTTESTIMATOR_H_
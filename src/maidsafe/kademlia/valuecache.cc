@@ -0,0 +1,112 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "maidsafe/kademlia/valuecache.h"
+#include "maidsafe/base/utils.h"
+
+namespace kad {
+
+ValueCache::ValueCache(const size_t &max_bytes, const boost::uint64_t &max_ttl)
+    : kMaxBytes_(max_bytes), kMaxTtl_(max_ttl), bytes_(0), entries_(), lru_(),
+      mutex_() {}
+
+bool ValueCache::Get(const KadId &key, FindValueResult *result) {
+  boost::mutex::scoped_lock guard(mutex_);
+  EntryMap::iterator it = entries_.find(key);
+  if (it == entries_.end())
+    return false;
+  if (it->second.expiry <= base::GetEpochMilliseconds()) {
+    Erase(it);
+    return false;
+  }
+  lru_.splice(lru_.end(), lru_, it->second.lru_position);
+  result->succeeded = true;
+  result->values = it->second.values;
+  result->signed_values = it->second.signed_values;
+  return true;
+}
+
+void ValueCache::Add(const KadId &key, const FindValueResult &result,
+                     const boost::int32_t &ttl) {
+  if (ttl == 0 || (result.values.empty() && result.signed_values.empty()))
+    return;
+  size_t bytes(key.String().size());
+  for (size_t i = 0; i < result.values.size(); ++i)
+    bytes += result.values[i].size();
+  for (size_t i = 0; i < result.signed_values.size(); ++i)
+    bytes += result.signed_values[i].ByteSize();
+  if (bytes > kMaxBytes_)
+    return;
+  boost::uint64_t lifetime(kMaxTtl_);
+  if (ttl > 0 && static_cast<boost::uint64_t>(ttl) * 1000 < lifetime)
+    lifetime = static_cast<boost::uint64_t>(ttl) * 1000;
+  boost::mutex::scoped_lock guard(mutex_);
+  EntryMap::iterator it = entries_.find(key);
+  if (it != entries_.end())
+    Erase(it);
+  while (bytes_ + bytes > kMaxBytes_)
+    Erase(entries_.find(lru_.front()));
+  Entry &entry = entries_[key];
+  entry.expiry = base::GetEpochMilliseconds() + lifetime;
+  entry.bytes = bytes;
+  entry.values = result.values;
+  entry.signed_values = result.signed_values;
+  entry.lru_position = lru_.insert(lru_.end(), key);
+  bytes_ += bytes;
+}
+
+void ValueCache::Remove(const KadId &key) {
+  boost::mutex::scoped_lock guard(mutex_);
+  EntryMap::iterator it = entries_.find(key);
+  if (it != entries_.end())
+    Erase(it);
+}
+
+void ValueCache::Clear() {
+  boost::mutex::scoped_lock guard(mutex_);
+  entries_.clear();
+  lru_.clear();
+  bytes_ = 0;
+}
+
+size_t ValueCache::Size() {
+  boost::mutex::scoped_lock guard(mutex_);
+  return entries_.size();
+}
+
+size_t ValueCache::Bytes() {
+  boost::mutex::scoped_lock guard(mutex_);
+  return bytes_;
+}
+
+void ValueCache::Erase(EntryMap::iterator it) {
+  bytes_ -= it->second.bytes;
+  lru_.erase(it->second.lru_position);
+  entries_.erase(it);
+}
+
+}  // namespace kad
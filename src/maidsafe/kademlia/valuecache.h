@@ -0,0 +1,87 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MAIDSAFE_KADEMLIA_VALUECACHE_H_
+#define MAIDSAFE_KADEMLIA_VALUECACHE_H_
+
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+#include "maidsafe/kademlia/kadid.h"
+#include "maidsafe/kademlia/knode-api.h"
+
+namespace kad {
+
+// Holds the values of recently found keys, so that Find can answer repeat
+// lookups without going to the network.  An entry lives for the TTL the
+// values had left on the node they were found on, but never longer than
+// max_ttl milliseconds.  The cache holds at most max_bytes of values; when
+// adding would exceed that, the least recently used entries are evicted.
+class ValueCache {
+ public:
+  ValueCache(const size_t &max_bytes, const boost::uint64_t &max_ttl);
+  // Sets result to the cached values for key and returns true if there is an
+  // unexpired entry for it.
+  bool Get(const KadId &key, FindValueResult *result);
+  // ttl is in seconds, -1 if the values don't expire.  Nothing is cached for
+  // a ttl of 0 or a result without values.
+  void Add(const KadId &key, const FindValueResult &result,
+           const boost::int32_t &ttl);
+  void Remove(const KadId &key);
+  void Clear();
+  size_t Size();
+  // Approximate number of bytes of values held.
+  size_t Bytes();
+ private:
+  struct Entry {
+    Entry() : expiry(0), bytes(0), values(), signed_values(), lru_position() {}
+    boost::uint64_t expiry;
+    size_t bytes;
+    std::vector<std::string> values;
+    std::vector<SignedValue> signed_values;
+    std::list<KadId>::iterator lru_position;
+  };
+  typedef std::map<KadId, Entry> EntryMap;
+  // Must be called with mutex_ locked.
+  void Erase(EntryMap::iterator it);
+  ValueCache(const ValueCache&);
+  ValueCache& operator=(const ValueCache&);
+  const size_t kMaxBytes_;
+  const boost::uint64_t kMaxTtl_;
+  size_t bytes_;
+  EntryMap entries_;
+  // Keys ordered from least to most recently used.
+  std::list<KadId> lru_;
+  boost::mutex mutex_;
+};
+
+}  // namespace kad
+
+#endif  // MAIDSAFE_KADEMLIA_VALUECACHE_H_
@@ -123,6 +123,14 @@ const boost::uint16_t kKeySizeBytes = 64;
 // The parallel level of search iterations.
 const boost::uint16_t kAlpha = 3;
 
+// In proximity-aware lookups, each iteration picks its alpha contacts from the
+// kProximityCandidates * alpha closest uncontacted ones, preferring the
+// closest and then those with the lowest smoothed round trip time.  Each
+// failed RPC to a contact since its last answer adds kProximityFailurePenalty
+// milliseconds to that time; contacts never measured come last.
+const boost::uint16_t kProximityCandidates = 2;
+const boost::uint32_t kProximityFailurePenalty = 1000;
+
 // The number of replies required in a search iteration to allow the next
 // iteration to begin.
 const boost::uint16_t kBeta = 1;
@@ -136,6 +144,13 @@ const boost::uint32_t kRepublishTime = 43200;  // 12 hours
 // The duration (in seconds) after which a given <key,value> is deleted locally.
 const boost::uint32_t kExpireTime = kRepublishTime + kRefreshTime + 300;
 
+// The number of independently locked partitions of the local DataStore.
+const boost::uint16_t kDataStoreShards = 16;
+
+// The number of records a persistent DataStore's log can reach before it is
+// compacted, which happens once more than half of its records are superseded.
+const boost::uint32_t kDataStoreCompactionThreshold = 1000;
+
 // RPC result constants.
 const std::string kRpcResultSuccess("T");
 const std::string kRpcResultFailure("F");
@@ -148,6 +163,71 @@ const double kMinSuccessfulPecentageStore = 0.75;
 // k-bucket.
 const boost::uint16_t kFailedRpc = 0;
 
+// The maximum number of keys for which the closest contacts found by a lookup
+// are kept for later stores, deletes, updates and refreshes of the same key.
+const boost::uint16_t kLookupCacheSize = 128;
+
+// The duration (in milliseconds) for which cached closest contacts are used.
+const boost::uint32_t kLookupCacheTtl = 60000;
+
+// The maximum number of bytes of values found on the network which are kept to
+// answer later lookups of the same keys.  0 disables the cache.
+const boost::uint32_t kValueCacheSize = 4 * 1024 * 1024;
+
+// The longest duration (in milliseconds) for which a found value is served
+// from the cache, even if it has longer to live.
+const boost::uint32_t kValueCacheTtl = 300000;
+
+// The maximum number of keys the refresh routine republishes at a time.  All
+// values stored under a key are refreshed together, after one lookup for the
+// key and with one signed request.
+const boost::uint16_t kRefreshKeysInFlight = 16;
+
+// The maximum number of entries in one BatchStore or BatchFindValue RPC.
+const boost::int32_t kMaxBatchSize = 256;
+
+// The time to live (in seconds) of a copy of a found value cached on the
+// closest node asked which lacked it.  It halves for each node found to be
+// closer to the key than that one, down to kMinCacheCopyTtl.  Kept below
+// kRefreshTime so that cached copies are never republished.
+const boost::int32_t kCacheCopyTtl = 1800;
+const boost::int32_t kMinCacheCopyTtl = 60;
+
+// RPCs to a contact time out after its smoothed round trip time plus four
+// times the RTT variation (as TCP's retransmission timeout), measured over
+// earlier RPCs to it, but no sooner than kMinRpcTimeout milliseconds.
+// Contacts never measured get rpcprotocol::kRpcTimeout.
+const boost::uint32_t kMinRpcTimeout = 1000;
+
+// The timeout doubles for each consecutive RPC to a contact which failed, up
+// to kMaxRpcBackoff times, and never exceeds rpcprotocol::kRpcTimeout.
+const boost::uint16_t kMaxRpcBackoff = 4;
+
+// Threads which handle the Kademlia RPCs needing signature checks (Store,
+// BatchStore, Delete and Update), and how many such requests may wait for
+// them before further ones are refused.
+const boost::uint16_t kCryptoWorkers = 2;
+const boost::uint16_t kCryptoQueueSize = 256;
+
+// The maximum number of contacts whose round trip times are kept.
+const boost::uint16_t kRttEstimatorSize = 1024;
+
+// The number of recent round trip times, over all contacts, from which the
+// hedging deadline is taken.
+const boost::uint16_t kRttSampleWindow = 256;
+
+// A lookup probe which hasn't answered within this percentile of recent round
+// trip times is hedged: the next closest uncontacted node is asked as well,
+// without cancelling the first.  No hedging happens until kHedgeMinSamples
+// round trip times are known.
+const double kHedgePercentile = 95;
+const boost::uint16_t kHedgeMinSamples = 32;
+
+// At most kHedgeBudget hedged probes are sent per 100 lookup probes, with
+// up to kMaxHedgeBurst saved for bursts.  0 disables hedging.
+const boost::uint16_t kHedgeBudget = 10;
+const boost::uint16_t kMaxHedgeBurst = 10;
+
 // The maximum number of bootstrap contacts allowed in the .kadconfig file.
 const boost::uint32_t kMaxBootstrapContacts = 10000;
 
@@ -171,6 +251,13 @@ const boost::uint16_t kMinPort = 5000;
 // RPC timeout duration (in milliseconds).
 const boost::uint32_t kRpcTimeout = 10000;
 
+// Maximum number of connections kept open for reuse by outgoing RPCs.  Zero
+// disables pooling, so each RPC uses its own connection.
+const boost::uint16_t kMaxPooledConnections = 64;
+
+// Time (in milliseconds) after which an unused pooled connection is closed.
+const boost::uint32_t kPooledConnectionIdleTimeout = 30000;
+
 // RPC result constants.
 const std::string kStartTransportSuccess("T");
 const std::string kStartTransportFailure("F");
@@ -190,6 +277,28 @@ namespace transport {
 
 enum TransportType { kUdt, kTcp, kOther };
 
+// Default number of threads dispatching received messages to the notifiers.
+const boost::uint16_t kMessageHandlerThreads = 1;
+
+// Maximum number of threads dispatching received messages to the notifiers.
+const boost::uint16_t kMaxMessageHandlerThreads = 64;
+
+// Maximum time (in milliseconds) the receiving thread waits for a readable
+// connection before checking whether the transport has been stopped.
+const boost::int64_t kReceiveWaitTimeout = 100;
+
+// Interval (in milliseconds) between checks for broken incoming connections.
+const boost::uint64_t kDeadConnectionCheckInterval = 1000;
+
+// Maximum number of released message buffers a transport keeps for reuse.
+const boost::uint16_t kMaxIdleBuffers = 64;
+
+// Size (in bytes) of the largest message buffer a transport keeps for reuse.
+const boost::uint32_t kMaxPooledBufferSize = 1024 * 1024;
+
+// Default size (in bytes) of the largest message a transport accepts.
+const boost::int64_t kMaxMessageSize = 64 * 1024 * 1024;
+
 }  // namespace transport
 
 #endif  // MAIDSAFE_MAIDSAFE_DHT_CONFIG_H_
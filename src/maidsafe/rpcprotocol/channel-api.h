@@ -83,6 +83,11 @@ class Controller : public google::protobuf::RpcController {
   */
   void set_timeout(const boost::uint32_t &seconds);
   /**
+  * Sets the timeout for the RPC request with millisecond resolution.
+  * @param milliseconds timeout time in milliseconds.
+  */
+  void set_timeout_ms(const boost::uint64_t &milliseconds);
+  /**
   * Returns time between sending and receiving the RPC request/response.
   * @return time in milliseconds
   */
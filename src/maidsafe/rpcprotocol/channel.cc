@@ -67,6 +67,10 @@ void Controller::set_timeout(const boost::uint32_t &seconds) {
   controller_pimpl_->set_timeout(seconds);
 }
 
+void Controller::set_timeout_ms(const boost::uint64_t &milliseconds) {
+  controller_pimpl_->set_timeout_ms(milliseconds);
+}
+
 boost::uint64_t Controller::timeout() const {
   return controller_pimpl_->timeout();
 }
@@ -114,15 +114,18 @@ void ChannelImpl::CallMethod(const google::protobuf::MethodDescriptor *method,
     req.args = response;
     req.callback = done;
     boost::uint32_t connection_id = 0;
+    bool new_connection = false;
     Controller *ctrl = static_cast<Controller*>(controller);
     ctrl->set_request_id(msg.message_id());
     ctrl->set_message_info(msg.service(), msg.method());
     ctrl->StartRpcTimer();
-    if (0 == transport_handler_->ConnectToSend(remote_ip_, remote_port_,
-                                               local_ip_, local_port_, rv_ip_,
-                                               rv_port_, true, &connection_id,
-                                               transport_id_)) {
+    if (0 == pmanager_->connection_pool()->Acquire(transport_id_, remote_ip_,
+                                                   remote_port_, local_ip_,
+                                                   local_port_, rv_ip_,
+                                                   rv_port_, &connection_id,
+                                                   &new_connection)) {
       req.connection_id = connection_id;
+      req.transport_id = transport_id_;
       // Set the RPC request timeout
       if (ctrl->timeout() != 0) {
         req.timeout = ctrl->timeout();
@@ -131,12 +134,14 @@ void ChannelImpl::CallMethod(const google::protobuf::MethodDescriptor *method,
       }
       req.ctrl = ctrl;
       if (!pmanager_->AddPendingRequest(msg.message_id(), req)) {
+        if (!pmanager_->connection_pool()->Release(connection_id, true))
+          transport_handler_->CloseConnection(connection_id, transport_id_);
         done->Run();
         return;
       }
       pmanager_->AddTimeOutRequest(connection_id, msg.message_id(),
                                    req.timeout);
-      if (0 != transport_handler_->Send(msg, connection_id, true,
+      if (0 != transport_handler_->Send(msg, connection_id, new_connection,
                                         transport_id_)) {
          if (transport_handler_->listening_port(transport_id_, &lp_node))
           DLOG(WARNING) << lp_node << " --- Failed to send request with id "
@@ -57,6 +57,9 @@ class ControllerImpl {
   void set_timeout(const boost::uint32_t &seconds) {
     timeout_ = static_cast<boost::uint64_t>(seconds)*1000;
   }
+  void set_timeout_ms(const boost::uint64_t &milliseconds) {
+    timeout_ = milliseconds;
+  }
   // returns timeout in milliseconds
   boost::uint64_t timeout() const { return timeout_; }
   // returns time between sending and receiving the RPC in milliseconds
@@ -62,6 +62,7 @@ typedef std::map<std::string, base::Stats<boost::uint64_t> > RpcStatsMap;
 
 class Channel;
 class ChannelManagerImpl;
+class ConnectionPool;
 struct PendingReq;
 class RpcMessage;
 
@@ -187,6 +188,24 @@ class ChannelManager {
   * Remove all entries from the RPC timings map.
   */
   void ClearRpcTimings();
+  /**
+  * Sets the limits of the pool of connections reused by outgoing RPCs.  Can
+  * only be called while the ChannelManager is stopped.
+  * @param max_connections maximum number of pooled connections, 0 to open a
+  * new connection for every RPC
+  * @param idle_timeout milliseconds after which an unused connection is closed
+  * @return True if the limits were set, False if the object is started
+  */
+  bool SetConnectionPool(const boost::uint16_t &max_connections,
+                         const boost::uint32_t &idle_timeout);
+  /**
+  * @return the number of connections currently held in the pool.
+  */
+  size_t PooledConnections();
+  /**
+  * @return the pool of connections used by the channels to send requests.
+  */
+  ConnectionPool* connection_pool();
  private:
   boost::shared_ptr<ChannelManagerImpl> pimpl_;
 };
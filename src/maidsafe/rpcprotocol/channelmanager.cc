@@ -106,4 +106,17 @@ RpcStatsMap ChannelManager::RpcTimings() {
 void ChannelManager::ClearRpcTimings() {
   return pimpl_->ClearRpcTimings();
 }
+
+bool ChannelManager::SetConnectionPool(const boost::uint16_t &max_connections,
+                                       const boost::uint32_t &idle_timeout) {
+  return pimpl_->SetConnectionPool(max_connections, idle_timeout);
+}
+
+size_t ChannelManager::PooledConnections() {
+  return pimpl_->PooledConnections();
+}
+
+ConnectionPool* ChannelManager::connection_pool() {
+  return pimpl_->connection_pool();
+}
 }  // namespace rpcprotocol
@@ -26,6 +26,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "maidsafe/rpcprotocol/channelmanagerimpl.h"
+#include <limits>
 #include <list>
 #include "maidsafe/base/log.h"
 #include "maidsafe/base/online.h"
@@ -42,9 +43,12 @@ ChannelManagerImpl::ChannelManagerImpl(
         : transport_handler_(transport_handler), is_started_(false),
           ptimer_(new base::CallLaterTimer), req_mutex_(), channels_mutex_(),
           id_mutex_(), pend_timeout_mutex_(), channels_ids_mutex_(),
-          timings_mutex_(), current_request_id_(0), current_channel_id_(0),
+          timings_mutex_(), sweep_mutex_(), current_request_id_(0),
+          current_channel_id_(0),
           channels_(), pending_req_(), pending_timeout_(), channels_ids_(),
-          rpc_timings_(), delete_channels_cond_(), online_status_id_(0) {}
+          rpc_timings_(), delete_channels_cond_(), online_status_id_(0),
+          connection_pool_(transport_handler),
+          sweep_id_(std::numeric_limits<boost::uint32_t>::max()) {}
 
 ChannelManagerImpl::~ChannelManagerImpl() {
   Stop();
@@ -92,7 +96,7 @@ bool ChannelManagerImpl::DeletePendingRequest(
   pending_req_.erase(it);
   req_mutex_.unlock();
   if (connection_id != 0)
-    transport_handler_->CloseConnection(connection_id, transport_id);
+    ReleaseConnection(connection_id, transport_id, false);
   callback->Run();
   return true;
 }
@@ -116,9 +120,8 @@ bool ChannelManagerImpl::CancelPendingRequest(
   delete it->second.callback;
   pending_req_.erase(it);
   req_mutex_.unlock();
-  if (connection_id != 0) {
-    transport_handler_->CloseConnection(connection_id, transport_id);
-  }
+  if (connection_id != 0)
+    ReleaseConnection(connection_id, transport_id, false);
 
   return true;
 }
@@ -180,6 +183,7 @@ int ChannelManagerImpl::Start() {
       base::OnlineController::Instance()->RegisterObserver(
           lp_node, boost::bind(&ChannelManagerImpl::OnlineStatusChanged,
           this, _1));
+  ScheduleConnectionSweep();
     return 0;
 }
 
@@ -194,6 +198,7 @@ int ChannelManagerImpl::Stop() {
     pending_timeout_.clear();
   }
   ClearCallLaters();
+  connection_pool_.Clear();
   {
     boost::mutex::scoped_lock lock(channels_ids_mutex_);
     while (!channels_ids_.empty()) {
@@ -284,7 +289,7 @@ void ChannelManagerImpl::MessageArrive(const RpcMessage &msg,
         done->Run();
         // TODO(dirvine) FIXREFRESH Check this is not connected to a node in
         // our first kbucketkbucket
-        transport_handler_->CloseConnection(connection_id, transport_id);
+        ReleaseConnection(connection_id, transport_id, false);
       } else {
         req_mutex_.unlock();
         if (transport_handler_->listening_port(transport_id, &lp_node))
@@ -320,7 +325,10 @@ void ChannelManagerImpl::TimerHandler(const boost::uint32_t &request_id) {
     boost::uint32_t connection_id = it->second.connection_id;
     boost::int16_t transport_id = it->second.transport_id;
     boost::uint64_t timeout = it->second.timeout;
-    if (transport_handler_->HasReceivedData(connection_id, transport_id,
+    // Data arriving on a connection shared with other requests may belong to
+    // any of them, so it only extends the timeout of an unshared connection.
+    if (!connection_pool_.Shared(connection_id) &&
+        transport_handler_->HasReceivedData(connection_id, transport_id,
                                             &size_rec)) {
       it->second.size_rec = size_rec;
       req_mutex_.unlock();
@@ -342,7 +350,7 @@ void ChannelManagerImpl::TimerHandler(const boost::uint32_t &request_id) {
       req_mutex_.unlock();
       done->Run();
       if (connection_id != 0)
-        transport_handler_->CloseConnection(connection_id, transport_id);
+        ReleaseConnection(connection_id, transport_id, true);
     }
   } else {
     req_mutex_.unlock();
@@ -368,18 +376,25 @@ void ChannelManagerImpl::ClearCallLaters() {
     pending_req_.clear();
   }
   ptimer_->CancelAll();
+  if (is_started_)
+    ScheduleConnectionSweep();
 }
 
 void ChannelManagerImpl::RequestSent(const boost::uint32_t &connection_id,
                                      const bool &success) {
-  std::map<boost::uint32_t, PendingTimeOut>::iterator it;
+  // Requests on the same connection are sent in the order they were queued.
+  std::map<boost::uint32_t, std::list<PendingTimeOut> >::iterator it;
   boost::mutex::scoped_lock guard(pend_timeout_mutex_);
   it = pending_timeout_.find(connection_id);
   if (it != pending_timeout_.end()) {
+    PendingTimeOut timestruct = it->second.front();
+    it->second.pop_front();
+    if (it->second.empty())
+      pending_timeout_.erase(it);
     if (success) {
-      AddReqToTimer(it->second.request_id, it->second.timeout);
+      AddReqToTimer(timestruct.request_id, timestruct.timeout);
     } else {
-      AddReqToTimer(it->second.request_id, 1000);
+      AddReqToTimer(timestruct.request_id, 1000);
     }
   }
 }
@@ -391,7 +406,41 @@ void ChannelManagerImpl::AddTimeOutRequest(const boost::uint32_t &connection_id,
   timestruct.request_id = request_id;
   timestruct.timeout = timeout;
   boost::mutex::scoped_lock guard(pend_timeout_mutex_);
-  pending_timeout_[connection_id] = timestruct;
+  pending_timeout_[connection_id].push_back(timestruct);
+}
+
+bool ChannelManagerImpl::SetConnectionPool(
+    const boost::uint16_t &max_connections,
+    const boost::uint32_t &idle_timeout) {
+  if (is_started_)
+    return false;
+  connection_pool_.SetLimits(max_connections, idle_timeout);
+  return true;
+}
+
+size_t ChannelManagerImpl::PooledConnections() {
+  return connection_pool_.Size();
+}
+
+void ChannelManagerImpl::ReleaseConnection(
+    const boost::uint32_t &connection_id, const boost::int16_t &transport_id,
+    const bool &failed) {
+  if (!connection_pool_.Release(connection_id, failed))
+    transport_handler_->CloseConnection(connection_id, transport_id);
+}
+
+void ChannelManagerImpl::ScheduleConnectionSweep() {
+  boost::mutex::scoped_lock guard(sweep_mutex_);
+  ptimer_->CancelOne(sweep_id_);
+  sweep_id_ = ptimer_->AddCallLater(connection_pool_.idle_timeout() / 2 + 1,
+      boost::bind(&ChannelManagerImpl::SweepIdleConnections, this));
+}
+
+void ChannelManagerImpl::SweepIdleConnections() {
+  if (!is_started_)
+    return;
+  connection_pool_.CloseIdle();
+  ScheduleConnectionSweep();
 }
 
 void ChannelManagerImpl::OnlineStatusChanged(const bool&) {
@@ -28,6 +28,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef MAIDSAFE_RPCPROTOCOL_CHANNELMANAGERIMPL_H_
 #define MAIDSAFE_RPCPROTOCOL_CHANNELMANAGERIMPL_H_
 
+#include <list>
 #include <map>
 #include <set>
 #include <string>
@@ -39,6 +40,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "maidsafe/base/calllatertimer.h"
 #include "maidsafe/maidsafe-dht.h"
 #include "maidsafe/rpcprotocol/channelimpl.h"
+#include "maidsafe/rpcprotocol/connectionpool.h"
 #include "maidsafe/transport/transport-api.h"
 
 namespace rpcprotocol {
@@ -86,8 +88,18 @@ class ChannelManagerImpl {
   bool RegisterNotifiersToTransport();
   RpcStatsMap RpcTimings();
   void ClearRpcTimings();
+  bool SetConnectionPool(const boost::uint16_t &max_connections,
+                         const boost::uint32_t &idle_timeout);
+  size_t PooledConnections();
+  ConnectionPool* connection_pool() { return &connection_pool_; }
  private:
+  void ReleaseConnection(const boost::uint32_t &connection_id,
+                         const boost::int16_t &transport_id,
+                         const bool &failed);
   void TimerHandler(const boost::uint32_t &request_id);
+  // Closes idle pooled connections every half idle timeout while started.
+  void ScheduleConnectionSweep();
+  void SweepIdleConnections();
   void RequestSent(const boost::uint32_t &connection_id, const bool &success);
   void OnlineStatusChanged(const bool &online);
   void MessageArrive(const RpcMessage &msg,
@@ -98,17 +110,19 @@ class ChannelManagerImpl {
   bool is_started_;
   boost::shared_ptr<base::CallLaterTimer> ptimer_;
   boost::mutex req_mutex_, channels_mutex_, id_mutex_, pend_timeout_mutex_,
-      channels_ids_mutex_, timings_mutex_;
+      channels_ids_mutex_, timings_mutex_, sweep_mutex_;
   boost::uint32_t current_request_id_, current_channel_id_;
   std::map<std::string, Channel*> channels_;
   std::map<boost::uint32_t, PendingReq> pending_req_;
   ChannelManagerImpl(const ChannelManagerImpl&);
   ChannelManagerImpl& operator=(const ChannelManagerImpl&);
-  std::map<boost::uint32_t, PendingTimeOut> pending_timeout_;
+  std::map<boost::uint32_t, std::list<PendingTimeOut> > pending_timeout_;
   std::set<boost::uint32_t> channels_ids_;
   RpcStatsMap rpc_timings_;
   boost::condition_variable delete_channels_cond_;
   boost::uint16_t online_status_id_;
+  ConnectionPool connection_pool_;
+  boost::uint32_t sweep_id_;
 };
 }  // namespace rpcprotocol
 #endif  // MAIDSAFE_RPCPROTOCOL_CHANNELMANAGERIMPL_H_
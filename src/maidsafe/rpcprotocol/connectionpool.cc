@@ -0,0 +1,204 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "maidsafe/rpcprotocol/connectionpool.h"
+#include <boost/lexical_cast.hpp>
+#include "maidsafe/base/log.h"
+#include "maidsafe/base/utils.h"
+#include "maidsafe/maidsafe-dht_config.h"
+#include "maidsafe/transport/transporthandler-api.h"
+
+namespace rpcprotocol {
+
+ConnectionPool::ConnectionPool(transport::TransportHandler *transport_handler)
+    : transport_handler_(transport_handler),
+      max_connections_(kMaxPooledConnections),
+      idle_timeout_(kPooledConnectionIdleTimeout), peers_(), connections_(),
+      mutex_() {}
+
+ConnectionPool::~ConnectionPool() {
+  Clear();
+}
+
+void ConnectionPool::SetLimits(const boost::uint16_t &max_connections,
+                               const boost::uint32_t &idle_timeout) {
+  boost::mutex::scoped_lock guard(mutex_);
+  max_connections_ = max_connections;
+  idle_timeout_ = idle_timeout;
+}
+
+int ConnectionPool::Acquire(const boost::int16_t &transport_id,
+                            const std::string &remote_ip,
+                            const boost::uint16_t &remote_port,
+                            const std::string &local_ip,
+                            const boost::uint16_t &local_port,
+                            const std::string &rendezvous_ip,
+                            const boost::uint16_t &rendezvous_port,
+                            boost::uint32_t *connection_id,
+                            bool *new_connection) {
+  std::string peer(boost::lexical_cast<std::string>(transport_id) + ":" +
+                   remote_ip + ":" +
+                   boost::lexical_cast<std::string>(remote_port) + ":" +
+                   rendezvous_ip + ":" +
+                   boost::lexical_cast<std::string>(rendezvous_port));
+  {
+    boost::mutex::scoped_lock guard(mutex_);
+    std::map<std::string, boost::uint32_t>::iterator peer_it =
+        peers_.find(peer);
+    if (peer_it != peers_.end()) {
+      std::map<boost::uint32_t, PooledConnection>::iterator it =
+          connections_.find(peer_it->second);
+      if (transport_handler_->ConnectionExists(it->first, transport_id)) {
+        ++it->second.outstanding;
+        it->second.last_used = base::GetEpochMilliseconds();
+        *connection_id = it->first;
+        *new_connection = false;
+        return 0;
+      }
+      // The transport has dropped the connection.
+      peers_.erase(peer_it);
+      if (it->second.outstanding == 0)
+        connections_.erase(it);
+      else
+        it->second.retired = true;
+    }
+  }
+
+  int result = transport_handler_->ConnectToSend(remote_ip, remote_port,
+      local_ip, local_port, rendezvous_ip, rendezvous_port, true,
+      connection_id, transport_id);
+  if (result != 0)
+    return result;
+  *new_connection = true;
+
+  boost::mutex::scoped_lock guard(mutex_);
+  boost::uint64_t now = base::GetEpochMilliseconds();
+  // If another request connected to the peer meanwhile, or there is no room,
+  // the new connection is used for this request only.
+  if (peers_.find(peer) != peers_.end() || !EvictIdle(now))
+    return 0;
+  PooledConnection connection;
+  connection.peer = peer;
+  connection.transport_id = transport_id;
+  connection.outstanding = 1;
+  connection.last_used = now;
+  connections_[*connection_id] = connection;
+  peers_[peer] = *connection_id;
+  return 0;
+}
+
+bool ConnectionPool::Release(const boost::uint32_t &connection_id,
+                             const bool &failed) {
+  boost::mutex::scoped_lock guard(mutex_);
+  std::map<boost::uint32_t, PooledConnection>::iterator it =
+      connections_.find(connection_id);
+  if (it == connections_.end())
+    return false;
+  if (it->second.outstanding > 0)
+    --it->second.outstanding;
+  it->second.last_used = base::GetEpochMilliseconds();
+  if (failed && !it->second.retired) {
+    it->second.retired = true;
+    peers_.erase(it->second.peer);
+  }
+  if (it->second.retired && it->second.outstanding == 0) {
+    connections_.erase(it);
+    return false;
+  }
+  return true;
+}
+
+bool ConnectionPool::Shared(const boost::uint32_t &connection_id) {
+  boost::mutex::scoped_lock guard(mutex_);
+  std::map<boost::uint32_t, PooledConnection>::iterator it =
+      connections_.find(connection_id);
+  return it != connections_.end() && it->second.outstanding > 1;
+}
+
+void ConnectionPool::CloseIdle() {
+  boost::mutex::scoped_lock guard(mutex_);
+  boost::uint64_t now = base::GetEpochMilliseconds();
+  std::map<boost::uint32_t, PooledConnection>::iterator it =
+      connections_.begin();
+  while (it != connections_.end()) {
+    if (it->second.outstanding == 0 && !it->second.retired &&
+        now - it->second.last_used >= idle_timeout_)
+      Erase(it++);
+    else
+      ++it;
+  }
+}
+
+void ConnectionPool::Clear() {
+  boost::mutex::scoped_lock guard(mutex_);
+  while (!connections_.empty())
+    Erase(connections_.begin());
+}
+
+size_t ConnectionPool::Size() {
+  boost::mutex::scoped_lock guard(mutex_);
+  return connections_.size();
+}
+
+boost::uint32_t ConnectionPool::idle_timeout() {
+  boost::mutex::scoped_lock guard(mutex_);
+  return idle_timeout_;
+}
+
+bool ConnectionPool::EvictIdle(const boost::uint64_t &now) {
+  std::map<boost::uint32_t, PooledConnection>::iterator it, lru;
+  lru = connections_.end();
+  it = connections_.begin();
+  while (it != connections_.end()) {
+    if (it->second.outstanding != 0 || it->second.retired) {
+      ++it;
+    } else if (now - it->second.last_used >= idle_timeout_) {
+      Erase(it++);
+    } else {
+      if (lru == connections_.end() ||
+          it->second.last_used < lru->second.last_used)
+        lru = it;
+      ++it;
+    }
+  }
+  if (connections_.size() < max_connections_)
+    return true;
+  if (lru == connections_.end())
+    return false;
+  Erase(lru);
+  return connections_.size() < max_connections_;
+}
+
+void ConnectionPool::Erase(
+    std::map<boost::uint32_t, PooledConnection>::iterator it) {
+  if (!it->second.retired)
+    peers_.erase(it->second.peer);
+  transport_handler_->CloseConnection(it->first, it->second.transport_id);
+  connections_.erase(it);
+}
+
+}  // namespace rpcprotocol
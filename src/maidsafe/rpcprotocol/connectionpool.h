@@ -0,0 +1,108 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MAIDSAFE_RPCPROTOCOL_CONNECTIONPOOL_H_
+#define MAIDSAFE_RPCPROTOCOL_CONNECTIONPOOL_H_
+
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+#include <map>
+#include <string>
+
+namespace transport {
+class TransportHandler;
+}  // namespace transport
+
+namespace rpcprotocol {
+
+struct PooledConnection {
+  PooledConnection() : peer(), transport_id(0), outstanding(0), last_used(0),
+                       retired(false) {}
+  std::string peer;
+  boost::int16_t transport_id;
+  boost::uint16_t outstanding;
+  boost::uint64_t last_used;
+  bool retired;
+};
+
+// Keeps connections to peers open after an RPC completes so that later RPCs
+// to the same peer reuse them.  Several requests may be outstanding on one
+// connection at a time; their responses are matched by message_id.
+class ConnectionPool {
+ public:
+  explicit ConnectionPool(transport::TransportHandler *transport_handler);
+  ~ConnectionPool();
+  // Sets the maximum number of pooled connections and the idle time (in
+  // milliseconds) after which an unused one is closed.
+  void SetLimits(const boost::uint16_t &max_connections,
+                 const boost::uint32_t &idle_timeout);
+  // Sets connection_id to an open connection to the peer, connecting a new
+  // one if none is pooled.  new_connection is set to true when the
+  // connection has just been made, in which case the first message must be
+  // sent with new_socket set.  Returns 0 on success, otherwise the result of
+  // TransportHandler::ConnectToSend.
+  int Acquire(const boost::int16_t &transport_id,
+              const std::string &remote_ip,
+              const boost::uint16_t &remote_port,
+              const std::string &local_ip,
+              const boost::uint16_t &local_port,
+              const std::string &rendezvous_ip,
+              const boost::uint16_t &rendezvous_port,
+              boost::uint32_t *connection_id,
+              bool *new_connection);
+  // Marks one request on the connection as finished.  If failed is true the
+  // connection is not handed out again.  Returns false if the connection is
+  // not (or no longer) held by the pool, in which case the caller must close
+  // it.
+  bool Release(const boost::uint32_t &connection_id, const bool &failed);
+  // Returns true if more than one request is outstanding on the connection.
+  bool Shared(const boost::uint32_t &connection_id);
+  // Closes pooled connections that have been unused for idle_timeout.
+  void CloseIdle();
+  // Closes all pooled connections.
+  void Clear();
+  size_t Size();
+  boost::uint32_t idle_timeout();
+ private:
+  ConnectionPool(const ConnectionPool&);
+  ConnectionPool& operator=(const ConnectionPool&);
+  // Closes idle connections older than idle_timeout_ and, if the pool is
+  // still full, the least recently used idle one.  Returns true if there is
+  // room for another connection.  Must be called with mutex_ held.
+  bool EvictIdle(const boost::uint64_t &now);
+  void Erase(std::map<boost::uint32_t, PooledConnection>::iterator it);
+  transport::TransportHandler *transport_handler_;
+  boost::uint16_t max_connections_;
+  boost::uint32_t idle_timeout_;
+  std::map<std::string, boost::uint32_t> peers_;
+  std::map<boost::uint32_t, PooledConnection> connections_;
+  boost::mutex mutex_;
+};
+
+}  // namespace rpcprotocol
+
+#endif  // MAIDSAFE_RPCPROTOCOL_CONNECTIONPOOL_H_
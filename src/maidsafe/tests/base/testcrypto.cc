@@ -26,11 +26,15 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <gtest/gtest.h>
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <cstdio>
 #include <cstdlib>
+#include <string>
+#include <vector>
 #include "maidsafe/base/crypto.h"
 #include "maidsafe/maidsafe-dht.h"
 
@@ -901,6 +905,280 @@ TEST(CryptoTest, BEH_BASE_AsymSign) {
   }
 }
 
+TEST(CryptoTest, BEH_BASE_AsymCheckSigCache) {
+  RsaKeyPair rsakp;
+  rsakp.GenerateKeys(4096);
+  const std::string kPublicKey(rsakp.public_key());
+  const std::string kPrivateKey(rsakp.private_key());
+  Crypto test_crypto;
+  const std::string kTestData(base::RandomString(1000));
+  const std::string kSignature(test_crypto.AsymSign(kTestData, "",
+                                                    kPrivateKey,
+                                                    STRING_STRING));
+  ASSERT_FALSE(kSignature.empty());
+  Crypto::ClearSignatureCache();
+  ASSERT_EQ(size_t(0), Crypto::VerifiedSignatureCacheSize());
+
+  // Only valid signatures are remembered
+  std::string bad_signature(kSignature);
+  bad_signature[0] ^= 1;
+  EXPECT_FALSE(test_crypto.AsymCheckSig(kTestData, bad_signature, kPublicKey,
+                                        STRING_STRING));
+  EXPECT_EQ(size_t(0), Crypto::VerifiedSignatureCacheSize());
+  EXPECT_TRUE(test_crypto.AsymCheckSig(kTestData, kSignature, kPublicKey,
+                                       STRING_STRING));
+  EXPECT_EQ(size_t(1), Crypto::VerifiedSignatureCacheSize());
+  EXPECT_TRUE(test_crypto.AsymCheckSig(kTestData, kSignature, kPublicKey,
+                                       STRING_STRING));
+  EXPECT_EQ(size_t(1), Crypto::VerifiedSignatureCacheSize());
+
+  // A cached signature doesn't validate other data, signatures or keys
+  EXPECT_FALSE(test_crypto.AsymCheckSig(kTestData + "a", kSignature,
+                                        kPublicKey, STRING_STRING));
+  EXPECT_FALSE(test_crypto.AsymCheckSig(kTestData, bad_signature, kPublicKey,
+                                        STRING_STRING));
+  rsakp.GenerateKeys(4096);
+  EXPECT_FALSE(test_crypto.AsymCheckSig(kTestData, kSignature,
+                                        rsakp.public_key(), STRING_STRING));
+  EXPECT_EQ(size_t(1), Crypto::VerifiedSignatureCacheSize());
+
+  Crypto::ClearSignatureCache();
+  EXPECT_EQ(size_t(0), Crypto::VerifiedSignatureCacheSize());
+  EXPECT_TRUE(test_crypto.AsymCheckSig(kTestData, kSignature, kPublicKey,
+                                       STRING_STRING));
+}
+
+namespace {
+
+void CheckSigDone(boost::mutex *mutex, boost::condition_variable *cond,
+                  int *results, int *valid, bool result) {
+  boost::mutex::scoped_lock guard(*mutex);
+  ++*results;
+  if (result)
+    ++*valid;
+  cond->notify_all();
+}
+
+void Block(boost::mutex *mutex, boost::condition_variable *cond,
+           bool *release) {
+  boost::mutex::scoped_lock guard(*mutex);
+  while (!*release)
+    cond->wait(guard);
+}
+
+}  // namespace
+
+TEST(CryptoTest, BEH_BASE_CryptoExecutor) {
+  RsaKeyPair rsakp;
+  rsakp.GenerateKeys(4096);
+  Crypto test_crypto;
+  const std::string kTestData(base::RandomString(1000));
+  const std::string kSignature(test_crypto.AsymSign(kTestData, "",
+                                                    rsakp.private_key(),
+                                                    STRING_STRING));
+  boost::mutex mutex;
+  boost::condition_variable cond;
+  int results(0), valid(0);
+  {
+    CryptoExecutor executor(2, 10);
+    EXPECT_TRUE(executor.AsymCheckSig(kTestData, kSignature,
+        rsakp.public_key(), boost::bind(&CheckSigDone, &mutex, &cond,
+                                        &results, &valid, _1)));
+    EXPECT_TRUE(executor.AsymCheckSig(kTestData + "a", kSignature,
+        rsakp.public_key(), boost::bind(&CheckSigDone, &mutex, &cond,
+                                        &results, &valid, _1)));
+    boost::mutex::scoped_lock guard(mutex);
+    while (results < 2)
+      cond.wait(guard);
+    EXPECT_EQ(1, valid);
+  }
+
+  // Tasks beyond the queue's limit are refused while the threads are busy
+  bool release(false);
+  {
+    CryptoExecutor executor(1, 2);
+    ASSERT_TRUE(executor.Submit(boost::bind(&Block, &mutex, &cond,
+                                            &release)));
+    while (executor.Queued() != 0)
+      boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    EXPECT_TRUE(executor.AsymCheckSig(kTestData, kSignature,
+        rsakp.public_key(), boost::bind(&CheckSigDone, &mutex, &cond,
+                                        &results, &valid, _1)));
+    EXPECT_TRUE(executor.AsymCheckSig(kTestData, kSignature,
+        rsakp.public_key(), boost::bind(&CheckSigDone, &mutex, &cond,
+                                        &results, &valid, _1)));
+    EXPECT_FALSE(executor.AsymCheckSig(kTestData, kSignature,
+        rsakp.public_key(), boost::bind(&CheckSigDone, &mutex, &cond,
+                                        &results, &valid, _1)));
+    EXPECT_EQ(size_t(2), executor.Queued());
+    {
+      boost::mutex::scoped_lock guard(mutex);
+      release = true;
+    }
+    cond.notify_all();
+  }
+  // Queued tasks are run before the executor is destroyed
+  EXPECT_EQ(4, results);
+  EXPECT_EQ(3, valid);
+  CryptoExecutor no_threads(0, 10);
+  EXPECT_FALSE(no_threads.Submit(boost::bind(&Block, &mutex, &cond,
+                                             &release)));
+}
+
+TEST(CryptoTest, BEH_BASE_AsymCheckSigs) {
+  RsaKeyPair rsakp;
+  rsakp.GenerateKeys(4096);
+  const std::string kPublicKey(rsakp.public_key());
+  const std::string kPrivateKey(rsakp.private_key());
+  rsakp.GenerateKeys(4096);
+  const std::string kAnotherPublicKey(rsakp.public_key());
+  Crypto test_crypto;
+  std::vector<SignedData> items;
+  for (int i = 0; i < 10; ++i) {
+    std::string data(base::RandomString(100));
+    items.push_back(SignedData(data, test_crypto.AsymSign(data, "",
+        kPrivateKey, STRING_STRING), kPublicKey));
+  }
+  items[1].data += "a";
+  items[3].public_key = kAnotherPublicKey;
+  items[5].public_key = kPublicKey.substr(0, kPublicKey.size() - 1);
+  items[7].signature.clear();
+  std::vector<bool> results;
+  for (boost::uint16_t threads = 0; threads < 4; ++threads) {
+    Crypto::ClearSignatureCache();
+    EXPECT_EQ(size_t(6), test_crypto.AsymCheckSigs(items, threads, &results));
+    ASSERT_EQ(items.size(), results.size());
+    for (size_t i = 0; i < results.size(); ++i) {
+      EXPECT_EQ(test_crypto.AsymCheckSig(items[i].data, items[i].signature,
+                                         items[i].public_key, STRING_STRING),
+                results[i]);
+    }
+  }
+  EXPECT_EQ(size_t(0), test_crypto.AsymCheckSigs(std::vector<SignedData>(), 2,
+                                                 &results));
+  EXPECT_TRUE(results.empty());
+}
+
+TEST(CryptoTest, FUNC_BASE_AsymCheckSigsThroughput) {
+  const size_t kKeys(4), kSignatures(400);
+  const boost::uint16_t kThreads(4);
+  std::vector<std::string> public_keys, private_keys;
+  RsaKeyPair rsakp;
+  for (size_t i = 0; i < kKeys; ++i) {
+    rsakp.GenerateKeys(4096);
+    public_keys.push_back(rsakp.public_key());
+    private_keys.push_back(rsakp.private_key());
+  }
+  Crypto test_crypto;
+  std::vector<SignedData> items;
+  for (size_t i = 0; i < kSignatures; ++i) {
+    std::string data(base::RandomString(1000));
+    items.push_back(SignedData(data, test_crypto.AsymSign(data, "",
+        private_keys[i % kKeys], STRING_STRING), public_keys[i % kKeys]));
+  }
+
+  Crypto::ClearSignatureCache();
+  boost::posix_time::ptime start(
+      boost::posix_time::microsec_clock::universal_time());
+  for (size_t i = 0; i < items.size(); ++i) {
+    ASSERT_TRUE(test_crypto.AsymCheckSig(items[i].data, items[i].signature,
+                                         items[i].public_key, STRING_STRING));
+  }
+  boost::posix_time::time_duration single(
+      boost::posix_time::microsec_clock::universal_time() - start);
+
+  std::vector<bool> results;
+  Crypto::ClearSignatureCache();
+  start = boost::posix_time::microsec_clock::universal_time();
+  ASSERT_EQ(kSignatures, test_crypto.AsymCheckSigs(items, 1, &results));
+  boost::posix_time::time_duration batch(
+      boost::posix_time::microsec_clock::universal_time() - start);
+
+  Crypto::ClearSignatureCache();
+  start = boost::posix_time::microsec_clock::universal_time();
+  ASSERT_EQ(kSignatures, test_crypto.AsymCheckSigs(items, kThreads, &results));
+  boost::posix_time::time_duration threaded(
+      boost::posix_time::microsec_clock::universal_time() - start);
+
+  start = boost::posix_time::microsec_clock::universal_time();
+  ASSERT_EQ(kSignatures, test_crypto.AsymCheckSigs(items, 1, &results));
+  boost::posix_time::time_duration cached(
+      boost::posix_time::microsec_clock::universal_time() - start);
+
+  printf("Verifying %u signatures under %u keys:\n",
+         static_cast<unsigned>(kSignatures), static_cast<unsigned>(kKeys));
+  printf("  one at a time:        %6d ms\n",
+         static_cast<int>(single.total_milliseconds()));
+  printf("  batch, 1 thread:      %6d ms\n",
+         static_cast<int>(batch.total_milliseconds()));
+  printf("  batch, %u threads:     %6d ms\n", kThreads,
+         static_cast<int>(threaded.total_milliseconds()));
+  printf("  batch, already known: %6d ms\n",
+         static_cast<int>(cached.total_milliseconds()));
+}
+
+TEST(CryptoTest, BEH_BASE_StreamingContexts) {
+  Crypto test_crypto;
+  const std::string kTestData(base::RandomString(100000));
+  const size_t kPieces[] = { 0, 1, 999, 50000, 100000 };
+
+  // Hashing in pieces gives the same digests as Crypto::Hash
+  HashType types[] = { SHA_512, SHA_1, SHA_256, SHA_384 };
+  for (int t = 0; t < 4; ++t) {
+    test_crypto.set_hash_algorithm(types[t]);
+    HashContext hash(types[t]);
+    for (int i = 0; i < 4; ++i)
+      hash.Update(kTestData.data() + kPieces[i], kPieces[i + 1] - kPieces[i]);
+    EXPECT_EQ(test_crypto.Hash(kTestData, "", STRING_STRING, true),
+              hash.Final(true));
+    hash.Update(kTestData);
+    EXPECT_EQ(test_crypto.Hash(kTestData, "", STRING_STRING, false),
+              hash.Final(false));
+    EXPECT_EQ(test_crypto.Hash(kTestData, "", STRING_STRING, false),
+              test_crypto.Hash(kTestData.data(), kTestData.size(), false));
+  }
+
+  // Signing in pieces gives the same signature as Crypto::AsymSign
+  RsaKeyPair rsakp;
+  rsakp.GenerateKeys(4096);
+  const std::string kPublicKey(rsakp.public_key());
+  const std::string kPrivateKey(rsakp.private_key());
+  const std::string kSignature(test_crypto.AsymSign(kTestData, "",
+                                                    kPrivateKey,
+                                                    STRING_STRING));
+  SignContext sign(kPrivateKey);
+  for (int i = 0; i < 4; ++i)
+    sign.Update(kTestData.data() + kPieces[i], kPieces[i + 1] - kPieces[i]);
+  EXPECT_EQ(kSignature, sign.Final());
+  sign.Update(kTestData);
+  EXPECT_EQ(kSignature, sign.Final());
+  EXPECT_EQ(kSignature, test_crypto.AsymSign(kTestData.data(),
+                                             kTestData.size(), kPrivateKey));
+  SignContext bad_sign(kPublicKey);
+  bad_sign.Update(kTestData);
+  EXPECT_TRUE(bad_sign.Final().empty());
+
+  // Verifying in pieces
+  VerifyContext verify(kPublicKey, kSignature);
+  for (int i = 0; i < 4; ++i)
+    verify.Update(kTestData.data() + kPieces[i], kPieces[i + 1] - kPieces[i]);
+  EXPECT_TRUE(verify.Final());
+  EXPECT_FALSE(verify.Final());
+  VerifyContext bad_data(kPublicKey, kSignature);
+  bad_data.Update(kTestData.data(), kTestData.size() - 1);
+  EXPECT_FALSE(bad_data.Final());
+  VerifyContext bad_signature(kPublicKey, kSignature.substr(1));
+  bad_signature.Update(kTestData);
+  EXPECT_FALSE(bad_signature.Final());
+  VerifyContext bad_key(kPrivateKey, kSignature);
+  bad_key.Update(kTestData);
+  EXPECT_FALSE(bad_key.Final());
+  EXPECT_TRUE(test_crypto.AsymCheckSig(kTestData.data(), kTestData.size(),
+                                       kSignature, kPublicKey));
+  EXPECT_FALSE(test_crypto.AsymCheckSig(kTestData.data(), kTestData.size() - 1,
+                                        kSignature, kPublicKey));
+}
+
 TEST(CryptoTest, BEH_BASE_Compress) {
   const size_t kTestDataSize(10000);
   const size_t kTolerance(kTestDataSize * 0.005);
@@ -156,7 +156,9 @@ int main(int argc, char **argv) {
       ("iterations,i", po::value(&iterations)->default_value(iterations),
         "Number of repetitions per Kad operation.")
       ("max_nodes", po::value(&max_nodes)->default_value(max_nodes),
-        "Maximum number of nodes taken from id_list for Kad operations.");
+        "Maximum number of nodes taken from id_list for Kad operations.")
+      ("crypto", po::bool_switch(),
+        "Only measure local hash and cipher throughput, then exit.");
       // TODO(Team#5#): 2010-04-19 - options: disable benchmarks, delay, sizes
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -164,6 +166,12 @@ int main(int argc, char **argv) {
       std::cout << desc << "\n";
       return 0;
     }
+    if (vm["crypto"].as<bool>()) {
+      printf("\n[ Testing crypto throughput ]\n");
+      benchmark::Operations::TestCryptoThroughput(
+          vm["iterations"].as<int>());
+      return 0;
+    }
     option_dependency(vm, "bs_id", "bs_ip");
     option_dependency(vm, "bs_ip", "bs_id");
     option_dependency(vm, "bs_id", "bs_port");
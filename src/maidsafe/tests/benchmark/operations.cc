@@ -40,12 +40,55 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string>
 #include <vector>
 
+#include "maidsafe/cryptopp/aes.h"
+#include "maidsafe/cryptopp/cpu.h"
+#include "maidsafe/cryptopp/modes.h"
+#include "maidsafe/cryptopp/sha.h"
 #include "maidsafe/protobuf/kademlia_service_messages.pb.h"
 #include "maidsafe/maidsafe-dht.h"
 
 
 namespace benchmark {
 
+namespace {
+
+// Amount of data pushed through each primitive per iteration.
+const size_t kCryptoBytesPerIteration(16 << 20);
+
+void HashData(CryptoPP::HashTransformation *hash, const byte *data,
+              const size_t &size) {
+  byte digest[CryptoPP::SHA512::DIGESTSIZE];
+  hash->CalculateDigest(digest, data, size);
+}
+
+void CipherData(CryptoPP::StreamTransformation *cipher, byte *output,
+                const byte *data, const size_t &size) {
+  cipher->ProcessData(output, data, size);
+}
+
+// Prints min/avg/max MB/s of running |process| over kCryptoBytesPerIteration
+// bytes, fed in |size|-byte messages.
+void PrintThroughput(
+    const std::string &name, const size_t &size, const int &iterations,
+    boost::function<void(const byte*, const size_t&)> process) {  // NOLINT
+  std::string data(size, 'a');
+  const byte *input(reinterpret_cast<const byte*>(data.data()));
+  base::Stats<double> stats;
+  for (int i = 0; i < iterations; ++i) {
+    boost::uint64_t t = base::GetEpochNanoseconds();
+    for (size_t done = 0; done < kCryptoBytesPerIteration; done += size)
+      process(input, size);
+    boost::uint64_t elapsed = base::GetEpochNanoseconds() - t;
+    stats.Add(kCryptoBytesPerIteration * 1000.0 /
+              (elapsed == 0 ? 1 : elapsed));
+  }
+  printf(" %-12s %6u B: min/avg/max %8.1f/%8.1f/%8.1f MB/s\n", name.c_str(),
+         static_cast<unsigned int>(size), stats.Min(), stats.Mean(),
+         stats.Max());
+}
+
+}  // namespace
+
 Operations::Operations(kad::KNode *node)
     : node_(node), cryobj_(), private_key_(), public_key_(),
       public_key_signature_() {
@@ -299,6 +342,33 @@ kad::KadId Operations::GetModId(int iteration) {
   return id ^ kad::KadId(iteration);
 }
 
+void Operations::TestCryptoThroughput(const int &iterations) {
+  printf("AES-NI: %s, SHA extensions: %s\n",
+         CryptoPP::HasAESNI() ? "yes" : "no",
+         CryptoPP::HasSHA() ? "yes" : "no");
+  CryptoPP::SHA256 sha256;
+  CryptoPP::SHA512 sha512;
+  byte key[CryptoPP::AES::MAX_KEYLENGTH] = {0};
+  byte iv[CryptoPP::AES::BLOCKSIZE] = {0};
+  CryptoPP::CFB_Mode<CryptoPP::AES>::Encryption encryptor(key, sizeof(key),
+                                                          iv);
+  CryptoPP::CFB_Mode<CryptoPP::AES>::Decryption decryptor(key, sizeof(key),
+                                                          iv);
+  // Hashes of RPC-sized messages, then bulk value sizes.
+  const size_t kSizes[] = {64, 1024, 64 << 10};
+  for (size_t i = 0; i < sizeof(kSizes) / sizeof(kSizes[0]); ++i) {
+    std::vector<byte> output(kSizes[i]);
+    PrintThroughput("SHA-256", kSizes[i], iterations,
+                    boost::bind(&HashData, &sha256, _1, _2));
+    PrintThroughput("SHA-512", kSizes[i], iterations,
+                    boost::bind(&HashData, &sha512, _1, _2));
+    PrintThroughput("AES-256/CFB+", kSizes[i], iterations,
+                    boost::bind(&CipherData, &encryptor, &output[0], _1, _2));
+    PrintThroughput("AES-256/CFB-", kSizes[i], iterations,
+                    boost::bind(&CipherData, &decryptor, &output[0], _1, _2));
+  }
+}
+
 void Operations::PrintRpcTimings(const rpcprotocol::RpcStatsMap &rpc_timings) {
   std::cout << boost::format("Calls  RPC Name  %40t% min/avg/max\n");
   for (rpcprotocol::RpcStatsMap::const_iterator it = rpc_timings.begin();
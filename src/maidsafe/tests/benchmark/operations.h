@@ -63,6 +63,8 @@ class Operations {
                         const int &iterations, const bool &sign);
   static kad::KadId GetModId(int iteration);
   static void PrintRpcTimings(const rpcprotocol::RpcStatsMap &rpc_timings);
+  // Local throughput of the hash and cipher primitives used by base::Crypto.
+  static void TestCryptoThroughput(const int &iterations);
  private:
   Operations(const Operations&);
   Operations& operator=(const Operations&);
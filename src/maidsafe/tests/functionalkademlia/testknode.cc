@@ -758,6 +758,116 @@ TEST_F(KNodeTest, FUNC_KAD_StoreAndLoad100Values) {
   printf("\nDone\n");
 }
 
+TEST_F(KNodeTest, FUNC_KAD_StoreAndFindBatch) {
+  // More entries than fit in one BatchStore RPC, spread over several keys
+  const size_t kKeyCount(4);
+  const size_t kValuesPerKey(kad::kMaxBatchSize / kKeyCount + 8);
+  std::string pub_key, priv_key, sig_pub_key, sig_req;
+  create_rsakeys(&pub_key, &priv_key);
+  std::vector<kad::KadId> keys;
+  std::vector<kad::StoreEntry> entries;
+  for (size_t k = 0; k < kKeyCount; ++k) {
+    keys.push_back(kad::KadId(cry_obj_.Hash("batch" + base::IntToString(k),
+                                            "", crypto::STRING_STRING,
+                                            false)));
+    create_req(pub_key, priv_key, keys[k].String(), &sig_pub_key, &sig_req);
+    kad::StoreEntry entry;
+    entry.key = keys[k];
+    entry.signed_request.set_signer_id(knodes_[1]->node_id().String());
+    entry.signed_request.set_public_key(pub_key);
+    entry.signed_request.set_signed_public_key(sig_pub_key);
+    entry.signed_request.set_signed_request(sig_req);
+    entry.ttl = 24 * 3600;
+    for (size_t n = 0; n < kValuesPerKey; ++n) {
+      entry.signed_value.set_value(base::RandomString(64));
+      entry.signed_value.set_value_signature(cry_obj_.AsymSign(
+          entry.signed_value.value(), "", priv_key, crypto::STRING_STRING));
+      entries.push_back(entry);
+    }
+  }
+  ASSERT_LT(static_cast<size_t>(kad::kMaxBatchSize), entries.size());
+  StoreBatchCallback store_cb;
+  knodes_[1]->StoreBatch(entries, boost::bind(&StoreBatchCallback::ResultFunc,
+                                              &store_cb, _1));
+  wait_result(&store_cb);
+  ASSERT_EQ(entries.size(), store_cb.results().size());
+  for (size_t i = 0; i < entries.size(); ++i)
+    EXPECT_TRUE(store_cb.results()[i].succeeded) << "entry " << i;
+
+  // Every entry is held by at least d of the K nodes
+  boost::int16_t d(static_cast<boost::int16_t>
+    (kTestK * kad::kMinSuccessfulPecentageStore));
+  std::vector<boost::int16_t> holders(entries.size(), 0);
+  for (boost::int16_t i = 0; i < kNetworkSize; ++i) {
+    for (size_t k = 0; k < kKeyCount; ++k) {
+      std::vector<std::string> values;
+      knodes_[i]->FindValueLocal(keys[k], &values);
+      std::set<std::string> held;
+      for (size_t n = 0; n < values.size(); ++n) {
+        kad::SignedValue sig_value;
+        ASSERT_TRUE(sig_value.ParseFromString(values[n]));
+        held.insert(sig_value.value());
+      }
+      for (size_t n = k * kValuesPerKey; n < (k + 1) * kValuesPerKey; ++n) {
+        if (held.count(entries[n].signed_value.value()) != 0)
+          ++holders[n];
+      }
+    }
+  }
+  for (size_t i = 0; i < entries.size(); ++i)
+    EXPECT_LE(d, holders[i]) << "entry " << i;
+
+  // FindBatch returns every value of every key
+  FindBatchCallback find_cb;
+  knodes_[kTestK - 1]->FindBatch(keys, false,
+      boost::bind(&FindBatchCallback::ResultFunc, &find_cb, _1));
+  wait_result(&find_cb);
+  ASSERT_EQ(kKeyCount, find_cb.results().size());
+  for (size_t k = 0; k < kKeyCount; ++k) {
+    const kad::FindValueResult &result = find_cb.results()[k];
+    ASSERT_TRUE(result.succeeded) << "key " << k;
+    std::set<std::string> found;
+    for (size_t n = 0; n < result.signed_values.size(); ++n)
+      found.insert(result.signed_values[n].value());
+    for (size_t n = k * kValuesPerKey; n < (k + 1) * kValuesPerKey; ++n)
+      EXPECT_EQ(1U, found.count(entries[n].signed_value.value()));
+  }
+
+  // A key whose closest node lacks the value is still found, by the lookup
+  // FindBatch falls back on
+  kad::KadId missing_key(cry_obj_.Hash("batchmissing", "",
+                                       crypto::STRING_STRING, false));
+  boost::int16_t finder(0), closest(-1);
+  for (boost::int16_t i = 1; i < kNetworkSize; ++i) {
+    if (closest == -1 || kad::KadId::CloserToTarget(knodes_[i]->node_id(),
+            knodes_[closest]->node_id(), missing_key))
+      closest = i;
+  }
+  create_req(pub_key, priv_key, missing_key.String(), &sig_pub_key, &sig_req);
+  kad::SignedValue missing_value;
+  missing_value.set_value(base::RandomString(64));
+  missing_value.set_value_signature(cry_obj_.AsymSign(missing_value.value(),
+                                    "", priv_key, crypto::STRING_STRING));
+  for (boost::int16_t i = 0; i < kNetworkSize; ++i) {
+    if (i != finder && i != closest)
+      ASSERT_TRUE(knodes_[i]->StoreValueLocal(missing_key,
+                  missing_value.SerializeAsString(), 24 * 3600));
+  }
+  std::vector<kad::KadId> missing_keys(1, missing_key);
+  missing_keys.push_back(keys[0]);
+  find_cb.Reset();
+  knodes_[finder]->FindBatch(missing_keys, false,
+      boost::bind(&FindBatchCallback::ResultFunc, &find_cb, _1));
+  wait_result(&find_cb);
+  ASSERT_EQ(missing_keys.size(), find_cb.results().size());
+  ASSERT_TRUE(find_cb.results()[0].succeeded);
+  ASSERT_EQ(1U, find_cb.results()[0].signed_values.size());
+  ASSERT_EQ(missing_value.value(),
+            find_cb.results()[0].signed_values[0].value());
+  ASSERT_TRUE(find_cb.results()[1].succeeded);
+  ASSERT_FALSE(find_cb.results()[1].signed_values.empty());
+}
+
 TEST_F(KNodeTest, FUNC_KAD_LoadNonExistingValue) {
   kad::KadId key(cry_obj_.Hash("bbffddnnoooo8822", "", crypto::STRING_STRING,
       false));
@@ -1506,6 +1616,92 @@ TEST_F(KNodeTest, FUNC_KAD_UpdateValue) {
   ASSERT_EQ(new_sig_value.SerializeAsString(), el_valiu.SerializeAsString());
 }
 
+TEST_F(KNodeTest, FUNC_KAD_TypedStoreFindUpdateDelete) {
+  kad::KadId key(cry_obj_.Hash(base::RandomString(5), "", crypto::STRING_STRING,
+                               false));
+  std::string value(base::RandomString(1024));
+  std::string pub_key, priv_key, sig_pub_key, sig_req;
+  create_rsakeys(&pub_key, &priv_key);
+  create_req(pub_key, priv_key, key.String(), &sig_pub_key, &sig_req);
+  kad::SignedValue sig_value;
+  sig_value.set_value(value);
+  sig_value.set_value_signature(cry_obj_.AsymSign(value, "", priv_key,
+                                                  crypto::STRING_STRING));
+  kad::SignedRequest req;
+  req.set_signer_id(knodes_[kTestK / 2]->node_id().String());
+  req.set_public_key(pub_key);
+  req.set_signed_public_key(sig_pub_key);
+  req.set_signed_request(sig_req);
+
+  StoreValueCallback svcb;
+  knodes_[kTestK / 2]->Store(key, sig_value, req, 24 * 3600,
+                             boost::bind(&StoreValueCallback::ResultFunc,
+                                         &svcb, _1));
+  wait_result(&svcb);
+  ASSERT_EQ(kad::kRpcResultSuccess, svcb.result());
+  boost::int16_t no_value_node(-1);
+  for (boost::int16_t i = 0; i < kNetworkSize; ++i) {
+    std::vector<std::string> values;
+    if (!knodes_[i]->FindValueLocal(key, &values))
+      no_value_node = i;
+  }
+  ASSERT_NE(-1, no_value_node);
+
+  FindCallback find_nodes_cb;
+  knodes_[no_value_node]->FindNodes(key,
+      boost::bind(&FindCallback::NodesResultFunc, &find_nodes_cb, _1));
+  wait_result(&find_nodes_cb);
+  ASSERT_EQ(kad::kRpcResultSuccess, find_nodes_cb.result());
+  ASSERT_EQ(static_cast<size_t>(kTestK), find_nodes_cb.closest_nodes().size());
+
+  FindCallback find_cb;
+  knodes_[no_value_node]->Find(key, false,
+      boost::bind(&FindCallback::ValueResultFunc, &find_cb, _1));
+  wait_result(&find_cb);
+  ASSERT_EQ(kad::kRpcResultSuccess, find_cb.result());
+  ASSERT_EQ(1U, find_cb.signed_values().size());
+  ASSERT_EQ(value, find_cb.signed_values()[0].value());
+
+  kad::SignedValue new_sig_value;
+  std::string new_value(base::RandomString(1024));
+  new_sig_value.set_value(new_value);
+  new_sig_value.set_value_signature(cry_obj_.AsymSign(new_value, "", priv_key,
+                                                      crypto::STRING_STRING));
+  // Every lookup is made by the one node without the value, so no cache copy
+  // is sent.  Update and Delete drop that node's cached result.
+  UpdateValueCallback update_cb;
+  knodes_[no_value_node]->Update(key, sig_value, new_sig_value, req, 24 * 3600,
+                                 boost::bind(&UpdateValueCallback::ResultFunc,
+                                             &update_cb, _1));
+  wait_result(&update_cb);
+  ASSERT_EQ(kad::kRpcResultSuccess, update_cb.result());
+  find_cb.Reset();
+  knodes_[no_value_node]->Find(key, false,
+      boost::bind(&FindCallback::ValueResultFunc, &find_cb, _1));
+  wait_result(&find_cb);
+  ASSERT_EQ(kad::kRpcResultSuccess, find_cb.result());
+  ASSERT_EQ(1U, find_cb.signed_values().size());
+  ASSERT_EQ(new_value, find_cb.signed_values()[0].value());
+
+  DeleteValueCallback del_cb;
+  knodes_[no_value_node]->Delete(key, new_sig_value, req,
+                                 boost::bind(&DeleteValueCallback::ResultFunc,
+                                             &del_cb, _1));
+  wait_result(&del_cb);
+  ASSERT_EQ(kad::kRpcResultSuccess, del_cb.result());
+  for (boost::int16_t i = 0; i < kNetworkSize; ++i) {
+    std::vector<std::string> values;
+    ASSERT_FALSE(knodes_[i]->FindValueLocal(key, &values));
+  }
+  find_cb.Reset();
+  knodes_[no_value_node]->Find(key, false,
+      boost::bind(&FindCallback::ValueResultFunc, &find_cb, _1));
+  wait_result(&find_cb);
+  ASSERT_EQ(kad::kRpcResultFailure, find_cb.result());
+  ASSERT_TRUE(find_cb.signed_values().empty());
+  ASSERT_FALSE(find_cb.closest_nodes().empty());
+}
+
 /*******************************************************************************
 * Test to reproduce the bug reported on issue #13 on the maidsafe-dht website.
 * Node L starts, node M joins, node M leaves, node N joins. Bootstrap of node N
@@ -33,6 +33,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 #include <string>
 #include "maidsafe/maidsafe-dht_config.h"
+#include "maidsafe/kademlia/knode-api.h"
 #include "maidsafe/protobuf/general_messages.pb.h"
 #include "maidsafe/protobuf/kademlia_service_messages.pb.h"
 
@@ -76,6 +77,9 @@ class StoreValueCallback :public FakeCallback {
     }
     result_ = result_msg.result();
   };
+  void ResultFunc(const kad::StoreValueResult &res) {
+    result_ = res.succeeded ? kad::kRpcResultSuccess : kad::kRpcResultFailure;
+  }
   void Reset() {
     result_msg.Clear();
     result_ = "";
@@ -101,6 +105,16 @@ class FindCallback : public FakeCallback {
       signed_values_.push_back(result_msg.signed_values(i));
     result_ = result_msg.result();
   };
+  void ValueResultFunc(const kad::FindValueResult &res) {
+    values_ = res.values;
+    signed_values_ = res.signed_values;
+    AddClosestNodes(res.closest_nodes);
+    result_ = res.succeeded ? kad::kRpcResultSuccess : kad::kRpcResultFailure;
+  }
+  void NodesResultFunc(const kad::FindNodesResult &res) {
+    AddClosestNodes(res.closest_nodes);
+    result_ = res.succeeded ? kad::kRpcResultSuccess : kad::kRpcResultFailure;
+  }
   void Reset() {
     result_msg.Clear();
     result_ = "";
@@ -112,6 +126,13 @@ class FindCallback : public FakeCallback {
   std::vector<std::string> closest_nodes() const {return closest_nodes_;}
   std::vector<kad::SignedValue> signed_values() {return signed_values_;}
  private:
+  void AddClosestNodes(std::vector<kad::Contact> contacts) {
+    for (size_t i = 0; i < contacts.size(); ++i) {
+      std::string ser_contact;
+      contacts[i].SerialiseToString(&ser_contact);
+      closest_nodes_.push_back(ser_contact);
+    }
+  }
   kad::FindResponse result_msg;
   std::vector<std::string> values_;
   std::vector<std::string> closest_nodes_;
@@ -169,6 +190,9 @@ class DeleteValueCallback : public FakeCallback {
     }
     result_ = result_msg.result();
   };
+  void ResultFunc(const bool &succeeded) {
+    result_ = succeeded ? kad::kRpcResultSuccess : kad::kRpcResultFailure;
+  }
   void Reset() {
     result_msg.Clear();
     result_ = "";
@@ -187,6 +211,10 @@ class UpdateValueCallback : public FakeCallback {
     result_ = result_msg.result();
   }
 
+  void ResultFunc(const bool &succeeded) {
+    result_ = succeeded ? kad::kRpcResultSuccess : kad::kRpcResultFailure;
+  }
+
   void Reset() {
     result_msg.Clear();
     result_ = "";
@@ -196,6 +224,44 @@ class UpdateValueCallback : public FakeCallback {
   kad::UpdateResponse result_msg;
 };
 
+class StoreBatchCallback : public FakeCallback {
+ public:
+  StoreBatchCallback() : FakeCallback(), results_() {}
+  void CallbackFunc(const std::string &res) {
+    result_ = res;
+  }
+  void ResultFunc(const std::vector<kad::StoreValueResult> &results) {
+    results_ = results;
+    result_ = kad::kRpcResultSuccess;
+  }
+  void Reset() {
+    results_.clear();
+    result_ = "";
+  }
+  std::vector<kad::StoreValueResult> results() const {return results_;}
+ private:
+  std::vector<kad::StoreValueResult> results_;
+};
+
+class FindBatchCallback : public FakeCallback {
+ public:
+  FindBatchCallback() : FakeCallback(), results_() {}
+  void CallbackFunc(const std::string &res) {
+    result_ = res;
+  }
+  void ResultFunc(const std::vector<kad::FindValueResult> &results) {
+    results_ = results;
+    result_ = kad::kRpcResultSuccess;
+  }
+  void Reset() {
+    results_.clear();
+    result_ = "";
+  }
+  std::vector<kad::FindValueResult> results() const {return results_;}
+ private:
+  std::vector<kad::FindValueResult> results_;
+};
+
 inline void wait_result(FakeCallback *callback) {
   while (1) {
     {
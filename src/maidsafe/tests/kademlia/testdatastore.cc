@@ -26,13 +26,16 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <boost/cstdint.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/lexical_cast.hpp>
 #include <gtest/gtest.h>
+#include <fstream>  // NOLINT
 #include <string>
 #include <vector>
 #include "maidsafe/kademlia/datastore.h"
+#include "maidsafe/kademlia/datastorebackend.h"
 #include "maidsafe/base/crypto.h"
 #include "maidsafe/maidsafe-dht.h"
 
@@ -801,3 +804,153 @@ TEST_F(DataStoreTest, BEH_KAD_UpdateItem) {
   it = value_set.find("bolotas0");
   ASSERT_FALSE(value_set.end() == it);
 }
+
+void StoreAndLoad(kad::DataStore *ds, const int &thread_index,
+                  const int &count, bool *success) {
+  *success = true;
+  for (int i = 0; i < count; ++i) {
+    std::string key("key_" + base::IntToString(thread_index) + "_" +
+                    base::IntToString(i));
+    std::string value("value_" + base::IntToString(i));
+    std::vector<std::string> values;
+    if (!ds->StoreItem(key, value, 3600*24, false) ||
+        !ds->LoadItem(key, &values) || values.size() != 1 ||
+        values[0] != value)
+      *success = false;
+  }
+}
+
+void ScanDataStore(kad::DataStore *ds, const int &count) {
+  for (int i = 0; i < count; ++i) {
+    ds->ValuesToRefresh();
+    ds->DeleteExpiredValues();
+  }
+}
+
+TEST_F(DataStoreTest, BEH_KAD_ConcurrentStoreLoadAndScan) {
+  const int kThreads(8), kItems(200);
+  bool results[kThreads];
+  boost::thread_group threads;
+  for (int i = 0; i < kThreads; ++i)
+    threads.create_thread(boost::bind(&StoreAndLoad, test_ds_.get(), i,
+                                      kItems, &results[i]));
+  threads.create_thread(boost::bind(&ScanDataStore, test_ds_.get(), 50));
+  threads.join_all();
+  for (int i = 0; i < kThreads; ++i)
+    ASSERT_TRUE(results[i]);
+  std::set<std::string> keys;
+  ASSERT_TRUE(test_ds_->Keys(&keys));
+  ASSERT_EQ(size_t(kThreads * kItems), keys.size());
+  test_ds_->Clear();
+  ASSERT_TRUE(test_ds_->Keys(&keys));
+  ASSERT_TRUE(keys.empty());
+}
+
+class PersistentDataStoreTest: public testing::Test {
+ protected:
+  PersistentDataStoreTest()
+      : test_dir_(std::string("temp/DataStoreTest") +
+                  boost::lexical_cast<std::string>(base::RandomUint32())) {}
+  virtual void TearDown() {
+    try {
+      boost::filesystem::remove_all(test_dir_);
+    }
+    catch(const std::exception &e) {
+      printf("filesystem error: %s\n", e.what());
+    }
+  }
+  boost::shared_ptr<kad::DataStore> Open() {
+    boost::shared_ptr<kad::DataStoreBackend> backend(
+        new kad::LogDataStoreBackend(test_dir_));
+    boost::shared_ptr<kad::DataStore> ds(new kad::DataStore(kad::kRefreshTime,
+                                                            backend));
+    EXPECT_TRUE(ds->Open());
+    return ds;
+  }
+  std::string test_dir_;
+};
+
+TEST_F(PersistentDataStoreTest, BEH_KAD_ReloadAfterRestart) {
+  boost::shared_ptr<kad::DataStore> ds(Open());
+  ASSERT_TRUE(ds->persistent());
+  ASSERT_TRUE(ds->StoreItem("key1", "value1", 3600, false));
+  ASSERT_TRUE(ds->StoreItem("key1", "value2", -1, true));
+  ASSERT_TRUE(ds->StoreItem("key2", "value3", 3600, false));
+  ASSERT_TRUE(ds->StoreItem("key3", "value4", 3600, false));
+  ASSERT_TRUE(ds->UpdateItem("key1", "value1", "value5", 7200, false));
+  ASSERT_TRUE(ds->MarkForDeletion("key2", "value3", "delete request"));
+  ASSERT_TRUE(ds->DeleteKey("key3"));
+  boost::uint32_t expire_time = ds->ExpireTime("key1", "value5");
+  ds.reset();
+
+  ds = Open();
+  ASSERT_EQ(size_t(3), ds->Size());
+  std::vector<std::string> values;
+  ASSERT_TRUE(ds->LoadItem("key1", &values));
+  ASSERT_EQ(size_t(2), values.size());
+  ASSERT_EQ(7200, ds->TimeToLive("key1", "value5"));
+  ASSERT_EQ(expire_time, ds->ExpireTime("key1", "value5"));
+  ASSERT_EQ(-1, ds->TimeToLive("key1", "value2"));
+  ASSERT_FALSE(ds->LoadItem("key2", &values));
+  std::string ser_del_request;
+  ASSERT_FALSE(ds->RefreshItem("key2", "value3", &ser_del_request));
+  ASSERT_EQ("delete request", ser_del_request);
+  ASSERT_FALSE(ds->LoadItem("key3", &values));
+
+  ds->Clear();
+  ds = Open();
+  ASSERT_EQ(size_t(0), ds->Size());
+}
+
+TEST_F(PersistentDataStoreTest, BEH_KAD_DropTornRecord) {
+  boost::shared_ptr<kad::DataStore> ds(Open());
+  ASSERT_TRUE(ds->StoreItem("key1", "value1", 3600, false));
+  ds.reset();
+  {
+    // A record cut short by a crash.
+    std::ofstream log((test_dir_ + "/datastore.log").c_str(),
+                      std::ios::out | std::ios::binary | std::ios::app);
+    log.write("\x40\x00\x00\x00\x12\x34", 6);
+  }
+  ds = Open();
+  ASSERT_EQ(size_t(1), ds->Size());
+  ASSERT_TRUE(ds->StoreItem("key2", "value2", 3600, false));
+  ds = Open();
+  std::vector<std::string> values;
+  ASSERT_TRUE(ds->LoadItem("key1", &values));
+  ASSERT_TRUE(ds->LoadItem("key2", &values));
+}
+
+TEST_F(PersistentDataStoreTest, BEH_KAD_OpenFails) {
+  boost::filesystem::create_directories(
+      boost::filesystem::path(test_dir_).parent_path());
+  {
+    // A file where the log's directory should be.
+    std::ofstream blocker(test_dir_.c_str());
+    blocker << "not a directory";
+  }
+  boost::shared_ptr<kad::DataStoreBackend> backend(
+      new kad::LogDataStoreBackend(test_dir_));
+  kad::DataStore ds(kad::kRefreshTime, backend);
+  ASSERT_FALSE(ds.Open());
+}
+
+TEST_F(PersistentDataStoreTest, BEH_KAD_Compaction) {
+  kad::LogDataStoreBackend *backend = new kad::LogDataStoreBackend(test_dir_);
+  boost::shared_ptr<kad::DataStore> ds(new kad::DataStore(kad::kRefreshTime,
+      boost::shared_ptr<kad::DataStoreBackend>(backend)));
+  ASSERT_TRUE(ds->Open());
+  const int kItems(kad::kDataStoreCompactionThreshold);
+  for (int i = 0; i < kItems; ++i) {
+    std::string key("key" + base::IntToString(i));
+    ASSERT_TRUE(ds->StoreItem(key, "value", 3600, false));
+    ASSERT_TRUE(ds->DeleteItem(key, "value"));
+  }
+  ASSERT_TRUE(ds->StoreItem("key", "value", 3600, false));
+  ASSERT_EQ(boost::uint64_t(2 * kItems + 1), backend->LogRecords());
+  ds->DeleteExpiredValues();
+  ASSERT_EQ(boost::uint64_t(1), backend->LogRecords());
+  ASSERT_TRUE(ds->StoreItem("key", "value2", 3600, false));
+  ds = Open();
+  ASSERT_EQ(size_t(2), ds->Size());
+}
@@ -26,6 +26,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <gtest/gtest.h>
+#include <algorithm>
 #include "maidsafe/kademlia/contact.h"
 #include "maidsafe/kademlia/kadid.h"
 #include "maidsafe/kademlia/knodeimpl.h"
@@ -60,6 +61,43 @@ KadId IncreaseId(const KadId &kad_id) {
   return KadId(raw);
 }
 
+// Distance comparison on string ids as KadId did before using a fixed-size
+// array, kept as the baseline for the benchmark below.
+bool StringCloserToTarget(const std::string &id1, const std::string &id2,
+                          const std::string &target_id) {
+  std::string raw_id1(id1);
+  std::string raw_id2(id2);
+  std::string raw_id_target(target_id);
+  for (boost::uint16_t i = 0; i < kKeySizeBytes; ++i) {
+    unsigned char result1 = raw_id1[i] ^ raw_id_target[i];
+    unsigned char result2 = raw_id2[i] ^ raw_id_target[i];
+    if (result1 != result2)
+      return result1 < result2;
+  }
+  return false;
+}
+
+class StringDistanceComparator {
+ public:
+  explicit StringDistanceComparator(const std::string &target)
+      : target_(target) {}
+  bool operator()(const std::string &id1, const std::string &id2) const {
+    return StringCloserToTarget(id1, id2, target_);
+  }
+ private:
+  std::string target_;
+};
+
+class KadIdDistanceComparator {
+ public:
+  explicit KadIdDistanceComparator(const KadId &target) : target_(target) {}
+  bool operator()(const KadId &id1, const KadId &id2) const {
+    return KadId::CloserToTarget(id1, id2, target_);
+  }
+ private:
+  KadId target_;
+};
+
 const std::string ToBinary(const std::string &raw_id)  {
   std::string hex_encoded(base::EncodeToHex(raw_id));
   std::string result;
@@ -490,6 +528,77 @@ TEST(TestKadId, BEH_KAD_OperatorEql) {
   ASSERT_EQ(kadid1.String(), kadid2.String());
 }
 
+TEST(TestKadId, BEH_KAD_CommonPrefixLength) {
+  KadId kadid1(KadId::kRandomId);
+  ASSERT_EQ(kKeySizeBits, kadid1.CommonPrefixLength(kadid1));
+  KadId zero;
+  for (boost::uint16_t i = 0; i < kKeySizeBits; ++i) {
+    KadId power(i);
+    ASSERT_EQ(kKeySizeBits - 1 - i, zero.CommonPrefixLength(power));
+    ASSERT_EQ(kKeySizeBits - 1 - i, power.CommonPrefixLength(zero));
+  }
+  for (boost::uint16_t i = 0; i < kKeySizeBits; ++i) {
+    std::string binary(kadid1.ToStringEncoded(KadId::kBinary));
+    binary[i] = binary[i] == '0' ? '1' : '0';
+    KadId kadid2(binary, KadId::kBinary);
+    ASSERT_EQ(i, kadid1.CommonPrefixLength(kadid2));
+  }
+  KadId bad_id(-2);
+  ASSERT_EQ(0, kadid1.CommonPrefixLength(bad_id));
+  ASSERT_EQ(0, bad_id.CommonPrefixLength(kadid1));
+}
+
+TEST(TestKadId, BEH_KAD_CloserToTarget) {
+  for (int i = 0; i < 1000; ++i) {
+    KadId kadid1(KadId::kRandomId), kadid2(KadId::kRandomId);
+    KadId target(KadId::kRandomId);
+    ASSERT_EQ(StringCloserToTarget(kadid1.String(), kadid2.String(),
+                                   target.String()),
+              KadId::CloserToTarget(kadid1, kadid2, target));
+    ASSERT_EQ(KadId::CloserToTarget(kadid1, kadid2, target),
+              (kadid1 ^ target) < (kadid2 ^ target));
+    ASSERT_FALSE(KadId::CloserToTarget(kadid1, kadid1, target));
+  }
+  KadId bad_id(-2), kadid(KadId::kRandomId);
+  ASSERT_FALSE(KadId::CloserToTarget(bad_id, kadid, kadid));
+  ASSERT_FALSE(bad_id.IsValid());
+  ASSERT_FALSE((bad_id ^ kadid).IsValid());
+  ASSERT_TRUE(bad_id < kadid);
+  ASSERT_FALSE(bad_id == kadid);
+}
+
+TEST(TestKadId, FUNC_KAD_DistanceSortBenchmark) {
+  const size_t kIds(5000);
+  const int kRounds(20);
+  std::vector<KadId> kad_ids;
+  std::vector<std::string> string_ids;
+  for (size_t i = 0; i < kIds; ++i) {
+    kad_ids.push_back(KadId(KadId::kRandomId));
+    string_ids.push_back(kad_ids.back().String());
+  }
+  boost::uint64_t string_time(0), kadid_time(0);
+  for (int round = 0; round < kRounds; ++round) {
+    KadId target(KadId::kRandomId);
+    std::vector<std::string> sorted_strings(string_ids);
+    boost::uint64_t start(base::GetEpochNanoseconds());
+    std::sort(sorted_strings.begin(), sorted_strings.end(),
+              StringDistanceComparator(target.String()));
+    string_time += base::GetEpochNanoseconds() - start;
+    std::vector<KadId> sorted_ids(kad_ids);
+    start = base::GetEpochNanoseconds();
+    std::sort(sorted_ids.begin(), sorted_ids.end(),
+              KadIdDistanceComparator(target));
+    kadid_time += base::GetEpochNanoseconds() - start;
+    for (size_t i = 0; i < kIds; ++i)
+      ASSERT_EQ(sorted_strings[i], sorted_ids[i].String());
+  }
+  printf("Sorting %u ids by distance (average of %d rounds):\n"
+         "  std::string ids: %llu us\n  KadId ids:       %llu us\n",
+         static_cast<unsigned int>(kIds), kRounds,
+         static_cast<unsigned long long>(string_time / kRounds / 1000),  // NOLINT
+         static_cast<unsigned long long>(kadid_time / kRounds / 1000));  // NOLINT
+}
+
 }  // namespace test_kadid
 
 }  // namespace kad
@@ -617,6 +617,303 @@ TEST_F(KadServicesTest, BEH_KAD_ServicesStore) {
   ASSERT_EQ(3, valuesfound);
 }
 
+TEST_F(KadServicesTest, BEH_KAD_ServicesStoreOnCryptoWorkers) {
+  std::string public_key, private_key, signed_public_key, signed_request;
+  std::string key(crypto_.Hash("key", "", crypto::STRING_STRING, false));
+  CreateRSAKeys(&public_key, &private_key);
+  CreateSignedRequest(public_key, private_key, key, &signed_public_key,
+                      &signed_request);
+  // The request is deleted before the workers get to it, as the channel does.
+  StoreRequest *store_request = new StoreRequest;
+  store_request->set_key(key);
+  SignedValue *svalue = store_request->mutable_sig_value();
+  svalue->set_value("Value");
+  svalue->set_value_signature(crypto_.AsymSign("Value", "", private_key,
+      crypto::STRING_STRING));
+  std::string ser_sig_value(svalue->SerializeAsString());
+  SignedRequest *sig_req = store_request->mutable_signed_request();
+  sig_req->set_signer_id("id1");
+  sig_req->set_public_key(public_key);
+  sig_req->set_signed_public_key(signed_public_key);
+  sig_req->set_signed_request(signed_request);
+  store_request->set_publish(true);
+  store_request->set_ttl(3600*24);
+  *store_request->mutable_sender_info() = contact_;
+
+  service_->StartCryptoWorkers(1, 10);
+  rpcprotocol::Controller controller;
+  StoreResponse store_response;
+  Callback cb_obj;
+  google::protobuf::Closure *done = google::protobuf::NewCallback<Callback>
+      (&cb_obj, &Callback::CallbackFunction);
+  service_->Store(&controller, store_request, &store_response, done);
+  delete store_request;
+  // Waits for the queued request to be handled
+  service_->StopCryptoWorkers();
+  EXPECT_TRUE(store_response.IsInitialized());
+  EXPECT_EQ(kRpcResultSuccess, store_response.result());
+  EXPECT_EQ(node_id_.String(), store_response.node_id());
+  std::vector<std::string> values;
+  ASSERT_TRUE(datastore_->LoadItem(key, &values));
+  ASSERT_EQ(size_t(1), values.size());
+  EXPECT_EQ(ser_sig_value, values[0]);
+}
+
+TEST_F(KadServicesTest, BEH_KAD_ServicesUpdateOnCryptoWorkers) {
+  std::string public_key, private_key, publickey_signature, request_signature,
+              key;
+  CreateDecodedKey(&key);
+  CreateRSAKeys(&public_key, &private_key);
+  CreateSignedRequest(public_key, private_key, key, &publickey_signature,
+                      &request_signature);
+  crypto::Crypto co;
+  SignedValue old_value;
+  old_value.set_value("value0");
+  old_value.set_value_signature(co.AsymSign(old_value.value(), "",
+                                            private_key,
+                                            crypto::STRING_STRING));
+  ASSERT_TRUE(datastore_->StoreItem(key, old_value.SerializeAsString(),
+                                    3600 * 24, false));
+
+  // Several workers race to replace the same value; only one may succeed.
+  const size_t kUpdates(4);
+  rpcprotocol::Controller controllers[kUpdates];
+  UpdateResponse responses[kUpdates];
+  Callback cb_obj;
+  service_->StartCryptoWorkers(kUpdates, 10);
+  for (size_t n = 0; n < kUpdates; ++n) {
+    UpdateRequest *request = new UpdateRequest;
+    request->set_key(key);
+    *request->mutable_old_value() = old_value;
+    SignedValue *new_value = request->mutable_new_value();
+    new_value->set_value("new value" + base::IntToString(n));
+    new_value->set_value_signature(co.AsymSign(new_value->value(), "",
+                                               private_key,
+                                               crypto::STRING_STRING));
+    request->set_ttl(86400);
+    SignedRequest *signed_request = request->mutable_request();
+    signed_request->set_signer_id(co.Hash(public_key + publickey_signature,
+                                          "", crypto::STRING_STRING, false));
+    signed_request->set_public_key(public_key);
+    signed_request->set_signed_public_key(publickey_signature);
+    signed_request->set_signed_request(request_signature);
+    *request->mutable_sender_info() = contact_;
+    google::protobuf::Closure *done = google::protobuf::NewCallback<Callback>
+                                      (&cb_obj, &Callback::CallbackFunction);
+    service_->Update(&controllers[n], request, &responses[n], done);
+    delete request;
+  }
+  service_->StopCryptoWorkers();
+  size_t succeeded(0);
+  for (size_t n = 0; n < kUpdates; ++n) {
+    ASSERT_TRUE(responses[n].IsInitialized());
+    if (responses[n].result() == kRpcResultSuccess)
+      ++succeeded;
+  }
+  EXPECT_EQ(size_t(1), succeeded);
+  std::vector<std::string> values;
+  ASSERT_TRUE(datastore_->LoadItem(key, &values));
+  ASSERT_EQ(size_t(1), values.size());
+  SignedValue stored;
+  ASSERT_TRUE(stored.ParseFromString(values[0]));
+  EXPECT_NE(old_value.value(), stored.value());
+}
+
+TEST_F(KadServicesTest, BEH_KAD_ServicesBatchStore) {
+  rpcprotocol::Controller controller;
+  std::string public_key, private_key;
+  CreateRSAKeys(&public_key, &private_key);
+  BatchStoreRequest batch_request;
+  std::vector<std::string> keys, ser_sig_values;
+  for (int i = 0; i < 3; ++i) {
+    std::string key(crypto_.Hash(boost::lexical_cast<std::string>(i), "",
+                                 crypto::STRING_STRING, false));
+    std::string value("Val" + boost::lexical_cast<std::string>(i));
+    std::string signed_public_key, signed_request;
+    CreateSignedRequest(public_key, private_key, key, &signed_public_key,
+                        &signed_request);
+    BatchStoreEntry *entry = batch_request.add_entries();
+    entry->set_key(key);
+    SignedValue *svalue = entry->mutable_sig_value();
+    svalue->set_value(value);
+    svalue->set_value_signature(crypto_.AsymSign(value, "", private_key,
+        crypto::STRING_STRING));
+    entry->set_ttl(3600*24);
+    SignedRequest *sig_req = entry->mutable_signed_request();
+    sig_req->set_signer_id("id1");
+    sig_req->set_public_key(public_key);
+    sig_req->set_signed_public_key(signed_public_key);
+    sig_req->set_signed_request(signed_request);
+    keys.push_back(key);
+    ser_sig_values.push_back(svalue->SerializeAsString());
+  }
+  // Third entry carries an unsigned value and must be rejected on its own.
+  batch_request.mutable_entries(2)->clear_sig_value();
+  batch_request.mutable_entries(2)->set_value("Val2");
+  batch_request.set_publish(true);
+  *batch_request.mutable_sender_info() = contact_;
+  BatchStoreResponse batch_response;
+  Callback cb_obj;
+  google::protobuf::Closure *done1 = google::protobuf::NewCallback<Callback>
+      (&cb_obj, &Callback::CallbackFunction);
+  service_->BatchStore(&controller, &batch_request, &batch_response, done1);
+  EXPECT_TRUE(batch_response.IsInitialized());
+  EXPECT_EQ(kRpcResultSuccess, batch_response.result());
+  EXPECT_EQ(node_id_.String(), batch_response.node_id());
+  ASSERT_EQ(3, batch_response.results_size());
+  EXPECT_EQ(kRpcResultSuccess, batch_response.results(0).result());
+  EXPECT_EQ(kRpcResultSuccess, batch_response.results(1).result());
+  EXPECT_EQ(kRpcResultFailure, batch_response.results(2).result());
+  for (int i = 0; i < 2; ++i) {
+    std::vector<std::string> values;
+    ASSERT_TRUE(datastore_->LoadItem(keys[i], &values));
+    ASSERT_EQ(size_t(1), values.size());
+    EXPECT_EQ(ser_sig_values[i], values[0]);
+  }
+  std::vector<std::string> values;
+  EXPECT_FALSE(datastore_->LoadItem(keys[2], &values));
+  Contact contactback;
+  EXPECT_TRUE(routingtable_->GetContact(kad::KadId(contact_.node_id()),
+      &contactback));
+
+  // Oversized batch is refused as a whole.
+  BatchStoreRequest big_request(batch_request);
+  while (big_request.entries_size() <= kMaxBatchSize)
+    *big_request.add_entries() = batch_request.entries(0);
+  batch_response.Clear();
+  google::protobuf::Closure *done2 = google::protobuf::NewCallback<Callback>
+      (&cb_obj, &Callback::CallbackFunction);
+  service_->BatchStore(&controller, &big_request, &batch_response, done2);
+  EXPECT_TRUE(batch_response.IsInitialized());
+  EXPECT_EQ(kRpcResultFailure, batch_response.result());
+  EXPECT_EQ(0, batch_response.results_size());
+}
+
+TEST_F(KadServicesTest, BEH_KAD_ServicesBatchFindValue) {
+  rpcprotocol::Controller controller;
+  std::string public_key, private_key;
+  CreateRSAKeys(&public_key, &private_key);
+  std::string key1(crypto_.Hash("key1", "", crypto::STRING_STRING, false));
+  std::string key2(crypto_.Hash("key2", "", crypto::STRING_STRING, false));
+  SignedValue svalue;
+  svalue.set_value("Val1");
+  svalue.set_value_signature(crypto_.AsymSign("Val1", "", private_key,
+      crypto::STRING_STRING));
+  std::string ser_sig_value(svalue.SerializeAsString());
+  ASSERT_TRUE(datastore_->StoreItem(key1, ser_sig_value, 3600*24, false));
+
+  BatchFindValueRequest batch_request;
+  batch_request.add_keys(key1);
+  batch_request.add_keys(key2);
+  *batch_request.mutable_sender_info() = contact_;
+  BatchFindValueResponse batch_response;
+  Callback cb_obj;
+  google::protobuf::Closure *done = google::protobuf::NewCallback<Callback>
+      (&cb_obj, &Callback::CallbackFunction);
+  service_->BatchFindValue(&controller, &batch_request, &batch_response, done);
+  EXPECT_TRUE(batch_response.IsInitialized());
+  EXPECT_EQ(kRpcResultSuccess, batch_response.result());
+  EXPECT_EQ(node_id_.String(), batch_response.node_id());
+  ASSERT_EQ(2, batch_response.results_size());
+  EXPECT_EQ(kRpcResultSuccess, batch_response.results(0).result());
+  ASSERT_EQ(1, batch_response.results(0).signed_values_size());
+  EXPECT_EQ(ser_sig_value,
+            batch_response.results(0).signed_values(0).SerializeAsString());
+  EXPECT_EQ(kRpcResultFailure, batch_response.results(1).result());
+  EXPECT_EQ(0, batch_response.results(1).closest_nodes_size());
+  Contact contactback;
+  EXPECT_TRUE(routingtable_->GetContact(kad::KadId(contact_.node_id()),
+      &contactback));
+}
+
+TEST_F(KadServicesTest, BEH_KAD_ServicesBatchStoreCacheCopy) {
+  rpcprotocol::Controller controller;
+  std::string public_key, private_key;
+  CreateRSAKeys(&public_key, &private_key);
+  SignedValue svalue;
+  svalue.set_value("Val1");
+  svalue.set_value_signature(crypto_.AsymSign("Val1", "", private_key,
+      crypto::STRING_STRING));
+  std::string ser_sig_value(svalue.SerializeAsString());
+  std::string key1(crypto_.Hash(svalue.value() + svalue.value_signature(), "",
+                                crypto::STRING_STRING, false));
+  std::string key2(crypto_.Hash("key2", "", crypto::STRING_STRING, false));
+  ASSERT_TRUE(datastore_->StoreItem(key2, ser_sig_value, 3600*24, false));
+
+  // Cache copies need no signed request, but are only stored under keys not
+  // already held and never for longer than kCacheCopyTtl.
+  BatchStoreRequest batch_request;
+  BatchStoreEntry *entry = batch_request.add_entries();
+  entry->set_key(key1);
+  *entry->mutable_sig_value() = svalue;
+  entry->set_ttl(3600*24);
+  entry = batch_request.add_entries();
+  entry->set_key(key2);
+  entry->mutable_sig_value()->set_value("Val2");
+  entry->mutable_sig_value()->set_value_signature(crypto_.AsymSign("Val2", "",
+      private_key, crypto::STRING_STRING));
+  entry->set_ttl(3600*24);
+  batch_request.set_publish(true);
+  batch_request.set_cache_copy(true);
+  *batch_request.mutable_sender_info() = contact_;
+  BatchStoreResponse batch_response;
+  Callback cb_obj;
+  google::protobuf::Closure *done = google::protobuf::NewCallback<Callback>
+      (&cb_obj, &Callback::CallbackFunction);
+  service_->BatchStore(&controller, &batch_request, &batch_response, done);
+  EXPECT_TRUE(batch_response.IsInitialized());
+  EXPECT_EQ(kRpcResultSuccess, batch_response.result());
+  ASSERT_EQ(2, batch_response.results_size());
+  EXPECT_EQ(kRpcResultSuccess, batch_response.results(0).result());
+  EXPECT_EQ(kRpcResultFailure, batch_response.results(1).result());
+  std::vector<std::string> values;
+  ASSERT_TRUE(datastore_->LoadItem(key1, &values));
+  ASSERT_EQ(size_t(1), values.size());
+  EXPECT_EQ(ser_sig_value, values[0]);
+  EXPECT_EQ(kCacheCopyTtl, datastore_->TimeToLive(key1, ser_sig_value));
+  values.clear();
+  ASSERT_TRUE(datastore_->LoadItem(key2, &values));
+  ASSERT_EQ(size_t(1), values.size());
+  EXPECT_EQ(ser_sig_value, values[0]);
+}
+
+TEST_F(KadServicesTest, BEH_KAD_ServicesBatchStoreUnauthenticatedCacheCopy) {
+  rpcprotocol::Controller controller;
+  std::string public_key, private_key;
+  CreateRSAKeys(&public_key, &private_key);
+  std::string key1(crypto_.Hash("key1", "", crypto::STRING_STRING, false));
+  std::string key2(crypto_.Hash("key2", "", crypto::STRING_STRING, false));
+
+  // A signed value under a key that isn't its hash can't be authenticated
+  // without the owner's signed request, and neither can an unsigned value.
+  BatchStoreRequest batch_request;
+  BatchStoreEntry *entry = batch_request.add_entries();
+  entry->set_key(key1);
+  entry->mutable_sig_value()->set_value("Val1");
+  entry->mutable_sig_value()->set_value_signature(crypto_.AsymSign("Val1", "",
+      private_key, crypto::STRING_STRING));
+  entry->set_ttl(3600*24);
+  entry = batch_request.add_entries();
+  entry->set_key(key2);
+  entry->set_value("Val2");
+  entry->set_ttl(3600*24);
+  batch_request.set_publish(true);
+  batch_request.set_cache_copy(true);
+  *batch_request.mutable_sender_info() = contact_;
+  BatchStoreResponse batch_response;
+  Callback cb_obj;
+  google::protobuf::Closure *done = google::protobuf::NewCallback<Callback>
+      (&cb_obj, &Callback::CallbackFunction);
+  service_->BatchStore(&controller, &batch_request, &batch_response, done);
+  EXPECT_TRUE(batch_response.IsInitialized());
+  ASSERT_EQ(2, batch_response.results_size());
+  EXPECT_EQ(kRpcResultFailure, batch_response.results(0).result());
+  EXPECT_EQ(kRpcResultFailure, batch_response.results(1).result());
+  std::vector<std::string> values;
+  EXPECT_FALSE(datastore_->LoadItem(key1, &values));
+  EXPECT_FALSE(datastore_->LoadItem(key2, &values));
+}
+
 TEST_F(KadServicesTest, BEH_KAD_InvalidStoreValue) {
   std::string value("value4"), value1("value5");
   std::string key = crypto_.Hash(value, "", crypto::STRING_STRING, false);
@@ -27,6 +27,9 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <gtest/gtest.h>
 #include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <list>
+#include <vector>
 #include "maidsafe/kademlia/kbucket.h"
 #include "maidsafe/kademlia/kadid.h"
 #include "maidsafe/base/crypto.h"
@@ -351,4 +354,53 @@ TEST_F(TestKbucket, BEH_KAD_GetOldestContact) {
   }
 }
 
+TEST_F(TestKbucket, BEH_KAD_AddRemoveMatchesLruList) {
+  KBucket kbucket(KadId(), KadId(KadId::kMaxId), test_kbucket::K);
+  // Small ids share long prefixes, as contacts in one k-bucket do.
+  std::vector<KadId> ids;
+  for (int i = 0; i < 3 * test_kbucket::K; ++i)
+    ids.push_back(KadId(KadId(), KadId(boost::uint16_t(16))));
+  std::list<KadId> expected;
+  std::string ip("127.0.0.1");
+  for (int n = 0; n < 5000; ++n) {
+    const KadId &id = ids[base::RandomUint32() % ids.size()];
+    std::list<KadId>::iterator it =
+        std::find(expected.begin(), expected.end(), id);
+    if (base::RandomUint32() % 3 == 0) {
+      kbucket.RemoveContact(id, true);
+      if (it != expected.end())
+        expected.erase(it);
+    } else {
+      KBucketExitCode result = kbucket.AddContact(Contact(id, ip, 8000));
+      if (it != expected.end()) {
+        ASSERT_EQ(SUCCEED, result);
+        expected.erase(it);
+        expected.push_front(id);
+      } else if (expected.size() == test_kbucket::K) {
+        ASSERT_EQ(FULL, result);
+      } else {
+        ASSERT_EQ(SUCCEED, result);
+        expected.push_front(id);
+      }
+    }
+    ASSERT_EQ(expected.size(), kbucket.Size());
+    Contact contact;
+    ASSERT_EQ(std::find(expected.begin(), expected.end(), id) !=
+              expected.end(), kbucket.GetContact(id, &contact));
+  }
+  std::vector<Contact> contacts, exclude;
+  kbucket.GetContacts(test_kbucket::K, exclude, &contacts);
+  ASSERT_EQ(expected.size(), contacts.size());
+  size_t i(0);
+  for (std::list<KadId>::iterator it = expected.begin(); it != expected.end();
+       ++it, ++i)
+    ASSERT_TRUE(*it == contacts[i].node_id());
+  exclude.push_back(contacts.front());
+  contacts.clear();
+  kbucket.GetContacts(test_kbucket::K, exclude, &contacts);
+  ASSERT_EQ(expected.size() - 1, contacts.size());
+  for (i = 0; i < contacts.size(); ++i)
+    ASSERT_FALSE(contacts[i].node_id() == exclude.front().node_id());
+}
+
 }  // namespace kad
@@ -28,6 +28,12 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <boost/lexical_cast.hpp>
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <set>
+#include <vector>
+
 #include "maidsafe/base/alternativestore.h"
 #include "maidsafe/base/crypto.h"
 #include "maidsafe/base/utils.h"
@@ -79,6 +85,11 @@ void BootstrapCallbackTestCallback(const std::string &ser_result,
   *done = true;
 }
 
+void StoreBatchTestCallback(const std::vector<StoreValueResult> &results,
+                            std::vector<StoreValueResult> *copy) {
+  *copy = results;
+}
+
 static const boost::uint16_t K = 16;
 
 class TestKNodeImpl : public testing::Test {
@@ -159,8 +170,23 @@ TEST_F(TestKNodeImpl, BEH_KNodeImpl_ContactFunctions) {
                           local_ip.to_string(), 5001);
   ASSERT_FALSE(CompareContact(catk1, catk2));
 
-  std::list<LookupContact> contact_list;
-  SortLookupContact(target_key, &contact_list);
+  IterativeLookUpData data(FIND_NODE, target_key, &dummy_find_callback);
+  std::list<Contact> contacts;
+  for (boost::uint16_t i = 0; i < 20; ++i) {
+    contacts.push_back(Contact(KadId(KadId::kRandomId), local_ip.to_string(),
+                               5000 + i, local_ip.to_string(), 5000 + i));
+    ASSERT_TRUE(data.AddToShortList(contacts.back()));
+  }
+  ASSERT_FALSE(data.AddToShortList(contacts.front()));
+  ASSERT_EQ(contacts.size(), data.short_list.size());
+  SortContactList(target_key, &contacts);
+  std::list<Contact>::iterator it = contacts.begin();
+  std::map<KadId, LookupContact>::iterator it1;
+  for (it1 = data.short_list.begin(); it1 != data.short_list.end();
+       ++it1, ++it) {
+    ASSERT_TRUE(it->Equals(it1->second.kad_contact));
+    ASSERT_FALSE(it1->second.contacted);
+  }
 }
 
 TEST_F(TestKNodeImpl, BEH_KNodeImpl_Destroy) {
@@ -281,19 +307,19 @@ TEST_F(TestKNodeImpl, BEH_KNodeImpl_ExecuteRPCs) {
   SignedValue old_value, new_value;
   SignedRequest sig_req;
   UpdateValueCallback uvc;
-  node_->ExecuteUpdateRPCs("summat that doesn't parse", KadId(KadId::kRandomId),
+  node_->ExecuteUpdateRPCs(FindNodesResult(), KadId(KadId::kRandomId),
                            old_value, new_value, sig_req, 3600 * 24,
-                           boost::bind(&UpdateValueCallback::CallbackFunc,
+                           boost::bind(&UpdateValueCallback::ResultFunc,
                                        &uvc, _1));
   ASSERT_EQ("", uvc.result());
 
   DeleteValueCallback dvc;
-  node_->DelValue_ExecuteDeleteRPCs("summat that doesn't parse",
+  node_->DelValue_ExecuteDeleteRPCs(FindNodesResult(),
                                     KadId(KadId::kRandomId),
                                     old_value,
                                     sig_req,
                                     boost::bind(
-                                        &DeleteValueCallback::CallbackFunc,
+                                        &DeleteValueCallback::ResultFunc,
                                         &dvc, _1));
   ASSERT_EQ("", dvc.result());
 
@@ -305,7 +331,7 @@ TEST_F(TestKNodeImpl, BEH_KNodeImpl_ExecuteRPCs) {
   boost::shared_ptr<IterativeDelValueData> data(
       new struct IterativeDelValueData(close_nodes, key, svalue, sreq,
                                        boost::bind(
-                                          &DeleteValueCallback::CallbackFunc,
+                                          &DeleteValueCallback::ResultFunc,
                                           &dvc, _1)));
   data->is_callbacked = true;
   DeleteCallbackArgs callback_data(data);
@@ -314,29 +340,27 @@ TEST_F(TestKNodeImpl, BEH_KNodeImpl_ExecuteRPCs) {
 
   node_->is_joined_ = true;
   uvc.Reset();
-  FindResponse fr;
-  fr.set_result(kRpcResultSuccess);
-  std::string ser_fr, ser_c;
+  FindNodesResult fnr;
+  fnr.succeeded = true;
   Contact c(KadId(KadId::kRandomId), "127.0.0.1", 1234, "127.0.0.2", 1235,
             "127.0.0.3", 1236);
-  c.SerialiseToString(&ser_c);
   int count = kMinSuccessfulPecentageStore * K - 1;
   for (int n = 0; n < count; ++n)
-    fr.add_closest_nodes(ser_c);
+    fnr.closest_nodes.push_back(c);
 
-  node_->ExecuteUpdateRPCs(fr.SerializeAsString(), KadId(KadId::kRandomId),
+  node_->ExecuteUpdateRPCs(fnr, KadId(KadId::kRandomId),
                            old_value, new_value, sig_req, 3600 * 24,
-                           boost::bind(&UpdateValueCallback::CallbackFunc,
+                           boost::bind(&UpdateValueCallback::ResultFunc,
                                        &uvc, _1));
   while (uvc.result() == "")
     boost::this_thread::sleep(boost::posix_time::milliseconds(100));
   ASSERT_EQ(kRpcResultFailure, uvc.result());
 
-  fr.set_result(kRpcResultFailure);
+  fnr.succeeded = false;
   uvc.Reset();
-  node_->ExecuteUpdateRPCs(fr.SerializeAsString(), KadId(KadId::kRandomId),
+  node_->ExecuteUpdateRPCs(fnr, KadId(KadId::kRandomId),
                            old_value, new_value, sig_req, 3600 * 24,
-                           boost::bind(&UpdateValueCallback::CallbackFunc,
+                           boost::bind(&UpdateValueCallback::ResultFunc,
                                        &uvc, _1));
   while (uvc.result() == "")
     boost::this_thread::sleep(boost::posix_time::milliseconds(100));
@@ -347,30 +371,540 @@ TEST_F(TestKNodeImpl, BEH_KNodeImpl_ExecuteRPCs) {
   ASSERT_EQ("", dvc.result());
 
   dvc.Reset();
-  node_->DelValue_ExecuteDeleteRPCs("summat that doesn't parse",
+  node_->DelValue_ExecuteDeleteRPCs(FindNodesResult(),
                                     KadId(KadId::kRandomId),
                                     old_value,
                                     sig_req,
                                     boost::bind(
-                                        &DeleteValueCallback::CallbackFunc,
+                                        &DeleteValueCallback::ResultFunc,
                                         &dvc, _1));
   while (dvc.result() == "")
     boost::this_thread::sleep(boost::posix_time::milliseconds(100));
   ASSERT_EQ(kRpcResultFailure, dvc.result());
 
   dvc.Reset();
-  fr.Clear();
-  fr.set_result(kRpcResultSuccess);
-  node_->DelValue_ExecuteDeleteRPCs(fr.SerializeAsString(),
+  FindNodesResult no_nodes;
+  no_nodes.succeeded = true;
+  node_->DelValue_ExecuteDeleteRPCs(no_nodes,
                                     KadId(KadId::kRandomId),
                                     old_value,
                                     sig_req,
                                     boost::bind(
-                                        &DeleteValueCallback::CallbackFunc,
+                                        &DeleteValueCallback::ResultFunc,
                                         &dvc, _1));
   while (dvc.result() == "")
     boost::this_thread::sleep(boost::posix_time::milliseconds(100));
   ASSERT_EQ(kRpcResultFailure, dvc.result());
+
+  StoreValueCallback svc;
+  node_->StoreValue_ExecuteStoreRPCs(FindNodesResult(),
+                                     KadId(KadId::kRandomId), "value",
+                                     SignedValue(), SignedRequest(), true,
+                                     3600 * 24,
+                                     boost::bind(
+                                         &StoreValueCallback::ResultFunc,
+                                         &svc, _1));
+  while (svc.result() == "")
+    boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+  ASSERT_EQ(kRpcResultFailure, svc.result());
+}
+
+TEST_F(TestKNodeImpl, BEH_KNodeImpl_ProximityProbes) {
+  KadId key(KadId::kRandomId);
+  boost::shared_ptr<IterativeLookUpData> data(
+      new IterativeLookUpData(FIND_NODE, key, &dummy_find_callback));
+  for (int i = 0; i < 2 * kad::kProximityCandidates * kad::kAlpha; ++i)
+    data->AddToShortList(Contact(KadId(KadId::kRandomId), "127.0.0.1",
+                                 5000 + i));
+  std::vector<Contact> by_distance;
+  std::map<KadId, LookupContact>::iterator it;
+  for (it = data->short_list.begin(); it != data->short_list.end(); ++it)
+    by_distance.push_back(it->second.kad_contact);
+
+  // All of these are below kMinRpcTimeout, so their RPC timeouts are equal.
+  // by_distance[1] is never measured and by_distance[3] has since failed.
+  node_->rtt_estimator_.AddSample(by_distance[2].node_id(), 250);
+  node_->rtt_estimator_.AddSample(by_distance[3].node_id(), 50);
+  node_->rtt_estimator_.AddFailure(by_distance[3].node_id());
+  node_->rtt_estimator_.AddSample(by_distance[4].node_id(), 100);
+  node_->rtt_estimator_.AddSample(by_distance[5].node_id(), 40);
+
+  std::vector<LookupContact*> probes;
+  node_->SelectProbes(data, &probes);
+  ASSERT_EQ(size_t(kad::kAlpha), probes.size());
+  for (size_t i = 0; i < probes.size(); ++i)
+    EXPECT_EQ(by_distance[i].node_id(), probes[i]->kad_contact.node_id());
+
+  node_->set_proximity_lookups(true);
+  probes.clear();
+  node_->SelectProbes(data, &probes);
+  ASSERT_EQ(size_t(kad::kAlpha), probes.size());
+  EXPECT_EQ(by_distance[0].node_id(), probes[0]->kad_contact.node_id());
+  EXPECT_EQ(by_distance[5].node_id(), probes[1]->kad_contact.node_id());
+  EXPECT_EQ(by_distance[4].node_id(), probes[2]->kad_contact.node_id());
+
+  // Over a simulated network in which each contact answers with the K closest
+  // to the key, the contacts skipped for being slow are still asked, so the
+  // lookup ends with the same K contacts as a plain one.
+  std::vector<Contact> network;
+  for (boost::uint16_t i = 0; i < 4 * K; ++i) {
+    network.push_back(Contact(KadId(KadId::kRandomId), "127.0.0.1",
+                              6000 + i));
+    node_->rtt_estimator_.AddSample(network.back().node_id(),
+                                    10 + base::RandomUint32() % 500);
+  }
+  std::map<KadId, Contact> by_key_distance;
+  for (size_t i = 0; i < network.size(); ++i)
+    by_key_distance[network[i].node_id() ^ key] = network[i];
+  std::vector<Contact> closest;
+  std::map<KadId, Contact>::iterator close_it;
+  for (close_it = by_key_distance.begin();
+       close_it != by_key_distance.end() && closest.size() < K; ++close_it)
+    closest.push_back(close_it->second);
+
+  std::vector<KadId> results[2];
+  for (int proximity = 0; proximity < 2; ++proximity) {
+    node_->set_proximity_lookups(proximity == 1);
+    boost::shared_ptr<IterativeLookUpData> lookup(
+        new IterativeLookUpData(FIND_NODE, key, &dummy_find_callback));
+    for (size_t i = network.size() - kad::kAlpha; i < network.size(); ++i)
+      lookup->AddToShortList(network[i]);
+    int iterations(0);
+    while (true) {
+      probes.clear();
+      node_->SelectProbes(lookup, &probes);
+      if (probes.empty())
+        break;
+      // Stop, as SearchIteration does, once none of the uncontacted contacts
+      // is closer than the furthest of the K closest which answered.
+      if (lookup->active_contacts.size() >= K) {
+        std::map<KadId, Contact>::iterator kth =
+            lookup->active_contacts.begin();
+        std::advance(kth, K - 1);
+        if (kth->first < (probes[0]->kad_contact.node_id() ^ key))
+          break;
+      }
+      ASSERT_GT(4 * K, ++iterations);
+      for (size_t i = 0; i < probes.size(); ++i) {
+        probes[i]->contacted = true;
+        lookup->active_contacts[probes[i]->kad_contact.node_id() ^ key] =
+            probes[i]->kad_contact;
+        for (size_t j = 0; j < closest.size(); ++j) {
+          if (closest[j].node_id() != probes[i]->kad_contact.node_id())
+            lookup->AddToShortList(closest[j]);
+        }
+      }
+    }
+    std::map<KadId, Contact>::iterator active_it;
+    for (active_it = lookup->active_contacts.begin();
+         active_it != lookup->active_contacts.end() &&
+         results[proximity].size() < K; ++active_it)
+      results[proximity].push_back(active_it->second.node_id());
+  }
+  node_->set_proximity_lookups(false);
+  node_->rtt_estimator_.Clear();
+  ASSERT_EQ(size_t(K), results[0].size());
+  for (size_t i = 0; i < closest.size(); ++i)
+    EXPECT_EQ(closest[i].node_id(), results[0][i]);
+  EXPECT_TRUE(results[0] == results[1]);
+}
+
+TEST_F(TestKNodeImpl, BEH_KNodeImpl_PathCacheCopies) {
+  // The TTL halves for each closer node down to kMinCacheCopyTtl, and never
+  // exceeds the TTL of the values copied.
+  EXPECT_EQ(kCacheCopyTtl, node_->CacheCopyTtl(0, -1));
+  EXPECT_EQ(kCacheCopyTtl / 2, node_->CacheCopyTtl(1, -1));
+  EXPECT_EQ(kCacheCopyTtl / 4, node_->CacheCopyTtl(2, 0));
+  size_t floor_closer(0);
+  while ((kCacheCopyTtl >> floor_closer) >= kMinCacheCopyTtl)
+    ++floor_closer;
+  EXPECT_LT(kMinCacheCopyTtl, node_->CacheCopyTtl(floor_closer - 1, -1));
+  EXPECT_EQ(kMinCacheCopyTtl, node_->CacheCopyTtl(floor_closer, -1));
+  EXPECT_EQ(kMinCacheCopyTtl, node_->CacheCopyTtl(40, -1));
+  EXPECT_EQ(100, node_->CacheCopyTtl(0, 100));
+  EXPECT_EQ(kCacheCopyTtl / 4, node_->CacheCopyTtl(2, kCacheCopyTtl));
+  EXPECT_EQ(kMinCacheCopyTtl / 2,
+            node_->CacheCopyTtl(floor_closer, kMinCacheCopyTtl / 2));
+
+  // A found value is copied to the closest node which answered without it,
+  // here a second node, with two nodes closer to the key.
+  std::string test_dir = std::string("temp/TestKNodeImpl") +
+                         boost::lexical_cast<std::string>(base::RandomUint32());
+  boost::int16_t transport_id;
+  transport::TransportUDT *udt = new transport::TransportUDT;
+  transport::TransportHandler *handler = new transport::TransportHandler;
+  handler->Register(udt, &transport_id);
+  rpcprotocol::ChannelManager *manager =
+      new rpcprotocol::ChannelManager(handler);
+  KNodeImpl *holder_node = new KNodeImpl(manager, handler, kad::VAULT, K,
+                                         kad::kAlpha, kad::kBeta,
+                                         kad::kRefreshTime, node_->private_key_,
+                                         node_->public_key_, false, false);
+  holder_node->set_transport_id(transport_id);
+  EXPECT_TRUE(manager->RegisterNotifiersToTransport());
+  EXPECT_TRUE(handler->RegisterOnServerDown(
+                  boost::bind(&kad::KNodeImpl::HandleDeadRendezvousServer,
+                              holder_node, _1)));
+  EXPECT_EQ(0, handler->Start(0, transport_id));
+  EXPECT_EQ(0, manager->Start());
+  boost::asio::ip::address local_ip;
+  ASSERT_TRUE(base::GetLocalAddress(&local_ip));
+  boost::uint16_t port;
+  ASSERT_TRUE(handler->listening_port(transport_id, &port));
+  GeneralKadCallback cb;
+  holder_node->Join(test_dir + std::string(".kadconfig"), local_ip.to_string(),
+                    port,
+                    boost::bind(&GeneralKadCallback::CallbackFunc, &cb, _1));
+  wait_result(&cb);
+  ASSERT_EQ(kad::kRpcResultSuccess, cb.result());
+
+  node_->ResetPathCacheStatistics();
+  crypto::Crypto co;
+  co.set_hash_algorithm(crypto::SHA_512);
+  std::vector<SignedValue> sig_values(2);
+  std::vector<KadId> keys;
+  for (size_t i = 0; i < sig_values.size(); ++i) {
+    sig_values[i].set_value(base::RandomString(64));
+    sig_values[i].set_value_signature(base::RandomString(64));
+    keys.push_back(KadId(co.Hash(sig_values[i].value() +
+                                 sig_values[i].value_signature(), "",
+                                 crypto::STRING_STRING, false)));
+  }
+  Contact holder(holder_node->contact_info());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    std::vector<KadId> distances;
+    for (int n = 0; n < 3; ++n)
+      distances.push_back(KadId(KadId::kRandomId));
+    std::sort(distances.begin(), distances.end());
+    boost::shared_ptr<IterativeLookUpData> data(
+        new IterativeLookUpData(FIND_VALUE, keys[i], &dummy_find_callback));
+    data->active_contacts[distances[0]] =
+        Contact(KadId(KadId::kRandomId), "127.0.0.1", 5000);
+    data->active_contacts[distances[1]] =
+        Contact(KadId(KadId::kRandomId), "127.0.0.1", 5001);
+    data->active_contacts[distances[2]] = holder;
+    data->no_value_contacts[distances[2]] = holder;
+    data->sig_values_found.push_back(sig_values[i]);
+    // The second value expires before the copy would
+    data->values_ttl = i == 0 ? -1 : 100;
+    node_->SearchIteration_Callback(data);
+  }
+  PathCacheStats stats(node_->PathCacheStatistics());
+  for (int i = 0; i < 100 && stats.copies_stored < keys.size(); ++i) {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+    stats = node_->PathCacheStatistics();
+  }
+  EXPECT_EQ(2U, stats.hits);
+  EXPECT_EQ(0U, stats.misses);
+  EXPECT_EQ(2U, stats.copies_sent);
+  EXPECT_EQ(2U, stats.copies_stored);
+  EXPECT_EQ(kCacheCopyTtl / 4, holder_node->pdata_store_->TimeToLive(
+      keys[0].String(), sig_values[0].SerializeAsString()));
+  EXPECT_EQ(100, holder_node->pdata_store_->TimeToLive(
+      keys[1].String(), sig_values[1].SerializeAsString()));
+
+  // A value found on every node asked is a hit with nothing to copy, and a
+  // lookup without the value a miss.
+  boost::shared_ptr<IterativeLookUpData> data(
+      new IterativeLookUpData(FIND_VALUE, keys[0], &dummy_find_callback));
+  data->active_contacts[KadId(KadId::kRandomId)] = holder;
+  data->sig_values_found.push_back(sig_values[0]);
+  node_->SearchIteration_Callback(data);
+  KadId missing_key(KadId::kRandomId);
+  data.reset(
+      new IterativeLookUpData(FIND_VALUE, missing_key, &dummy_find_callback));
+  data->active_contacts[KadId(KadId::kRandomId)] = holder;
+  data->no_value_contacts[KadId(KadId::kRandomId)] = holder;
+  node_->SearchIteration_Callback(data);
+  stats = node_->PathCacheStatistics();
+  EXPECT_EQ(3U, stats.hits);
+  EXPECT_EQ(1U, stats.misses);
+  EXPECT_EQ(2U, stats.copies_sent);
+  EXPECT_EQ(2U, stats.copies_stored);
+
+  node_->ResetPathCacheStatistics();
+  stats = node_->PathCacheStatistics();
+  EXPECT_EQ(0U, stats.hits + stats.misses + stats.copies_sent +
+                stats.copies_stored);
+  for (size_t i = 0; i < keys.size(); ++i)
+    node_->value_cache_.Remove(keys[i]);
+  node_->value_cache_.Remove(missing_key);
+
+  holder_node->Leave();
+  delete holder_node;
+  udt->Stop();
+  delete udt;
+  delete handler;
+  manager->ClearCallLaters();
+  delete manager;
+}
+
+TEST_F(TestKNodeImpl, BEH_KNodeImpl_RefreshValues) {
+  // A node with a one second refresh time and no contacts, on which a whole
+  // refresh run completes within RefreshValuesRoutine.  Its data store adds up
+  // to four seconds to the refresh time.
+  boost::int16_t transport_id;
+  transport::TransportUDT *udt = new transport::TransportUDT;
+  transport::TransportHandler *handler = new transport::TransportHandler;
+  handler->Register(udt, &transport_id);
+  rpcprotocol::ChannelManager *manager =
+      new rpcprotocol::ChannelManager(handler);
+  KNodeImpl *node = new KNodeImpl(manager, handler, kad::VAULT, K, kad::kAlpha,
+                                  kad::kBeta, 1, node_->private_key_,
+                                  node_->public_key_, false, false);
+  node->prouting_table_.reset(new RoutingTable(node->node_id_, K));
+  node->is_joined_ = true;
+  node->refresh_routine_started_ = true;
+
+  const size_t kKeyCount(kRefreshKeysInFlight + 2);
+  std::vector<std::string> keys;
+  std::map<std::string, std::vector<std::string> > values;
+  for (size_t k = 0; k < kKeyCount; ++k) {
+    keys.push_back(base::RandomString(64));
+    for (int n = 0; n < 2; ++n) {
+      SignedValue sig_value;
+      sig_value.set_value(base::RandomString(64));
+      sig_value.set_value_signature(base::RandomString(64));
+      values[keys[k]].push_back(sig_value.SerializeAsString());
+      ASSERT_TRUE(node->pdata_store_->StoreItem(keys[k], values[keys[k]][n],
+                                                3600, false));
+    }
+  }
+  std::string invalid_key(base::RandomString(64)), invalid_value("invalid");
+  ASSERT_TRUE(node->pdata_store_->StoreItem(keys[0], invalid_value, 3600,
+                                            false));
+  ASSERT_TRUE(node->pdata_store_->StoreItem(invalid_key, invalid_value, 3600,
+                                            false));
+  boost::this_thread::sleep(boost::posix_time::seconds(6));
+
+  // Each round takes up to kRefreshKeysInFlight keys, with one signed request
+  // for all the values of a key, and leaves out values which aren't valid.
+  RefreshValuesData data;
+  std::vector<refresh_value> due(node->pdata_store_->ValuesToRefresh());
+  for (size_t i = 0; i < due.size(); ++i)
+    data.pending_keys[due[i].key_].push_back(due[i]);
+  ASSERT_EQ(kKeyCount + 1, data.pending_keys.size());
+  data.signed_public_key = "signed public key";
+  std::set<std::string> refreshed_keys, requests;
+  int rounds(0);
+  while (!data.pending_keys.empty()) {
+    size_t pending(data.pending_keys.size());
+    std::vector<BatchStoreEntry> entries;
+    std::vector<refresh_value> entry_values;
+    node->NextRefreshEntries(&data, &entries, &entry_values);
+    ++rounds;
+    EXPECT_EQ(std::min(pending, static_cast<size_t>(kRefreshKeysInFlight)),
+              pending - data.pending_keys.size());
+    ASSERT_EQ(entries.size(), entry_values.size());
+    std::map<std::string, std::string> key_requests;
+    std::map<std::string, size_t> key_entries;
+    for (size_t i = 0; i < entries.size(); ++i) {
+      ++key_entries[entries[i].key()];
+      EXPECT_EQ(entry_values[i].key_, entries[i].key());
+      EXPECT_EQ(entry_values[i].value_,
+                entries[i].sig_value().SerializeAsString());
+      std::string request(entries[i].signed_request().SerializeAsString());
+      std::map<std::string, std::string>::iterator it =
+          key_requests.find(entries[i].key());
+      if (it == key_requests.end()) {
+        key_requests[entries[i].key()] = request;
+        EXPECT_TRUE(requests.insert(request).second);
+      } else {
+        EXPECT_EQ(it->second, request);
+      }
+    }
+    std::map<std::string, std::string>::iterator it;
+    for (it = key_requests.begin(); it != key_requests.end(); ++it) {
+      EXPECT_TRUE(refreshed_keys.insert(it->first).second);
+      EXPECT_EQ(values[it->first].size(), key_entries[it->first]);
+    }
+  }
+  EXPECT_EQ(2, rounds);
+  EXPECT_EQ(kKeyCount, refreshed_keys.size());
+  EXPECT_EQ(0U, refreshed_keys.count(invalid_key));
+
+  // A run refreshes every valid value, leaving the invalid ones due without
+  // holding up the keys after them, and schedules the next run.
+  std::map<std::string, boost::uint32_t> refresh_times;
+  for (size_t k = 0; k < kKeyCount; ++k) {
+    for (size_t n = 0; n < values[keys[k]].size(); ++n)
+      refresh_times[values[keys[k]][n]] =
+          node->pdata_store_->LastRefreshTime(keys[k], values[keys[k]][n]);
+  }
+  boost::uint32_t invalid_time(
+      node->pdata_store_->LastRefreshTime(invalid_key, invalid_value));
+  node->RefreshValuesRoutine();
+  EXPECT_EQ(1U, node->ptimer_->TimersMapSize());
+  for (size_t k = 0; k < kKeyCount; ++k) {
+    for (size_t n = 0; n < values[keys[k]].size(); ++n)
+      EXPECT_LT(refresh_times[values[keys[k]][n]],
+                node->pdata_store_->LastRefreshTime(keys[k],
+                                                    values[keys[k]][n]));
+  }
+  EXPECT_EQ(invalid_time,
+            node->pdata_store_->LastRefreshTime(invalid_key, invalid_value));
+
+  // A run finding only values marked for deletion still schedules the next.
+  node->ptimer_->CancelAll();
+  node->pdata_store_->Clear();
+  ASSERT_TRUE(node->pdata_store_->StoreItem(keys[0], values[keys[0]][0], 3600,
+                                            false));
+  ASSERT_TRUE(node->pdata_store_->MarkForDeletion(keys[0], values[keys[0]][0],
+                                                  "delete request"));
+  boost::this_thread::sleep(boost::posix_time::seconds(6));
+  node->RefreshValuesRoutine();
+  EXPECT_EQ(1U, node->ptimer_->TimersMapSize());
+
+  // A value deleted after the run read it is left out of the run.
+  node->ptimer_->CancelAll();
+  node->pdata_store_->Clear();
+  RefreshValuesData late_data;
+  for (size_t n = 0; n < values[keys[0]].size(); ++n) {
+    ASSERT_TRUE(node->pdata_store_->StoreItem(keys[0], values[keys[0]][n],
+                                              3600, false));
+    late_data.pending_keys[keys[0]].push_back(
+        refresh_value(keys[0], values[keys[0]][n], 3600));
+  }
+  ASSERT_TRUE(node->pdata_store_->MarkForDeletion(keys[0], values[keys[0]][0],
+                                                  "delete request"));
+  std::vector<BatchStoreEntry> late_entries;
+  std::vector<refresh_value> late_values;
+  node->NextRefreshEntries(&late_data, &late_entries, &late_values);
+  EXPECT_TRUE(late_data.pending_keys.empty());
+  ASSERT_EQ(1U, late_values.size());
+  EXPECT_EQ(values[keys[0]][1], late_values[0].value_);
+
+  // A refresh which finds a value deleted fails, however many nodes stored it.
+  std::vector<StoreValueResult> store_results;
+  boost::shared_ptr<BatchStoreData> batch(new BatchStoreData(late_entries,
+      false, boost::bind(&StoreBatchTestCallback, _1, &store_results)));
+  batch->save_nodes[0] = K;
+  batch->rpcs = 1;
+  node->StoreBatch_RpcDone(batch);
+  ASSERT_EQ(1U, store_results.size());
+  EXPECT_TRUE(store_results[0].succeeded);
+  batch->delete_requests[0].set_signer_id("signer");
+  batch->delete_requests[0].set_public_key("public key");
+  batch->delete_requests[0].set_signed_public_key("signed public key");
+  batch->delete_requests[0].set_signed_request("signed request");
+  node->StoreBatch_RpcDone(batch);
+  ASSERT_EQ(1U, store_results.size());
+  EXPECT_FALSE(store_results[0].succeeded);
+  EXPECT_EQ("signed request", store_results[0].signed_request.signed_request());
+
+  node->refresh_routine_started_ = false;
+  node->is_joined_ = false;
+  node->ptimer_->CancelAll();
+  delete node;
+  delete udt;
+  delete handler;
+  manager->ClearCallLaters();
+  delete manager;
+}
+
+TEST_F(TestKNodeImpl, BEH_KNodeImpl_HedgeProbes) {
+  // Each probe scheduled adds kHedgeBudget / 100 tokens, up to
+  // kMaxHedgeBurst.
+  KadId key(KadId::kRandomId);
+  boost::shared_ptr<IterativeLookUpData> data(
+      new IterativeLookUpData(FIND_NODE, key, &dummy_find_callback));
+  data->is_callbacked = true;
+  node_->rtt_estimator_.Clear();
+  node_->hedge_tokens_ = 0;
+  std::vector<Contact> probes(kad::kAlpha,
+                              Contact(KadId(KadId::kRandomId), "127.0.0.1",
+                                      7000));
+  node_->ScheduleHedges(probes, data);
+  EXPECT_DOUBLE_EQ(kad::kAlpha * kHedgeBudget / 100.0, node_->hedge_tokens_);
+  for (int i = 0; i < 100 * kMaxHedgeBurst; ++i)
+    node_->ScheduleHedges(probes, data);
+  EXPECT_DOUBLE_EQ(kMaxHedgeBurst, node_->hedge_tokens_);
+
+  // A lookup with alpha probes out and two more contacts to ask
+  data.reset(new IterativeLookUpData(FIND_NODE, key, &dummy_find_callback));
+  for (boost::uint16_t i = 0; i < kad::kAlpha + 2; ++i)
+    data->AddToShortList(Contact(KadId(KadId::kRandomId), "127.0.0.1",
+                                 7001 + i));
+  std::vector<Contact> by_distance;
+  std::map<KadId, LookupContact>::iterator it;
+  for (it = data->short_list.begin(); it != data->short_list.end(); ++it) {
+    if (by_distance.size() < kad::kAlpha) {
+      it->second.contacted = true;
+      data->current_alpha.push_back(it->second.kad_contact);
+      data->active_probes.push_back(it->second.kad_contact);
+    }
+    by_distance.push_back(it->second.kad_contact);
+  }
+  const Contact &slow(by_distance[1]);
+  const Contact &next(by_distance[kad::kAlpha]);
+
+  // No hedge without a token, in the final iteration or once the lookup has
+  // called back
+  node_->hedge_tokens_ = 0.5;
+  node_->HedgeProbe(slow, data);
+  data->in_final_iteration = true;
+  node_->hedge_tokens_ = 1;
+  node_->HedgeProbe(slow, data);
+  data->in_final_iteration = false;
+  data->is_callbacked = true;
+  node_->HedgeProbe(slow, data);
+  data->is_callbacked = false;
+  std::list<Contact>::iterator alpha_it(data->current_alpha.begin());
+  for (size_t i = 0; i < kad::kAlpha; ++i, ++alpha_it)
+    EXPECT_EQ(by_distance[i].node_id(), alpha_it->node_id());
+  EXPECT_EQ(size_t(kad::kAlpha), data->active_probes.size());
+  EXPECT_FALSE(data->short_list[next.node_id() ^ key].contacted);
+  EXPECT_DOUBLE_EQ(1, node_->hedge_tokens_);
+
+  // A probe still holding up the iteration is replaced in current_alpha by the
+  // closest uncontacted contact, but stays active
+  node_->HedgeProbe(slow, data);
+  {
+    boost::mutex::scoped_lock guard(data->mutex);
+    EXPECT_DOUBLE_EQ(0, node_->hedge_tokens_);
+    EXPECT_TRUE(data->short_list[next.node_id() ^ key].contacted);
+    EXPECT_FALSE(data->short_list[by_distance[kad::kAlpha + 1].node_id() ^
+                                  key].contacted);
+    alpha_it = data->current_alpha.begin();
+    for (size_t i = 0; i < kad::kAlpha; ++i, ++alpha_it)
+      EXPECT_EQ((i == 1 ? next : by_distance[i]).node_id(),
+                alpha_it->node_id());
+    bool slow_active(false), next_active(false);
+    for (alpha_it = data->active_probes.begin();
+         alpha_it != data->active_probes.end(); ++alpha_it) {
+      slow_active = slow_active || alpha_it->node_id() == slow.node_id();
+      next_active = next_active || alpha_it->node_id() == next.node_id();
+    }
+    EXPECT_TRUE(slow_active);
+    EXPECT_TRUE(next_active);
+  }
+
+  // Once hedged, the probe no longer holds up the iteration
+  node_->hedge_tokens_ = 1;
+  node_->HedgeProbe(slow, data);
+  EXPECT_DOUBLE_EQ(1, node_->hedge_tokens_);
+
+  // The slow probe's late answer is still merged into the lookup
+  Contact new_contact(KadId(KadId::kRandomId), "127.0.0.1", 7100);
+  std::string ser_contact;
+  new_contact.SerialiseToString(&ser_contact);
+  FindResponse *response = new FindResponse;
+  response->set_result(kRpcResultSuccess);
+  response->add_closest_nodes(ser_contact);
+  response->set_node_id(slow.node_id().String());
+  FindCallbackArgs callback_args(data);
+  callback_args.remote_ctc = slow;
+  callback_args.rpc_ctrler = new rpcprotocol::Controller;
+  node_->SearchIteration_ExtendShortList(response, callback_args);
+  {
+    boost::mutex::scoped_lock guard(data->mutex);
+    EXPECT_EQ(1U, data->active_contacts.count(slow.node_id() ^ key));
+    EXPECT_EQ(1U, data->short_list.count(new_contact.node_id() ^ key));
+    data->is_callbacked = true;
+  }
+  node_->RemoveContact(slow.node_id());
+  node_->rtt_estimator_.Clear();
+  node_->hedge_tokens_ = 0;
 }
 
 TEST_F(TestKNodeImpl, BEH_KNodeImpl_NotJoined) {
@@ -380,7 +914,7 @@ TEST_F(TestKNodeImpl, BEH_KNodeImpl_NotJoined) {
   StoreValueCallback svc;
   boost::shared_ptr<IterativeStoreValueData> isvd(
       new IterativeStoreValueData(std::vector<Contact>(), KadId(), "",
-                                  boost::bind(&StoreValueCallback::CallbackFunc,
+                                  boost::bind(&StoreValueCallback::ResultFunc,
                                               &svc, _1),
                                   true, 3600 * 24, SignedValue(),
                                   SignedRequest()));
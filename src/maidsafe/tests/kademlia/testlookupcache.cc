@@ -0,0 +1,134 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <algorithm>
+#include <vector>
+#include "maidsafe/kademlia/contact.h"
+#include "maidsafe/kademlia/kadid.h"
+#include "maidsafe/kademlia/lookupcache.h"
+
+namespace kad {
+
+namespace test_lookupcache {
+
+std::vector<Contact> MakeContacts(const size_t &count) {
+  std::vector<Contact> contacts;
+  for (size_t i = 0; i < count; ++i)
+    contacts.push_back(Contact(KadId(KadId::kRandomId), "127.0.0.1",
+                               static_cast<boost::uint16_t>(8000 + i)));
+  return contacts;
+}
+
+bool CloserToKey(const Contact &lhs, const Contact &rhs, const KadId &key) {
+  return KadId::CloserToTarget(lhs.node_id(), rhs.node_id(), key);
+}
+
+}  // namespace test_lookupcache
+
+TEST(TestLookupCache, BEH_KAD_LookupCacheAddGet) {
+  LookupCache cache(4, 60000);
+  KadId key(KadId::kRandomId);
+  std::vector<Contact> contacts(test_lookupcache::MakeContacts(3)), result;
+  ASSERT_FALSE(cache.Get(key, &result));
+  cache.Add(key, std::vector<Contact>());
+  ASSERT_EQ(size_t(0), cache.Size());
+  cache.Add(key, contacts);
+  ASSERT_TRUE(cache.Get(key, &result));
+  ASSERT_EQ(contacts.size(), result.size());
+  for (size_t i = 0; i < contacts.size(); ++i)
+    ASSERT_TRUE(contacts[i].Equals(result[i]));
+  cache.Clear();
+  ASSERT_FALSE(cache.Get(key, &result));
+}
+
+TEST(TestLookupCache, BEH_KAD_LookupCacheExpiry) {
+  LookupCache cache(4, 200);
+  KadId key(KadId::kRandomId);
+  std::vector<Contact> result;
+  cache.Add(key, test_lookupcache::MakeContacts(2));
+  ASSERT_TRUE(cache.Get(key, &result));
+  boost::this_thread::sleep(boost::posix_time::milliseconds(300));
+  ASSERT_FALSE(cache.Get(key, &result));
+  ASSERT_EQ(size_t(0), cache.Size());
+}
+
+TEST(TestLookupCache, BEH_KAD_LookupCacheBounded) {
+  const size_t kMaxSize(4);
+  LookupCache cache(kMaxSize, 60000);
+  std::vector<KadId> keys;
+  std::vector<Contact> result;
+  for (size_t i = 0; i < kMaxSize + 1; ++i) {
+    keys.push_back(KadId(KadId::kRandomId));
+    cache.Add(keys.back(), test_lookupcache::MakeContacts(2));
+    boost::this_thread::sleep(boost::posix_time::milliseconds(2));
+  }
+  ASSERT_EQ(kMaxSize, cache.Size());
+  // The first key added was the closest to expiry.
+  ASSERT_FALSE(cache.Get(keys.front(), &result));
+  for (size_t i = 1; i < keys.size(); ++i)
+    ASSERT_TRUE(cache.Get(keys[i], &result));
+}
+
+TEST(TestLookupCache, BEH_KAD_LookupCacheRemoveContact) {
+  LookupCache cache(4, 60000);
+  std::vector<Contact> contacts(test_lookupcache::MakeContacts(3)), result;
+  KadId key1(KadId::kRandomId), key2(KadId::kRandomId);
+  cache.Add(key1, contacts);
+  cache.Add(key2, std::vector<Contact>(contacts.begin(), contacts.begin() + 1));
+  cache.RemoveContact(KadId(KadId::kRandomId));
+  ASSERT_EQ(size_t(2), cache.Size());
+  cache.RemoveContact(contacts[2].node_id());
+  ASSERT_FALSE(cache.Get(key1, &result));
+  ASSERT_TRUE(cache.Get(key2, &result));
+  cache.RemoveContact(contacts[0].node_id());
+  ASSERT_EQ(size_t(0), cache.Size());
+}
+
+TEST(TestLookupCache, BEH_KAD_LookupCacheAddContact) {
+  LookupCache cache(4, 60000);
+  KadId key(KadId::kRandomId);
+  std::vector<Contact> contacts(test_lookupcache::MakeContacts(4)), result;
+  std::sort(contacts.begin(), contacts.end(),
+            boost::bind(&test_lookupcache::CloserToKey, _1, _2, key));
+  std::vector<Contact> close_nodes(contacts.begin(), contacts.begin() + 3);
+  // A contact already held, or one further than all of the k held, leaves the
+  // entry; one further but with fewer than k held, or a closer one, drops it.
+  cache.Add(key, close_nodes);
+  cache.AddContact(close_nodes[1].node_id(), 3);
+  cache.AddContact(contacts[3].node_id(), 3);
+  ASSERT_TRUE(cache.Get(key, &result));
+  cache.AddContact(contacts[3].node_id(), 4);
+  ASSERT_FALSE(cache.Get(key, &result));
+  cache.Add(key, std::vector<Contact>(contacts.begin() + 1, contacts.end()));
+  cache.AddContact(contacts[0].node_id(), 3);
+  ASSERT_FALSE(cache.Get(key, &result));
+}
+
+}  // namespace kad
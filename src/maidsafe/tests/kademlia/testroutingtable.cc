@@ -27,6 +27,9 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <gtest/gtest.h>
 #include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <map>
+#include <vector>
 #include "maidsafe/base/log.h"
 #include "maidsafe/kademlia/kbucket.h"
 #include "maidsafe/kademlia/kadroutingtable.h"
@@ -51,6 +54,52 @@ bool TestInRange(const kad::KadId &key_id, const kad::KadId &min_range,
   return static_cast<bool>(min_range <= key_id && key_id <= max_range);
 }
 
+class ContactDistanceComparator {
+ public:
+  explicit ContactDistanceComparator(const kad::KadId &key) : key_(key) {}
+  bool operator()(const kad::Contact &lhs, const kad::Contact &rhs) const {
+    return kad::KadId::CloserToTarget(lhs.node_id(), rhs.node_id(), key_);
+  }
+ private:
+  kad::KadId key_;
+};
+
+// The FindCloseNodes implementation which the heap-based one replaced:  the
+// key's k-bucket in LRU order, then the other k-buckets by distance, each
+// sorted in full.  A k-bucket's distance is taken from one of its contacts,
+// which orders them the same way as their ranges.
+void LegacyFindCloseNodes(kad::RoutingTable *routingtable,
+                          const kad::KadId &key, const size_t &count,
+                          const std::vector<kad::Contact> &exclude_contacts,
+                          std::vector<kad::Contact> *close_nodes) {
+  boost::int16_t index = routingtable->KBucketIndex(key);
+  if (index < 0)
+    return;
+  std::vector<kad::Contact> contacts;
+  routingtable->GetContacts(index, exclude_contacts, &contacts);
+  for (size_t i = 0; i < contacts.size() && close_nodes->size() < count; ++i)
+    close_nodes->push_back(contacts[i]);
+  std::map<kad::KadId, boost::uint16_t> buckets;
+  for (size_t i = 0; i < routingtable->KbucketSize(); ++i) {
+    kad::Contact last_seen = routingtable->GetLastSeenContact(i);
+    if (static_cast<boost::int16_t>(i) != index &&
+        last_seen.node_id().IsValid())
+      buckets.insert(std::make_pair(last_seen.node_id() ^ key, i));
+  }
+  for (std::map<kad::KadId, boost::uint16_t>::iterator it = buckets.begin();
+       it != buckets.end() && close_nodes->size() < count; ++it) {
+    routingtable->GetContacts(it->second, exclude_contacts, &contacts);
+    std::map<kad::KadId, kad::Contact> distance;
+    for (size_t i = 0; i < contacts.size(); ++i)
+      distance.insert(std::make_pair(contacts[i].node_id() ^ key,
+                                     contacts[i]));
+    for (std::map<kad::KadId, kad::Contact>::iterator dist_it =
+         distance.begin(); dist_it != distance.end() &&
+         close_nodes->size() < count; ++dist_it)
+      close_nodes->push_back(dist_it->second);
+  }
+}
+
 
 class TestRoutingTable : public testing::Test {
  public:
@@ -849,3 +898,69 @@ TEST_F(TestRoutingTable, BEH_KAD_GetFurthestNodes) {
                           << std::endl;
   }
 }
+
+TEST_F(TestRoutingTable, FUNC_KAD_FindCloseNodesBenchmark) {
+  const size_t kSizes[] = {1000, 10000, 100000};
+  const int kRounds(100);
+  std::string ip("127.0.0.1");
+  for (size_t n = 0; n < sizeof(kSizes) / sizeof(kSizes[0]); ++n) {
+    // Contacts at every distance from the holder fill a few hundred
+    // k-buckets, each sized to hold all of those offered to it.
+    kad::KadId holder_id(kad::KadId::kRandomId);
+    kad::RoutingTable routingtable(holder_id, kSizes[n] / 256);
+    for (size_t i = 0; i < kSizes[n]; ++i) {
+      boost::uint16_t power(base::RandomUint32() % kad::kKeySizeBits);
+      kad::Contact contact(holder_id ^ kad::KadId(kad::KadId(),
+                           kad::KadId(power)), ip, 5000 + i % 60000);
+      routingtable.AddContact(contact);
+    }
+    std::vector<kad::Contact> all_contacts, exclude_contacts, contacts;
+    for (size_t i = 0; i < routingtable.KbucketSize(); ++i) {
+      routingtable.GetContacts(i, exclude_contacts, &contacts);
+      all_contacts.insert(all_contacts.end(), contacts.begin(),
+                          contacts.end());
+    }
+    ASSERT_EQ(routingtable.Size(), all_contacts.size());
+    for (int i = 0; i < 4; ++i)
+      exclude_contacts.push_back(all_contacts[i * all_contacts.size() / 4]);
+
+    boost::uint64_t heap_time(0), legacy_time(0);
+    for (int round = 0; round < kRounds; ++round) {
+      // Alternate between random keys and keys near the holder, which fall
+      // in its many small k-buckets.
+      kad::KadId key = (round % 2 == 0) ? kad::KadId(kad::KadId::kRandomId) :
+          holder_id ^ kad::KadId(kad::KadId(), kad::KadId(boost::uint16_t(64)));
+      std::vector<kad::Contact> close_nodes, legacy_nodes;
+      boost::uint64_t start(base::GetEpochNanoseconds());
+      routingtable.FindCloseNodes(key, test_routing_table::K, exclude_contacts,
+                                  &close_nodes);
+      heap_time += base::GetEpochNanoseconds() - start;
+      start = base::GetEpochNanoseconds();
+      LegacyFindCloseNodes(&routingtable, key, test_routing_table::K,
+                           exclude_contacts, &legacy_nodes);
+      legacy_time += base::GetEpochNanoseconds() - start;
+
+      std::vector<kad::Contact> expected;
+      for (size_t i = 0; i < all_contacts.size(); ++i) {
+        bool excluded(false);
+        for (size_t j = 0; j < exclude_contacts.size(); ++j)
+          excluded = excluded || all_contacts[i].Equals(exclude_contacts[j]);
+        if (!excluded)
+          expected.push_back(all_contacts[i]);
+      }
+      std::partial_sort(expected.begin(),
+                        expected.begin() + test_routing_table::K,
+                        expected.end(), ContactDistanceComparator(key));
+      ASSERT_EQ(size_t(test_routing_table::K), close_nodes.size());
+      ASSERT_EQ(size_t(test_routing_table::K), legacy_nodes.size());
+      for (size_t i = 0; i < close_nodes.size(); ++i)
+        ASSERT_TRUE(expected[i].Equals(close_nodes[i]));
+    }
+    printf("FindCloseNodes for %u contacts in %u k-buckets (average of %d "
+           "rounds):\n  heap-based: %llu us\n  legacy:     %llu us\n",
+           static_cast<unsigned int>(routingtable.Size()),
+           static_cast<unsigned int>(routingtable.KbucketSize()), kRounds,
+           static_cast<unsigned long long>(heap_time / kRounds / 1000),  // NOLINT
+           static_cast<unsigned long long>(legacy_time / kRounds / 1000));  // NOLINT
+  }
+}
@@ -0,0 +1,117 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+#include <boost/thread/thread.hpp>
+#include "maidsafe/kademlia/kadid.h"
+#include "maidsafe/kademlia/rttestimator.h"
+
+namespace kad {
+
+TEST(TestRttEstimator, BEH_KAD_RttEstimatorTimeout) {
+  RttEstimator estimator(16, 100, 10000, 3, 0);
+  KadId id(KadId::kRandomId);
+  double srtt(0);
+  ASSERT_FALSE(estimator.SmoothedRtt(id, &srtt));
+  ASSERT_EQ(boost::uint64_t(10000), estimator.Timeout(id));
+  // First sample: srtt = 200, rttvar = 100, timeout = 600.
+  estimator.AddSample(id, 200);
+  ASSERT_TRUE(estimator.SmoothedRtt(id, &srtt));
+  ASSERT_DOUBLE_EQ(200, srtt);
+  ASSERT_EQ(boost::uint64_t(600), estimator.Timeout(id));
+  // Steady samples shrink the variance, but never below the minimum timeout.
+  for (int i = 0; i < 100; ++i)
+    estimator.AddSample(id, 10);
+  ASSERT_TRUE(estimator.SmoothedRtt(id, &srtt));
+  ASSERT_NEAR(10, srtt, 1);
+  ASSERT_EQ(boost::uint64_t(100), estimator.Timeout(id));
+  // A large sample raises the timeout.
+  estimator.AddSample(id, 2000);
+  ASSERT_LT(boost::uint64_t(1000), estimator.Timeout(id));
+  ASSERT_EQ(size_t(1), estimator.Size());
+  estimator.Clear();
+  ASSERT_EQ(size_t(0), estimator.Size());
+  ASSERT_EQ(boost::uint64_t(10000), estimator.Timeout(id));
+}
+
+TEST(TestRttEstimator, BEH_KAD_RttEstimatorBackoff) {
+  RttEstimator estimator(16, 100, 1000, 2, 0);
+  KadId id(KadId::kRandomId);
+  estimator.AddSample(id, 100);
+  ASSERT_EQ(boost::uint64_t(300), estimator.Timeout(id));
+  estimator.AddFailure(id);
+  ASSERT_EQ(boost::uint64_t(600), estimator.Timeout(id));
+  // Backoff stops at max_backoff doublings and at the maximum timeout.
+  estimator.AddFailure(id);
+  estimator.AddFailure(id);
+  ASSERT_EQ(boost::uint64_t(1000), estimator.Timeout(id));
+  // A response clears the backoff.
+  estimator.AddSample(id, 100);
+  ASSERT_GT(boost::uint64_t(600), estimator.Timeout(id));
+  // Failures alone don't make a contact measured.
+  KadId other(KadId::kRandomId);
+  estimator.AddFailure(other);
+  ASSERT_EQ(boost::uint64_t(1000), estimator.Timeout(other));
+}
+
+TEST(TestRttEstimator, BEH_KAD_RttEstimatorEviction) {
+  RttEstimator estimator(2, 100, 10000, 3, 0);
+  KadId id1(KadId::kRandomId), id2(KadId::kRandomId), id3(KadId::kRandomId);
+  double srtt(0);
+  estimator.AddSample(id1, 100);
+  boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+  estimator.AddSample(id2, 200);
+  boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+  estimator.AddSample(id1, 100);
+  boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+  estimator.AddSample(id3, 300);
+  ASSERT_EQ(size_t(2), estimator.Size());
+  ASSERT_TRUE(estimator.SmoothedRtt(id1, &srtt));
+  ASSERT_FALSE(estimator.SmoothedRtt(id2, &srtt));
+  ASSERT_TRUE(estimator.SmoothedRtt(id3, &srtt));
+}
+
+TEST(TestRttEstimator, BEH_KAD_RttEstimatorPercentile) {
+  RttEstimator estimator(0, 100, 10000, 3, 10);
+  boost::uint64_t rtt(0);
+  ASSERT_FALSE(estimator.Percentile(50, 0, &rtt));
+  // Samples from the oldest are dropped beyond the window.
+  for (boost::uint64_t i = 0; i < 20; ++i)
+    estimator.AddSample(KadId(KadId::kRandomId), 1000 - i * 10);
+  ASSERT_EQ(size_t(0), estimator.Size());
+  ASSERT_FALSE(estimator.Percentile(50, 11, &rtt));
+  ASSERT_TRUE(estimator.Percentile(0, 10, &rtt));
+  ASSERT_EQ(boost::uint64_t(810), rtt);
+  ASSERT_TRUE(estimator.Percentile(100, 10, &rtt));
+  ASSERT_EQ(boost::uint64_t(900), rtt);
+  ASSERT_TRUE(estimator.Percentile(50, 10, &rtt));
+  ASSERT_EQ(boost::uint64_t(850), rtt);
+  estimator.Clear();
+  ASSERT_FALSE(estimator.Percentile(50, 0, &rtt));
+}
+
+}  // namespace kad
@@ -0,0 +1,113 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+#include <boost/thread/thread.hpp>
+#include <string>
+#include <vector>
+#include "maidsafe/kademlia/kadid.h"
+#include "maidsafe/kademlia/valuecache.h"
+
+namespace kad {
+
+namespace test_valuecache {
+
+FindValueResult MakeResult(const std::string &value) {
+  FindValueResult result;
+  result.succeeded = true;
+  result.values.push_back(value);
+  return result;
+}
+
+}  // namespace test_valuecache
+
+TEST(TestValueCache, BEH_KAD_ValueCacheAddGet) {
+  ValueCache cache(1024, 60000);
+  KadId key(KadId::kRandomId);
+  FindValueResult result;
+  ASSERT_FALSE(cache.Get(key, &result));
+  cache.Add(key, FindValueResult(), -1);
+  cache.Add(key, test_valuecache::MakeResult("Value"), 0);
+  ASSERT_EQ(size_t(0), cache.Size());
+  cache.Add(key, test_valuecache::MakeResult("Value"), -1);
+  ASSERT_TRUE(cache.Get(key, &result));
+  ASSERT_TRUE(result.succeeded);
+  ASSERT_EQ(size_t(1), result.values.size());
+  ASSERT_EQ("Value", result.values[0]);
+  ASSERT_LT(size_t(0), cache.Bytes());
+  cache.Remove(key);
+  ASSERT_FALSE(cache.Get(key, &result));
+  ASSERT_EQ(size_t(0), cache.Bytes());
+}
+
+TEST(TestValueCache, BEH_KAD_ValueCacheExpiry) {
+  ValueCache cache(1024, 200);
+  KadId key1(KadId::kRandomId), key2(KadId::kRandomId);
+  FindValueResult result;
+  // Values which don't expire are still only kept for the cache's TTL, ...
+  cache.Add(key1, test_valuecache::MakeResult("Value1"), -1);
+  // ... and values which do are kept no longer than they have left to live.
+  ValueCache long_cache(1024, 60000);
+  long_cache.Add(key2, test_valuecache::MakeResult("Value2"), 1);
+  ASSERT_TRUE(cache.Get(key1, &result));
+  ASSERT_TRUE(long_cache.Get(key2, &result));
+  boost::this_thread::sleep(boost::posix_time::milliseconds(1100));
+  ASSERT_FALSE(cache.Get(key1, &result));
+  ASSERT_FALSE(long_cache.Get(key2, &result));
+  ASSERT_EQ(size_t(0), cache.Size());
+  ASSERT_EQ(size_t(0), long_cache.Size());
+}
+
+TEST(TestValueCache, BEH_KAD_ValueCacheBounded) {
+  const std::string kValue(100, 'v');
+  KadId key(KadId::kRandomId);
+  const size_t kEntryBytes(key.String().size() + kValue.size());
+  ValueCache cache(3 * kEntryBytes, 60000);
+  std::vector<KadId> keys;
+  FindValueResult result;
+  for (size_t i = 0; i < 3; ++i) {
+    keys.push_back(KadId(KadId::kRandomId));
+    cache.Add(keys.back(), test_valuecache::MakeResult(kValue), -1);
+  }
+  ASSERT_EQ(3 * kEntryBytes, cache.Bytes());
+  // Using the first key makes the second the least recently used.
+  ASSERT_TRUE(cache.Get(keys[0], &result));
+  keys.push_back(KadId(KadId::kRandomId));
+  cache.Add(keys.back(), test_valuecache::MakeResult(kValue), -1);
+  ASSERT_EQ(size_t(3), cache.Size());
+  ASSERT_FALSE(cache.Get(keys[1], &result));
+  ASSERT_TRUE(cache.Get(keys[0], &result));
+  ASSERT_TRUE(cache.Get(keys[2], &result));
+  ASSERT_TRUE(cache.Get(keys[3], &result));
+  // A result bigger than the whole cache is never held.
+  cache.Add(key, test_valuecache::MakeResult(std::string(4 * kEntryBytes, 'v')),
+            -1);
+  ASSERT_FALSE(cache.Get(key, &result));
+  ASSERT_EQ(size_t(3), cache.Size());
+}
+
+}  // namespace kad
@@ -276,6 +276,9 @@ class RpcProtocolTest : public testing::Test {
     server_transport_handler->StopAll();
     client_chann_manager->Stop();
     server_chann_manager->Stop();
+    client_chann_manager->SetConnectionPool(
+        rpcprotocol::kMaxPooledConnections,
+        rpcprotocol::kPooledConnectionIdleTimeout);
   }
   static rpcprotocol::ChannelManager *server_chann_manager,
       *client_chann_manager;
@@ -991,3 +994,168 @@ TEST(RpcControllerTest, BEH_RPC_RpcController) {
   ASSERT_EQ("abc", service);
   ASSERT_EQ("xyz", method);
 }
+
+TEST_F(RpcProtocolTest, BEH_RPC_PooledConnectionReuse) {
+  PingTestService service;
+  rpcprotocol::Channel service_channel(server_chann_manager,
+                                       server_transport_handler);
+  service_channel.SetService(&service);
+  server_chann_manager->RegisterChannel(service.GetDescriptor()->name(),
+                                        &service_channel);
+  boost::uint16_t lp_node;
+  ASSERT_TRUE(server_transport_handler->listening_port(server_transport_id,
+                                                       &lp_node));
+  tests::PingRequest req;
+  req.set_ping("ping");
+  req.set_ip("127.0.0.1");
+  req.set_port(lp_node);
+  ResultHolder resultholder;
+  for (int i = 0; i < 3; ++i) {
+    rpcprotocol::Controller controller;
+    controller.set_timeout(5);
+    rpcprotocol::Channel out_channel(client_chann_manager,
+        client_transport_handler, client_transport_id, "127.0.0.1", lp_node,
+        "", 0, "", 0);
+    tests::PingTest::Stub stubservice(&out_channel);
+    tests::PingResponse resp;
+    google::protobuf::Closure *done = google::protobuf::NewCallback<
+        ResultHolder, const tests::PingResponse*,
+        const rpcprotocol::Controller*>(&resultholder,
+        &ResultHolder::HandlePingResponse, &resp, &controller);
+    stubservice.Ping(&controller, &req, &resp, done);
+    resultholder.WaitForResponse(boost::posix_time::milliseconds(10000));
+    ASSERT_EQ("S", resultholder.ping_result().result());
+    ASSERT_EQ("pong", resultholder.ping_result().pong());
+    ASSERT_FALSE(controller.Failed());
+    // The connection stays open for the next request.
+    ASSERT_EQ(size_t(1), client_chann_manager->PooledConnections());
+    resultholder.Reset();
+  }
+  RpcProtocolTest::server_chann_manager->ClearCallLaters();
+  RpcProtocolTest::client_chann_manager->ClearCallLaters();
+}
+
+TEST_F(RpcProtocolTest, BEH_RPC_MultiplexedRequests) {
+  MirrorTestService service;
+  rpcprotocol::Channel service_channel(server_chann_manager,
+                                       server_transport_handler);
+  service_channel.SetService(&service);
+  server_chann_manager->RegisterChannel(service.GetDescriptor()->name(),
+                                        &service_channel);
+  boost::uint16_t lp_node;
+  ASSERT_TRUE(server_transport_handler->listening_port(server_transport_id,
+                                                       &lp_node));
+  const int kRequests(5);
+  boost::shared_ptr<rpcprotocol::Controller> controllers[kRequests];
+  boost::shared_ptr<rpcprotocol::Channel> channels[kRequests];
+  tests::StringMirrorResponse responses[kRequests];
+  ResultHolder resultholders[kRequests];
+  for (int i = 0; i < kRequests; ++i) {
+    controllers[i].reset(new rpcprotocol::Controller);
+    controllers[i]->set_timeout(10);
+    channels[i].reset(new rpcprotocol::Channel(client_chann_manager,
+        client_transport_handler, client_transport_id, "127.0.0.1", lp_node,
+        "", 0, "", 0));
+    tests::MirrorTest::Stub stubservice(channels[i].get());
+    tests::StringMirrorRequest req;
+    req.set_message("abc" + base::IntToString(i));
+    req.set_ip("127.0.0.1");
+    req.set_port(lp_node);
+    req.set_not_pause(true);
+    google::protobuf::Closure *done = google::protobuf::NewCallback<
+        ResultHolder, const tests::StringMirrorResponse*,
+        const rpcprotocol::Controller*>(&resultholders[i],
+        &ResultHolder::HandleMirrorResponse, &responses[i],
+        controllers[i].get());
+    stubservice.Mirror(controllers[i].get(), &req, &responses[i], done);
+  }
+  for (int i = 0; i < kRequests; ++i) {
+    resultholders[i].WaitForResponse(boost::posix_time::milliseconds(20000));
+    ASSERT_FALSE(controllers[i]->Failed());
+    ASSERT_EQ(base::IntToString(i) + "cba",
+              resultholders[i].mirror_result().mirrored_string());
+  }
+  // All requests were sent over a single connection.
+  ASSERT_EQ(size_t(1), client_chann_manager->PooledConnections());
+  RpcProtocolTest::server_chann_manager->ClearCallLaters();
+  RpcProtocolTest::client_chann_manager->ClearCallLaters();
+}
+
+TEST_F(RpcProtocolTest, BEH_RPC_ConnectionPoolDisabled) {
+  ASSERT_FALSE(client_chann_manager->SetConnectionPool(0, 1000));
+  client_chann_manager->Stop();
+  ASSERT_TRUE(client_chann_manager->SetConnectionPool(0, 1000));
+  ASSERT_EQ(0, client_chann_manager->Start());
+  PingTestService service;
+  rpcprotocol::Channel service_channel(server_chann_manager,
+                                       server_transport_handler);
+  service_channel.SetService(&service);
+  server_chann_manager->RegisterChannel(service.GetDescriptor()->name(),
+                                        &service_channel);
+  boost::uint16_t lp_node;
+  ASSERT_TRUE(server_transport_handler->listening_port(server_transport_id,
+                                                       &lp_node));
+  rpcprotocol::Controller controller;
+  controller.set_timeout(5);
+  rpcprotocol::Channel out_channel(client_chann_manager,
+      client_transport_handler, client_transport_id, "127.0.0.1", lp_node,
+      "", 0, "", 0);
+  tests::PingTest::Stub stubservice(&out_channel);
+  tests::PingRequest req;
+  tests::PingResponse resp;
+  req.set_ping("ping");
+  req.set_ip("127.0.0.1");
+  req.set_port(lp_node);
+  ResultHolder resultholder;
+  google::protobuf::Closure *done = google::protobuf::NewCallback<ResultHolder,
+      const tests::PingResponse*, const rpcprotocol::Controller*>(&resultholder,
+      &ResultHolder::HandlePingResponse, &resp, &controller);
+  stubservice.Ping(&controller, &req, &resp, done);
+  resultholder.WaitForResponse(boost::posix_time::milliseconds(10000));
+  ASSERT_EQ("S", resultholder.ping_result().result());
+  ASSERT_FALSE(controller.Failed());
+  ASSERT_EQ(size_t(0), client_chann_manager->PooledConnections());
+  RpcProtocolTest::server_chann_manager->ClearCallLaters();
+  RpcProtocolTest::client_chann_manager->ClearCallLaters();
+}
+
+TEST_F(RpcProtocolTest, BEH_RPC_IdleConnectionClosed) {
+  client_chann_manager->Stop();
+  ASSERT_TRUE(client_chann_manager->SetConnectionPool(
+      rpcprotocol::kMaxPooledConnections, 1000));
+  ASSERT_EQ(0, client_chann_manager->Start());
+  PingTestService service;
+  rpcprotocol::Channel service_channel(server_chann_manager,
+                                       server_transport_handler);
+  service_channel.SetService(&service);
+  server_chann_manager->RegisterChannel(service.GetDescriptor()->name(),
+                                        &service_channel);
+  boost::uint16_t lp_node;
+  ASSERT_TRUE(server_transport_handler->listening_port(server_transport_id,
+                                                       &lp_node));
+  rpcprotocol::Controller controller;
+  controller.set_timeout(5);
+  rpcprotocol::Channel out_channel(client_chann_manager,
+      client_transport_handler, client_transport_id, "127.0.0.1", lp_node,
+      "", 0, "", 0);
+  tests::PingTest::Stub stubservice(&out_channel);
+  tests::PingRequest req;
+  tests::PingResponse resp;
+  req.set_ping("ping");
+  req.set_ip("127.0.0.1");
+  req.set_port(lp_node);
+  ResultHolder resultholder;
+  google::protobuf::Closure *done = google::protobuf::NewCallback<ResultHolder,
+      const tests::PingResponse*, const rpcprotocol::Controller*>(&resultholder,
+      &ResultHolder::HandlePingResponse, &resp, &controller);
+  stubservice.Ping(&controller, &req, &resp, done);
+  resultholder.WaitForResponse(boost::posix_time::milliseconds(10000));
+  ASSERT_EQ("S", resultholder.ping_result().result());
+  ASSERT_FALSE(controller.Failed());
+  ASSERT_EQ(size_t(1), client_chann_manager->PooledConnections());
+  // No further request is made; the sweep alone closes the connection.
+  boost::this_thread::sleep(boost::posix_time::milliseconds(2500));
+  ASSERT_EQ(size_t(0), client_chann_manager->PooledConnections());
+  RpcProtocolTest::server_chann_manager->ClearCallLaters();
+  RpcProtocolTest::client_chann_manager->ClearCallLaters();
+}
@@ -33,9 +33,13 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <boost/lexical_cast.hpp>
 #include <boost/thread/thread.hpp>
 #include <gtest/gtest.h>
+#include <limits>
 #include <list>
+#include <set>
 #include <string>
+#include <vector>
 #include "maidsafe/protobuf/rpcmessage.pb.h"
+#include "maidsafe/transport/bufferpool.h"
 #include "maidsafe/transport/transport-api.h"
 #include "maidsafe/transport/transporthandler-api.h"
 #include "maidsafe/transport/transportudt.h"
@@ -243,6 +247,51 @@ class MessageHandlerEchoResp {
   MessageHandlerEchoResp& operator=(const MessageHandlerEchoResp&);
 };
 
+class MessageHandlerSlow {
+ public:
+  explicit MessageHandlerSlow(const boost::uint32_t &delay)
+      : mutex_(), delay_(delay), active_(0), max_active_(0),
+        msgs_received_(0), ids_() {}
+  void OnRPCMessage(const rpcprotocol::RpcMessage&,
+                    const boost::uint32_t &connection_id,
+                    const boost::int16_t,
+                    const float&) {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      ++active_;
+      if (active_ > max_active_)
+        max_active_ = active_;
+    }
+    boost::this_thread::sleep(boost::posix_time::milliseconds(delay_));
+    boost::mutex::scoped_lock lock(mutex_);
+    --active_;
+    ++msgs_received_;
+    ids_.insert(connection_id);
+  }
+  void OnDeadRendezvousServer(const bool&, const std::string&,
+                              const boost::uint16_t&) {}
+  void OnSend(const boost::uint32_t&, const bool&) {}
+  int max_active() {
+    boost::mutex::scoped_lock lock(mutex_);
+    return max_active_;
+  }
+  int msgs_received() {
+    boost::mutex::scoped_lock lock(mutex_);
+    return msgs_received_;
+  }
+  size_t connections() {
+    boost::mutex::scoped_lock lock(mutex_);
+    return ids_.size();
+  }
+ private:
+  MessageHandlerSlow(const MessageHandlerSlow&);
+  MessageHandlerSlow& operator=(const MessageHandlerSlow&);
+  boost::mutex mutex_;
+  boost::uint32_t delay_;
+  int active_, max_active_, msgs_received_;
+  std::set<boost::uint32_t> ids_;
+};
+
 class TransportTest: public testing::Test {};
 
 TEST_F(TransportTest, BEH_TRANS_SendOneMessageFromOneToAnother) {
@@ -1940,4 +1989,293 @@ TEST_F(TransportTest, BEH_TRANS_RegisterNotifiers) {
   node1_handler.Stop(node1_id);
 }
 
+TEST_F(TransportTest, BEH_TRANS_ParallelMessageHandlers) {
+  transport::TransportHandler node1_handler, node2_handler;
+  boost::int16_t node1_id, node2_id;
+  transport::TransportUDT node1_transudt, node2_transudt;
+  ASSERT_EQ(transport::kMessageHandlerThreads,
+            node2_transudt.message_handler_threads());
+  ASSERT_FALSE(node2_transudt.SetMessageHandlerThreads(0));
+  ASSERT_FALSE(node2_transudt.SetMessageHandlerThreads(
+      transport::kMaxMessageHandlerThreads + 1));
+  ASSERT_TRUE(node2_transudt.SetMessageHandlerThreads(4));
+  ASSERT_EQ(4, node2_transudt.message_handler_threads());
+  node1_handler.Register(&node1_transudt, &node1_id);
+  node2_handler.Register(&node2_transudt, &node2_id);
+  MessageHandler msg_handler1;
+  MessageHandlerSlow msg_handler2(200);
+  ASSERT_TRUE(node1_handler.RegisterOnRPCMessage(
+    boost::bind(&MessageHandler::OnRPCMessage, &msg_handler1, _1, _2, _3, _4)));
+  ASSERT_TRUE(node1_handler.RegisterOnServerDown(
+    boost::bind(&MessageHandler::OnDeadRendezvousServer, &msg_handler1,
+    _1, _2, _3)));
+  ASSERT_TRUE(node1_handler.RegisterOnSend(boost::bind(&MessageHandler::OnSend,
+    &msg_handler1, _1, _2)));
+  ASSERT_EQ(0, node1_handler.Start(0, node1_id));
+  ASSERT_TRUE(node2_handler.RegisterOnRPCMessage(
+    boost::bind(&MessageHandlerSlow::OnRPCMessage, &msg_handler2,
+                _1, _2, _3, _4)));
+  ASSERT_TRUE(node2_handler.RegisterOnServerDown(
+    boost::bind(&MessageHandlerSlow::OnDeadRendezvousServer, &msg_handler2,
+    _1, _2, _3)));
+  ASSERT_TRUE(node2_handler.RegisterOnSend(boost::bind(
+    &MessageHandlerSlow::OnSend, &msg_handler2, _1, _2)));
+  ASSERT_EQ(0, node2_handler.Start(0, node2_id));
+  ASSERT_FALSE(node2_transudt.SetMessageHandlerThreads(2));
+  boost::uint16_t lp_node2;
+  ASSERT_TRUE(node2_handler.listening_port(node2_id, &lp_node2));
+  rpcprotocol::RpcMessage rpc_msg;
+  rpc_msg.set_rpc_type(rpcprotocol::REQUEST);
+  rpc_msg.set_message_id(2000);
+  rpc_msg.set_args(base::RandomString(1024));
+  const int kMessages = 8;
+  for (int i = 0; i < kMessages; ++i) {
+    boost::uint32_t id;
+    ASSERT_EQ(0, node1_handler.ConnectToSend("127.0.0.1", lp_node2, "", 0, "",
+      0, false, &id, node1_id));
+    ASSERT_EQ(0, node1_handler.Send(rpc_msg, id, true, node1_id));
+  }
+  int count = 0;
+  while (msg_handler2.msgs_received() < kMessages && count < 1000) {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    ++count;
+  }
+  ASSERT_EQ(kMessages, msg_handler2.msgs_received());
+  ASSERT_EQ(size_t(kMessages), msg_handler2.connections());
+  ASSERT_LT(1, msg_handler2.max_active());
+  ASSERT_GE(4, msg_handler2.max_active());
+  transport::MessageHandlerStats stats =
+      node2_transudt.MessageHandlerStatistics();
+  ASSERT_EQ(size_t(0), stats.queue_depth);
+  ASSERT_LE(size_t(1), stats.max_queue_depth);
+  ASSERT_EQ(boost::uint64_t(kMessages), stats.dispatch_latency.Size());
+  ASSERT_EQ(boost::uint64_t(kMessages), stats.handling_time.Size());
+  ASSERT_LE(boost::uint64_t(200000), stats.handling_time.Min());
+  node2_transudt.ClearMessageHandlerStatistics();
+  ASSERT_EQ(boost::uint64_t(0),
+            node2_transudt.MessageHandlerStatistics().dispatch_latency.Size());
+  node1_handler.Stop(node1_id);
+  node2_handler.Stop(node2_id);
+}
+
+TEST_F(TransportTest, BEH_TRANS_ParallelMessageHandlersKeepConnectionOrder) {
+  transport::TransportHandler node1_handler, node2_handler;
+  boost::int16_t node1_id, node2_id;
+  transport::TransportUDT node1_transudt, node2_transudt;
+  ASSERT_TRUE(node2_transudt.SetMessageHandlerThreads(4));
+  node1_handler.Register(&node1_transudt, &node1_id);
+  node2_handler.Register(&node2_transudt, &node2_id);
+  MessageHandler msg_handler1, msg_handler2;
+  ASSERT_TRUE(node1_handler.RegisterOnRPCMessage(
+    boost::bind(&MessageHandler::OnRPCMessage, &msg_handler1, _1, _2, _3, _4)));
+  ASSERT_TRUE(node1_handler.RegisterOnServerDown(
+    boost::bind(&MessageHandler::OnDeadRendezvousServer, &msg_handler1,
+    _1, _2, _3)));
+  ASSERT_TRUE(node1_handler.RegisterOnSend(boost::bind(&MessageHandler::OnSend,
+    &msg_handler1, _1, _2)));
+  ASSERT_EQ(0, node1_handler.Start(0, node1_id));
+  ASSERT_TRUE(node2_handler.RegisterOnRPCMessage(
+    boost::bind(&MessageHandler::OnRPCMessage, &msg_handler2, _1, _2, _3, _4)));
+  ASSERT_TRUE(node2_handler.RegisterOnServerDown(
+    boost::bind(&MessageHandler::OnDeadRendezvousServer, &msg_handler2,
+    _1, _2, _3)));
+  ASSERT_TRUE(node2_handler.RegisterOnSend(boost::bind(&MessageHandler::OnSend,
+    &msg_handler2, _1, _2)));
+  ASSERT_EQ(0, node2_handler.Start(0, node2_id));
+  boost::uint16_t lp_node2;
+  ASSERT_TRUE(node2_handler.listening_port(node2_id, &lp_node2));
+  boost::uint32_t id;
+  ASSERT_EQ(0, node1_handler.ConnectToSend("127.0.0.1", lp_node2, "", 0, "", 0,
+    true, &id, node1_id));
+  // Only a single connection is used, so the messages are handled serially by
+  // whichever thread picks them up and must arrive in order.
+  std::list<std::string> sent_msgs;
+  const int kMessages = 5;
+  for (int i = 0; i < kMessages; ++i) {
+    rpcprotocol::RpcMessage rpc_msg;
+    rpc_msg.set_rpc_type(rpcprotocol::REQUEST);
+    rpc_msg.set_message_id(2000 + i);
+    rpc_msg.set_args(base::RandomString(1024));
+    std::string msg;
+    rpc_msg.SerializeToString(&msg);
+    sent_msgs.push_back(msg);
+    ASSERT_EQ(0, node1_handler.Send(rpc_msg, id, i == 0, node1_id));
+  }
+  int count = 0;
+  while (msg_handler2.msgs.size() < size_t(kMessages) && count < 1000) {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    ++count;
+  }
+  node1_handler.Stop(node1_id);
+  node2_handler.Stop(node2_id);
+  ASSERT_EQ(sent_msgs, msg_handler2.msgs);
+}
+
+TEST_F(TransportTest, BEH_TRANS_ReceiveOnManyOpenConnections) {
+  transport::TransportHandler node1_handler, node2_handler;
+  boost::int16_t node1_id, node2_id;
+  transport::TransportUDT node1_transudt, node2_transudt;
+  node1_handler.Register(&node1_transudt, &node1_id);
+  node2_handler.Register(&node2_transudt, &node2_id);
+  MessageHandler msg_handler1, msg_handler2;
+  ASSERT_TRUE(node1_handler.RegisterOnRPCMessage(
+    boost::bind(&MessageHandler::OnRPCMessage, &msg_handler1, _1, _2, _3, _4)));
+  ASSERT_TRUE(node1_handler.RegisterOnServerDown(
+    boost::bind(&MessageHandler::OnDeadRendezvousServer, &msg_handler1,
+    _1, _2, _3)));
+  ASSERT_TRUE(node1_handler.RegisterOnSend(boost::bind(&MessageHandler::OnSend,
+    &msg_handler1, _1, _2)));
+  ASSERT_EQ(0, node1_handler.Start(0, node1_id));
+  ASSERT_TRUE(node2_handler.RegisterOnRPCMessage(
+    boost::bind(&MessageHandler::OnRPCMessage, &msg_handler2, _1, _2, _3, _4)));
+  ASSERT_TRUE(node2_handler.RegisterOnServerDown(
+    boost::bind(&MessageHandler::OnDeadRendezvousServer, &msg_handler2,
+    _1, _2, _3)));
+  ASSERT_TRUE(node2_handler.RegisterOnSend(boost::bind(&MessageHandler::OnSend,
+    &msg_handler2, _1, _2)));
+  ASSERT_EQ(0, node2_handler.Start(0, node2_id));
+  boost::uint16_t lp_node2;
+  ASSERT_TRUE(node2_handler.listening_port(node2_id, &lp_node2));
+  rpcprotocol::RpcMessage rpc_msg;
+  rpc_msg.set_rpc_type(rpcprotocol::REQUEST);
+  rpc_msg.set_message_id(2000);
+  rpc_msg.set_args(base::RandomString(64 * 1024));
+  std::string msg;
+  rpc_msg.SerializeToString(&msg);
+  // Open all the connections first and leave them idle, then use them in
+  // reverse order so that only a few of the watched sockets are ever ready.
+  const int kConnections = 20;
+  std::vector<boost::uint32_t> ids;
+  for (int i = 0; i < kConnections; ++i) {
+    boost::uint32_t id;
+    ASSERT_EQ(0, node1_handler.ConnectToSend("127.0.0.1", lp_node2, "", 0, "",
+      0, true, &id, node1_id));
+    ids.push_back(id);
+  }
+  boost::this_thread::sleep(boost::posix_time::milliseconds(500));
+  for (int i = kConnections - 1; i >= 0; --i) {
+    ASSERT_EQ(0, node1_handler.Send(rpc_msg, ids[i], true, node1_id));
+    int count = 0;
+    while (msg_handler2.msgs.size() < size_t(kConnections - i) &&
+           count < 500) {
+      boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+      ++count;
+    }
+    ASSERT_EQ(size_t(kConnections - i), msg_handler2.msgs.size());
+    ASSERT_EQ(msg, msg_handler2.msgs.back());
+  }
+  // A second message on an already used connection must also be picked up.
+  ASSERT_EQ(0, node1_handler.Send(rpc_msg, ids[0], false, node1_id));
+  int count = 0;
+  while (msg_handler2.msgs.size() < size_t(kConnections + 1) && count < 500) {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    ++count;
+  }
+  ASSERT_EQ(size_t(kConnections + 1), msg_handler2.msgs.size());
+  std::list<boost::uint32_t>::iterator it;
+  for (it = msg_handler2.ids.begin(); it != msg_handler2.ids.end(); ++it) {
+    node2_handler.CloseConnection(*it, node2_id);
+    ASSERT_FALSE(node2_handler.ConnectionExists(*it, node2_id));
+  }
+  node1_handler.Stop(node1_id);
+  node2_handler.Stop(node2_id);
+}
+
+TEST_F(TransportTest, BEH_TRANS_BufferPoolReuse) {
+  transport::BufferPool pool(2, 4096);
+  ASSERT_EQ(size_t(4096), pool.max_buffer_size());
+  char *first(NULL);
+  {
+    boost::shared_array<char> buffer(pool.Get(1000));
+    first = buffer.get();
+    boost::shared_array<char> copy(buffer);
+    buffer.reset();
+    ASSERT_EQ(size_t(0), pool.IdleBuffers());
+  }
+  ASSERT_EQ(size_t(1), pool.IdleBuffers());
+  // Sizes in the same size class share buffers, other sizes do not.
+  boost::shared_array<char> small(pool.Get(100));
+  ASSERT_NE(first, small.get());
+  ASSERT_EQ(size_t(1), pool.IdleBuffers());
+  boost::shared_array<char> same_class(pool.Get(1024));
+  ASSERT_EQ(first, same_class.get());
+  ASSERT_EQ(size_t(0), pool.IdleBuffers());
+  // Only max_idle_buffers buffers are kept, and large ones never are.
+  boost::shared_array<char> large(pool.Get(4097));
+  boost::shared_array<char> other(pool.Get(4096));
+  large.reset();
+  ASSERT_EQ(size_t(0), pool.IdleBuffers());
+  small.reset();
+  same_class.reset();
+  other.reset();
+  ASSERT_EQ(size_t(2), pool.IdleBuffers());
+  // A buffer released after the pool is gone is freed by its last reference.
+  boost::shared_array<char> survivor;
+  {
+    transport::BufferPool short_lived(1, 512);
+    survivor = short_lived.Get(512);
+  }
+  memset(survivor.get(), 0, 512);
+  survivor.reset();
+}
+
+TEST_F(TransportTest, BEH_TRANS_RejectOversizedMessage) {
+  boost::uint32_t id = 0;
+  transport::TransportHandler node1_handler, node2_handler;
+  transport::TransportUDT node1_transudt, node2_transudt;
+  boost::int16_t node1_id, node2_id;
+  node1_handler.Register(&node1_transudt, &node1_id);
+  node2_handler.Register(&node2_transudt, &node2_id);
+  MessageHandler msg_handler[2];
+  ASSERT_TRUE(node1_handler.RegisterOnRPCMessage(
+    boost::bind(&MessageHandler::OnRPCMessage,
+                &msg_handler[0], _1, _2, _3, _4)));
+  ASSERT_TRUE(node1_handler.RegisterOnServerDown(
+    boost::bind(&MessageHandler::OnDeadRendezvousServer, &msg_handler[0],
+    _1, _2, _3)));
+  ASSERT_TRUE(node1_handler.RegisterOnSend(boost::bind(&MessageHandler::OnSend,
+    &msg_handler[0], _1, _2)));
+  ASSERT_EQ(0, node1_handler.Start(0, node1_id));
+  ASSERT_TRUE(node2_handler.RegisterOnRPCMessage(
+    boost::bind(&MessageHandler::OnRPCMessage,
+                &msg_handler[1], _1, _2, _3, _4)));
+  ASSERT_TRUE(node2_handler.RegisterOnServerDown(
+    boost::bind(&MessageHandler::OnDeadRendezvousServer, &msg_handler[1],
+    _1, _2, _3)));
+  ASSERT_TRUE(node2_handler.RegisterOnSend(boost::bind(&MessageHandler::OnSend,
+    &msg_handler[1], _1, _2)));
+  ASSERT_EQ(transport::kMaxMessageSize, node2_transudt.max_message_size());
+  ASSERT_FALSE(node2_transudt.set_max_message_size(0));
+  ASSERT_FALSE(node2_transudt.set_max_message_size(
+      boost::int64_t(std::numeric_limits<int>::max()) + 1));
+  ASSERT_EQ(transport::kMaxMessageSize, node2_transudt.max_message_size());
+  ASSERT_TRUE(node2_transudt.set_max_message_size(64 * 1024));
+  ASSERT_EQ(boost::int64_t(64 * 1024), node2_transudt.max_message_size());
+  ASSERT_EQ(0, node2_handler.Start(0, node2_id));
+  boost::uint16_t lp_node2;
+  ASSERT_TRUE(node2_handler.listening_port(node2_id, &lp_node2));
+  rpcprotocol::RpcMessage msg;
+  msg.set_rpc_type(rpcprotocol::REQUEST);
+  msg.set_message_id(2000);
+  msg.set_args(base::RandomString(256 * 1024));
+  ASSERT_EQ(0, node1_handler.ConnectToSend("127.0.0.1", lp_node2, "", 0, "", 0,
+    false, &id, node1_id));
+  ASSERT_EQ(0, node1_handler.Send(msg, id, true, node1_id));
+  boost::this_thread::sleep(boost::posix_time::seconds(2));
+  ASSERT_TRUE(msg_handler[1].msgs.empty());
+  // Messages within the limit still arrive.
+  msg.set_args(base::RandomString(32 * 1024));
+  std::string sent_msg;
+  msg.SerializeToString(&sent_msg);
+  ASSERT_EQ(0, node1_handler.ConnectToSend("127.0.0.1", lp_node2, "", 0, "", 0,
+    false, &id, node1_id));
+  ASSERT_EQ(0, node1_handler.Send(msg, id, true, node1_id));
+  while (msg_handler[1].msgs.empty())
+    boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+  node1_handler.Stop(node1_id);
+  node2_handler.Stop(node2_id);
+  ASSERT_EQ(size_t(1), msg_handler[1].msgs.size());
+  ASSERT_EQ(sent_msg, msg_handler[1].msgs.front());
+}
+
 }  // namespace test_udt_transport
@@ -0,0 +1,117 @@
+/* Copyright (c) 2009 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "maidsafe/transport/bufferpool.h"
+#include <boost/thread/mutex.hpp>
+#include <vector>
+
+namespace transport {
+
+namespace {
+
+// Size of the smallest buffer handed out.
+const size_t kMinBufferSize = 512;
+
+}  // namespace
+
+struct BufferPool::FreeLists {
+  explicit FreeLists(const size_t &max_idle)
+      : mutex(), buffers(), idle(0), max_idle(max_idle) {}
+  ~FreeLists() {
+    for (size_t i = 0; i < buffers.size(); ++i) {
+      for (size_t j = 0; j < buffers[i].size(); ++j)
+        delete [] buffers[i][j];
+    }
+  }
+  boost::mutex mutex;
+  // Idle buffers of kMinBufferSize << i bytes are in buffers[i].
+  std::vector< std::vector<char*> > buffers;
+  size_t idle, max_idle;
+};
+
+class BufferPool::Releaser {
+ public:
+  Releaser(boost::shared_ptr<FreeLists> free_lists, const size_t &size_class)
+      : free_lists_(free_lists), size_class_(size_class) {}
+  void operator()(char *buffer) {
+    {
+      boost::mutex::scoped_lock guard(free_lists_->mutex);
+      if (free_lists_->idle < free_lists_->max_idle) {
+        free_lists_->buffers[size_class_].push_back(buffer);
+        ++free_lists_->idle;
+        return;
+      }
+    }
+    delete [] buffer;
+  }
+ private:
+  boost::shared_ptr<FreeLists> free_lists_;
+  size_t size_class_;
+};
+
+BufferPool::BufferPool(const size_t &max_idle_buffers,
+                       const size_t &max_buffer_size)
+    : max_buffer_size_(kMinBufferSize),
+      free_lists_(new FreeLists(max_idle_buffers)) {
+  size_t size_classes(1);
+  while (max_buffer_size_ < max_buffer_size) {
+    max_buffer_size_ <<= 1;
+    ++size_classes;
+  }
+  free_lists_->buffers.resize(size_classes);
+}
+
+boost::shared_array<char> BufferPool::Get(const size_t &size) {
+  if (size > max_buffer_size_)
+    return boost::shared_array<char>(new char[size]);
+  size_t size_class(0), buffer_size(kMinBufferSize);
+  while (buffer_size < size) {
+    buffer_size <<= 1;
+    ++size_class;
+  }
+  char *buffer(NULL);
+  {
+    boost::mutex::scoped_lock guard(free_lists_->mutex);
+    std::vector<char*> &free_list = free_lists_->buffers[size_class];
+    if (!free_list.empty()) {
+      buffer = free_list.back();
+      free_list.pop_back();
+      --free_lists_->idle;
+    }
+  }
+  if (buffer == NULL)
+    buffer = new char[buffer_size];
+  return boost::shared_array<char>(buffer, Releaser(free_lists_, size_class));
+}
+
+size_t BufferPool::IdleBuffers() {
+  boost::mutex::scoped_lock guard(free_lists_->mutex);
+  return free_lists_->idle;
+}
+
+}  // namespace transport
@@ -0,0 +1,62 @@
+/* Copyright (c) 2009 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MAIDSAFE_TRANSPORT_BUFFERPOOL_H_
+#define MAIDSAFE_TRANSPORT_BUFFERPOOL_H_
+
+#include <boost/shared_array.hpp>
+#include <boost/shared_ptr.hpp>
+#include <cstddef>
+
+namespace transport {
+
+// Hands out reference counted buffers which go back to the pool when their
+// last reference is released, so steady traffic keeps reusing the same few
+// allocations.  Sizes are rounded up to a power of two; buffers larger than
+// max_buffer_size are allocated and freed individually.  Buffers may outlive
+// the pool.
+class BufferPool {
+ public:
+  BufferPool(const size_t &max_idle_buffers, const size_t &max_buffer_size);
+  // Returns a buffer of at least size bytes.
+  boost::shared_array<char> Get(const size_t &size);
+  // Number of released buffers waiting to be reused.
+  size_t IdleBuffers();
+  size_t max_buffer_size() const { return max_buffer_size_; }
+ private:
+  BufferPool(const BufferPool&);
+  BufferPool& operator=(const BufferPool&);
+  struct FreeLists;
+  class Releaser;
+  size_t max_buffer_size_;
+  boost::shared_ptr<FreeLists> free_lists_;
+};
+
+}  // namespace transport
+
+#endif  // MAIDSAFE_TRANSPORT_BUFFERPOOL_H_
@@ -28,7 +28,10 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "maidsafe/transport/transportudt.h"
 #include <boost/scoped_array.hpp>
 #include <boost/lexical_cast.hpp>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
 #include <exception>
+#include <limits>
 #include "maidsafe/base/utils.h"
 #include "maidsafe/base/log.h"
 #include "maidsafe/base/online.h"
@@ -41,20 +44,23 @@ namespace transport {
 
 struct IncomingMessages {
   IncomingMessages(const boost::uint32_t &id, const boost::int16_t &transid)
-      : msg(), raw_data(), connection_id(id), transport_id(transid), rtt(0) {}
+      : msg(), raw_data(), connection_id(id), transport_id(transid), rtt(0),
+        enqueue_time(0) {}
   IncomingMessages()
-      : msg(), raw_data(), connection_id(0), transport_id(0), rtt(0) {}
+      : msg(), raw_data(), connection_id(0), transport_id(0), rtt(0),
+        enqueue_time(0) {}
   rpcprotocol::RpcMessage msg;
   std::string raw_data;
   boost::uint32_t connection_id;
   boost::int16_t transport_id;
   double rtt;
+  boost::uint64_t enqueue_time;
 };
 
 TransportUDT::TransportUDT()
     : stop_(true), rpc_message_notifier_(), message_notifier_(),
       server_down_notifier_(), accept_routine_(), recv_routine_(),
-      send_routine_(), ping_rendz_routine_(), handle_msgs_routine_(),
+      send_routine_(), ping_rendz_routine_(), handle_msgs_routines_(),
       listening_socket_(0), peer_address_(), listening_port_(0),
       my_rendezvous_port_(0), my_rendezvous_ip_(), incoming_sockets_(),
       outgoing_queue_(), incoming_msgs_queue_(), send_mutex_(),
@@ -63,7 +69,12 @@ TransportUDT::TransportUDT()
       ping_rend_cond_(), recv_cond_(), msg_hdl_cond_(), ping_rendezvous_(false),
       directly_connected_(false), accepted_connections_(0), msgs_sent_(0),
       last_id_(0), data_arrived_(), ips_from_connections_(), send_notifier_(),
-      send_sockets_(), transport_type_(kUdt), transport_id_(0) {
+      send_sockets_(), transport_type_(kUdt), transport_id_(0),
+      message_handler_threads_(kMessageHandlerThreads), busy_connections_(),
+      msg_hdl_stats_(), recv_epoll_id_(-1), socket_connections_(),
+      send_buffers_(kMaxIdleBuffers, kMaxPooledBufferSize),
+      receive_buffers_(kMaxIdleBuffers, kMaxPooledBufferSize),
+      max_message_size_(kMaxMessageSize) {
   UDT::startup();
 }
 
@@ -133,6 +144,14 @@ int TransportUDT::Start(const boost::uint16_t &port) {
     freeaddrinfo(addrinfo_res_);
     return 1;
   }
+  recv_epoll_id_ = UDT::epoll_create();
+  if (UDT::ERROR == recv_epoll_id_) {
+    LOG(ERROR) << "(" << listening_port_ << ") UDT epoll_create error: " <<
+        UDT::getlasterror().getErrorMessage() << std::endl;
+    UDT::close(listening_socket_);
+    freeaddrinfo(addrinfo_res_);
+    return 1;
+  }
   stop_ = false;
   // start the listening loop
   try {
@@ -143,11 +162,12 @@ int TransportUDT::Start(const boost::uint16_t &port) {
     send_routine_.reset(new boost::thread(&TransportUDT::SendHandle, this));
     ping_rendz_routine_.reset(new boost::thread(&TransportUDT::PingHandle,
         this));
-    handle_msgs_routine_.reset(new boost::thread(
-      &TransportUDT::MessageHandler, this));
+    StartMessageHandlers();
   }
   catch(const boost::thread_resource_error&) {
     stop_ = true;
+    StopMessageHandlers();
+    UDT::epoll_release(recv_epoll_id_);
     int result;
     result = UDT::close(listening_socket_);
     freeaddrinfo(addrinfo_res_);
@@ -160,43 +180,17 @@ int TransportUDT::Start(const boost::uint16_t &port) {
 int TransportUDT::Send(const std::string &data, DataType type,
                        const boost::uint32_t &connection_id,
                        const bool &new_socket, const bool &is_rpc) {
-  UDTSOCKET skt;
-  if (new_socket) {
-    std::map<boost::uint32_t, UDTSOCKET>::iterator it;
-    {
-      boost::mutex::scoped_lock guard(msg_hdl_mutex_);
-      it = send_sockets_.find(connection_id);
-      if (it == send_sockets_.end()) {
-        send_notifier_(connection_id, false);
-        return 1;
-      }
-      skt = (*it).second;
-      send_sockets_.erase(it);
-    }
-  } else {
-    std::map<boost::uint32_t, IncomingData>::iterator it;
-    {
-      boost::mutex::scoped_lock guard(recv_mutex_);
-      it = incoming_sockets_.find(connection_id);
-      if (it == incoming_sockets_.end()) {
-        send_notifier_(connection_id, false);
-        return 1;
-      }
-      skt = (*it).second.udt_socket;
-    }
-  }
-
   if (type == kString) {
-    int64_t data_size = data.size();
-    OutgoingData out_data(skt, data_size, connection_id, is_rpc);
-    memcpy(out_data.data.get(),
-      const_cast<char*>(static_cast<const char*>(data.c_str())), data_size);
-    {
-      boost::mutex::scoped_lock(send_mutex_);
-      outgoing_queue_.push_back(out_data);
-    }
-    send_cond_.notify_one();
+    boost::int64_t data_size = data.size();
+    boost::shared_array<char> buffer(MessageBuffer(data_size));
+    memcpy(buffer.get() + sizeof(data_size), data.data(), data_size);
+    return QueueMessage(buffer, data_size, connection_id, new_socket, is_rpc);
   } else if (type == kFile) {
+    UDTSOCKET skt;
+    if (!GetSendSocket(connection_id, new_socket, &skt)) {
+      send_notifier_(connection_id, false);
+      return 1;
+    }
     char *file_name = const_cast<char*>(static_cast<const char*>(data.c_str()));
     std::fstream ifs(file_name, std::ios::in | std::ios::binary);
     ifs.seekg(0, std::ios::end);
@@ -215,6 +209,54 @@ int TransportUDT::Send(const std::string &data, DataType type,
   return 0;
 }
 
+bool TransportUDT::GetSendSocket(const boost::uint32_t &connection_id,
+                                 const bool &new_socket,
+                                 UdtSocket *udt_socket) {
+  if (new_socket) {
+    boost::mutex::scoped_lock guard(msg_hdl_mutex_);
+    std::map<boost::uint32_t, UDTSOCKET>::iterator it =
+        send_sockets_.find(connection_id);
+    if (it == send_sockets_.end())
+      return false;
+    *udt_socket = (*it).second;
+    send_sockets_.erase(it);
+  } else {
+    boost::mutex::scoped_lock guard(recv_mutex_);
+    std::map<boost::uint32_t, IncomingData>::iterator it =
+        incoming_sockets_.find(connection_id);
+    if (it == incoming_sockets_.end())
+      return false;
+    *udt_socket = (*it).second.udt_socket;
+  }
+  return true;
+}
+
+boost::shared_array<char> TransportUDT::MessageBuffer(
+    const boost::int64_t &message_size) {
+  boost::shared_array<char> buffer(
+      send_buffers_.Get(sizeof(message_size) + message_size));
+  memcpy(buffer.get(), &message_size, sizeof(message_size));
+  return buffer;
+}
+
+int TransportUDT::QueueMessage(boost::shared_array<char> buffer,
+                               const boost::int64_t &message_size,
+                               const boost::uint32_t &connection_id,
+                               const bool &new_socket, const bool &is_rpc) {
+  UDTSOCKET skt;
+  if (!GetSendSocket(connection_id, new_socket, &skt)) {
+    send_notifier_(connection_id, false);
+    return 1;
+  }
+  {
+    boost::mutex::scoped_lock guard(send_mutex_);
+    outgoing_queue_.push_back(OutgoingData(skt, buffer,
+        sizeof(message_size) + message_size, connection_id, is_rpc));
+  }
+  send_cond_.notify_one();
+  return 0;
+}
+
 void TransportUDT::Stop() {
   if (stop_)
     return;
@@ -257,19 +299,14 @@ void TransportUDT::Stop() {
     }
     ping_rendezvous_ = false;
   }
-  if (handle_msgs_routine_.get()) {
-    msg_hdl_cond_.notify_one();
-    if (!handle_msgs_routine_->timed_join(boost::posix_time::seconds(5))) {
-      // forcing to interrupt the thread
-      handle_msgs_routine_->interrupt();
-      handle_msgs_routine_->join();
-    }
-  }
+  StopMessageHandlers();
   UDT::close(listening_socket_);
   std::map<boost::uint32_t, IncomingData>::iterator it;
   for (it = incoming_sockets_.begin(); it != incoming_sockets_.end(); it++)
     UDT::close((*it).second.udt_socket);
   incoming_sockets_.clear();
+  socket_connections_.clear();
+  UDT::epoll_release(recv_epoll_id_);
   std::map<boost::uint32_t, UDTSOCKET>::iterator it1;
   for (it1 = send_sockets_.begin(); it1 != send_sockets_.end(); ++it1) {
     UDT::close((*it1).second);
@@ -292,12 +329,10 @@ bool TransportUDT::peer_address(struct sockaddr* addr) {
 }
 
 void TransportUDT::ReceiveHandler() {
-  timeval tv;
-  tv.tv_sec = 0;
-  tv.tv_usec = 1000;
-  UDT::UDSET readfds;
+  boost::uint64_t next_check =
+      base::GetEpochMilliseconds() + kDeadConnectionCheckInterval;
+  std::set<UdtSocket> readfds;
   while (true) {
-    boost::this_thread::sleep(boost::posix_time::milliseconds(1));
     {
       boost::mutex::scoped_lock guard(recv_mutex_);
       while (incoming_sockets_.empty() && !stop_) {
@@ -305,196 +340,184 @@ void TransportUDT::ReceiveHandler() {
       }
     }
     if (stop_) return;
-    // read data.
+    // Sockets stay registered with the epoll for as long as they're in
+    // incoming_sockets_, so this only returns the ones with data waiting.
+    readfds.clear();
+    if (UDT::ERROR == UDT::epoll_wait(recv_epoll_id_, &readfds, NULL,
+                                      kReceiveWaitTimeout)) {
+      if (stop_) return;
+      DLOG(ERROR) << "(" << listening_port_ << ") UDT epoll_wait error: " <<
+          UDT::getlasterror().getErrorMessage() << std::endl;
+      continue;
+    }
     std::list<boost::uint32_t> dead_connections_ids;
-    std::map<boost::uint32_t, IncomingData>::iterator it;
-    {
     boost::mutex::scoped_lock guard(recv_mutex_);
-    UD_ZERO(&readfds);
-    for (it = incoming_sockets_.begin(); it != incoming_sockets_.end(); ++it) {
-      int res = UDT::send((*it).second.udt_socket, NULL, 0, 0);
-      if (res == 0) {
-        UD_SET((*it).second.udt_socket, &readfds);
-      } else {
-        dead_connections_ids.push_back((*it).first);
-      }
-    }
+    std::set<UdtSocket>::iterator skt_it;
+    for (skt_it = readfds.begin(); skt_it != readfds.end(); ++skt_it) {
+      std::map<UdtSocket, boost::uint32_t>::iterator conn_it =
+          socket_connections_.find(*skt_it);
+      if (conn_it == socket_connections_.end())
+        continue;
+      std::map<boost::uint32_t, IncomingData>::iterator it =
+          incoming_sockets_.find(conn_it->second);
+      if (it == incoming_sockets_.end())
+        continue;
+      if (!ReceiveData(it->first, &it->second))
+        dead_connections_ids.push_back(it->first);
     }
-    int res = UDT::select(0, &readfds, NULL, NULL, &tv);
-    {
-    boost::mutex::scoped_lock guard(recv_mutex_);
-    if (res != UDT::ERROR) {
+    // Broken connections aren't reported as readable, so check for them
+    // periodically rather than on every pass.
+    boost::uint64_t now = base::GetEpochMilliseconds();
+    if (now >= next_check) {
+      std::map<boost::uint32_t, IncomingData>::iterator it;
       for (it = incoming_sockets_.begin(); it != incoming_sockets_.end();
            ++it) {
-        if (UD_ISSET((*it).second.udt_socket, &readfds)) {
-          int result = 0;
-          // save the remote peer address
-          int peer_addr_size = sizeof(struct sockaddr);
-          if (UDT::ERROR == UDT::getpeername((*it).second.udt_socket,
-                                             &peer_address_, &peer_addr_size)) {
-            continue;
-          }
-          if ((*it).second.expect_size == 0) {
-            // get size information
-            int64_t size;
-            if (UDT::ERROR == UDT::recv((*it).second.udt_socket,
-                reinterpret_cast<char*>(&size), sizeof(size), 0)) {
-              if (UDT::getlasterror().getErrorCode() !=
-                  CUDTException::EASYNCRCV) {
-                UDT::close((*it).second.udt_socket);
-                dead_connections_ids.push_back((*it).first);
-                continue;
-              }
-              continue;
-            }
-            if (size > 0) {
-              (*it).second.expect_size = size;
-            } else {
-              UDT::close((*it).second.udt_socket);
-              dead_connections_ids.push_back((*it).first);
-              continue;
-            }
-          } else {
-            if ((*it).second.data == NULL)
-              (*it).second.data = boost::shared_array<char>
-                  (new char[(*it).second.expect_size]);
-            int rsize = 0;
-            if (UDT::ERROR == (rsize = UDT::recv((*it).second.udt_socket,
-                (*it).second.data.get() + (*it).second.received_size,
-                (*it).second.expect_size - (*it).second.received_size,
-                0))) {
-              if (UDT::getlasterror().getErrorCode() !=
-                  CUDTException::EASYNCRCV) {
-                UDT::close((*it).second.udt_socket);
-                dead_connections_ids.push_back((*it).first);
-                continue;
-              }
-              continue;
-            }
-            (*it).second.received_size += rsize;
-            UDT::TRACEINFO perf;
-            if (UDT::ERROR == UDT::perfmon((*it).second.udt_socket, &perf)) {
-              DLOG(ERROR) << "UDT permon error: " <<
-                  UDT::getlasterror().getErrorMessage() << std::endl;
-            } else {
-              (*it).second.cumulative_rtt += perf.msRTT;
-              ++(*it).second.observations;
-            }
-            if ((*it).second.expect_size <= (*it).second.received_size) {
-              ++last_id_;
-              std::string message = std::string((*it).second.data.get(),
-                                    (*it).second.expect_size);
-              boost::uint32_t connection_id = (*it).first;
-              (*it).second.expect_size = 0;
-              (*it).second.received_size = 0;
-              TransportMessage t_msg;
-              if (t_msg.ParseFromString(message)) {
-                if (t_msg.has_hp_msg()) {
-                  HandleRendezvousMsgs(t_msg.hp_msg());
-                  result = UDT::close((*it).second.udt_socket);
-                  dead_connections_ids.push_back((*it).first);
-                } else if (t_msg.has_rpc_msg() &&
-                           !rpc_message_notifier_.empty()) {
-                  IncomingMessages msg(connection_id, transport_id());
-                  msg.msg = t_msg.rpc_msg();
-                  DLOG(INFO) << "(" << listening_port_ << ") message for id "
-                      << connection_id << " arrived" << std::endl;
-                  UDT::TRACEINFO perf;
-                  if (UDT::ERROR == UDT::perfmon((*it).second.udt_socket,
-                      &perf)) {
-                    DLOG(ERROR) << "UDT permon error: " <<
-                        UDT::getlasterror().getErrorMessage() << std::endl;
-                  } else {
-                    msg.rtt = perf.msRTT;
-                    if ((*it).second.observations != 0) {
-                      msg.rtt = (*it).second.cumulative_rtt /
-                          static_cast<double>((*it).second.observations);
-                    } else {
-                      msg.rtt = 0.0;
-                    }
-                  }
-                  data_arrived_.insert(connection_id);
-                  {  // NOLINT Fraser
-                    boost::mutex::scoped_lock guard1(msg_hdl_mutex_);
-                    ips_from_connections_[connection_id] = peer_address_;
-                    incoming_msgs_queue_.push_back(msg);
-                  }
-                  msg_hdl_cond_.notify_one();
-                } else {
-                  LOG(WARNING) << "( " << listening_port_ <<
-                      ") Invalid Message received" << std::endl;
-                }
-              } else if (!message_notifier_.empty()) {
-                IncomingMessages msg(connection_id, transport_id());
-                msg.raw_data = message;
-                DLOG(INFO) << "(" << listening_port_ << ") message for id "
-                    << connection_id << " arrived" << std::endl;
-                UDT::TRACEINFO perf;
-                if (UDT::ERROR == UDT::perfmon((*it).second.udt_socket,
-                    &perf)) {
-                  DLOG(ERROR) << "UDT permon error: " <<
-                      UDT::getlasterror().getErrorMessage() << std::endl;
-                } else {
-                  msg.rtt = perf.msRTT;
-                  if ((*it).second.observations != 0) {
-                    msg.rtt = (*it).second.cumulative_rtt /
-                        static_cast<double>((*it).second.observations);
-                  } else {
-                    msg.rtt = 0.0;
-                  }
-                }
-                data_arrived_.insert(connection_id);
-                {  // NOLINT Fraser
-                  boost::mutex::scoped_lock guard1(msg_hdl_mutex_);
-                  ips_from_connections_[connection_id] = peer_address_;
-                  incoming_msgs_queue_.push_back(msg);
-                }
-                msg_hdl_cond_.notify_one();
-              } else {
-                LOG(WARNING) << "( " << listening_port_ <<
-                    ") Invalid Message received" << std::endl;
-              }
-            }
-          }
-        }
+        if (UDT::send((*it).second.udt_socket, NULL, 0, 0) != 0)
+          dead_connections_ids.push_back((*it).first);
       }
+      next_check = now + kDeadConnectionCheckInterval;
     }
     // Deleting dead connections
+    dead_connections_ids.sort();
+    dead_connections_ids.unique();
     std::list<boost::uint32_t>::iterator it1;
     for (it1 = dead_connections_ids.begin(); it1 != dead_connections_ids.end();
          ++it1) {
-      UDT::close(incoming_sockets_[*it1].udt_socket);
-      incoming_sockets_.erase(*it1);
+      RemoveIncomingConnection(*it1);
+    }
+  }
+}
+
+bool TransportUDT::ReceiveData(const boost::uint32_t &connection_id,
+                               IncomingData *incoming_data) {
+  // save the remote peer address
+  int peer_addr_size = sizeof(struct sockaddr);
+  if (UDT::ERROR == UDT::getpeername(incoming_data->udt_socket,
+                                     &peer_address_, &peer_addr_size)) {
+    return false;
+  }
+  // Read until the socket has no more data buffered, as it won't be reported
+  // ready again until further data arrives.
+  while (true) {
+    if (incoming_data->expect_size == 0) {
+      // get size information
+      int64_t size;
+      if (UDT::ERROR == UDT::recv(incoming_data->udt_socket,
+          reinterpret_cast<char*>(&size), sizeof(size), 0)) {
+        return UDT::getlasterror().getErrorCode() == CUDTException::EASYNCRCV;
+      }
+      if (size <= 0)
+        return false;
+      if (size > max_message_size_) {
+        LOG(WARNING) << "(" << listening_port_ << ") Message of " << size <<
+            " bytes exceeds maximum message size" << std::endl;
+        return false;
+      }
+      incoming_data->expect_size = size;
+      continue;
+    }
+    if (incoming_data->data == NULL)
+      incoming_data->data = receive_buffers_.Get(incoming_data->expect_size);
+    int rsize = 0;
+    if (UDT::ERROR == (rsize = UDT::recv(incoming_data->udt_socket,
+        incoming_data->data.get() + incoming_data->received_size,
+        incoming_data->expect_size - incoming_data->received_size, 0))) {
+      return UDT::getlasterror().getErrorCode() == CUDTException::EASYNCRCV;
+    }
+    incoming_data->received_size += rsize;
+    UDT::TRACEINFO perf;
+    if (UDT::ERROR == UDT::perfmon(incoming_data->udt_socket, &perf)) {
+      DLOG(ERROR) << "UDT permon error: " <<
+          UDT::getlasterror().getErrorMessage() << std::endl;
+    } else {
+      incoming_data->cumulative_rtt += perf.msRTT;
+      ++incoming_data->observations;
     }
+    if (incoming_data->expect_size > incoming_data->received_size)
+      continue;
+    ++last_id_;
+    // Keep the buffer until the message has been parsed from it, then let it
+    // go back to the pool.
+    boost::shared_array<char> message(incoming_data->data);
+    int message_size = static_cast<int>(incoming_data->expect_size);
+    incoming_data->expect_size = 0;
+    incoming_data->received_size = 0;
+    incoming_data->data.reset();
+    IncomingMessages msg(connection_id, transport_id());
+    if (incoming_data->observations != 0) {
+      msg.rtt = incoming_data->cumulative_rtt /
+          static_cast<double>(incoming_data->observations);
+    }
+    TransportMessage t_msg;
+    if (t_msg.ParseFromArray(message.get(), message_size)) {
+      if (t_msg.has_hp_msg()) {
+        HandleRendezvousMsgs(t_msg.hp_msg());
+        return false;
+      } else if (t_msg.has_rpc_msg() && !rpc_message_notifier_.empty()) {
+        msg.msg = t_msg.rpc_msg();
+        DLOG(INFO) << "(" << listening_port_ << ") message for id "
+            << connection_id << " arrived" << std::endl;
+        data_arrived_.insert(connection_id);
+        EnqueueMessage(msg);
+      } else {
+        LOG(WARNING) << "( " << listening_port_ <<
+            ") Invalid Message received" << std::endl;
+      }
+    } else if (!message_notifier_.empty()) {
+      msg.raw_data.assign(message.get(), message_size);
+      DLOG(INFO) << "(" << listening_port_ << ") message for id "
+          << connection_id << " arrived" << std::endl;
+      data_arrived_.insert(connection_id);
+      EnqueueMessage(msg);
+    } else {
+      LOG(WARNING) << "( " << listening_port_ <<
+          ") Invalid Message received" << std::endl;
     }
   }
 }
 
 void TransportUDT::AddIncomingConnection(UdtSocket udt_socket,
                                          boost::uint32_t *connection_id) {
+  // ReceiveData reads a socket until it would block, so it mustn't be able to
+  // block.  Sockets from Connect are still blocking at this point.
+  bool blocking = false;
+  UDT::setsockopt(udt_socket, 0, UDT_RCVSYN, &blocking, sizeof(blocking));
   boost::mutex::scoped_lock guard(recv_mutex_);
   current_id_ = base::GenerateNextTransactionId(current_id_);
   IncomingData data(udt_socket);
   incoming_sockets_[current_id_] = data;
+  socket_connections_[udt_socket] = current_id_;
+  std::set<UdtSocket> sockets;
+  sockets.insert(udt_socket);
+  UDT::epoll_add(recv_epoll_id_, &sockets);
   *connection_id = current_id_;
   recv_cond_.notify_one();
 }
 
 void TransportUDT::AddIncomingConnection(UdtSocket udt_socket) {
-  boost::mutex::scoped_lock guard(recv_mutex_);
-  current_id_ = base::GenerateNextTransactionId(current_id_);
-  IncomingData data(udt_socket);
-  incoming_sockets_[current_id_] = data;
-  recv_cond_.notify_one();
+  boost::uint32_t connection_id;
+  AddIncomingConnection(udt_socket, &connection_id);
+}
+
+// Must be called with recv_mutex_ locked.
+void TransportUDT::RemoveIncomingConnection(
+    const boost::uint32_t &connection_id) {
+  std::map<boost::uint32_t, IncomingData>::iterator it =
+      incoming_sockets_.find(connection_id);
+  if (it == incoming_sockets_.end())
+    return;
+  std::set<UdtSocket> sockets;
+  sockets.insert((*it).second.udt_socket);
+  UDT::epoll_remove(recv_epoll_id_, &sockets);
+  UDT::close((*it).second.udt_socket);
+  socket_connections_.erase((*it).second.udt_socket);
+  incoming_sockets_.erase(it);
 }
 
 void TransportUDT::CloseConnection(const boost::uint32_t &connection_id) {
-  std::map<boost::uint32_t, IncomingData>::iterator it;
   boost::mutex::scoped_lock guard(recv_mutex_);
-  it = incoming_sockets_.find(connection_id);
-  if (it != incoming_sockets_.end()) {
-    UDT::close(incoming_sockets_[connection_id].udt_socket);
-    incoming_sockets_.erase(connection_id);
+  if (incoming_sockets_.find(connection_id) != incoming_sockets_.end()) {
+    RemoveIncomingConnection(connection_id);
     data_arrived_.erase(connection_id);
   }
 }
@@ -540,6 +563,20 @@ bool TransportUDT::HasReceivedData(const boost::uint32_t &connection_id,
   return result;
 }
 
+bool TransportUDT::set_max_message_size(const boost::int64_t &size) {
+  // Messages are received and parsed with int lengths.
+  if (size <= 0 || size > std::numeric_limits<int>::max())
+    return false;
+  boost::mutex::scoped_lock guard(recv_mutex_);
+  max_message_size_ = size;
+  return true;
+}
+
+boost::int64_t TransportUDT::max_message_size() {
+  boost::mutex::scoped_lock guard(recv_mutex_);
+  return max_message_size_;
+}
+
 void TransportUDT::SendHandle() {
   while (true) {
     boost::this_thread::sleep(boost::posix_time::milliseconds(1));
@@ -554,25 +591,12 @@ void TransportUDT::SendHandle() {
     std::list<OutgoingData>::iterator it;
     {
       boost::mutex::scoped_lock guard(send_mutex_);
+      // Messages queued on the same socket must not interleave, so only the
+      // oldest message of each socket is sent in a pass.
+      std::set<UdtSocket> busy_sockets;
       for (it = outgoing_queue_.begin(); it != outgoing_queue_.end(); ++it) {
-        if (!it->sent_size) {
-          if (UDT::ERROR == UDT::send(it->udt_socket,
-              reinterpret_cast<char*>(&it->data_size), sizeof(int64_t), 0)) {
-            if (UDT::getlasterror().getErrorCode() !=
-                  CUDTException::EASYNCSND) {
-              DLOG(ERROR) << "(" << listening_port_ <<
-                  ") Error sending message size: " <<
-                  UDT::getlasterror().getErrorMessage() << std::endl;
-              if (it->is_rpc)
-                send_notifier_(it->connection_id, false);
-              outgoing_queue_.erase(it);
-              break;
-            }
-            continue;
-          } else {
-            it->sent_size = true;
-          }
-        }
+        if (!busy_sockets.insert(it->udt_socket).second)
+          continue;
         if (it->data_sent < it->data_size) {
           int64_t ssize;
           if (UDT::ERROR ==
@@ -792,51 +816,143 @@ void TransportUDT::AcceptConnHandler() {
   }
 }
 
+void TransportUDT::StartMessageHandlers() {
+  handle_msgs_routines_.clear();
+  for (boost::uint16_t i = 0; i < message_handler_threads_; ++i) {
+    handle_msgs_routines_.push_back(boost::shared_ptr<boost::thread>(
+        new boost::thread(&TransportUDT::MessageHandler, this)));
+  }
+}
+
+void TransportUDT::StopMessageHandlers() {
+  {
+    boost::mutex::scoped_lock guard(msg_hdl_mutex_);
+    msg_hdl_cond_.notify_all();
+  }
+  for (size_t i = 0; i < handle_msgs_routines_.size(); ++i) {
+    if (!handle_msgs_routines_[i]->timed_join(boost::posix_time::seconds(5))) {
+      // forcing to interrupt the thread
+      handle_msgs_routines_[i]->interrupt();
+      handle_msgs_routines_[i]->join();
+    }
+  }
+  handle_msgs_routines_.clear();
+  boost::mutex::scoped_lock guard(msg_hdl_mutex_);
+  incoming_msgs_queue_.clear();
+  busy_connections_.clear();
+  msg_hdl_stats_.queue_depth = 0;
+}
+
+void TransportUDT::EnqueueMessage(const IncomingMessages &msg) {
+  {
+    boost::mutex::scoped_lock guard(msg_hdl_mutex_);
+    ips_from_connections_[msg.connection_id] = peer_address_;
+    incoming_msgs_queue_.push_back(msg);
+    incoming_msgs_queue_.back().enqueue_time =
+        base::GetEpochNanoseconds() / 1000;
+    ++msg_hdl_stats_.queue_depth;
+    if (msg_hdl_stats_.queue_depth > msg_hdl_stats_.max_queue_depth)
+      msg_hdl_stats_.max_queue_depth = msg_hdl_stats_.queue_depth;
+  }
+  msg_hdl_cond_.notify_one();
+}
+
+// Must be called with msg_hdl_mutex_ locked.  Returns the oldest message whose
+// connection isn't currently being handled by another thread, so that messages
+// from a single connection are never dispatched concurrently or out of order.
+std::list<IncomingMessages>::iterator TransportUDT::NextDispatchableMessage() {
+  std::list<IncomingMessages>::iterator it = incoming_msgs_queue_.begin();
+  while (it != incoming_msgs_queue_.end() &&
+         busy_connections_.find(it->connection_id) != busy_connections_.end())
+    ++it;
+  return it;
+}
+
 void TransportUDT::MessageHandler() {
   while (true) {
+    IncomingMessages msg;
     {
-      {
-        boost::mutex::scoped_lock guard(msg_hdl_mutex_);
-        while (incoming_msgs_queue_.empty() && !stop_) {
-          msg_hdl_cond_.wait(guard);
-        }
+      boost::mutex::scoped_lock guard(msg_hdl_mutex_);
+      std::list<IncomingMessages>::iterator it = incoming_msgs_queue_.end();
+      while (!stop_ &&
+             (it = NextDispatchableMessage()) == incoming_msgs_queue_.end()) {
+        msg_hdl_cond_.wait(guard);
       }
       if (stop_) return;
-      IncomingMessages msg;
-      {
-        boost::mutex::scoped_lock guard(msg_hdl_mutex_);
-        msg.msg = incoming_msgs_queue_.front().msg;
-        msg.raw_data = incoming_msgs_queue_.front().raw_data;
-        msg.connection_id = incoming_msgs_queue_.front().connection_id;
-        msg.rtt = incoming_msgs_queue_.front().rtt;
-        incoming_msgs_queue_.pop_front();
-      }
-      {
-        boost::mutex::scoped_lock gaurd(recv_mutex_);
-        data_arrived_.erase(msg.connection_id);
-      }
-      if (msg.raw_data.empty())
-        rpc_message_notifier_(msg.msg, msg.connection_id, transport_id(),
-                              msg.rtt);
-      else
-        message_notifier_(msg.raw_data, msg.connection_id, transport_id(),
-                          msg.rtt);
+      msg = *it;
+      incoming_msgs_queue_.erase(it);
+      busy_connections_.insert(msg.connection_id);
+      --msg_hdl_stats_.queue_depth;
+      boost::uint64_t now = base::GetEpochNanoseconds() / 1000;
+      msg_hdl_stats_.dispatch_latency.Add(
+          now > msg.enqueue_time ? now - msg.enqueue_time : 0);
+    }
+    {
+      boost::mutex::scoped_lock gaurd(recv_mutex_);
+      data_arrived_.erase(msg.connection_id);
+    }
+    if (msg.raw_data.empty())
+      rpc_message_notifier_(msg.msg, msg.connection_id, transport_id(),
+                            msg.rtt);
+    else
+      message_notifier_(msg.raw_data, msg.connection_id, transport_id(),
+                        msg.rtt);
+    {
+      boost::mutex::scoped_lock guard(msg_hdl_mutex_);
       ips_from_connections_.erase(msg.connection_id);
-      boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+      busy_connections_.erase(msg.connection_id);
+      boost::uint64_t now = base::GetEpochNanoseconds() / 1000;
+      msg_hdl_stats_.handling_time.Add(
+          now > msg.enqueue_time ? now - msg.enqueue_time : 0);
     }
+    // Messages queued behind this one for the same connection are now free to
+    // be picked up by any thread.
+    msg_hdl_cond_.notify_all();
   }
 }
 
+bool TransportUDT::SetMessageHandlerThreads(const boost::uint16_t &threads) {
+  if (!stop_ || threads == 0 || threads > kMaxMessageHandlerThreads)
+    return false;
+  message_handler_threads_ = threads;
+  return true;
+}
+
+MessageHandlerStats TransportUDT::MessageHandlerStatistics() {
+  boost::mutex::scoped_lock guard(msg_hdl_mutex_);
+  return msg_hdl_stats_;
+}
+
+void TransportUDT::ClearMessageHandlerStatistics() {
+  boost::mutex::scoped_lock guard(msg_hdl_mutex_);
+  size_t queue_depth = msg_hdl_stats_.queue_depth;
+  msg_hdl_stats_ = MessageHandlerStats();
+  msg_hdl_stats_.queue_depth = queue_depth;
+  msg_hdl_stats_.max_queue_depth = queue_depth;
+}
+
 int TransportUDT::Send(const rpcprotocol::RpcMessage &data,
                        const boost::uint32_t &connection_id,
                        const bool &new_socket) {
-  TransportMessage msg;
-  rpcprotocol::RpcMessage *rpc_msg = msg.mutable_rpc_msg();
-  *rpc_msg = data;
   if (data.IsInitialized()) {
-    std::string ser_msg;
-    msg.SerializeToString(&ser_msg);
-    return Send(ser_msg, kString, connection_id, new_socket, true);
+    // Write the TransportMessage holding data as its rpc_msg straight into the
+    // send buffer, rather than copying data into a TransportMessage first.
+    using google::protobuf::io::CodedOutputStream;
+    using google::protobuf::internal::WireFormatLite;
+    boost::uint32_t rpc_size = data.ByteSize();
+    boost::uint32_t tag = WireFormatLite::MakeTag(
+        TransportMessage::kRpcMsgFieldNumber,
+        WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+    boost::int64_t message_size = CodedOutputStream::VarintSize32(tag) +
+        CodedOutputStream::VarintSize32(rpc_size) + rpc_size;
+    boost::shared_array<char> buffer(MessageBuffer(message_size));
+    google::protobuf::uint8 *target =
+        reinterpret_cast<google::protobuf::uint8*>(buffer.get() +
+                                                   sizeof(message_size));
+    target = CodedOutputStream::WriteTagToArray(tag, target);
+    target = CodedOutputStream::WriteVarint32ToArray(rpc_size, target);
+    data.SerializeWithCachedSizesToArray(target);
+    return QueueMessage(buffer, message_size, connection_id, new_socket, true);
   } else {
     {
       boost::mutex::scoped_lock guard(msg_hdl_mutex_);
@@ -929,11 +1045,12 @@ bool TransportUDT::IsAddressUsable(const std::string &local_ip,
 
 bool TransportUDT::GetPeerAddr(const boost::uint32_t &connection_id,
                                struct sockaddr *peer_address) {
+  boost::mutex::scoped_lock guard(msg_hdl_mutex_);
   std::map<boost::uint32_t, struct sockaddr>::iterator it;
   it = ips_from_connections_.find(connection_id);
   if (it == ips_from_connections_.end())
     return false;
-  *peer_address = ips_from_connections_[connection_id];
+  *peer_address = it->second;
   return true;
 }
 
@@ -1083,6 +1200,14 @@ int TransportUDT::StartLocal(const boost::uint16_t &port) {
     freeaddrinfo(addrinfo_res_);
     return 1;
   }
+  recv_epoll_id_ = UDT::epoll_create();
+  if (UDT::ERROR == recv_epoll_id_) {
+    LOG(ERROR) << "(" << listening_port_ << ") UDT epoll_create error: " <<
+        UDT::getlasterror().getErrorMessage() << std::endl;
+    UDT::close(listening_socket_);
+    freeaddrinfo(addrinfo_res_);
+    return 1;
+  }
   stop_ = false;
   // start the listening loop
   try {
@@ -1091,10 +1216,11 @@ int TransportUDT::StartLocal(const boost::uint16_t &port) {
     recv_routine_.reset(new boost::thread(&TransportUDT::ReceiveHandler,
         this));
     send_routine_.reset(new boost::thread(&TransportUDT::SendHandle, this));
-    handle_msgs_routine_.reset(new boost::thread(
-      &TransportUDT::MessageHandler, this));
+    StartMessageHandlers();
   } catch(const boost::thread_resource_error& ) {
     stop_ = true;
+    StopMessageHandlers();
+    UDT::epoll_release(recv_epoll_id_);
     int result;
     result = UDT::close(listening_socket_);
     freeaddrinfo(addrinfo_res_);
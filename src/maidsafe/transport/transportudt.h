@@ -39,11 +39,14 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <boost/shared_ptr.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/thread.hpp>
+#include <maidsafe/base/utils.h>
+#include <maidsafe/transport/bufferpool.h>
 #include <maidsafe/transport/transport-api.h>
 #include <list>
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
 
 
 namespace rpcprotocol {
@@ -74,24 +77,39 @@ struct IncomingData {
   boost::uint32_t observations;
 };
 
+// A message queued for sending.  data holds the message size followed by the
+// message itself, so that both go out in the same send.
 struct OutgoingData {
   OutgoingData()
-      : udt_socket(), data_size(0), data_sent(0), data(NULL), sent_size(false),
-        connection_id(0), is_rpc(false) {}
-  OutgoingData(UdtSocket udt_socket, boost::int64_t data_size,
-               boost::uint32_t connection_id, bool is_rpc)
+      : udt_socket(), data_size(0), data_sent(0), data(), connection_id(0),
+        is_rpc(false) {}
+  OutgoingData(UdtSocket udt_socket, boost::shared_array<char> data,
+               boost::int64_t data_size, boost::uint32_t connection_id,
+               bool is_rpc)
       : udt_socket(udt_socket), data_size(data_size), data_sent(0),
-        data(new char[data_size]), sent_size(false),
-        connection_id(connection_id), is_rpc(is_rpc) {}
+        data(data), connection_id(connection_id), is_rpc(is_rpc) {}
   UdtSocket udt_socket;
   boost::int64_t data_size;
   boost::int64_t data_sent;
   boost::shared_array<char> data;
-  bool sent_size;
   boost::uint32_t connection_id;
   bool is_rpc;
 };
 
+// Counters for the pool of threads dispatching received messages.  Latencies
+// are in microseconds, measured from the message being queued by the receiving
+// thread until a handler thread starts the notifier (dispatch_latency) and
+// until the notifier returns (handling_time).
+struct MessageHandlerStats {
+  MessageHandlerStats()
+      : queue_depth(0), max_queue_depth(0), dispatch_latency(),
+        handling_time() {}
+  size_t queue_depth;
+  size_t max_queue_depth;
+  base::Stats<boost::uint64_t> dispatch_latency;
+  base::Stats<boost::uint64_t> handling_time;
+};
+
 class TransportUDT : public Transport {
  public:
   TransportUDT();
@@ -153,16 +171,41 @@ class TransportUDT : public Transport {
                        const std::string &remote_ip,
                        const boost::uint16_t &remote_port);
   bool IsPortAvailable(const boost::uint16_t &port);
+  // Sets the number of threads dispatching received messages.  Messages from
+  // the same connection are always dispatched in the order they arrived.  Can
+  // only be changed while the transport is stopped.
+  bool SetMessageHandlerThreads(const boost::uint16_t &threads);
+  boost::uint16_t message_handler_threads() const {
+    return message_handler_threads_;
+  }
+  // Sets the size (in bytes) of the largest message accepted.  A connection
+  // announcing a larger message is closed before anything is allocated for it.
+  // Returns false, leaving the limit unchanged, unless 0 < size <= INT_MAX.
+  bool set_max_message_size(const boost::int64_t &size);
+  boost::int64_t max_message_size();
+  MessageHandlerStats MessageHandlerStatistics();
+  void ClearMessageHandlerStatistics();
  private:
   TransportUDT& operator=(const TransportUDT&);
   TransportUDT(TransportUDT&);
   void AddIncomingConnection(UdtSocket udt_socket);
   void AddIncomingConnection(UdtSocket udt_socket,
                              boost::uint32_t *connection_id);
+  void RemoveIncomingConnection(const boost::uint32_t &connection_id);
+  bool ReceiveData(const boost::uint32_t &connection_id,
+                   IncomingData *incoming_data);
   void HandleRendezvousMsgs(const HolePunchingMsg &message);
   int Send(const std::string &data, DataType type,
            const boost::uint32_t &connection_id, const bool &new_socket,
            const bool &is_rpc);
+  bool GetSendSocket(const boost::uint32_t &connection_id,
+                     const bool &new_socket, UdtSocket *udt_socket);
+  // Returns a buffer holding message_size, with room for the message after it.
+  boost::shared_array<char> MessageBuffer(const boost::int64_t &message_size);
+  int QueueMessage(boost::shared_array<char> buffer,
+                   const boost::int64_t &message_size,
+                   const boost::uint32_t &connection_id,
+                   const bool &new_socket, const bool &is_rpc);
   void SendHandle();
   int Connect(const std::string &peer_address, const boost::uint16_t &peer_port,
               UdtSocket *udt_socket);
@@ -170,6 +213,10 @@ class TransportUDT : public Transport {
   void AcceptConnHandler();
   void ReceiveHandler();
   void MessageHandler();
+  void StartMessageHandlers();
+  void StopMessageHandlers();
+  std::list<IncomingMessages>::iterator NextDispatchableMessage();
+  void EnqueueMessage(const IncomingMessages &msg);
   volatile bool stop_;
   boost::function<void(const rpcprotocol::RpcMessage&,
                        const boost::uint32_t&,
@@ -184,8 +231,8 @@ class TransportUDT : public Transport {
   boost::shared_ptr<boost::thread> accept_routine_,
                                    recv_routine_,
                                    send_routine_,
-                                   ping_rendz_routine_,
-                                   handle_msgs_routine_;
+                                   ping_rendz_routine_;
+  std::vector< boost::shared_ptr<boost::thread> > handle_msgs_routines_;
   UdtSocket listening_socket_;
   struct sockaddr peer_address_;
   boost::uint16_t listening_port_, my_rendezvous_port_;
@@ -209,6 +256,13 @@ class TransportUDT : public Transport {
   std::map<boost::uint32_t, UdtSocket> send_sockets_;
   TransportType transport_type_;
   boost::int16_t transport_id_;
+  boost::uint16_t message_handler_threads_;
+  std::set<boost::uint32_t> busy_connections_;
+  MessageHandlerStats msg_hdl_stats_;
+  int recv_epoll_id_;
+  std::map<UdtSocket, boost::uint32_t> socket_connections_;
+  BufferPool send_buffers_, receive_buffers_;
+  boost::int64_t max_message_size_;
 };
 
 }  // namespace transport
@@ -2451,6 +2451,19 @@ void CUDT::checkTimers()
 void CUDT::addEPoll(const int eid)
 {
    m_sPollID.insert(eid);
+
+   // data may have arrived before the socket joined this epoll; the read event
+   // was then raised for none of its IDs, so raise it now
+   if (!m_bConnected || m_bBroken || m_bClosing)
+      return;
+
+   if ((NULL != m_pRcvBuffer) && (m_pRcvBuffer->getRcvDataSize() > 0))
+   {
+      std::set<int> eids;
+      eids.insert(eid);
+      s_UDTUnited.m_EPoll.enable_read(m_SocketID, eids);
+      CTimer::triggerEvent();
+   }
 }
 
 void CUDT::removeEPoll(const int eid)
@@ -137,6 +137,14 @@ int CEPoll::remove(const int eid, const set<UDTSOCKET>* socks, const set<SYSSOCK
       set<UDTSOCKET> res;
       set_difference(p->second.m_sUDTSocks.begin(), p->second.m_sUDTSocks.end(), socks->begin(), socks->end(), inserter(res, res.begin()));
       p->second.m_sUDTSocks = res;
+
+      // removed sockets no longer report their IO status to this epoll, so
+      // any pending events would otherwise never be cleared
+      for (set<UDTSOCKET>::const_iterator i = socks->begin(); i != socks->end(); ++ i)
+      {
+         p->second.m_sUDTReads.erase(*i);
+         p->second.m_sUDTWrites.erase(*i);
+      }
    }
 
    if (NULL != locals)
@@ -270,7 +278,8 @@ int CEPoll::wait(const int eid, set<UDTSOCKET>* readfds, set<UDTSOCKET>* writefd
 
       CTimer::waitForEvent();
 
-      if ((msTimeOut >= 0) && (int64_t(CTimer::getTime() - entertime) >= msTimeOut))
+      // CTimer::getTime() is in microseconds, msTimeOut in milliseconds
+      if ((msTimeOut >= 0) && (int64_t(CTimer::getTime() - entertime) >= msTimeOut * 1000))
          break;
    }
 